@@ -7,10 +7,12 @@
 
 #  ifdef __cplusplus
 // operator new and delete implemented in Common.cpp
-extern void *operator new(unsigned int size);
+extern void *operator new(__SIZE_TYPE__ size);
 extern void operator delete(void *p);
-extern void *operator new[](unsigned int size);
+extern void *operator new[](__SIZE_TYPE__ size);
 extern void operator delete[](void *p);
+/// placement new, normally from <new> which we don't have in the kernel
+inline void *operator new(__SIZE_TYPE__, void *p) { return p; }
 
 #   endif /* __cplusplus */
 
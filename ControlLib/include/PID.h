@@ -3,7 +3,7 @@
 
 #include "Thread.h"
 #include "Mutex.h"
-#include "Deque.h"
+#include "Ring.h"
 #include "SysDep.h"
 #include "Timer.h"
 
@@ -24,6 +24,12 @@
 
     u = Kp * e + Ki * (integral of e) + Kd * (derivative of e)
 
+    where the "integral" is the mean of e over the last numIntgrlPts
+    periods (or an exponentially weighted mean with that memory, see
+    ControlParams::integrator) and the derivative is per millisecond,
+    optionally of the process alone and low pass filtered.  Every
+    period costs the same however long the integration window is.
+
     Where Kp, Ki, and Kd are parameters to the algorithm affecting its
     behavior for a particular system, e is the error magnitude (the amount
     of deviation from the desired value of the system) and u is the output 
@@ -56,17 +62,43 @@ class PID : protected Thread
         what the output value should be to the control loop (or the output 
         delta, depending on usage). */
     virtual void setU(double u) = 0;
+
+    /** Optional, for ControlParams::dOnMeasurement: how much of the
+        change in e since the previous getE() is due to the setpoint
+        moving rather than the process.  Called right after getE(). */
+    virtual double eSetpointStep() { return 0.; }
+    /** Optional, for ControlParams::antiWindup: how much of the last u
+        given to setU() could not be applied because the output is at a
+        limit, as applied - requested (0 if it all went out).  Called
+        right after getE(). */
+    virtual double uShortfall() { return 0.; }
   };
 
   /// Used to communicate control parameters from client code the PID class.
   struct ControlParams 
   {
+      enum Integrator {
+        Window = 0,  ///< mean of e over the last numIntgrlPts periods (at most MAX_INTGRL_PTS)
+        Exponential  ///< i += (e - i) / numIntgrlPts, same memory, no history kept
+      };
+      enum AntiWindup {
+        NoAntiWindup = 0,
+        Conditional,    ///< hold the integral while the output is limited and e would push it further
+        BackCalculation ///< take Kaw of the output shortfall back out of the integral term every period
+      };
+
       /// NB don't init these in nonrt kernel to avoid FPU problems
       double Kp, Ki, Kd;
       unsigned numIntgrlPts; ///< limits of integral control state -- how many points of the error function to use for integration
+      int integrator; ///< see Integrator
+      int antiWindup; ///< see AntiWindup, needs Callback::uShortfall()
+      double Kaw;     ///< BackCalculation gain, 0..1
+      bool dOnMeasurement; ///< leave setpoint steps out of the derivative, needs Callback::eSetpointStep()
+      double dFilterMs; ///< time constant of a first order low pass on the derivative, ms, 0 for none
 
       /// Needs to be here to prevent kernel FPE
-      ControlParams()  : numIntgrlPts(0) { Clr(Kp), Clr(Ki), Clr(Kd); }
+      ControlParams()  : numIntgrlPts(0), integrator(Window), antiWindup(NoAntiWindup), dOnMeasurement(false)
+      { Clr(Kp), Clr(Ki), Clr(Kd), Clr(Kaw), Clr(dFilterMs); }
       /// Needs to be here to prevent kernel FPE
       ControlParams(const ControlParams &other) { *this = other; }
       /// Needs to be here to prevent kernel FPE
@@ -74,6 +106,8 @@ class PID : protected Thread
   };
 
   static unsigned MAX_RATE;
+  /// the longest Window integration, the ring is allocated up front
+  enum { MAX_INTGRL_PTS = 1024 };
 
   /// returns the current PID loop rate, in Hz
   unsigned rate() const;
@@ -103,17 +137,38 @@ class PID : protected Thread
   /// just calls Thead::running()
   bool running() const { return Thread::running(); }
 
+  /// cpu affinity and stack settings for the PID thread, see Thread
+  using Thread::setThreadAttrs;
+  using Thread::threadAttrs;
+
+  /// how the loop waits for its next period, see Timer::setPrecision().
+  /// Takes effect on the next start().
+  void setTimerPrecision(Timer::Precision p, Timer::Time spinMargin = Timer::DEFAULT_SPIN_MARGIN);
+  Timer::Precision timerPrecision() const { return timerPrec; }
+  /// wakeup lateness of the loop since start(), updated every period
+  Timer::JitterStats timerJitter() const;
+
 protected:
   /// from parent Thread class, implements the thread
   void run();
 
+  /// forget the derivative and integral, as at start(), before the next
+  /// period's doPID().  For when something other than the PID has been
+  /// driving the output and what it accumulated meanwhile means nothing.
+  /// Touches no doubles, so it's safe outside RT context.
+  void resetState();
+
 private:
   Callback *cb;
   mutable Mutex mut;
   volatile unsigned rateHz;
   volatile ControlParams cp;
   volatile bool pleaseStop;
+  volatile bool pleaseReset;
   Timer timer;
+  Timer::Precision timerPrec;
+  Timer::Time timerMargin;
+  Timer::JitterStats jitter; ///< copy of timer.jitter() taken under mut
   unsigned currRate;
   double period;
   void recomputePeriod(); ///< this is an rt function called inside of run()
@@ -121,20 +176,39 @@ private:
   /// PID control state
   struct State { 
     double d, i;
-    bool d_undef;
-    Deque<double> pts; ///< keeps track of previous point values for integration
-    unsigned num_pts; ///< the number of points in the deque pts
-    State() { reset(); }
+    double sum; ///< Window: sum of pts
+    double sumComp; ///< Window: the low order bits sum's rounding lost, see addToSum()
+    double dF;  ///< filtered derivative
+    bool d_undef, i_undef;
+    int integrator; ///< the mode i was kept in
+    Ring<double> pts; ///< Window: the last numIntgrlPts values of e
+    State() : pts(MAX_INTGRL_PTS) { reset(); }
     void reset() { 
       Clr(d); 
-      Clr(i); 
+      Clr(dF);
       d_undef = true; 
-      num_pts = 0; 
-      pts.clear(); 
+      resetIntegral();
+    }
+    void resetIntegral() {
+      Clr(i);
+      Clr(sum);
+      Clr(sumComp);
+      i_undef = true;
+      integrator = ControlParams::Window;
+      pts.clear();
+    }
+    /// sum += x, compensated (Kahan), so adding and taking away every
+    /// point for hours doesn't leave sum drifting away from the sum of pts
+    void addToSum(double x) {
+      const double y = x - sumComp, t = sum + y;
+      sumComp = (t - sum) - y;
+      sum = t;
     }
   }; 
   State state;
-  double doPID(double e, double timestep_millis); ///< return u based on e, cp, etc
+  /// return u based on e, cp, etc.  spStep and shortfall are from the
+  /// Callback's eSetpointStep() and uShortfall()
+  double doPID(double e, double spStep, double shortfall, double timestep_millis);
 
 };
 
@@ -3,6 +3,7 @@
 
 #include "Thread.h"
 #include "Mutex.h"
+#include "Timer.h"
 
 /** A PWM (pulse-width-modulation) controller.  
     
@@ -58,6 +59,17 @@ class PWM : protected Thread
   /// kills the PWM thread, stopping PWM.
   void stop();
 
+  /// cpu affinity and stack settings for the PWM thread, see Thread
+  using Thread::setThreadAttrs;
+  using Thread::threadAttrs;
+
+  /// how the PWM thread waits for its edges, see Timer::setPrecision().
+  /// Takes effect on the next start().
+  void setTimerPrecision(Timer::Precision p, Timer::Time spinMargin = Timer::DEFAULT_SPIN_MARGIN);
+  Timer::Precision timerPrecision() const { return timerPrec; }
+  /// lateness of the rising edges since start(), updated every window
+  Timer::JitterStats timerJitter() const;
+
 protected:
   /// from parent Thread class, implements the thread
   void run();
@@ -69,9 +81,13 @@ private:
   TimeScale tscale;
   unsigned _window, duty;
   int nCyclesLeft;
-  Mutex mut;
+  mutable Mutex mut;
   volatile bool pleaseStop;
   bool needPeriodRecalc;
+  Timer timer;
+  Timer::Precision timerPrec;
+  Timer::Time timerMargin;
+  Timer::JitterStats jitter; ///< copy of timer.jitter() taken under mut
 };
 
 #endif
@@ -0,0 +1,267 @@
+#ifndef Ring_H
+#define Ring_H
+
+#ifdef __KERNEL__
+#  include "Common.h" /* placement new */
+#else
+#  include <new>
+#endif
+
+/**
+   @brief A realtime-safe ring buffer with power-of-two capacity.
+
+   Like Deque, the storage is allocated once at construction time
+   (presumably in non-realtime context) and pushes onto a full ring are
+   dropped, but:
+
+   - the capacity is rounded up to a power of two so that indexing is a
+     mask instead of a % (head and tail are free running counters, the
+     size is just tail - head)
+   - the storage is left uninitialized, elements are constructed in
+     place on push and destroyed on pop, so T need not be default
+     constructible and an empty Ring of big T's costs no constructor calls
+   - when compiled as C++11 there are move-aware push_back()/push_front()
+     overloads and emplace_back()
+
+   Not thread-safe, see SPSCRing for handing data between threads. */
+template <typename T>
+class Ring
+{
+public:
+  typedef T & reference;
+  typedef const T & const_reference;
+  typedef unsigned long size_type;
+
+  Ring(size_type min_capacity = 1024)
+    : mask(roundUp(min_capacity) - 1), head(0), tail(0), buf(alloc(mask + 1))
+  {}
+
+  Ring(const Ring & other)
+    : mask(other.mask), head(0), tail(0), buf(alloc(mask + 1))
+  {
+    for (size_type i = other.head; i != other.tail; ++i) push_back(other.buf[i & other.mask]);
+  }
+
+  Ring & operator=(const Ring & other)
+  {
+    if (this == &other) return *this;
+    clear();
+    if (mask != other.mask) {
+      ::operator delete(buf);
+      mask = other.mask;
+      buf = alloc(mask + 1);
+    }
+    for (size_type i = other.head; i != other.tail; ++i) push_back(other.buf[i & other.mask]);
+    return *this;
+  }
+
+  ~Ring() { clear(); ::operator delete(buf); }
+
+  reference front() { return buf[head & mask]; }
+  const_reference front() const { return buf[head & mask]; }
+  reference back() { return buf[(tail - 1) & mask]; }
+  const_reference back() const { return buf[(tail - 1) & mask]; }
+  /// i-th element counting from the front
+  reference operator[](size_type i) { return buf[(head + i) & mask]; }
+  const_reference operator[](size_type i) const { return buf[(head + i) & mask]; }
+
+  /// always a power of two, >= the capacity asked for at construction
+  size_type capacity() const { return mask + 1; }
+  size_type size() const { return tail - head; }
+  bool empty() const { return tail == head; }
+  bool full() const { return size() > mask; }
+
+  /// @returns false (and does nothing) if the ring is full
+  bool push_back(const_reference t)
+  {
+    if (full()) return false;
+    new (&buf[tail & mask]) T(t);
+    ++tail;
+    return true;
+  }
+  /// @returns false (and does nothing) if the ring is full
+  bool push_front(const_reference t)
+  {
+    if (full()) return false;
+    new (&buf[(head - 1) & mask]) T(t);
+    --head;
+    return true;
+  }
+
+#if __cplusplus >= 201103L
+  bool push_back(T && t)
+  {
+    if (full()) return false;
+    new (&buf[tail & mask]) T(static_cast<T &&>(t));
+    ++tail;
+    return true;
+  }
+  bool push_front(T && t)
+  {
+    if (full()) return false;
+    new (&buf[(head - 1) & mask]) T(static_cast<T &&>(t));
+    --head;
+    return true;
+  }
+  /// constructs the new back element in place from args
+  template <typename... Args> bool emplace_back(Args &&... args)
+  {
+    if (full()) return false;
+    new (&buf[tail & mask]) T(static_cast<Args &&>(args)...);
+    ++tail;
+    return true;
+  }
+#endif
+
+  void pop_front()
+  {
+    if (empty()) return;
+    buf[head & mask].~T();
+    ++head;
+  }
+  void pop_back()
+  {
+    if (empty()) return;
+    --tail;
+    buf[tail & mask].~T();
+  }
+
+  void clear()
+  {
+    while (!empty()) pop_back();
+    head = tail = 0;
+  }
+
+private:
+  size_type mask, head, tail;
+  T *buf;
+
+  static size_type roundUp(size_type n)
+  {
+    size_type p = 1;
+    while (p < n) p <<= 1;
+    return p;
+  }
+  static T *alloc(size_type n) { return static_cast<T *>(::operator new(n * sizeof(T))); }
+};
+
+/**
+   @brief Lock-free single-producer/single-consumer ring.
+
+   For handing data from a realtime thread to a non-realtime one (or
+   vice versa) without a Mutex, which in RTLinux would let the
+   non-realtime side block the realtime side.  Exactly one thread may
+   call push() and exactly one other thread may call front()/pop(); both
+   may call size()/empty().
+
+   The producer-owned tail and the consumer-owned head live on separate
+   cache lines so that the two sides don't bounce a line between cpus
+   on every operation.  Capacity is a power of two, as for Ring.
+
+   Elements are copied in and out, so T should be small and cheap to
+   copy (samples, events, pointers). */
+template <typename T>
+class SPSCRing
+{
+public:
+  typedef unsigned long size_type;
+  enum { CacheLine = 64 };
+
+  SPSCRing(size_type min_capacity = 1024)
+    : head(0), tail(0)
+  {
+    size_type p = 1;
+    while (p < min_capacity) p <<= 1;
+    mask = p - 1;
+    buf = new T[p];
+  }
+  ~SPSCRing() { delete [] buf; }
+
+  size_type capacity() const { return mask + 1; }
+  /// approximate if called by a thread that is neither producer nor consumer
+  size_type size() const { return load(tail) - load(head); }
+  bool empty() const { return size() == 0; }
+
+  /// producer side.  @returns false if the ring is full
+  bool push(const T & t)
+  {
+    const size_type t0 = tail; // only we write tail
+    if (t0 - load(head) > mask) return false;
+    buf[t0 & mask] = t;
+    store(tail, t0 + 1); // publishes the element
+    return true;
+  }
+
+  /// consumer side.  @returns false if the ring is empty
+  bool pop(T & out)
+  {
+    const size_type h0 = head; // only we write head
+    if (load(tail) == h0) return false;
+    out = buf[h0 & mask];
+    store(head, h0 + 1); // hands the slot back to the producer
+    return true;
+  }
+
+  /// consumer side, peek without popping.  Returns 0 if empty.
+  const T *front() const
+  {
+    const size_type h0 = head;
+    if (load(tail) == h0) return 0;
+    return &buf[h0 & mask];
+  }
+  /// consumer side, drop the front element (if any)
+  void pop()
+  {
+    const size_type h0 = head;
+    if (load(tail) != h0) store(head, h0 + 1);
+  }
+
+private:
+  /// load-acquire and store-release of an index
+  static size_type load(const volatile size_type & x)
+  {
+#if defined(__ATOMIC_ACQUIRE)
+    return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+#else
+    size_type v = x;
+    Barrier();
+    return v;
+#endif
+  }
+  static void store(volatile size_type & x, size_type v)
+  {
+#if defined(__ATOMIC_RELEASE)
+    __atomic_store_n(&x, v, __ATOMIC_RELEASE);
+#else
+    Barrier();
+    x = v;
+#endif
+  }
+#if !defined(__ATOMIC_ACQUIRE)
+  static void Barrier()
+  {
+#  if defined(__i386__) || defined(__x86_64__)
+    // x86 doesn't reorder loads with loads or stores with stores, so
+    // keeping the compiler honest is enough
+    __asm__ __volatile__("" ::: "memory");
+#  else
+    __sync_synchronize();
+#  endif
+  }
+#endif
+
+  // consumer-owned
+  volatile size_type head;
+  char pad0[CacheLine - sizeof(size_type)];
+  // producer-owned
+  volatile size_type tail;
+  char pad1[CacheLine - sizeof(size_type)];
+  // read-only after construction
+  size_type mask;
+  T *buf;
+
+  SPSCRing(const SPSCRing &);
+  SPSCRing & operator=(const SPSCRing &);
+};
+
+#endif
@@ -13,6 +13,22 @@ extern "C" {
   typedef long long Time_t;
   extern AbsTime_t abstime_get(void); /**< Returns abs. time in ns */
   extern AbsTime_t abstime_nanosleep(AbsTime_t abstime);
+  /** Returns a monotonic time in ns that is unaffected by steps of the
+      wall clock, for measuring intervals.  Same as abstime_get() in the
+      kernel. */
+  extern AbsTime_t abstime_monotonic(void);
+
+  /** A periodic timer whose expirations are counted by the system, so
+      that no period is lost even if the waiter is late (Linux timerfd).
+      'first' is an abstime_get() time.  Returns a descriptor, or negative
+      if not supported (always in the kernel, where abstime_nanosleep() is
+      exact anyway). */
+  extern int ptimer_create(AbsTime_t first, Time_t period);
+  /** Blocks until the next expiration of the ptimer.  Returns the number
+      of expirations since the last call (more than 1 means periods were
+      missed) or negative on error. */
+  extern long ptimer_wait(int ptimer);
+  extern void ptimer_destroy(int ptimer);
 
 
   /*--------------------------------------------------------------------------
@@ -47,6 +63,34 @@ extern "C" {
 
   /** Returns true iff the current thread is in realtime context */
   extern int thread_self_is_rt(void); 
+
+  /** Optional per-thread placement and memory attributes for
+      thread_create_attrs().  All-zero means system defaults. */
+  struct ThreadAttrs
+  {
+    unsigned long cpu_mask;   /**< bit n set = may run on cpu n, 0 = any cpu.
+                                   RTLinux threads can only be bound to one
+                                   cpu, so there the lowest set bit wins */
+    unsigned long stack_size; /**< in bytes, 0 = system default */
+    int prefault_stack;       /**< nonzero = touch the whole stack when the
+                                   thread starts so it never page faults
+                                   later (userspace only, kernel stacks are
+                                   always resident) */
+  };
+  /** Just like thread_create() but with the extra attributes in attrs,
+      which may be NULL. */
+  extern Thread_t thread_create_attrs(int prio, int sched, 
+                                      ThreadFunc_t func, void *funcArg,
+                                      const struct ThreadAttrs *attrs);
+  /** Changes the cpu affinity of a running thread.  Returns nonzero on
+      failure, always fails in RTLinux where threads can't migrate. */
+  extern int thread_set_affinity(Thread_t, unsigned long cpu_mask);
+  /** Returns the number of online cpus. */
+  extern int cpu_count(void);
+  /** Locks (nonzero arg) or unlocks all current and future pages of the
+      process into RAM, like mlockall(MCL_CURRENT|MCL_FUTURE).  Returns 
+      nonzero on failure.  A noop in the kernel. */
+  extern int mem_lock_all(int lock);
   
   /*--------------------------------------------------------------------------
     Semaphore stuff.. 
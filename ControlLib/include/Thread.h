@@ -1,6 +1,8 @@
 #ifndef Thread_H
 #define Thread_H
 
+#include "SysDep.h"
+
 /// Encapsulates a thread on the target system.  Inherit from this to implement your own threads.
 class Thread
 {
@@ -19,6 +21,24 @@ public:
   /// blocks until the thread completes.
   void join();
 
+  /** Set the cpu affinity, stack size and stack prefaulting of this
+      thread.  Takes effect on the next start(), except that the cpu mask
+      is also applied right away if the thread is running (where the
+      system supports that). */
+  void setThreadAttrs(const ThreadAttrs &);
+  const ThreadAttrs & threadAttrs() const { return attrs; }
+  /// convenience: set just the cpu mask, bit n = cpu n, 0 = any cpu
+  void setCpuMask(unsigned long mask);
+  unsigned long cpuMask() const { return attrs.cpu_mask; }
+  /// convenience: set just the stack size (0 = default) and prefaulting
+  void setStackSize(unsigned long bytes, bool prefault = false);
+
+  /** Lock all current and future memory of the process into RAM (or 
+      unlock it) so that RT threads never take a page fault.  Process 
+      wide, so typically called once at startup.  Returns true on success.
+      A noop in the kernel. */
+  static bool lockMemory(bool lock = true);
+
   /// much like pthread_setcancelstate -- enable/disable cancellation for the
   /// *calling* thread
   static void setCancelState(bool enabledisable);
@@ -54,6 +74,10 @@ public:
 protected:
   /// The thread function -- derived classes need to implement this.
   virtual void run() = 0;
+  /// the thread last start()ed, 0 if none.  join() only waits for a
+  /// running thread, so a derived class whose run() can return on its
+  /// own keeps this to reap the thread afterwards.
+  Handle handle() const { return me; }
 
 private:
   /// no public copy c'tor 
@@ -66,6 +90,7 @@ private:
 
   bool is_running;
   Handle me;
+  ThreadAttrs attrs;
 };
 
 #endif
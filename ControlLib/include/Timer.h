@@ -24,6 +24,25 @@
        t.waitNextPeriod(); 
     }   
     @endcode
+
+    Outside of RTLinux the sleep itself is only as good as the kernel's
+    wakeup latency, which under load can be tens of microseconds or more.
+    setPrecision() trades cpu for accuracy there:
+
+    - Sleep      plain absolute sleep to the deadline (the default)
+    - SleepSpin  sleeps until spinMargin before the deadline, then busy
+                 polls the monotonic clock for the rest.  Burns up to
+                 spinMargin of cpu per period.
+    - TimerFD    lets a kernel periodic timer (timerfd) do the counting,
+                 so periods are never silently skipped -- if we overran,
+                 the missed expirations show up in jitter().missed and the
+                 schedule is advanced past them instead of firing them all
+                 back to back.
+
+    In the kernel only Sleep is available (the others silently fall back
+    to it), RTLinux sleeps are already exact.
+
+    Every waitNextPeriod() records how late we woke up in jitter().
 */
 class Timer
 {
@@ -72,6 +91,38 @@ public:
   /// deadline.
   void waitNextPeriod();
 
+  enum Precision {
+    Sleep,
+    SleepSpin,
+    TimerFD
+  };
+  static const Time DEFAULT_SPIN_MARGIN;
+  /// see the class description.  spinMargin only matters for SleepSpin.
+  /// Takes effect from the next period on.
+  void setPrecision(Precision p, Time spinMargin = DEFAULT_SPIN_MARGIN);
+  Precision precision() const { return prec; }
+  Time spinMargin() const { return margin; }
+
+  /// sleep until absolute time 'abs' honoring precision() (but without
+  /// touching the periodic schedule or the jitter statistics).  Useful for
+  /// sub-period deadlines such as a PWM falling edge.
+  void sleepUntil(Time abs) const;
+
+  /// wakeup lateness statistics, in ns, over the waitNextPeriod() calls
+  /// since the last resetJitter()
+  struct JitterStats
+  {
+    unsigned long long cycles; ///< number of samples
+    unsigned long long missed; ///< overruns of a whole period or more
+    Time min, max, sum;
+    double sumSq;
+
+    double mean() const;
+    double stddev() const;
+  };
+  const JitterStats & jitter() const { return jit; }
+  void resetJitter();
+
   /// the number of periods that have elapsed, this basically is a count
   /// of waitNextPeriod() calls that we have made since the last reset()!
   unsigned long long cycleCount() const;  
@@ -84,7 +135,18 @@ public:
 private:
   unsigned long long cycle;
   Time t0, nextWakeup, per;
-  
+  Precision prec;
+  Time margin;
+  int tfd; ///< the ptimer for TimerFD mode, or -1
+  JitterStats jit;
+
+  void armTimerFD();
+  void disarmTimerFD();
+  void recordWakeup(Time now);
+
+  // owns tfd
+  Timer(const Timer &);
+  Timer & operator=(const Timer &);
 };
 
 #endif
@@ -1,8 +1,8 @@
 #include "Common.h"
 
-void *operator new(unsigned int size) { return Alloc_mem(size); }
+void *operator new(__SIZE_TYPE__ size) { return Alloc_mem(size); }
 void operator delete(void *p) { Free_mem(p); }
-void *operator new[](unsigned int size) { return Alloc_mem(size); }
+void *operator new[](__SIZE_TYPE__ size) { return Alloc_mem(size); }
 void operator delete[](void *p) { Free_mem(p); }
 
 #ifdef __KERNEL__
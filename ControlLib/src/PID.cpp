@@ -9,9 +9,11 @@ unsigned PID::MAX_RATE = 50000;  /**< limit rate to 50kHz since most
                                       than that anyway */
 
 PID::PID()
-  : cb(0), rateHz(1), pleaseStop(false), currRate(0)
+  : cb(0), rateHz(1), pleaseStop(false), pleaseReset(false),
+    timerPrec(Timer::Sleep), timerMargin(Timer::DEFAULT_SPIN_MARGIN), currRate(0)
 {
   Clr(period);
+  Clr(jitter);
 }
 
 PID::~PID() 
@@ -47,6 +49,23 @@ void PID::setControlParams(const ControlParams & c)
 }
 
 
+void PID::setTimerPrecision(Timer::Precision p, Timer::Time m)
+{
+  mut.lock();
+  timerPrec = p;
+  timerMargin = m;
+  mut.unlock();
+}
+
+Timer::JitterStats PID::timerJitter() const
+{
+  Timer::JitterStats ret;
+  mut.lock();
+  Cpy(ret, jitter);
+  mut.unlock();
+  return ret;
+}
+
 void PID::start(Callback *c, unsigned r, const ControlParams *p, Thread::Priority prio)
 {
   if (!c) return;
@@ -69,6 +88,13 @@ void PID::stop()
   Thread::stop(); 
 }
 
+void PID::resetState()
+{
+  mut.lock();
+  pleaseReset = true;
+  mut.unlock();
+}
+
 void PID::recomputePeriod()
 {
   if (currRate != rateHz && rateHz) {
@@ -84,18 +110,29 @@ void PID::run()
   timer.reset();
   mut.lock();
   state.reset();
+  pleaseReset = false;
+  timer.setPrecision(timerPrec, timerMargin);
+  timer.resetJitter();
+  currRate = 0; // force a timer.setPeriod() so the schedule starts now
   recomputePeriod(); // calls timer.setPeriod, sets some class member vars
   pleaseStop = false;  
 
   while (!pleaseStop) {
-    double e, u = 0;
+    double e, u = 0, spStep, shortfall;
 
     mut.unlock();  // release the lock
     e = cb->getE();    // obtain e from client code without the lock
+    spStep = cb->eSetpointStep();
+    shortfall = cb->uShortfall();
     mut.lock(); // obtain the lock again
 
+    if (pleaseReset) {
+      state.reset();
+      pleaseReset = false;
+    }
+
     // do stuff, compute u based on e and cp params
-    u = doPID(e, period/static_cast<double>(1e6) /* timestep is in millis */);
+    u = doPID(e, spStep, shortfall, period/static_cast<double>(1e6) /* timestep is in millis */);
 
     recomputePeriod(); // only does something if rate changed..
 
@@ -106,6 +143,7 @@ void PID::run()
     timer.waitNextPeriod(); // wait for next period with lock released
 
     mut.lock(); // acquire the lock again because we are checking pleaseStop
+    Cpy(jitter, timer.jitter());
   }
 
   mut.unlock(); // at this point lock is always held, release it
@@ -113,36 +151,72 @@ void PID::run()
 
 
 #define ABS(x) ( (x) < 0 ? -(x) : (x) )
-double PID::doPID(double e, double timestep)
+double PID::doPID(double e, double spStep, double shortfall, double timestep)
 {
-  double iTerm = 0.0, dTerm = 0.0;
-
-  if (cp.numIntgrlPts) {
-    while (state.num_pts >= cp.numIntgrlPts) {
-      // we reached max integral points, so delete the area of the first (oldest) point in our list
-      state.i -=  state.pts.front();
-      state.pts.pop_front();
-      --state.num_pts;
+  double dTerm = 0.0;
+  const unsigned n = cp.numIntgrlPts < unsigned(MAX_INTGRL_PTS) ? cp.numIntgrlPts : unsigned(MAX_INTGRL_PTS);
+
+  if (!n || cp.integrator != state.integrator) {
+    state.resetIntegral();
+    state.integrator = cp.integrator;
+  }
+  if (n) {
+    // anti-windup, from how the last u came out
+    bool hold = false;
+    if (shortfall != 0.0 && cp.Ki != 0.0) {
+      if (cp.antiWindup == ControlParams::Conditional) {
+        // the output fell short in the direction Ki * e is pushing
+        hold = cp.Ki * e * shortfall < 0.0;
+      } else if (cp.antiWindup == ControlParams::BackCalculation && !state.i_undef) {
+        const double di = cp.Kaw * shortfall / cp.Ki;
+        if (cp.integrator == ControlParams::Exponential) {
+          state.i += di;
+        } else {
+          // into the newest point, so it leaves the window with it
+          const double dsum = di * state.pts.size();
+          state.pts.back() += dsum;
+          state.addToSum(dsum);
+          state.i = state.sum / state.pts.size();
+        }
+      }
+    }
+    if (!hold) {
+      if (cp.integrator == ControlParams::Exponential) {
+        if (state.i_undef) state.i = e;
+        else state.i += (e - state.i) / n;
+      } else {
+        // only loops if numIntgrlPts just shrank
+        while (state.pts.size() >= n) {
+          state.addToSum(-state.pts.front());
+          state.pts.pop_front();
+        }
+        state.pts.push_back(e);
+        state.addToSum(e);
+        state.i = state.sum / state.pts.size();
+      }
+      state.i_undef = false;
     }
-    double thisPt = e/++state.num_pts;
-    state.i += thisPt;
-    state.pts.push_back(thisPt);
-    iTerm = state.i;
   }
  
   // calculate the derivative term
   if (state.d_undef || ABS(timestep - 0.0) < 0.000001) {
     // d is undefined.. just say slope is 0
-    dTerm = 0.0;
     state.d_undef = false;
+    Clr(state.dF);
   } else {
     // d is defined, calculate derivative
-    dTerm = (e - state.d) / timestep;
+    double de = e - state.d;
+    if (cp.dOnMeasurement) de -= spStep;
+    dTerm = de / timestep;
+    if (cp.dFilterMs > 0.0) {
+      state.dF += (dTerm - state.dF) * timestep / (cp.dFilterMs + timestep);
+      dTerm = state.dF;
+    }
   }
   // save previous e value for state.d
   state.d = e;
 
   // u = Kp * e + Ki * (integral of e) + Kd * (derivative of e)
 
-  return cp.Kp*e + cp.Ki*iTerm + cp.Kd*dTerm;
+  return cp.Kp*e + cp.Ki*state.i + cp.Kd*dTerm;
 }
@@ -14,8 +14,11 @@ static inline int powi(int n, int p)
 
 
 PWM::PWM()
-  : highcb(0), lowcb(0), tscale(Milliseconds), _window(100)
-{}
+  : highcb(0), lowcb(0), tscale(Milliseconds), _window(100),
+    timerPrec(Timer::Sleep), timerMargin(Timer::DEFAULT_SPIN_MARGIN)
+{
+  Clr(jitter);
+}
 
 PWM::~PWM() 
 {}
@@ -64,6 +67,23 @@ PWM::TimeScale PWM::timeScale() const
   return tscale;
 }
 
+void PWM::setTimerPrecision(Timer::Precision p, Timer::Time m)
+{
+  mut.lock();
+  timerPrec = p;
+  timerMargin = m;
+  mut.unlock();
+}
+
+Timer::JitterStats PWM::timerJitter() const
+{
+  Timer::JitterStats ret;
+  mut.lock();
+  Cpy(ret, jitter);
+  mut.unlock();
+  return ret;
+}
+
 void PWM::start(Callback *h, Callback *l, unsigned n, Thread::Priority p)
 {
   highcb = h;
@@ -84,10 +104,11 @@ void PWM::stop()
 
 void PWM::run()
 {
-  Timer timer;
   mut.lock();
   pleaseStop = false;
   needPeriodRecalc = true;
+  timer.setPrecision(timerPrec, timerMargin);
+  timer.resetJitter();
   while (!pleaseStop && nCyclesLeft) {
     if (needPeriodRecalc) 
       timer.setPeriod(windowToNS()), needPeriodRecalc = false;
@@ -97,14 +118,14 @@ void PWM::run()
       // duty cycle off if < 100 and lowcb
       // sleep from now until the duty cycle ends
       mut.unlock();
-      Timer::nanoSleep(timer.lastWakeupTime() + (timer.period()/100 * saved_duty), 
-                       Timer::Absolute);
+      timer.sleepUntil(timer.lastWakeupTime() + (timer.period()/100 * saved_duty));
       mut.lock(); // NB: possible priority inversion here but it's ok since this only happens on param change
       (*lowcb)(); // duty cycle off
     }
     mut.unlock();
     timer.waitNextPeriod();
     mut.lock();
+    Cpy(jitter, timer.jitter());
   }
   mut.unlock();
 }
@@ -69,6 +69,29 @@ AbsTime_t abstime_nanosleep(AbsTime_t abs)
   return timespec_to_ns(&rem);
 }
 
+AbsTime_t abstime_monotonic(void)
+{
+  return gethrtime();
+}
+
+/* RTLinux sleeps are already hard realtime, no need for these */
+int ptimer_create(AbsTime_t first, Time_t period)
+{
+  (void)first; (void)period;
+  return -1;
+}
+
+long ptimer_wait(int ptimer)
+{
+  (void)ptimer;
+  return -1;
+}
+
+void ptimer_destroy(int ptimer)
+{
+  (void)ptimer;
+}
+
 int RTFOpen(int minor, int size)
 {
   int err;
@@ -179,6 +202,45 @@ AbsTime_t abstime_nanosleep(AbsTime_t abs)
   return abs;
 }
 
+AbsTime_t abstime_monotonic(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (AbsTime_t)(ts.tv_sec) * (AbsTime_t)(BILLION) + (AbsTime_t)ts.tv_nsec;
+}
+
+#    include <sys/timerfd.h>
+#    include <unistd.h>
+#    include <stdint.h>
+
+int ptimer_create(AbsTime_t first, Time_t period)
+{
+  struct itimerspec its;
+  int fd = timerfd_create(CLOCK_REALTIME, 0);
+  if (fd < 0) return -1;
+  its.it_value.tv_sec = first / BILLION;
+  its.it_value.tv_nsec = first % BILLION;
+  its.it_interval.tv_sec = period / BILLION;
+  its.it_interval.tv_nsec = period % BILLION;
+  if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, 0)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+long ptimer_wait(int fd)
+{
+  uint64_t n = 0;
+  if (read(fd, &n, sizeof(n)) != sizeof(n)) return -1;
+  return (long)n;
+}
+
+void ptimer_destroy(int fd)
+{
+  if (fd >= 0) close(fd);
+}
+
 #    include <string.h>
 #    include <sys/types.h>
 #    include <sys/stat.h>
@@ -342,12 +404,32 @@ struct ThreadArgs
 {
   ThreadFunc_t func;
   void *arg;
+  unsigned long prefault; /* bytes of stack to touch on startup */
 };
 
+#ifndef __KERNEL__
+#  include <alloca.h>
+/* Leave this much of the stack alone when prefaulting, for the guard page,
+   TLS and whatever pthread_create already used */
+#  define PREFAULT_SLACK (16*1024)
+static void stack_prefault(unsigned long size)
+{
+  volatile char *p;
+  unsigned long i;
+  if (size <= PREFAULT_SLACK) return;
+  size -= PREFAULT_SLACK;
+  p = (volatile char *)alloca(size);
+  for (i = 0; i < size; i += 4096) p[i] = 0;
+}
+#endif
+
 static void *thread_wrapper(void *arg)
 {
   struct ThreadArgs *a = (struct ThreadArgs *)arg;
   pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+#ifndef __KERNEL__
+  if (a->prefault) stack_prefault(a->prefault);
+#endif
   return a->func(a->arg);
 }
 
@@ -365,6 +447,12 @@ static inline int scheduler_translate(int s)
 }
 
 Thread_t thread_create(int prio, int sched, ThreadFunc_t func, void *arg)
+{
+  return thread_create_attrs(prio, sched, func, arg, 0);
+}
+
+Thread_t thread_create_attrs(int prio, int sched, ThreadFunc_t func, void *arg,
+                             const struct ThreadAttrs *ta)
 {
 #define n_static 256
   static struct ThreadArgs args_hack[n_static];
@@ -398,6 +486,29 @@ Thread_t thread_create(int prio, int sched, ThreadFunc_t func, void *arg)
 #endif
   args->func = func;
   args->arg = arg;
+  args->prefault = 0;
+  if (ta && ta->stack_size) {
+    pthread_attr_setstacksize(&attr, ta->stack_size);
+  }
+  if (ta && ta->cpu_mask) {
+#ifdef __KERNEL__
+    pthread_attr_setcpu_np(&attr, Ffs(ta->cpu_mask));
+#else
+    cpu_set_t set;
+    unsigned i;
+    CPU_ZERO(&set);
+    for (i = 0; i < sizeof(ta->cpu_mask)*8; ++i) 
+      if (ta->cpu_mask & (0x1UL<<i)) CPU_SET(i, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+#endif
+  }
+#ifndef __KERNEL__
+  if (ta && ta->prefault_stack) {
+    size_t sz = 0;
+    pthread_attr_getstacksize(&attr, &sz);
+    args->prefault = sz;
+  }
+#endif
   (void) prio; /* TODO: implement priorities.. */
   if (pthread_create(&thr, &attr, thread_wrapper, args)) 
     /* TODO handle errors here.. */
@@ -416,6 +527,22 @@ void *thread_kill(Thread_t thr)
   return ret;
 }
 
+int thread_set_affinity(Thread_t thr, unsigned long mask)
+{
+#ifdef __KERNEL__
+  (void)thr; (void)mask;
+  return -1;
+#else
+  cpu_set_t set;
+  unsigned i;
+  CPU_ZERO(&set);
+  if (!mask) mask = ~0UL;
+  for (i = 0; i < sizeof(mask)*8; ++i) 
+    if (mask & (0x1UL<<i)) CPU_SET(i, &set);
+  return pthread_setaffinity_np((pthread_t)thr, sizeof(set), &set);
+#endif
+}
+
 void thread_exit(void *return_arg)
 {
   pthread_exit(return_arg);
@@ -472,6 +599,33 @@ int thread_self_is_rt(void)
 #endif
 }
 
+#ifdef __KERNEL__
+#  include <linux/smp.h>
+#else
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+int cpu_count(void)
+{
+#ifdef __KERNEL__
+  return smp_num_cpus;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+int mem_lock_all(int lock)
+{
+#ifdef __KERNEL__
+  (void)lock;
+  return 0;
+#else
+  return lock ? mlockall(MCL_CURRENT|MCL_FUTURE) : munlockall();
+#endif
+}
+
 
 /*--------------------------------------------------------------------------
   Semaphore stuff.. 
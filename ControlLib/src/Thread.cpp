@@ -4,7 +4,9 @@
 
 Thread::Thread()
   : is_running(false), me(0)
-{}
+{
+  Clr(attrs);
+}
 
 Thread::~Thread() 
 {
@@ -24,7 +26,7 @@ void Thread::start(Priority p)
   int s = Default;
   if (p == IdlePriority) s = Other;
   if (p == InheritPriority) s = Inherit, p = IdlePriority;
-  me = (Handle)::thread_create(p + thread_prio_min(s), s, &run_func_wrapper, static_cast<void *>(this));
+  me = (Handle)::thread_create_attrs(p + thread_prio_min(s), s, &run_func_wrapper, static_cast<void *>(this), &attrs);
   if (me) is_running = true;
 }
 
@@ -36,6 +38,33 @@ void Thread::stop()
   }
 }
 
+void Thread::setThreadAttrs(const ThreadAttrs & a)
+{
+  unsigned long oldmask = attrs.cpu_mask;
+  Cpy(attrs, a);
+  if (running() && oldmask != attrs.cpu_mask) 
+    ::thread_set_affinity(static_cast<Thread_t>(me), attrs.cpu_mask);
+}
+
+void Thread::setCpuMask(unsigned long mask)
+{
+  ThreadAttrs a = attrs;
+  a.cpu_mask = mask;
+  setThreadAttrs(a);
+}
+
+void Thread::setStackSize(unsigned long bytes, bool prefault)
+{
+  attrs.stack_size = bytes;
+  attrs.prefault_stack = prefault;
+}
+
+/*static*/
+bool Thread::lockMemory(bool lock)
+{
+  return ::mem_lock_all(lock) == 0;
+}
+
 //static
 void Thread::exit()
 {
@@ -2,14 +2,18 @@
 #include "SysDep.h"
 
 const Timer::Time Timer::DEFAULT_PERIOD = 1000000; ///< default to 1ms
+const Timer::Time Timer::DEFAULT_SPIN_MARGIN = 50000; ///< 50us
 
 Timer::Timer()
+  : prec(Sleep), margin(DEFAULT_SPIN_MARGIN), tfd(-1)
 {
   reset();
   per = DEFAULT_PERIOD;
+  nextWakeup = absTime() + per;
+  resetJitter();
 }
 
-Timer::~Timer() {}
+Timer::~Timer() { disarmTimerFD(); }
 
 void Timer::reset()
 {
@@ -19,7 +23,17 @@ void Timer::reset()
 
 void Timer::waitNextPeriod() 
 {
-  nanoSleep(nextWakeup, Absolute);
+  if (tfd >= 0) {
+    long n = ::ptimer_wait(tfd);
+    if (n > 1) {
+      // we overran: the timer kept counting, skip the periods we missed
+      // rather than trying to catch up on them
+      nextWakeup += per * (n-1);
+      jit.missed += n-1;
+    }
+  } else
+    sleepUntil(nextWakeup);
+  recordWakeup(absTime());
   ++cycle;
   nextWakeup += per;
 }
@@ -28,6 +42,77 @@ void Timer::setPeriod(Time p)
 {
   per = p;
   nextWakeup = absTime() + per;
+  if (prec == TimerFD) armTimerFD();
+}
+
+void Timer::setPrecision(Precision p, Time spinMargin)
+{
+  prec = p;
+  margin = spinMargin;
+  if (prec == TimerFD) armTimerFD();
+  else disarmTimerFD();
+}
+
+void Timer::sleepUntil(Time abs) const
+{
+  if (prec != SleepSpin || margin <= 0) {
+    ::abstime_nanosleep(abs);
+    return;
+  }
+  if (abs - margin > absTime()) ::abstime_nanosleep(abs - margin);
+  // the wall clock can be slewed under us, so spin on the monotonic one
+  const Time deadline = abs - absTime() + ::abstime_monotonic();
+  while (::abstime_monotonic() < deadline) {
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#endif
+  }
+}
+
+void Timer::armTimerFD()
+{
+  disarmTimerFD();
+  tfd = ::ptimer_create(nextWakeup, per);
+  // no timerfd (kernel, old libc): plain sleeps then
+  if (tfd < 0) prec = Sleep;
+}
+
+void Timer::disarmTimerFD()
+{
+  if (tfd >= 0) ::ptimer_destroy(tfd);
+  tfd = -1;
+}
+
+void Timer::recordWakeup(Time now)
+{
+  Time late = now - nextWakeup;
+  if (late < 0) late = 0;
+  // a whole period late: the next waitNextPeriod() will return right
+  // away to catch up (TimerFD counted its skipped periods above)
+  if (late >= per) ++jit.missed;
+  if (!jit.cycles || late < jit.min) jit.min = late;
+  if (!jit.cycles || late > jit.max) jit.max = late;
+  jit.sum += late;
+  jit.sumSq += double(late) * double(late);
+  ++jit.cycles;
+}
+
+void Timer::resetJitter() { Clr(jit); }
+
+double Timer::JitterStats::mean() const
+{
+  return cycles ? double(sum) / double(cycles) : 0.;
+}
+
+double Timer::JitterStats::stddev() const
+{
+  if (cycles < 2) return 0.;
+  double m = mean(), var = sumSq / double(cycles) - m*m;
+  if (var <= 0.) return 0.;
+  // no libm in the kernel, a few Newton steps are plenty here
+  double x = var > 1. ? var : 1.;
+  for (int i = 0; i < 32; ++i) x = 0.5 * (x + var/x);
+  return x;
 }
 
 
@@ -0,0 +1,163 @@
+#ifndef BenchStats_H
+#define BenchStats_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <time.h>
+
+/** Sample accumulator for the userspace benchmarks.
+
+    Samples are stored in a buffer preallocated at construction time so that
+    add() is cheap and never allocates -- it is meant to be called from
+    inside a timed loop.  Samples beyond the capacity are counted but
+    dropped. */
+class BenchStats
+{
+public:
+  explicit BenchStats(unsigned long capacity = 0) : n(0), dropped(0) { v.resize(capacity); }
+
+  void add(double sample)
+  {
+    if (n < v.size()) v[n++] = sample;
+    else ++dropped;
+  }
+  void merge(const BenchStats & o)
+  {
+    v.resize(n);
+    v.insert(v.end(), o.v.begin(), o.v.begin() + o.n);
+    n = v.size();
+    dropped += o.dropped;
+  }
+  void clear() { n = 0; dropped = 0; }
+
+  unsigned long count() const { return n; }
+  unsigned long numDropped() const { return dropped; }
+
+  double mean() const
+  {
+    double s = 0.;
+    for (unsigned long i = 0; i < n; ++i) s += v[i];
+    return n ? s/n : 0.;
+  }
+  double min() const { return n ? *std::min_element(v.begin(), v.begin()+n) : 0.; }
+  double max() const { return n ? *std::max_element(v.begin(), v.begin()+n) : 0.; }
+  /// p is in [0,100].  Sorts the samples in place.
+  double percentile(double p)
+  {
+    if (!n) return 0.;
+    std::sort(v.begin(), v.begin() + n);
+    unsigned long idx = static_cast<unsigned long>(p/100.0 * (n-1) + 0.5);
+    if (idx >= n) idx = n-1;
+    return v[idx];
+  }
+  /// number of samples strictly greater than thresh
+  unsigned long countAbove(double thresh) const
+  {
+    unsigned long c = 0;
+    for (unsigned long i = 0; i < n; ++i) if (v[i] > thresh) ++c;
+    return c;
+  }
+
+private:
+  std::vector<double> v;
+  unsigned long n, dropped;
+};
+
+/** Emits benchmark results as either an aligned text table, CSV, or one
+    JSON object per line, so that the output can be diffed by eye or
+    slurped up by a regression tracker. */
+class BenchReport
+{
+public:
+  enum Format { Text, CSV, JSON };
+
+  explicit BenchReport(Format f = Text) : fmt(f), nrec(0) {}
+
+  static bool parseFormat(const std::string & s, Format & out)
+  {
+    if (s == "text") out = Text;
+    else if (s == "csv") out = CSV;
+    else if (s == "json") out = JSON;
+    else return false;
+    return true;
+  }
+
+  /// start a new record, 'name' identifies the benchmark
+  void begin(const std::string & name)
+  {
+    keys.clear(); vals.clear();
+    keys.push_back("bench"); vals.push_back(name);
+    isnum.clear(); isnum.push_back(false);
+  }
+  void field(const std::string & k, double val)
+  {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.6g", val);
+    keys.push_back(k); vals.push_back(buf); isnum.push_back(true);
+  }
+  void field(const std::string & k, const std::string & val)
+  {
+    keys.push_back(k); vals.push_back(val); isnum.push_back(false);
+  }
+  /// convenience: count, mean, min, p50, p90, p99, p99.9, max with prefix,
+  /// each multiplied by scale (eg 1e-3 to turn ns samples into us)
+  void stats(const std::string & prefix, BenchStats & s, double scale = 1.0)
+  {
+    field(prefix + "_n", s.count());
+    field(prefix + "_mean", s.mean() * scale);
+    field(prefix + "_min", s.min() * scale);
+    field(prefix + "_p50", s.percentile(50) * scale);
+    field(prefix + "_p90", s.percentile(90) * scale);
+    field(prefix + "_p99", s.percentile(99) * scale);
+    field(prefix + "_p999", s.percentile(99.9) * scale);
+    field(prefix + "_max", s.max() * scale);
+  }
+  void end()
+  {
+    switch (fmt) {
+    case CSV:
+      if (keys != lastKeys) { printRow(keys); lastKeys = keys; }
+      printRow(vals);
+      break;
+    case JSON:
+      std::printf("{");
+      for (unsigned i = 0; i < keys.size(); ++i)
+        std::printf(isnum[i] ? "%s\"%s\": %s" : "%s\"%s\": \"%s\"", i ? ", " : "", keys[i].c_str(), vals[i].c_str());
+      std::printf("}\n");
+      break;
+    case Text:
+    default:
+      std::printf("%s%s\n", nrec ? "\n" : "", vals[0].c_str());
+      for (unsigned i = 1; i < keys.size(); ++i)
+        std::printf("  %-28s %s\n", keys[i].c_str(), vals[i].c_str());
+      break;
+    }
+    std::fflush(stdout);
+    ++nrec;
+  }
+
+private:
+  void printRow(const std::vector<std::string> & r)
+  {
+    for (unsigned i = 0; i < r.size(); ++i)
+      std::printf("%s%s", i ? "," : "", r[i].c_str());
+    std::printf("\n");
+  }
+
+  Format fmt;
+  unsigned nrec;
+  std::vector<std::string> keys, vals, lastKeys;
+  std::vector<bool> isnum;
+};
+
+/// CPU time consumed by the calling thread, in ns
+inline long long ThreadCPUTime()
+{
+  struct timespec ts;
+  ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<long long>(ts.tv_sec)*1000000000LL + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,413 @@
+/**
+   @file bench_control.cpp
+   @brief Control loop scalability benchmark for the userspace ControlLib.
+
+   Spins up N PID loops, M PWM loops and K periodic DAQ-style threads and
+   lets them run for a while.  The loops are wired together roughly the
+   way the olfactometer coprocess wires them: each PID reads its input
+   from one DAQ thread's scan and writes its output into another DAQ
+   thread's scan (taking that thread's mutex, like
+   Kernel::DAQTask::putSample() does), and each PWM writes its edges into
+   a third.
+
+   Reports per loop type: achieved rate, wakeup latency percentiles,
+   deadline misses, CPU time per loop iteration and, for the DAQ threads,
+   how contended their mutex was.  Use -f csv or -f json for output that
+   can be tracked across builds.
+
+   -P picks the Timer precision mode of all the loops (plain sleep,
+   sleep-then-spin or timerfd, see Timer::setPrecision()) and the
+   *_timer records report the Timers' own jitter statistics, so the
+   modes can be compared under the same load.
+
+   Run as root to get SCHED_RR threads, otherwise the numbers mostly
+   measure the CFS scheduler.
+*/
+#include "PID.h"
+#include "PWM.h"
+#include "Thread.h"
+#include "Mutex.h"
+#include "Timer.h"
+#include "BenchStats.h"
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace {
+
+  /// mutex acquisition stats, only updated with the mutex held
+  struct Contention
+  {
+    Contention() : acquisitions(0), contended(0), waits(1<<16) {}
+    unsigned long acquisitions, contended;
+    BenchStats waits; ///< ns spent blocked, for contended acquisitions only
+  };
+
+  void lockCounted(Mutex & m, Contention & c)
+  {
+    Timer::Time waited = -1;
+    if (!m.tryLock()) {
+      Timer::Time t0 = Timer::absTime();
+      m.lock();
+      waited = Timer::absTime() - t0;
+    }
+    ++c.acquisitions;
+    if (waited >= 0) { ++c.contended; c.waits.add(waited); }
+  }
+
+  /// per-loop timing, owned by exactly one thread while running
+  struct LoopStats
+  {
+    LoopStats(unsigned long cap) : n(0), t_first(0), t_last(0), cpu_first(0), cpu_last(0), latency(cap) {}
+    void tick(Timer::Time now, Timer::Time expected)
+    {
+      long long cpu = ThreadCPUTime();
+      if (!n) t_first = now, cpu_first = cpu;
+      else latency.add(now - expected);
+      t_last = now; cpu_last = cpu;
+      ++n;
+    }
+    double rateHz() const { return n > 1 ? (n-1) / ((t_last - t_first) / 1e9) : 0.; }
+    double cpuPerLoopNs() const { return n > 1 ? double(cpu_last - cpu_first) / (n-1) : 0.; }
+    unsigned long n;
+    Timer::Time t_first, t_last;
+    long long cpu_first, cpu_last;
+    BenchStats latency; ///< ns late vs. the ideal period grid
+  };
+
+  /// A stand-in for Kernel::DAQTask in periodic mode
+  class DAQLoop : protected Thread
+  {
+  public:
+    DAQLoop(unsigned rate, unsigned long cap)
+      : rate(rate), pleaseStop(false), stats(cap), prec(Timer::Sleep), margin(0)
+    {
+      Clr(jitter);
+      for (unsigned i = 0; i < 32; ++i) scan[i] = 0;
+    }
+    ~DAQLoop() { stop(); }
+
+    void start() { pleaseStop = false; Thread::start(Thread::HighPriority); }
+    void stop() { pleaseStop = true; if (running()) join(); }
+    using Thread::setThreadAttrs;
+    void setTimerPrecision(Timer::Precision p, Timer::Time m) { prec = p; margin = m; }
+    /// valid after stop()
+    Timer::JitterStats timerJitter() const { return jitter; }
+
+    /// like DAQTask::getSample() in periodic mode: no lock
+    unsigned getSample(unsigned ch) const { return scan[ch%32]; }
+    /// like DAQTask::putSample(): takes the lock
+    void putSample(unsigned ch, unsigned v)
+    {
+      lockCounted(mut, contention);
+      scan[ch%32] = v;
+      changed_mask |= 0x1<<(ch%32);
+      mut.unlock();
+    }
+
+    const unsigned rate;
+    volatile bool pleaseStop;
+    LoopStats stats;
+    Contention contention;
+
+  protected:
+    void run()
+    {
+      Timer timer;
+      timer.setPrecision(prec, margin);
+      timer.setPeriod(1000000000 / rate);
+      stats.tick(Timer::absTime(), 0);
+      while (!pleaseStop) {
+        lockCounted(mut, contention);
+        // pretend to do the IO: read back everything, clear changed mask
+        unsigned sum = 0;
+        for (unsigned i = 0; i < 32; ++i) sum += scan[i];
+        junk = sum;
+        changed_mask = 0;
+        mut.unlock();
+        timer.waitNextPeriod();
+        stats.tick(Timer::absTime(), timer.lastWakeupTime());
+      }
+      jitter = timer.jitter();
+    }
+
+  private:
+    Timer::Precision prec;
+    Timer::Time margin;
+    Timer::JitterStats jitter;
+    Mutex mut;
+    volatile unsigned scan[32], changed_mask, junk;
+  };
+
+  /// A PID::Callback with a trivial first-order plant on the other end
+  class PIDLoop : public PID::Callback
+  {
+  public:
+    PIDLoop(unsigned chan, DAQLoop *ai, DAQLoop *ao, unsigned rate, unsigned long cap)
+      : chan(chan), ai(ai), ao(ao), period(1000000000 / rate), stats(cap), y(0.), u(0.)
+    {}
+
+    double getE()
+    {
+      Timer::Time now = Timer::absTime();
+      stats.tick(now, stats.n ? stats.t_first + stats.n * period : now);
+      if (ai) y += (double(ai->getSample(chan)) / 4095. - y) * 0.1;
+      else y += (u - y) * 0.1;
+      return y - 0.5; // setpoint is 0.5
+    }
+    void setU(double du)
+    {
+      u += du;
+      if (u < 0.) u = 0.;
+      if (u > 1.) u = 1.;
+      if (ao) ao->putSample(chan, static_cast<unsigned>(u * 4095.));
+    }
+
+    PID pid;
+    unsigned chan;
+    DAQLoop *ai, *ao;
+    const Timer::Time period;
+    LoopStats stats;
+  private:
+    double y, u;
+  };
+
+  /// Records PWM edges against the ideal edge times
+  class PWMLoop
+  {
+  public:
+    struct Edge : public PWM::Callback
+    {
+      Edge(PWMLoop *p, bool high) : p(p), high(high) {}
+      void operator()() { p->edge(high); }
+      PWMLoop *p;
+      bool high;
+    };
+
+    PWMLoop(unsigned chan, DAQLoop *dio, unsigned window_us, unsigned duty, unsigned long cap)
+      : hi(this, true), lo(this, false), chan(chan), dio(dio),
+        window(window_us * 1000LL), duty(duty), stats(cap), lowLate(cap), lastHigh(0)
+    {
+      pwm.setTimeScale(PWM::Microseconds);
+      pwm.setWindow(window_us);
+      pwm.setDutyCycle(duty);
+    }
+
+    void edge(bool high)
+    {
+      Timer::Time now = Timer::absTime();
+      if (high) {
+        stats.tick(now, stats.n ? stats.t_first + stats.n * window : now);
+        lastHigh = stats.t_first + (stats.n-1) * window;
+      } else if (stats.n) {
+        // PWM sleeps until period/100*duty past the ideal window start
+        lowLate.add(now - (lastHigh + window/100*duty));
+      }
+      if (dio) dio->putSample(chan, high ? 1 : 0);
+    }
+
+    Edge hi, lo;
+    PWM pwm;
+    unsigned chan;
+    DAQLoop *dio;
+    const Timer::Time window;
+    const unsigned duty;
+    LoopStats stats; ///< rising edges
+    BenchStats lowLate; ///< falling edge latency, written only by the PWM thread
+    Timer::Time lastHigh;
+  };
+
+  void usage(const char *argv0)
+  {
+    std::fprintf(stderr,
+                 "Usage: %s [-p num_pid] [-r pid_hz] [-w num_pwm] [-W pwm_window_us] [-u pwm_duty]\n"
+                 "          [-d num_daq] [-R daq_hz] [-t seconds] [-f text|csv|json]\n"
+                 "          [-c cpu_mask] [-s stack_kb] [-L] [-P sleep|spin|timerfd] [-M spin_us]\n"
+                 "Defaults: -p 24 -r 100 -w 12 -W 50000 -u 50 -d 6 -R 2000 -t 10 -f text -P sleep -M 50\n"
+                 "-c pins all loop threads to the cpus in cpu_mask (eg 0xc), -s sets their\n"
+                 "stack size and prefaults it, -L locks all memory (mlockall)\n"
+                 "-P sets the Timer precision mode of all loops, -M the spin margin for -P spin\n",
+                 argv0);
+  }
+
+  void reportLoops(BenchReport & rep, const char *name, unsigned num, unsigned target_hz,
+                   const std::vector<LoopStats *> & loops, double period_ns)
+  {
+    BenchStats lat;
+    double rate = 0., cpu = 0.;
+    unsigned long iters = 0;
+    for (unsigned i = 0; i < loops.size(); ++i) {
+      lat.merge(loops[i]->latency);
+      rate += loops[i]->rateHz();
+      cpu += loops[i]->cpuPerLoopNs();
+      iters += loops[i]->n;
+    }
+    rep.begin(name);
+    rep.field("loops", num);
+    rep.field("target_hz", target_hz);
+    rep.field("achieved_hz_mean", loops.size() ? rate / loops.size() : 0.);
+    rep.field("iterations", iters);
+    rep.field("cpu_per_loop_us", loops.size() ? cpu / loops.size() / 1e3 : 0.);
+    rep.field("missed_deadlines", lat.countAbove(period_ns));
+    rep.field("dropped_samples", lat.numDropped());
+    rep.stats("latency_us", lat, 1e-3);
+    rep.end();
+  }
+
+  void reportJitter(BenchReport & rep, const char *name, const std::vector<Timer::JitterStats> & js)
+  {
+    unsigned long long cycles = 0, missed = 0;
+    Timer::Time mn = 0, mx = 0;
+    double sum = 0., sd = 0.;
+    for (unsigned i = 0; i < js.size(); ++i) {
+      const Timer::JitterStats & j = js[i];
+      if (!j.cycles) continue;
+      if (!cycles || j.min < mn) mn = j.min;
+      if (!cycles || j.max > mx) mx = j.max;
+      cycles += j.cycles;
+      missed += j.missed;
+      sum += j.sum;
+      sd += j.stddev();
+    }
+    rep.begin(name);
+    rep.field("cycles", cycles);
+    rep.field("missed", missed);
+    rep.field("late_min_us", mn / 1e3);
+    rep.field("late_mean_us", cycles ? sum / cycles / 1e3 : 0.);
+    rep.field("late_stddev_us_avg", js.size() ? sd / js.size() / 1e3 : 0.);
+    rep.field("late_max_us", mx / 1e3);
+    rep.end();
+  }
+
+  bool parsePrecision(const std::string & s, Timer::Precision & out)
+  {
+    if (s == "sleep") out = Timer::Sleep;
+    else if (s == "spin") out = Timer::SleepSpin;
+    else if (s == "timerfd") out = Timer::TimerFD;
+    else return false;
+    return true;
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned npid = 24, pid_hz = 100, npwm = 12, pwm_window_us = 50000, pwm_duty = 50,
+    ndaq = 6, daq_hz = 2000, secs = 10;
+  BenchReport::Format fmt = BenchReport::Text;
+  ThreadAttrs attrs;
+  bool lockMem = false;
+  Timer::Precision prec = Timer::Sleep;
+  Timer::Time margin = Timer::DEFAULT_SPIN_MARGIN;
+  Clr(attrs);
+  int opt;
+  while ((opt = ::getopt(argc, argv, "p:r:w:W:u:d:R:t:f:c:s:LP:M:h")) != -1) {
+    switch (opt) {
+    case 'p': npid = std::atoi(optarg); break;
+    case 'r': pid_hz = std::atoi(optarg); break;
+    case 'w': npwm = std::atoi(optarg); break;
+    case 'W': pwm_window_us = std::atoi(optarg); break;
+    case 'u': pwm_duty = std::atoi(optarg); break;
+    case 'd': ndaq = std::atoi(optarg); break;
+    case 'R': daq_hz = std::atoi(optarg); break;
+    case 't': secs = std::atoi(optarg); break;
+    case 'c': attrs.cpu_mask = std::strtoul(optarg, 0, 0); break;
+    case 's': attrs.stack_size = std::strtoul(optarg, 0, 0) * 1024; attrs.prefault_stack = 1; break;
+    case 'L': lockMem = true; break;
+    case 'M': margin = std::atoi(optarg) * 1000LL; break;
+    case 'P':
+      if (parsePrecision(optarg, prec)) break;
+      usage(argv[0]); return 1;
+    case 'f':
+      if (BenchReport::parseFormat(optarg, fmt)) break;
+      // fall through
+    default: usage(argv[0]); return 1;
+    }
+  }
+  if (!pid_hz || !daq_hz || !pwm_window_us || pwm_duty > 100 || !secs) { usage(argv[0]); return 1; }
+
+  std::vector<DAQLoop *> daqs;
+  std::vector<PIDLoop *> pids;
+  std::vector<PWMLoop *> pwms;
+  for (unsigned i = 0; i < ndaq; ++i)
+    daqs.push_back(new DAQLoop(daq_hz, daq_hz * secs + 1024));
+  // like the olfactometer: daq 0 is AI, daq 1 is AO, the rest are DIO
+  DAQLoop *ai = ndaq > 0 ? daqs[0] : 0, *ao = ndaq > 1 ? daqs[1] : ai;
+  for (unsigned i = 0; i < npid; ++i)
+    pids.push_back(new PIDLoop(i, ai, ao, pid_hz, pid_hz * secs + 1024));
+  for (unsigned i = 0; i < npwm; ++i)
+    pwms.push_back(new PWMLoop(i, ndaq > 2 ? daqs[2 + i%(ndaq-2)] : ao,
+                               pwm_window_us, pwm_duty,
+                               1000000ULL * secs / pwm_window_us + 1024));
+
+  if (lockMem && !Thread::lockMemory())
+    std::fprintf(stderr, "Warning: could not lock memory, are you root?\n");
+  for (unsigned i = 0; i < daqs.size(); ++i) daqs[i]->setThreadAttrs(attrs);
+  for (unsigned i = 0; i < pids.size(); ++i) pids[i]->pid.setThreadAttrs(attrs);
+  for (unsigned i = 0; i < pwms.size(); ++i) pwms[i]->pwm.setThreadAttrs(attrs);
+  for (unsigned i = 0; i < daqs.size(); ++i) daqs[i]->setTimerPrecision(prec, margin);
+  for (unsigned i = 0; i < pids.size(); ++i) pids[i]->pid.setTimerPrecision(prec, margin);
+  for (unsigned i = 0; i < pwms.size(); ++i) pwms[i]->pwm.setTimerPrecision(prec, margin);
+
+  PID::ControlParams cp;
+  cp.Kp = 0.05; cp.Ki = 0.01; cp.Kd = 0.; cp.numIntgrlPts = 10;
+  for (unsigned i = 0; i < daqs.size(); ++i) daqs[i]->start();
+  for (unsigned i = 0; i < pids.size(); ++i) pids[i]->pid.start(pids[i], pid_hz, &cp, Thread::NormalPriority);
+  for (unsigned i = 0; i < pwms.size(); ++i) pwms[i]->pwm.start(&pwms[i]->hi, &pwms[i]->lo, 0, Thread::HighPriority);
+
+  ::sleep(secs);
+
+  for (unsigned i = 0; i < pwms.size(); ++i) pwms[i]->pwm.stop();
+  for (unsigned i = 0; i < pids.size(); ++i) pids[i]->pid.stop();
+  for (unsigned i = 0; i < daqs.size(); ++i) daqs[i]->stop();
+
+  BenchReport rep(fmt);
+  std::vector<LoopStats *> ls;
+
+  for (unsigned i = 0; i < pids.size(); ++i) ls.push_back(&pids[i]->stats);
+  reportLoops(rep, "pid", npid, pid_hz, ls, 1e9 / pid_hz);
+
+  ls.clear();
+  BenchStats low;
+  for (unsigned i = 0; i < pwms.size(); ++i) ls.push_back(&pwms[i]->stats), low.merge(pwms[i]->lowLate);
+  reportLoops(rep, "pwm", npwm, 1000000 / pwm_window_us, ls, pwm_window_us * 1e3);
+  if (npwm) {
+    rep.begin("pwm_falling_edge");
+    rep.stats("latency_us", low, 1e-3);
+    rep.end();
+  }
+
+  ls.clear();
+  for (unsigned i = 0; i < daqs.size(); ++i) ls.push_back(&daqs[i]->stats);
+  reportLoops(rep, "daq", ndaq, daq_hz, ls, 1e9 / daq_hz);
+
+  for (unsigned i = 0; i < daqs.size(); ++i) {
+    Contention & c = daqs[i]->contention;
+    char name[32];
+    std::snprintf(name, sizeof(name), "daq%u_mutex", i);
+    rep.begin(name);
+    rep.field("acquisitions", c.acquisitions);
+    rep.field("contended", c.contended);
+    rep.field("contended_pct", c.acquisitions ? 100. * c.contended / c.acquisitions : 0.);
+    rep.stats("wait_us", c.waits, 1e-3);
+    rep.end();
+  }
+
+  std::vector<Timer::JitterStats> js;
+  for (unsigned i = 0; i < pids.size(); ++i) js.push_back(pids[i]->pid.timerJitter());
+  reportJitter(rep, "pid_timer", js);
+  js.clear();
+  for (unsigned i = 0; i < pwms.size(); ++i) js.push_back(pwms[i]->pwm.timerJitter());
+  reportJitter(rep, "pwm_timer", js);
+  js.clear();
+  for (unsigned i = 0; i < daqs.size(); ++i) js.push_back(daqs[i]->timerJitter());
+  reportJitter(rep, "daq_timer", js);
+
+  for (unsigned i = 0; i < pwms.size(); ++i) delete pwms[i];
+  for (unsigned i = 0; i < pids.size(); ++i) delete pids[i];
+  for (unsigned i = 0; i < daqs.size(); ++i) delete daqs[i];
+  return 0;
+}
@@ -0,0 +1,440 @@
+/**
+   @file bench_primitives.cpp
+   @brief Microbenchmarks for the ControlLib synchronization and container
+          primitives, userspace build.
+
+   Measures, as percentiles:
+
+   - mutex:      uncontended lock()/unlock() pair cost
+   - mutex_mt:   time spent inside lock() with -T threads hammering one Mutex
+   - condition:  Condition::signal() to wakeup latency of a thread blocked
+                 in Condition::wait()
+   - semaphore:  Semaphore post()/wait() ping-pong round trip between two
+                 threads
+   - fifo:       message throughput and per-message write() cost by message
+                 size, reader and writer on separate threads
+   - deque:      Deque<T> and Ring<T> push_back()/pop_front() cost
+   - spsc:       SPSCRing<T> producer to consumer throughput and latency
+   - nanosleep:  Timer::nanoSleep() wakeup lateness, relative and absolute
+
+   Operations that are much cheaper than reading the clock (mutex, deque)
+   are timed in batches and the per-op time is the batch time divided by
+   the batch size.
+
+   NB: in userspace RTFifo::read()/write() are plain read(2)/write(2) on
+   /dev/rtfN, which only exists with the RTLinux fifo module loaded and
+   has no userspace-to-userspace loopback.  The fifo benchmark therefore
+   drives RTFRead()/RTFWrite() -- the functions RTFifo calls -- on a
+   pipe, which is the same code path minus the rtf driver.
+*/
+#include "Mutex.h"
+#include "Condition.h"
+#include "Semaphore.h"
+#include "Thread.h"
+#include "Timer.h"
+#include "Deque.h"
+#include "Ring.h"
+#include "SysDep.h"
+#include "BenchStats.h"
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sched.h>
+
+namespace {
+
+  const unsigned BATCH = 64;
+
+  void usage(const char *argv0)
+  {
+    std::fprintf(stderr,
+                 "Usage: %s [-b bench[,bench...]] [-n iterations] [-T threads] [-f text|csv|json]\n"
+                 "Benches: mutex, mutex_mt, condition, semaphore, fifo, deque, spsc, nanosleep (default: all)\n"
+                 "Defaults: -n 100000 -T 4 -f text\n",
+                 argv0);
+  }
+
+  bool wanted(const std::string & list, const char *name)
+  {
+    if (list.empty()) return true;
+    std::string l = "," + list + ",";
+    return l.find(std::string(",") + name + ",") != std::string::npos;
+  }
+
+  /*--------------------------------------------------------------------------
+    mutex
+   --------------------------------------------------------------------------*/
+  void benchMutex(BenchReport & rep, unsigned long n)
+  {
+    Mutex m;
+    BenchStats s(n / BATCH + 1);
+    for (unsigned long i = 0; i < n; i += BATCH) {
+      Timer::Time t0 = Timer::absTime();
+      for (unsigned j = 0; j < BATCH; ++j) { m.lock(); m.unlock(); }
+      s.add(double(Timer::absTime() - t0) / BATCH);
+    }
+    rep.begin("mutex");
+    rep.field("batch", BATCH);
+    rep.stats("lock_unlock_ns", s);
+    rep.end();
+  }
+
+  class MutexHammer : protected Thread
+  {
+  public:
+    MutexHammer(Mutex & m, volatile unsigned long & shared, unsigned long n)
+      : waits(n), m(m), shared(shared), n(n) {}
+    ~MutexHammer() { if (running()) join(); }
+    void start() { Thread::start(Thread::NormalPriority); }
+    void wait() { join(); }
+    BenchStats waits;
+  protected:
+    void run()
+    {
+      for (unsigned long i = 0; i < n; ++i) {
+        Timer::Time t0 = Timer::absTime();
+        m.lock();
+        waits.add(Timer::absTime() - t0);
+        ++shared;
+        m.unlock();
+      }
+    }
+  private:
+    Mutex & m;
+    volatile unsigned long & shared;
+    const unsigned long n;
+  };
+
+  void benchMutexMT(BenchReport & rep, unsigned long n, unsigned nthreads)
+  {
+    Mutex m;
+    volatile unsigned long shared = 0;
+    unsigned long per = n / nthreads + 1;
+    std::vector<MutexHammer *> ts;
+    for (unsigned i = 0; i < nthreads; ++i) ts.push_back(new MutexHammer(m, shared, per));
+    Timer::Time t0 = Timer::absTime();
+    for (unsigned i = 0; i < ts.size(); ++i) ts[i]->start();
+    for (unsigned i = 0; i < ts.size(); ++i) ts[i]->wait();
+    Timer::Time elapsed = Timer::absTime() - t0;
+    BenchStats all;
+    for (unsigned i = 0; i < ts.size(); ++i) { all.merge(ts[i]->waits); delete ts[i]; }
+    rep.begin("mutex_mt");
+    rep.field("threads", nthreads);
+    rep.field("acquisitions", shared);
+    rep.field("ops_per_sec", elapsed > 0 ? shared / (elapsed / 1e9) : 0.);
+    rep.stats("lock_ns", all);
+    rep.end();
+  }
+
+  /*--------------------------------------------------------------------------
+    condition
+   --------------------------------------------------------------------------*/
+  class CondWaiter : protected Thread
+  {
+  public:
+    CondWaiter(unsigned long n) : lat(n), waiting(false), go(false), quit(false), t0(0) {}
+    ~CondWaiter() { if (running()) join(); }
+    void start() { Thread::start(Thread::NormalPriority); }
+
+    /// signal the waiter once it is blocked in wait(), last makes it exit
+    void signalOnce(bool last)
+    {
+      for (;;) {
+        m.lock();
+        if (waiting) break;
+        m.unlock();
+        ::sched_yield();
+      }
+      waiting = false;
+      quit = last;
+      go = true;
+      t0 = Timer::absTime();
+      c.signal();
+      m.unlock();
+    }
+    void wait() { join(); }
+
+    BenchStats lat;
+  protected:
+    void run()
+    {
+      m.lock();
+      while (!quit) {
+        waiting = true;
+        while (!go) c.wait(m);
+        Timer::Time now = Timer::absTime();
+        if (!quit) lat.add(now - t0);
+        go = false;
+      }
+      m.unlock();
+    }
+  private:
+    Mutex m;
+    Condition c;
+    bool waiting, go, quit;
+    Timer::Time t0;
+  };
+
+  void benchCondition(BenchReport & rep, unsigned long n)
+  {
+    CondWaiter w(n);
+    w.start();
+    for (unsigned long i = 0; i < n; ++i) w.signalOnce(false);
+    w.signalOnce(true);
+    w.wait();
+    rep.begin("condition");
+    rep.stats("signal_to_wake_ns", w.lat);
+    rep.end();
+  }
+
+  /*--------------------------------------------------------------------------
+    semaphore
+   --------------------------------------------------------------------------*/
+  class SemEcho : protected Thread
+  {
+  public:
+    SemEcho(Semaphore & in, Semaphore & out, unsigned long n) : in(in), out(out), n(n) {}
+    ~SemEcho() { if (running()) join(); }
+    void start() { Thread::start(Thread::NormalPriority); }
+    void wait() { join(); }
+  protected:
+    void run() { for (unsigned long i = 0; i < n; ++i) { in.wait(); out.post(); } }
+  private:
+    Semaphore & in, & out;
+    const unsigned long n;
+  };
+
+  void benchSemaphore(BenchReport & rep, unsigned long n)
+  {
+    Semaphore ping(0), pong(0);
+    SemEcho echo(ping, pong, n);
+    BenchStats rtt(n);
+    echo.start();
+    for (unsigned long i = 0; i < n; ++i) {
+      Timer::Time t0 = Timer::absTime();
+      ping.post();
+      pong.wait();
+      rtt.add(Timer::absTime() - t0);
+    }
+    echo.wait();
+    rep.begin("semaphore");
+    rep.stats("round_trip_ns", rtt);
+    rep.end();
+  }
+
+  /*--------------------------------------------------------------------------
+    fifo
+   --------------------------------------------------------------------------*/
+  class FifoReader : protected Thread
+  {
+  public:
+    FifoReader(int fd, unsigned long total) : got(0), fd(fd), total(total) {}
+    ~FifoReader() { if (running()) join(); }
+    void start() { Thread::start(Thread::NormalPriority); }
+    void wait() { join(); }
+    unsigned long got;
+  protected:
+    void run()
+    {
+      char buf[16384];
+      while (got < total) {
+        int r = RTFRead(fd, buf, sizeof(buf));
+        if (r <= 0) break;
+        got += r;
+      }
+    }
+  private:
+    int fd;
+    const unsigned long total;
+  };
+
+  void benchFifo(BenchReport & rep, unsigned long n)
+  {
+    static const unsigned sizes[] = { 8, 64, 256, 1024, 4096 };
+    std::vector<char> msg(4096, 'x');
+    for (unsigned k = 0; k < sizeof(sizes)/sizeof(*sizes); ++k) {
+      const unsigned sz = sizes[k];
+      int fds[2];
+      if (::pipe(fds)) { std::perror("pipe"); return; }
+      // cap the volume so the big messages don't take forever
+      unsigned long nmsg = n;
+      if (nmsg * sz > 256UL*1024*1024) nmsg = 256UL*1024*1024 / sz;
+      FifoReader rd(fds[0], nmsg * sz);
+      BenchStats wr(nmsg);
+      rd.start();
+      Timer::Time t0 = Timer::absTime();
+      for (unsigned long i = 0; i < nmsg; ++i) {
+        Timer::Time w0 = Timer::absTime();
+        if (RTFWrite(fds[1], &msg[0], sz) != int(sz)) { std::perror("write"); break; }
+        wr.add(Timer::absTime() - w0);
+      }
+      rd.wait();
+      Timer::Time elapsed = Timer::absTime() - t0;
+      RTFClose(fds[0]);
+      RTFClose(fds[1]);
+
+      double secs = elapsed / 1e9;
+      rep.begin("fifo");
+      rep.field("transport", "pipe");
+      rep.field("msg_bytes", sz);
+      rep.field("messages", nmsg);
+      rep.field("msgs_per_sec", secs > 0. ? nmsg / secs : 0.);
+      rep.field("mbytes_per_sec", secs > 0. ? rd.got / secs / (1024.*1024.) : 0.);
+      rep.stats("write_ns", wr);
+      rep.end();
+    }
+  }
+
+  /*--------------------------------------------------------------------------
+    deque
+   --------------------------------------------------------------------------*/
+  template <typename T, typename Q>
+  void benchDequeT(BenchReport & rep, const char *container, const char *type, unsigned long n)
+  {
+    Q d(1024);
+    BenchStats push(n / BATCH + 1), pop(n / BATCH + 1);
+    volatile T sink = T();
+    // keep it half full so both the wraparound and the steady state get hit
+    for (unsigned i = 0; i < 512; ++i) d.push_back(T(i));
+    for (unsigned long i = 0; i < n; i += BATCH) {
+      Timer::Time t0 = Timer::absTime();
+      for (unsigned j = 0; j < BATCH; ++j) d.push_back(T(j));
+      Timer::Time t1 = Timer::absTime();
+      for (unsigned j = 0; j < BATCH; ++j) { sink = d.front(); d.pop_front(); }
+      Timer::Time t2 = Timer::absTime();
+      push.add(double(t1 - t0) / BATCH);
+      pop.add(double(t2 - t1) / BATCH);
+    }
+    (void)sink;
+    rep.begin("deque");
+    rep.field("container", container);
+    rep.field("type", type);
+    rep.field("capacity", d.capacity());
+    rep.field("batch", BATCH);
+    rep.stats("push_back_ns", push);
+    rep.stats("pop_front_ns", pop);
+    rep.end();
+  }
+
+  void benchDeque(BenchReport & rep, unsigned long n)
+  {
+    benchDequeT<int, Deque<int> >(rep, "Deque", "int", n);
+    benchDequeT<double, Deque<double> >(rep, "Deque", "double", n);
+    benchDequeT<int, Ring<int> >(rep, "Ring", "int", n);
+    benchDequeT<double, Ring<double> >(rep, "Ring", "double", n);
+  }
+
+  /*--------------------------------------------------------------------------
+    spsc
+   --------------------------------------------------------------------------*/
+  class SPSCConsumer : protected Thread
+  {
+  public:
+    SPSCConsumer(SPSCRing<Timer::Time> & q, unsigned long n) : lat(n), q(q), n(n) {}
+    ~SPSCConsumer() { if (running()) join(); }
+    // same scheduling class as main() so that the two can yield to each
+    // other on a single cpu
+    void start() { Thread::start(Thread::IdlePriority); }
+    void wait() { join(); }
+    BenchStats lat;
+  protected:
+    void run()
+    {
+      Timer::Time t;
+      for (unsigned long i = 0; i < n; ) {
+        if (q.pop(t)) { lat.add(Timer::absTime() - t); ++i; }
+        else ::sched_yield();
+      }
+    }
+  private:
+    SPSCRing<Timer::Time> & q;
+    const unsigned long n;
+  };
+
+  void benchSPSC(BenchReport & rep, unsigned long n)
+  {
+    SPSCRing<Timer::Time> q(1024);
+    SPSCConsumer c(q, n);
+    unsigned long full = 0;
+    c.start();
+    Timer::Time t0 = Timer::absTime();
+    for (unsigned long i = 0; i < n; ) {
+      if (q.push(Timer::absTime())) ++i;
+      else { ++full; ::sched_yield(); }
+    }
+    c.wait();
+    Timer::Time elapsed = Timer::absTime() - t0;
+    rep.begin("spsc");
+    rep.field("capacity", q.capacity());
+    rep.field("items", n);
+    rep.field("items_per_sec", elapsed > 0 ? n / (elapsed / 1e9) : 0.);
+    rep.field("producer_full", full);
+    rep.stats("push_to_pop_ns", c.lat);
+    rep.end();
+  }
+
+  /*--------------------------------------------------------------------------
+    nanosleep
+   --------------------------------------------------------------------------*/
+  void benchNanoSleep(BenchReport & rep, unsigned long n)
+  {
+    static const Timer::Time reqs[] = { 50000, 500000, 2000000 };
+    // sleeping is slow, so cap the number of samples at ~2 s per request
+    for (unsigned k = 0; k < sizeof(reqs)/sizeof(*reqs); ++k) {
+      unsigned long num = n;
+      if (num * reqs[k] > 2000000000ULL) num = 2000000000ULL / reqs[k];
+      BenchStats rel(num), abs(num);
+      for (unsigned long i = 0; i < num; ++i) {
+        Timer::Time t0 = Timer::absTime();
+        Timer::nanoSleep(reqs[k], Timer::Relative);
+        rel.add(Timer::absTime() - t0 - reqs[k]);
+        Timer::Time target = Timer::absTime() + reqs[k];
+        Timer::nanoSleep(target, Timer::Absolute);
+        abs.add(Timer::absTime() - target);
+      }
+      rep.begin("nanosleep");
+      rep.field("request_us", reqs[k] / 1e3);
+      rep.field("samples", num);
+      rep.stats("relative_late_us", rel, 1e-3);
+      rep.stats("absolute_late_us", abs, 1e-3);
+      rep.end();
+    }
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long n = 100000;
+  unsigned nthreads = 4;
+  std::string which;
+  BenchReport::Format fmt = BenchReport::Text;
+  int opt;
+  while ((opt = ::getopt(argc, argv, "b:n:T:f:h")) != -1) {
+    switch (opt) {
+    case 'b': which = optarg; break;
+    case 'n': n = std::strtoul(optarg, 0, 0); break;
+    case 'T': nthreads = std::atoi(optarg); break;
+    case 'f':
+      if (BenchReport::parseFormat(optarg, fmt)) break;
+      // fall through
+    default: usage(argv[0]); return 1;
+    }
+  }
+  if (!n || !nthreads) { usage(argv[0]); return 1; }
+
+  BenchReport rep(fmt);
+  if (wanted(which, "mutex")) benchMutex(rep, n);
+  if (wanted(which, "mutex_mt")) benchMutexMT(rep, n, nthreads);
+  if (wanted(which, "condition")) benchCondition(rep, n);
+  if (wanted(which, "semaphore")) benchSemaphore(rep, n);
+  if (wanted(which, "fifo")) benchFifo(rep, n);
+  if (wanted(which, "deque")) benchDeque(rep, n * 10);
+  if (wanted(which, "spsc")) benchSPSC(rep, n * 10);
+  if (wanted(which, "nanosleep")) benchNanoSleep(rep, n);
+  return 0;
+}
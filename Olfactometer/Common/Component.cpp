@@ -3,6 +3,7 @@
 
 /* static */ const std::string Component::NAMELESS ("(NamelessComponent)");
 /* static */ unsigned Component::compIdCtr = 0;
+/* static */ unsigned Component::treeGen = 0;
 /* static */ Component::NameMap Component::nameCompMap; ///< map component names to component instances
 /* static */ Component::IdCompMap Component::idCompMap; ///< map component id's to component instances
 
@@ -35,6 +36,7 @@ Component::~Component()
 void
 Component::reparent(Component *newParent)
 {
+  ++treeGen;
   if (_parent) _parent->childRemoved(this);
   _parent = newParent;
   if (_parent) _parent->childAdded(this);
@@ -111,6 +113,7 @@ Component::setName(const std::string &name)
   NameMap::iterator it = nameCompMap.find(nam);
   if (it != nameCompMap.end() && it->second == this) nameCompMap.erase(it);
   nam = name;
+  ++treeGen;
   if (name != NAMELESS) nameCompMap[name] = this;
   if (_parent) _parent->childRenamed(this);
 }
@@ -73,12 +73,30 @@ const char * const Protocol::IsEnabled = "IS ENABLED"; ///< takes 1 arg, a valid
 const char * const Protocol::Monitor = "MONITOR"; ///< takes 3 args
 const char * const Protocol::SetDesiredTotalFlow = "SET DESIRED TOTAL FLOW"; ///< takes 2 args, mixname and flow in ml/min
 const char * const Protocol::List = "LIST";
+const char * const Protocol::GetState = "GET STATE";///< takes 0 or 1 args, a component
 const char * const Protocol::GetControlParams = "GET CONTROL PARAMS";///< takes 1 arg, a pidflow controller name
 const char * const Protocol::SetControlParams = "SET CONTROL PARAMS";///< takes 2+ args:  controller_name args..
 const char * const Protocol::GetCoeffs = "GET COEFFS";///< takes 1 arg, a pidflow controller name
 const char * const Protocol::SetCoeffs = "SET COEFFS";///< takes 5 args, a pidflow controller name a b c d
 const char * const Protocol::GetCalib = "GET CALIB";///< takes 1 arg, a pidflow controller name
 const char * const Protocol::SetCalib = "SET CALIB";///< takes >1 args, a pidflow controller name v=flow ...
+const char * const Protocol::Calibrate = "CALIBRATE";///< takes >1 args, flowcontroller=reference ... [param=value ...]
+const char * const Protocol::AutoTune = "AUTOTUNE";///< takes >=1 args, pidflowcontroller [param=value ...]
+const char * const Protocol::Identify = "IDENTIFY";///< takes >=1 args, pidflowcontroller [param=value ...]
+const char * const Protocol::SetWaveform = "SET WAVEFORM";///< takes >=1 args, pidflowcontroller|mix [shape=...] [param=value ...]
+const char * const Protocol::StartWaveform = "START WAVEFORM";///< takes >=1 args, pidflowcontroller|mix [loops|delay_s=value ...]
+const char * const Protocol::StopWaveform = "STOP WAVEFORM";///< takes 1 arg, pidflowcontroller|mix
+const char * const Protocol::GetWaveform = "GET WAVEFORM";///< takes 1 arg, pidflowcontroller|mix
+const char * const Protocol::SetProgram = "SET PROGRAM";///< takes 0 args, then the program as text input
+const char * const Protocol::RunProgram = "RUN PROGRAM";///< takes 0 args
+const char * const Protocol::StopProgram = "STOP PROGRAM";///< takes 0 args
+const char * const Protocol::GetProgram = "GET PROGRAM";///< takes 0 args
+const char * const Protocol::ArmProgram = "ARM PROGRAM";///< takes 0 args
+const char * const Protocol::SetTrigger = "SET TRIGGER";///< takes >=2 args, slot input=daq_task:chan [edge=..] [once=..] [program=..], then the actions as text input
+const char * const Protocol::ClearTrigger = "CLEAR TRIGGER";///< takes 1 arg, a slot
+const char * const Protocol::GetTriggers = "GET TRIGGERS";///< takes 0 args
+const char * const Protocol::GetAlarms = "GET ALARMS";///< takes 0 args
+const char * const Protocol::WatchAlarms = "WATCH ALARMS";///< takes 0 args, streams alarm events
 const char * const Protocol::Start = "START"; ///< takes 1 args, a StartStoppable name
 const char * const Protocol::Stop = "STOP"; ///< takes 1 args, a StartStoppable name
 const char * const Protocol::Running = "RUNNING"; ///< takes 1 args, a StartStoppable
@@ -55,6 +55,9 @@ public:
   static unsigned idFromName(const std::string & name);
   /// globally find a component name by id, or empty string if not found
   static std::string nameFromId(unsigned id);
+  /// bumped whenever any component is added, removed, reparented or
+  /// renamed, so caches of the tree can tell they're stale
+  static unsigned treeGeneration() { return treeGen; }
 
 protected:
   /// reparents this component to a new parent
@@ -79,6 +82,7 @@ private:
   NameMap childNameMap;
 
   static unsigned compIdCtr; ///< source for component id's
+  static unsigned treeGen; ///< see treeGeneration()
   typedef std::map<unsigned, Component *> IdCompMap;
   static NameMap nameCompMap; ///< map component names to component instances
   static IdCompMap idCompMap; ///< map component id's to component instances
@@ -43,12 +43,30 @@ namespace Protocol
   extern const char * const Monitor; ///< takes 3 args, rate in hz, bank|mix name, param
   extern const char * const SetDesiredTotalFlow; ///< takes 2 args, mixname and flow in ml/min
   extern const char * const List; ///< takes varags
+  extern const char * const GetState; ///< takes 0 or 1 args, a component, sends the state of it and everything under it (default the whole olfactometer) in one consistent snapshot
   extern const char * const GetControlParams; ///< takes 1 args
   extern const char * const SetControlParams; ///< takes 2+ args
   extern const char * const GetCoeffs; ///< takes 1 args
   extern const char * const SetCoeffs; ///< takes 5 args
   extern const char * const GetCalib; ///< takes 1 args
   extern const char * const SetCalib; ///< takes 1 args, but also some text input
+  extern const char * const Calibrate; ///< takes 1+ args, flowcontroller=reference pairs and optional param=value settings
+  extern const char * const AutoTune; ///< takes 1+ args, a pid flow controller and optional param=value settings
+  extern const char * const Identify; ///< takes 1+ args, a pid flow controller and optional param=value settings
+  extern const char * const SetWaveform; ///< takes 1+ args, a pid flow controller or mix and optional shape param=value settings, then for a table some text input
+  extern const char * const StartWaveform; ///< takes 1+ args, a pid flow controller or mix and optional loops=, delay_s=
+  extern const char * const StopWaveform; ///< takes 1 arg, a pid flow controller or mix
+  extern const char * const GetWaveform; ///< takes 1 arg, a pid flow controller or mix
+  extern const char * const SetProgram; ///< takes 0 args, then the trial program as text input, see TrialSequencer
+  extern const char * const RunProgram; ///< takes 0 args
+  extern const char * const StopProgram; ///< takes 0 args
+  extern const char * const GetProgram; ///< takes 0 args, sends the program's status then its text
+  extern const char * const ArmProgram; ///< takes 0 args, the program starts when a trigger with program=yes fires
+  extern const char * const SetTrigger; ///< takes >=2 args, slot input=daq_task:chan [edge=rising|falling|both] [once=yes|no] [program=yes|no], then the trigger's actions as text input
+  extern const char * const ClearTrigger; ///< takes 1 arg, a trigger slot
+  extern const char * const GetTriggers; ///< takes 0 args, sends one line per trigger set
+  extern const char * const GetAlarms; ///< takes 0 args, sends one line per alarm rule
+  extern const char * const WatchAlarms; ///< takes 0 args, then sends a line per alarm raised or cleared until the connection closes
   extern const char * const IsDataLogging; ///< takes 2 args, a datalogable component and one of 'cooked' 'raw' 'other'
   extern const char * const SetDataLogging; ///< takes 3 args, a datalogable component, one of cooked, raw, other,  and a boolean
   extern const char * const DataLogCount; ///< takes 0 args
@@ -0,0 +1,312 @@
+#include "AlarmEngine.h"
+#include "DataLogable.h"
+#include "Common.h"
+#include "Log.h"
+#include <sstream>
+#include <string.h>
+#include <math.h>
+
+const char * const AlarmEngine::DefaultName = "Alarms";
+
+/// A rule and its state.  Only AlarmEngine::dataEvent() moves the
+/// state on, under the engine's mutex.
+class AlarmEngine::Rule : public Component
+{
+public:
+  Rule(Component *parent, const std::string & name, const RuleSpec & spec)
+    : Component(parent, name), spec(spec), value(0.), active(false), count(0),
+      holding(false), since(0), haveLast(false), lastValue(0.), lastTs(0),
+      haveCause(false), lastCause(0.), pending(false), base(0.), deadline(0)
+  { have[0] = have[1] = false; v[0] = v[1] = 0.; }
+
+  virtual std::string typeName() const { return "Alarm"; }
+
+  /// which's event came in: returns +1 if that raised the alarm, -1 if
+  /// it cleared it, else 0
+  int step(int which, long long ts, double datum);
+  int set(bool on); ///< step()'s return for active going to on
+
+  const RuleSpec spec;
+  double value;
+  bool active;
+  unsigned count;
+
+private:
+  bool have[2];
+  double v[2];
+  bool holding;        ///< the test has held since since
+  long long since;
+  bool haveLast;       ///< for the rate: the last value and its time
+  double lastValue;
+  long long lastTs;
+  bool haveCause;      ///< NoResponse: the cause's last value, and
+  double lastCause;    ///< whether the value has yet to move from base
+  bool pending;        ///< by deadline
+  double base;
+  long long deadline;
+};
+
+int AlarmEngine::Rule::set(bool on)
+{
+  if (on == active) return 0;
+  active = on;
+  if (on) ++count;
+  return on ? 1 : -1;
+}
+
+int AlarmEngine::Rule::step(int which, long long ts, double datum)
+{
+  if (which == 2) {
+    // the cause: a change starts the clock on the value's response
+    const bool changed = haveCause && datum != lastCause;
+    haveCause = true;
+    lastCause = datum;
+    if (changed && have[0]) {
+      pending = true;
+      base = value;
+      deadline = ts + spec.withinMs * 1000000LL;
+    }
+  } else {
+    have[which] = true;
+    v[which] = datum;
+    if (spec.combine != Single && (!have[0] || !have[1])) return 0;
+    if (spec.combine == Minus) value = v[0] - v[1];
+    else if (spec.combine == Ratio) {
+      if (v[1] == 0.) return 0;
+      value = v[0] / v[1];
+    } else value = v[0];
+  }
+
+  bool cond = false;
+  switch (spec.test) {
+  case Above: cond = value > spec.x; break;
+  case Below: cond = value < spec.x; break;
+  case Outside: cond = value < spec.x || value > spec.y; break;
+  case RateAbove:
+    if (which == 2) return 0;
+    if (haveLast && ts > lastTs)
+      cond = ::fabs(value - lastValue) / ((ts - lastTs) * 1e-9) > spec.x;
+    else cond = holding; // no new rate yet, nothing changes
+    haveLast = true;
+    lastValue = value;
+    lastTs = ts;
+    break;
+  case NoResponse:
+    if (pending && ::fabs(value - base) >= spec.x) pending = false;
+    if (pending && ts >= deadline) {
+      pending = false;
+      return set(true);
+    }
+    // it stays up until the value does move
+    if (active && which != 2 && ::fabs(value - base) >= spec.x) return set(false);
+    return 0;
+  }
+
+  if (!cond) {
+    holding = false;
+    return set(false);
+  }
+  if (!holding) holding = true, since = ts;
+  return ts - since >= spec.forMs * 1000000LL ? set(true) : 0;
+}
+
+AlarmEngine::AlarmEngine(Component *parent, const std::string & name, RTLCoprocess *c)
+  : Component(parent, name), coprocess(c), seq(0)
+{
+  if (coprocess) coprocess->setEventHook(this);
+}
+
+AlarmEngine::~AlarmEngine()
+{
+  // the rules are our children, Component's d'tor deletes them after this
+  if (coprocess) coprocess->setEventHook(0);
+}
+
+bool AlarmEngine::ParseTest(const std::string & s, RuleSpec & spec, std::string & err)
+{
+  StringList words = String::split(s, "[[:space:]]+");
+  const std::string what = words.empty() ? "" : String(words.front()).lower();
+  if (!words.empty()) words.pop_front();
+  std::vector<double> n;
+  for (StringList::iterator it = words.begin(); it != words.end(); ++it) {
+    bool ok;
+    n.push_back(it->toDouble(&ok));
+    if (!ok) { err = "\"" + *it + "\" is not a number"; return false; }
+  }
+  unsigned want = 1;
+  if (what == "above") spec.test = Above;
+  else if (what == "below") spec.test = Below;
+  else if (what == "outside") spec.test = Outside, want = 2;
+  else if (what == "rate_above") spec.test = RateAbove;
+  else if (what == "no_response") spec.test = NoResponse, want = 2;
+  else {
+    err = "expected above X, below X, outside LO HI, rate_above X or no_response X MS";
+    return false;
+  }
+  if (n.size() != want) {
+    err = what + " takes " + Str(want) + " number" + (want > 1 ? "s" : "");
+    return false;
+  }
+  spec.x = n[0];
+  spec.y = want > 1 ? n[1] : 0.;
+  if (spec.test == Outside && spec.y < spec.x) {
+    err = "outside LO HI needs LO <= HI";
+    return false;
+  }
+  if (spec.test == NoResponse) {
+    if (spec.y < 1.) { err = "no_response needs at least 1 MS"; return false; }
+    spec.withinMs = static_cast<unsigned>(spec.y + 0.5);
+    spec.y = 0.;
+  }
+  return true;
+}
+
+std::string AlarmEngine::TestString(const RuleSpec & spec)
+{
+  std::ostringstream os;
+  switch (spec.test) {
+  case Above: os << "above " << spec.x; break;
+  case Below: os << "below " << spec.x; break;
+  case Outside: os << "outside " << spec.x << " " << spec.y; break;
+  case RateAbove: os << "rate_above " << spec.x; break;
+  case NoResponse: os << "no_response " << spec.x << " " << spec.withinMs; break;
+  }
+  return os.str();
+}
+
+bool AlarmEngine::ParseCombine(const std::string & s, int & combine)
+{
+  const std::string c = String(s).lower();
+  if (c == "minus") combine = Minus;
+  else if (c == "ratio") combine = Ratio;
+  else return false;
+  return true;
+}
+
+bool AlarmEngine::input(const std::string & signal, Rule *r, int which, std::string & err)
+{
+  const std::string::size_type colon = signal.rfind(':');
+  const std::string comp = signal.substr(0, colon);
+  const std::string meta = colon == std::string::npos ? "" : signal.substr(colon+1);
+  Component *c = Component::findByName(comp);
+  if (!meta.length() || meta.length() >= sizeof(Input().meta)) {
+    err = "signal " + signal + ": expected component:meta, meta at most 7 characters, as in the data log";
+    return false;
+  }
+  if (!c) {
+    err = "signal " + signal + ": no component called " + comp;
+    return false;
+  }
+  Input in;
+  ::strncpy(in.meta, meta.c_str(), sizeof(in.meta));
+  in.rule = r;
+  in.which = which;
+  if (c->id() >= byId.size()) byId.resize(c->id() + 1);
+  byId[c->id()].push_back(in);
+  // the rule sees nothing the coprocess doesn't log
+  DataLogable *d = dynamic_cast<DataLogable *>(c);
+  if (d) {
+    d->setLoggingEnabled(true, DataLogable::Cooked);
+    d->setLoggingEnabled(true, DataLogable::Raw);
+    d->setLoggingEnabled(true, DataLogable::Other);
+  } else {
+    Warning() << "Alarm " << r->name() << ": " << comp << " isn't data logable, its signal may never come\n";
+  }
+  return true;
+}
+
+bool AlarmEngine::addRule(const std::string & name, const RuleSpec & spec, std::string & err)
+{
+  if (!spec.signal.length()) { err = "needs a signal"; return false; }
+  if (spec.combine != Single && !spec.signal2.length()) { err = "combine needs a signal2"; return false; }
+  if ((spec.test == NoResponse) != (spec.cause.length() > 0)) {
+    err = "no_response, and only no_response, needs a cause";
+    return false;
+  }
+  if (Component::findByName(name)) { err = "there is already a component called " + name; return false; }
+  MutexLocker l(mut);
+  Rule *r = new Rule(this, name, spec);
+  if (!input(spec.signal, r, 0, err)
+      || (spec.combine != Single && !input(spec.signal2, r, 1, err))
+      || (spec.test == NoResponse && !input(spec.cause, r, 2, err))) {
+    // take back whatever inputs it got
+    for (unsigned i = 0; i < byId.size(); ++i)
+      for (unsigned j = byId[i].size(); j-- > 0; )
+        if (byId[i][j].rule == r) byId[i].erase(byId[i].begin() + j);
+    delete r;
+    return false;
+  }
+  rules.push_back(r);
+  std::ostringstream os;
+  os << "Alarm " << name << ": " << spec.signal;
+  if (spec.combine == Minus) os << " - " << spec.signal2;
+  else if (spec.combine == Ratio) os << " / " << spec.signal2;
+  os << " " << TestString(spec);
+  if (spec.test == NoResponse) os << " after " << spec.cause << " changes\n";
+  else os << " for " << spec.forMs << " ms\n";
+  Log() << os.str();
+  return true;
+}
+
+void AlarmEngine::dataEvent(const DataEvent & e)
+{
+  MutexLocker l(mut);
+  if (e.id >= byId.size()) return; // nobody's listening
+  const std::vector<Input> & ins = byId[e.id];
+  for (unsigned i = 0; i < ins.size(); ++i) {
+    if (::strncmp(ins[i].meta, e.meta, sizeof(ins[i].meta))) continue;
+    const int r = ins[i].rule->step(ins[i].which, e.ts_ns, e.datum);
+    if (r) raise(ins[i].rule, e.ts_ns, r > 0);
+  }
+}
+
+// mut is held
+void AlarmEngine::raise(Rule *r, long long ts_ns, bool raised)
+{
+  Event ev;
+  ev.seq = ++seq;
+  ev.ts_ns = ts_ns;
+  ev.rule = r->name();
+  ev.raised = raised;
+  ev.value = r->value;
+  history.push_back(ev);
+  if (history.size() > MaxHistory) history.pop_front();
+
+  if (raised) Warning() << "Alarm " << r->name() << " raised: " << r->spec.signal << " " << TestString(r->spec) << ", value " << r->value << "\n";
+  else Log() << "Alarm " << r->name() << " cleared, value " << r->value << "\n";
+
+  if (coprocess) {
+    DataEvent d;
+    ::memset(&d, 0, sizeof(d));
+    d.ts_ns = ts_ns;
+    d.id = r->id();
+    ::strncpy(d.meta, raised ? "alarm" : "clear", sizeof(d.meta) - 1);
+    d.datum = r->value;
+    coprocess->addEvent(d);
+  }
+}
+
+unsigned AlarmEngine::events(unsigned since, std::vector<Event> & out) const
+{
+  MutexLocker l(mut);
+  out.clear();
+  for (std::deque<Event>::const_iterator it = history.begin(); it != history.end(); ++it)
+    if (it->seq > since) out.push_back(*it);
+  return seq;
+}
+
+std::vector<AlarmEngine::Status> AlarmEngine::status() const
+{
+  MutexLocker l(mut);
+  std::vector<Status> ret;
+  for (unsigned i = 0; i < rules.size(); ++i) {
+    Status s;
+    s.rule = rules[i]->name();
+    s.spec = rules[i]->spec;
+    s.active = rules[i]->active;
+    s.count = rules[i]->count;
+    s.value = rules[i]->value;
+    ret.push_back(s);
+  }
+  return ret;
+}
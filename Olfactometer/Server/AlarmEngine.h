@@ -0,0 +1,119 @@
+#ifndef AlarmEngine_H
+#define AlarmEngine_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include "Component.h"
+#include "RTLCoprocess.h"
+#include "Mutex.h"
+
+/**
+   Alarms on the live data log stream.  A rule watches a signal -- one
+   component's data log entries with one meta, eg. PIDFlow1:e or
+   MiscSensor:RawCh03 -- optionally combined with a second one, and is
+   evaluated as the coprocess's grabber thread receives each of their
+   events (see RTLCoprocess::EventHook), in constant time per event:
+
+     above X, below X, outside LO HI
+                      the value, held for for_ms
+     rate_above X     |d value/dt|, per second, held for for_ms
+     no_response X MS whenever the cause signal changes the value has
+                      to move by X within MS milliseconds
+
+   With a second signal the value is signal - signal2 (combine minus) or
+   signal / signal2 (combine ratio), each side's latest.  Time is the
+   events' own, so a rule only moves on when its signals are logged;
+   addRule() turns their components' data logging on.
+
+   Each rule is a child component, so its alarms go in the data log
+   under its name (meta "alarm" when it's raised, "clear" when it
+   clears, the datum is the value), as well as to the log and to
+   clients watching (see events()).  They're set up from the ini, see
+   ComediOlfactometer::buildAlarms().
+*/
+class AlarmEngine : public Component, public RTLCoprocess::EventHook
+{
+public:
+  /// what ComediOlfactometer::doSetup() calls the one it makes
+  static const char * const DefaultName;
+  enum { MaxHistory = 256 };
+
+  AlarmEngine(Component *parent, const std::string & name, RTLCoprocess *);
+  ~AlarmEngine();
+
+  enum Test { Above = 0, Below, Outside, RateAbove, NoResponse };
+  enum Combine { Single = 0, Minus, Ratio };
+  /// a rule's settings
+  struct RuleSpec
+  {
+    RuleSpec() : combine(Single), test(Above), x(0.), y(0.), forMs(0), withinMs(0) {}
+    std::string signal, signal2, cause; ///< component:meta
+    int combine;      ///< a Combine, signal2 is only used if it isn't Single
+    int test;         ///< a Test
+    double x, y;      ///< the test's threshold(s), y is Outside's HI
+    unsigned forMs;   ///< how long the test has to hold for
+    unsigned withinMs; ///< NoResponse's time limit
+  };
+  /// parses a test= string into spec's test, x, y and withinMs
+  static bool ParseTest(const std::string & s, RuleSpec & spec, std::string & err);
+  static std::string TestString(const RuleSpec & spec);
+  /// minus or ratio to a Combine
+  static bool ParseCombine(const std::string & s, int & combine);
+
+  /// adds a rule called name, false with err set if a signal doesn't
+  /// name a component or the spec doesn't make sense
+  bool addRule(const std::string & name, const RuleSpec & spec, std::string & err);
+
+  /// an alarm being raised or cleared
+  struct Event
+  {
+    unsigned seq;
+    long long ts_ns;
+    std::string rule;
+    bool raised;
+    double value;
+  };
+  /// the events after the one numbered since, oldest first, at most the
+  /// last MaxHistory.  Returns the number of the newest one there is,
+  /// for the next call (start from 0).
+  unsigned events(unsigned since, std::vector<Event> & out) const;
+
+  struct Status
+  {
+    std::string rule;
+    RuleSpec spec;
+    bool active;
+    unsigned count; ///< times raised
+    double value;   ///< the last value evaluated
+  };
+  std::vector<Status> status() const;
+
+  /// from RTLCoprocess::EventHook
+  void dataEvent(const DataEvent & e);
+
+  virtual std::string typeName() const { return "AlarmEngine"; }
+
+private:
+  class Rule;
+  /// where events with one id and meta go
+  struct Input
+  {
+    char meta[8]; ///< as DataEvent::meta
+    Rule *rule;
+    int which; ///< 0 signal, 1 signal2, 2 cause
+  };
+  /// component:meta to an Input, false with err set if there's no such component
+  bool input(const std::string & signal, Rule *r, int which, std::string & err);
+  void raise(Rule *r, long long ts_ns, bool raised);
+
+  RTLCoprocess *coprocess;
+  std::vector<Rule *> rules;
+  /// by component id, each id's handful of Inputs
+  std::vector< std::vector<Input> > byId;
+  std::deque<Event> history;
+  unsigned seq;
+  mutable Mutex mut;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "AutoTuner.h"
+#include "PIDFlowController.h"
+#include "rtl_coprocess/RelayTune.h"
+#include "Log.h"
+#include "Thread.h"
+#include "Timer.h"
+#include "Common.h"
+#include <math.h>
+#include <sstream>
+#include <algorithm>
+
+namespace {
+  const int PollMicros = 100000;
+}
+
+AutoTuner::Params::Params()
+  : rule(TyreusLuyben), amp(0.25), hyst_frac(0.005), cycles(4),
+    settle_s(3.), timeout_s(60.), setpoint(-1.), schedule(0)
+{}
+
+AutoTuner::AutoTuner(PIDFlowController *pfc, const Params & p) : pfc(pfc), par(p) {}
+
+bool AutoTuner::setParam(const std::string & name, const std::string & value)
+{
+  if (name == "rule") {
+    if (value == "zn") par.rule = ZieglerNichols;
+    else if (value == "tl") par.rule = TyreusLuyben;
+    else return false;
+    return true;
+  }
+  bool ok;
+  const double v = String(value).toDouble(&ok);
+  if (!ok) return false;
+  if (name == "amp" && v > 0.) par.amp = v;
+  else if (name == "hyst_frac" && v >= 0. && v < 0.5) par.hyst_frac = v;
+  else if (name == "cycles" && v >= 1.) par.cycles = static_cast<unsigned>(v);
+  else if (name == "settle_s" && v >= 0.) par.settle_s = v;
+  else if (name == "timeout_s" && v > 0.) par.timeout_s = v;
+  else if (name == "setpoint") par.setpoint = v;
+  else if (name == "schedule" && v >= 0.) par.schedule = static_cast<unsigned>(v);
+  else return false;
+  return true;
+}
+
+/*static*/
+void AutoTuner::ruleGains(Rule r, double Ku, double Pu, double & Kc, double & Ti)
+{
+  switch (r) {
+  case ZieglerNichols: Kc = 0.45 * Ku; Ti = Pu / 1.2; break;
+  case TyreusLuyben:
+  default:             Kc = Ku / 3.2;  Ti = 2.2 * Pu; break;
+  }
+}
+
+bool AutoTuner::tuneAt(double flow, int dir, Point & pt, std::string & err)
+{
+  std::ostringstream os;
+  if (!pfc->setFlow(flow)) { os << "could not set flow " << flow; err = os.str(); return false; }
+  Thread::usleep(static_cast<int>(par.settle_s * 1e6));
+
+  RelayTune t;
+  if (!pfc->getValveV(t.bias)) { err = "could not read the valve voltage"; return false; }
+  const unsigned rate = pfc->rateHz();
+  t.setpoint = flow;
+  t.amp = par.amp;
+  t.hyst = par.hyst_frac * (pfc->max() - pfc->min());
+  t.direction = dir;
+  t.cycles = par.cycles;
+  t.maxPeriods = static_cast<unsigned>(par.timeout_s * rate);
+  if (!pfc->startRelayTune(t)) { err = "the RT loop refused the relay experiment"; return false; }
+
+  const Timer::Time end = Timer::absTime() + static_cast<Timer::Time>((par.timeout_s + 5.) * 1e9);
+  RelayTune res;
+  bool got;
+  while ((got = pfc->getRelayTune(res)) && res.state == RelayTune::Running && Timer::absTime() < end)
+    Thread::usleep(PollMicros);
+  if (!got || res.state == RelayTune::Running) {
+    RelayTune abort;
+    abort.state = RelayTune::Aborted;
+    pfc->startRelayTune(abort);
+  }
+  if (!got || res.state != RelayTune::Done) {
+    os << "no sustained oscillation at flow " << flow << " within " << par.timeout_s << "s, try a larger amp";
+    err = os.str();
+    return false;
+  }
+  const double a2 = res.a * res.a - t.hyst * t.hyst;
+  if (a2 <= 0. || res.Pu <= 0.) {
+    os << "oscillation at flow " << flow << " is within the hysteresis band, try a larger amp or smaller hyst_frac";
+    err = os.str();
+    return false;
+  }
+  pt.flow = flow;
+  pt.a = res.a;
+  pt.Pu = res.Pu;
+  pt.Ku = 4. * t.amp / (M_PI * sqrt(a2));
+
+  double Kc, Ti;
+  ruleGains(par.rule, pt.Ku, pt.Pu, Kc, Ti);
+  pt.gains = pfc->loopGains(dir * Kc, Ti);
+  Log() << "AutoTune " << pfc->name() << " at " << flow << ": a=" << pt.a << " Pu=" << pt.Pu << "s Ku=" << pt.Ku
+        << " -> Kp=" << pt.gains[0] << " Kd=" << pt.gains[2] << "\n";
+  return true;
+}
+
+AutoTuner::Result AutoTuner::run()
+{
+  Result r;
+  const Timer::Time t0 = Timer::absTime();
+  const bool wasRunning = pfc->isStarted();
+  if (!wasRunning && !pfc->start()) { r.error = "could not start the PID loop"; return r; }
+  const double oldFlow = pfc->commandedFlow();
+  const int dir = pfc->valveDirection();
+
+  std::vector<double> flows;
+  const double lo = pfc->min(), hi = pfc->max();
+  if (par.schedule > 1)
+    for (unsigned i = 0; i < par.schedule; ++i)
+      flows.push_back(lo + (hi - lo) * (i + 1) / (par.schedule + 1));
+  else if (par.setpoint >= 0.)
+    flows.push_back(par.setpoint);
+  else
+    flows.push_back(oldFlow > 0. ? oldFlow : (lo + hi) / 2.);
+
+  for (unsigned i = 0; i < flows.size(); ++i) {
+    Point p;
+    if (!tuneAt(flows[i], dir, p, r.error)) break;
+    r.points.push_back(p);
+  }
+  r.ok = r.error.empty();
+
+  if (r.ok) {
+    std::vector<double> cp = pfc->controlParams(); // for numIntgrlPts
+    if (r.points.size() > 1) {
+      PIDFlowController::GainSchedule gs;
+      for (unsigned i = 0; i < r.points.size(); ++i) gs[r.points[i].flow] = r.points[i].gains;
+      if (!pfc->setGainSchedule(gs)) r.ok = false, r.error = "could not apply the gain schedule";
+    } else {
+      pfc->setGainSchedule(PIDFlowController::GainSchedule());
+      std::copy(r.points[0].gains.begin(), r.points[0].gains.end(), cp.begin());
+      if (!pfc->Controller::setControlParams(cp)) r.ok = false, r.error = "could not apply the gains";
+    }
+  }
+  pfc->setFlow(oldFlow);
+  if (!wasRunning) pfc->stop();
+  r.seconds = (Timer::absTime() - t0) / 1e9;
+  return r;
+}
@@ -0,0 +1,89 @@
+#ifndef AutoTuner_H
+#define AutoTuner_H
+
+#include <string>
+#include <vector>
+
+class PIDFlowController;
+
+/**
+   @brief Relay feedback (Astrom-Hagglund) auto-tuning of a PID flow
+   controller.
+
+   At each tuning flow the controller first settles under its current
+   gains, then the RT loop replaces the PID with a relay around the
+   valve voltage it settled at (see RelayTune).  The flow then
+   oscillates at the loop's ultimate period Pu with amplitude a, which
+   gives the ultimate gain Ku = 4 * amp / (pi * sqrt(a^2 - hyst^2)).
+   A tuning rule turns Ku and Pu into textbook gains Kc, Ti, which
+   are then converted to the Kp, Ki, Kd of PID::doPID() as driven by
+   Kernel::PIDFlowController.
+
+   That loop adds u to the valve voltage every period, so it is a
+   velocity form PID: its Kp term is the integral action (Kc * T / Ti)
+   and its Kd term, a first difference of e, is the proportional action
+   (Kc * T, with T in ms as doPID() uses).  There is no second
+   difference of e, so only PI rules are offered and Ki is set to 0.
+
+   With schedule > 1 the experiment is repeated at that many flows
+   spread over the controller's range and the results become its gain
+   schedule (see PIDFlowController::setGainSchedule()), otherwise the
+   gains are applied directly.  Either way SAVE stores them.
+*/
+class AutoTuner
+{
+public:
+  enum Rule {
+    ZieglerNichols, ///< Kc = 0.45 Ku, Ti = Pu / 1.2 -- fast, ~25% overshoot
+    TyreusLuyben    ///< Kc = Ku / 3.2, Ti = 2.2 Pu -- slower, well damped
+  };
+
+  struct Params
+  {
+    Params();
+    Rule rule;
+    double amp;        ///< relay amplitude, valve volts
+    double hyst_frac;  ///< relay hysteresis, fraction of the flow range
+    unsigned cycles;   ///< oscillations averaged at each flow
+    double settle_s;   ///< time to settle at each flow before the relay
+    double timeout_s;  ///< give up on a flow that won't oscillate after this
+    double setpoint;   ///< flow to tune at, < 0 means the current setpoint (or mid range)
+    unsigned schedule; ///< > 1: build a gain schedule over this many flows
+  };
+
+  struct Point
+  {
+    double flow, Ku, Pu, a;
+    std::vector<double> gains; ///< Kp, Ki, Kd
+  };
+
+  struct Result
+  {
+    Result() : ok(false), seconds(0.) {}
+    bool ok;
+    std::string error;
+    std::vector<Point> points;
+    double seconds;
+  };
+
+  AutoTuner(PIDFlowController *pfc, const Params & p = Params());
+
+  const Params & params() const { return par; }
+  /// sets one of the Params by name, for the protocol layer. rule is
+  /// zn or tl.  Returns false if the name or value is invalid.
+  bool setParam(const std::string & name, const std::string & value);
+
+  /// tunes, blocking until done, and applies the result if ok
+  Result run();
+
+  /// textbook PI gains for a rule, Ti in seconds
+  static void ruleGains(Rule r, double Ku, double Pu, double & Kc, double & Ti);
+
+private:
+  bool tuneAt(double flow, int direction, Point & out, std::string & err);
+
+  PIDFlowController *pfc;
+  Params par;
+};
+
+#endif
@@ -6,17 +6,32 @@
 #include "ConfParse.h"
 #include <algorithm>
 
-bool Calib::setTable(const Table & t)
+/*static*/
+PolynomialFit::Options Calib::robustFitOptions()
 {
-  Coeffs c = fitData(t, 3);
-  if (c.size() != 4) {
-    Error() << "Calibration table specified failed to curve-fit to a 3rd degree polynomial\n";
+  PolynomialFit::Options o;
+  o.autoDegree = true;
+  o.outlierSigmas = 4.;
+  return o;
+}
+
+bool Calib::setTable(const Table & t, const std::vector<double> *weights, const PolynomialFit::Options & opts)
+{
+  PolynomialFit::Fit f;
+  Coeffs c = fitData(t, 3, weights, opts, f);
+  if (!f.ok) {
+    Error() << "Calibration table specified failed to curve-fit to a polynomial: " << f.msg << "\n";
     return false;
   }
+  // set first, setCoeffs() may tabulate it
+  Table old = calibTable;
+  calibTable = t;
   if (setCoeffs(c)) {
-    calibTable = t;
+    lastFit = f;
+    Debug() << "Calibration fit: degree " << f.degree << ", R^2 " << f.r2 << ", rms " << f.rms << ", " << f.numOutliers << " outliers\n";
     return true;
   }
+  calibTable = old;
   return false;
 }
 
@@ -33,6 +48,22 @@ Calib::fitData(const Table & data, unsigned degree)
   return ans;
 }
 
+/*static*/
+Calib::Coeffs
+Calib::fitData(const Table & data, unsigned degree,
+               const std::vector<double> *weights,
+               const PolynomialFit::Options & opts,
+               PolynomialFit::Fit & f)
+{
+  f = PolynomialFit::WeightedFit(degree, data, weights, opts);
+  if (!f.ok) return Coeffs();
+  // pad to degree+1 so consumers expecting a cubic get one
+  Coeffs ans = f.coeffs;
+  ans.resize(degree + 1, 0.);
+  std::reverse(ans.begin(), ans.end());
+  return ans;
+}
+
 
 /// apply calibration by transformin an X-value to a calib-value
 /// (essentially applies the equation: ret = a*x^3 + b*x^2 + c*x^1 + d*x^0)
@@ -50,19 +81,24 @@ bool Calib::save(Settings &ini, const String & name)
 {
   ini.put(name, Conf::Keys::calib_table, Conf::Gen::calibTable(calibTable));
   ini.put(name, Conf::Keys::curve_fit_coeffs, Conf::Gen::calibCoeffs(coeffs));
+  if (valveTable.size())
+    ini.put(name, Conf::Keys::valve_table, Conf::Gen::calibTable(valveTable));
   return ini.save();    
 }
 
 bool Calib::load(Settings &ini, const String & objname)
 {
   calibTable = Conf::Parse::calibTable(ini.get(objname, Conf::Keys::calib_table)); 
+  valveTable = Conf::Parse::calibTable(ini.get(objname, Conf::Keys::valve_table));
   // validate or compute curve fit coefficients
   String cfc = ini.get(objname, Conf::Keys::curve_fit_coeffs);
   if (!cfc.length()) {
     if (!calibTable.size())  
       return false;
     Log() << "Calib obj. '" << objname << "':  auto-fitting calibration curve based on  calibration table from .ini file!\n";
-    coeffs = Calib::fitData(calibTable);
+    coeffs = Calib::fitData(calibTable, 3, 0, PolynomialFit::Options(), lastFit);
+    if (lastFit.ok)
+      Log() << "Calib obj. '" << objname << "':  degree " << lastFit.degree << " fit, R^2 " << lastFit.r2 << ", rms " << lastFit.rms << ", " << lastFit.numOutliers << " outliers\n";
   } else { // process cfc
     coeffs = Conf::Parse::calibCoeffs(cfc);
   }
@@ -72,35 +108,45 @@ bool Calib::load(Settings &ini, const String & objname)
 
 double Calib::inverse(double y) const
 {
-  if (coeffs.size() == 4) { // cubic
-    // approximate solution using two points linear interpolation.. sorry but i don't think i want to implement a generic cubic equation solution
-    double p1 = xform(0.), p2 = xform(100.);
-    double b = p1, a = (p2-p1)/100.;
-    // y = ax + b
-    // 0 = ax + b -y
-    //-ax = b - y
-    // ax = -b + y
-    // x = (y-b)/a
-    return a != 0. ? (y-b)/a : y ;
-  } else if (coeffs.size() == 3) { // quadratic, use quadratic equation
-    double  a = coeffs[0], b = coeffs[1],  c = coeffs[2];
-    // x = (-b +- sqrt(b^2-4ac)) / 2a - y
-    if (a != 0)
-      return  ((-b + sqrt(pow(b, 2)-4*a*c)) / 2*a) - y;
-    else
-      return y;
-  } else if (coeffs.size() == 2) { // linear
-    const double & a = coeffs[0], & b = coeffs[1];
-    // y = ax^1 + b
-    // 0 = ax + b - y
-    // -ax = b - y
-    // x = b/-a - y/-a
-    return a != 0. ? (y-b)/a : y;
-  } else if (coeffs.size() == 1) { // offset?
-    // y = 0x + b
-    // y = b
-    // x = ANYTHING
-    return 0; // infinitely many solutions
+  if (coeffs.size() == 1) return 0.; // y = d, x is anything
+  if (coeffs.size() < 2) return y;
+  double lo = -10., hi = 10.;
+  if (calibTable.size() >= 2) lo = calibTable.begin()->first, hi = calibTable.rbegin()->first;
+  return inverse(coeffs, y, lo, hi);
+}
+
+/*static*/
+double Calib::inverse(const Coeffs & c, double y, double lo, double hi)
+{
+  // f(x) = poly(x) - y and f'(x), by Horner
+  struct F {
+    const Coeffs & c; double y;
+    F(const Coeffs & c, double y) : c(c), y(y) {}
+    double operator()(double x, double *df) const {
+      double f = 0., d = 0.;
+      for (unsigned i = 0; i < c.size(); ++i) d = d*x + f, f = f*x + c[i];
+      *df = d;
+      return f - y;
+    }
+  } f(c, y);
+  double d, flo = f(lo, &d), fhi = f(hi, &d);
+  if (flo == 0.) return lo;
+  if (fhi == 0.) return hi;
+  const bool bracketed = (flo < 0.) != (fhi < 0.);
+  // start from the secant if there's a root in range, else the closer end
+  double x = bracketed ? lo - flo * (hi - lo) / (fhi - flo) : (fabs(flo) < fabs(fhi) ? lo : hi);
+  for (int iter = 0; iter < 100; ++iter) {
+    const double fx = f(x, &d);
+    if (fx == 0.) break;
+    if (bracketed) { // shrink the bracket, bisect whenever Newton leaves it
+      if ((fx < 0.) == (flo < 0.)) lo = x, flo = fx; else hi = x;
+    }
+    double nx = d != 0. ? x - fx/d : x;
+    if (bracketed && (d == 0. || nx <= lo || nx >= hi)) nx = (lo + hi) / 2.;
+    else if (d == 0.) break;
+    const bool done = fabs(nx - x) <= 1e-12 * (1. + fabs(x));
+    x = nx;
+    if (done) break;
   }
-  return y;
+  return x;
 }
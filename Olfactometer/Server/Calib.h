@@ -5,6 +5,7 @@
 #include <map>
 #include <vector>
 #include "Settings.h"
+#include "PolynomialFit.h"
 
 /** Calib objects support the getTable() and setTable()
     and getCoeffs() and setCoeffs() methods.
@@ -28,9 +29,24 @@ public:
   virtual ~Calib() {}
   
   const Table & getTable() const { return calibTable; }
+  /// valve volts -> flow, as measured by a calibration sweep.  Used by
+  /// implementations that can feed forward (see PIDFlowController).
+  const Table & getValveTable() const { return valveTable; }
+  virtual bool setValveTable(const Table & t) { valveTable = t; return true; }
   const Coeffs & getCoeffs() const { return coeffs; }
 
-  bool setTable(const Table &);
+  /// fits a cubic to the table and applies it, or whatever opts asks
+  /// for (see robustFitOptions()).  weights, if given, are per table
+  /// entry in table order (eg. 1/variance of each reference reading)
+  bool setTable(const Table &, const std::vector<double> *weights = 0,
+                const PolynomialFit::Options & opts = PolynomialFit::Options());
+  /// the simplest polynomial up to a cubic that the data supports (by
+  /// AICc), ignoring readings more than 4 sigma off the curve.  What
+  /// CALIBRATE fits its sweeps with; a table from the ini file or from
+  /// SET CALIB is taken as it is and gets a plain cubic.
+  static PolynomialFit::Options robustFitOptions();
+  /// how well the last setTable() or load() fit went
+  const PolynomialFit::Fit & fitInfo() const { return lastFit; }
   /// implement this to actualize the calibration by affecting some external object...
   virtual bool setCoeffs(const Coeffs & coeffs) = 0;
 
@@ -38,15 +54,24 @@ public:
   /// points specified by the first argument
   static Coeffs fitData(const Table & data,
                         unsigned degree = 3);
+  /// like fitData() but with weights and options, and always returns
+  /// degree + 1 coefficients (highest first, zero padded) if f.ok
+  static Coeffs fitData(const Table & data, unsigned degree,
+                        const std::vector<double> *weights,
+                        const PolynomialFit::Options & opts,
+                        PolynomialFit::Fit & f);
   
   /// apply calibration by transforming an X-value to a calibrated-value
   /// (essentially applies the equation: ret = a*x^3 + b*x^2 + c*x^1 + d*x^0)
   /// where a,b,c,d are the coefficients 
   double xform(double x) const; 
-  /// tries to reverse the calibration transformation -- doesn't always work
-  /// only works if there is a unique mapping from x -> y in calibration equation
-  /// if there isn't result is going to be the first solution to the cubic equation solved for x
+  /// reverses the calibration transformation: the x for which xform(x) == y,
+  /// by safeguarded Newton iteration within the range of the calibration
+  /// table (or +-10V without one).  If y is out of that range the end
+  /// closer to it is the starting point and Newton may leave the range.
   double inverse(double y) const; 
+  /// the x in [lo,hi] for which the polynomial c (highest degree first) is y
+  static double inverse(const Coeffs & c, double y, double lo, double hi);
 
 
   /// convenience method to save a calib to an ini file section
@@ -59,6 +84,8 @@ protected:
 
   Coeffs coeffs;
   Table calibTable;
+  Table valveTable;
+  PolynomialFit::Fit lastFit;
 
 };
 
@@ -0,0 +1,339 @@
+#include "Calibrator.h"
+#include "Olfactometer.h"
+#include "ComediOlfactometer.h"
+#include "ComediChan.h"
+#include "DAQTaskProxy.h"
+#include "StartStoppable.h"
+#include "Log.h"
+#include "Thread.h"
+#include "Mutex.h"
+#include "Timer.h"
+#include <math.h>
+#include <sstream>
+
+namespace {
+  const int PollMicros = 10000; ///< for sensors that aren't on a periodic daq task
+
+  struct Stats
+  {
+    Stats() : mean(0.), sd(0.), n(0) {}
+    double mean, sd;
+    unsigned long long n;
+  };
+
+  /// the sensor itself, or the first sensor child of c
+  Sensor *sensorOf(Component *c)
+  {
+    Sensor *s = dynamic_cast<Sensor *>(c);
+    if (!s && c) {
+      std::list<Component *> chlds = c->children(false);
+      for (std::list<Component *>::iterator it = chlds.begin(); it != chlds.end() && !s; ++it)
+        s = dynamic_cast<Sensor *>(*it);
+    }
+    return s;
+  }
+}
+
+Calibrator::Params::Params()
+  // the sweep defaults are those of @SimpleOlfClient/Calibrate.m
+  : v_start(0.), v_end(5.), v_step(0.05),
+    window_s(0.25), min_settle_s(0.5), max_settle_s(30.),
+    z(3.), tol(0.002), settle_windows(3), measure_windows(4)
+{}
+
+/// Windowed mean/stddev of one sensor, either volts (raw) or units.
+class Calibrator::Probe
+{
+public:
+  Probe(Sensor *s, bool raw)
+    : s(s), raw(raw), chan(dynamic_cast<ComediChan *>(s)), csens(dynamic_cast<ComediSensor *>(s)), daq(0)
+  {
+    DAQTaskProxy *d = chan ? chan->getDAQ() : 0;
+    if (d && d->rateHz() && chan->chan() < DAQAccum::MaxChans && (raw || csens))
+      daq = d;
+  }
+
+  bool isRT() const { return daq; }
+
+  double fullScale() const
+  {
+    if (!raw) return s->max() - s->min();
+    return chan ? chan->rangeMax() - chan->rangeMin() : 5.;
+  }
+
+  bool begin()
+  {
+    n = 0; sum = sumsq = 0.;
+    return !daq || daq->getAccum(a0);
+  }
+
+  void poll()
+  {
+    if (daq) return;
+    double v = raw ? s->readRaw() : s->read();
+    sum += v; sumsq += v*v; ++n;
+  }
+
+  bool end(Stats & out)
+  {
+    double m, var;
+    if (daq) {
+      DAQAccum a1;
+      const unsigned c = chan->chan();
+      // per channel counts, it may have a rate divisor
+      if (!daq->getAccum(a1) || a1.cnt[c] == a0.cnt[c]) return false;
+      const double dn = double(a1.cnt[c] - a0.cnt[c]);
+      m = double(a1.sum[c] - a0.sum[c]) / dn;
+      var = double(a1.sumsq[c] - a0.sumsq[c]) / dn - m*m;
+      out.n = a1.cnt[c] - a0.cnt[c];
+      // raw samples -> volts is linear, volts -> units may not be
+      const double k = fabs(chan->sampleToVolts(1.) - chan->sampleToVolts(0.));
+      double vm = chan->sampleToVolts(m), vsd = var > 0. ? sqrt(var) * k : 0.;
+      if (!raw) {
+        const double u = csens->voltsToUnits(vm);
+        vsd = fabs(csens->voltsToUnits(vm + vsd) - u);
+        vm = u;
+      }
+      out.mean = vm; out.sd = vsd;
+      return true;
+    }
+    if (!n) return false;
+    m = sum / n;
+    var = sumsq / n - m*m;
+    out.mean = m; out.sd = var > 0. ? sqrt(var) : 0.; out.n = n;
+    return true;
+  }
+
+private:
+  Sensor *s;
+  bool raw;
+  ComediChan *chan;
+  ComediSensor *csens;
+  DAQTaskProxy *daq;
+  DAQAccum a0;
+  unsigned long long n;
+  double sum, sumsq;
+};
+
+/// Sweeps one controller, see Calibrator
+class Calibrator::Worker : protected Thread
+{
+public:
+  Worker(const Params & p, FlowController *fc, Sensor *own, Sensor *ref, Mutex *meter)
+    : par(p), fc(fc), meter(meter), pown(own, true), pref(ref, false)
+  {
+    both.push_back(&pown);
+    both.push_back(&pref);
+  }
+
+  void start() { Thread::start(Thread::LowPriority); }
+  using Thread::join;
+
+  Result result;
+
+protected:
+  void run();
+
+private:
+  bool window(std::vector<Probe *> & probes, double secs, std::vector<Stats> & out);
+  bool settle(std::vector<Probe *> & probes, double min_secs);
+
+  const Params par;
+  FlowController *fc;
+  Mutex *meter;
+  Probe pown, pref;
+  std::vector<Probe *> both;
+};
+
+bool Calibrator::Worker::window(std::vector<Probe *> & probes, double secs, std::vector<Stats> & out)
+{
+  bool polled = false;
+  out.resize(probes.size());
+  for (unsigned i = 0; i < probes.size(); ++i) {
+    if (!probes[i]->begin()) { result.error = "could not read daq task sums"; return false; }
+    polled = polled || !probes[i]->isRT();
+  }
+  const Timer::Time end = Timer::absTime() + static_cast<Timer::Time>(secs * 1e9);
+  if (!polled)
+    Timer::nanoSleep(end, Timer::Absolute);
+  else
+    do {
+      for (unsigned i = 0; i < probes.size(); ++i) probes[i]->poll();
+      Thread::usleep(PollMicros);
+    } while (Timer::absTime() < end);
+  for (unsigned i = 0; i < probes.size(); ++i)
+    if (!probes[i]->end(out[i])) { result.error = "no samples acquired in a window"; return false; }
+  return true;
+}
+
+/// true if settled, false on timeout or error (result.error set)
+bool Calibrator::Worker::settle(std::vector<Probe *> & probes, double min_secs)
+{
+  std::vector<Stats> prev, cur;
+  unsigned agree = 0;
+  double elapsed = 0.;
+  while (window(probes, par.window_s, cur)) {
+    elapsed += par.window_s;
+    if (prev.size()) {
+      bool same = true;
+      for (unsigned i = 0; i < cur.size() && same; ++i) {
+        const double d = fabs(cur[i].mean - prev[i].mean),
+          se = sqrt(cur[i].sd*cur[i].sd/cur[i].n + prev[i].sd*prev[i].sd/prev[i].n);
+        same = d <= par.z * se || d <= par.tol * probes[i]->fullScale();
+      }
+      agree = same ? agree+1 : 0;
+      if (agree + 1 >= par.settle_windows && elapsed >= min_secs) return true;
+    }
+    if (elapsed >= par.max_settle_s) return false;
+    prev = cur;
+  }
+  return false;
+}
+
+void Calibrator::Worker::run()
+{
+  result.name = fc->name();
+  // our turn at the meter, the others on it are closed meanwhile
+  MutexLocker l(*meter);
+  const Timer::Time t0 = Timer::absTime();
+
+  const unsigned nsteps = static_cast<unsigned>((par.v_end - par.v_start) / par.v_step + 0.5) + 1;
+  std::map<double, double> vars; ///< same keys as result.table
+  for (unsigned i = 0; i < nsteps && result.error.empty(); ++i) {
+    const double v = par.v_start + i * par.v_step;
+    if (!fc->writeRaw(v)) {
+      std::ostringstream os;
+      os << "valve write of " << v << "V failed";
+      result.error = os.str();
+      break;
+    }
+    const bool settled = settle(both, par.min_settle_s);
+    if (!result.error.empty()) break;
+    std::vector<Stats> s;
+    if (!window(both, par.window_s * par.measure_windows, s)) break;
+    if (!settled) ++result.unsettled;
+    result.table[s[0].mean] = s[1].mean;
+    result.valveTable[v] = s[1].mean;
+    vars[s[0].mean] = s[1].n ? s[1].sd*s[1].sd / s[1].n : 0.;
+    Debug() << "Calibrate " << result.name << ": " << v << "V valve, " << s[0].mean << "V sensor -> " << s[1].mean << (settled ? "" : " (unsettled)") << "\n";
+  }
+
+  for (std::map<double, double>::iterator it = vars.begin(); it != vars.end(); ++it) {
+    if (it->second <= 0.) { result.weights.clear(); break; }
+    result.weights.push_back(1. / it->second);
+  }
+
+  fc->writeRaw(0.); // closed again for whoever has the meter next
+  result.ok = result.error.empty();
+  result.seconds = (Timer::absTime() - t0) / 1e9;
+}
+
+/* static */ std::set<const Component *> Calibrator::busy;
+
+Calibrator::Calibrator(const Params & p) : par(p), reserved(false) {}
+
+Calibrator::~Calibrator()
+{
+  release();
+  for (std::map<Sensor *, Mutex *>::iterator it = meters.begin(); it != meters.end(); ++it)
+    delete it->second;
+}
+
+bool Calibrator::setParam(const std::string & name, double v)
+{
+  if (name == "v_start") par.v_start = v;
+  else if (name == "v_end") par.v_end = v;
+  else if (name == "v_step" && v > 0.) par.v_step = v;
+  else if (name == "window_s" && v > 0.) par.window_s = v;
+  else if (name == "min_settle_s" && v >= 0.) par.min_settle_s = v;
+  else if (name == "max_settle_s" && v > 0.) par.max_settle_s = v;
+  else if (name == "z" && v >= 0.) par.z = v;
+  else if (name == "tol" && v >= 0.) par.tol = v;
+  else if (name == "settle_windows" && v >= 1.) par.settle_windows = static_cast<unsigned>(v);
+  else if (name == "measure_windows" && v >= 1.) par.measure_windows = static_cast<unsigned>(v);
+  else return false;
+  return true;
+}
+
+bool Calibrator::add(FlowController *fc, Component *refcomp, std::string & err)
+{
+  Sensor *own = sensorOf(fc), *ref = sensorOf(refcomp);
+  if (!fc || !dynamic_cast<Calib *>(fc)) { err = "not a calibratable flow controller"; return false; }
+  if (!own) { err = fc->name() + " has no sensor"; return false; }
+  if (!ref) { err = (refcomp ? refcomp->name() : std::string("reference")) + " is not a sensor and does not contain one"; return false; }
+  if (own == ref) { err = fc->name() + " cannot be its own reference"; return false; }
+  for (unsigned i = 0; i < jobs.size(); ++i)
+    if (jobs[i].fc == fc) { err = fc->name() + " was given twice"; return false; }
+  Job j;
+  j.fc = fc; j.own = own; j.ref = ref; j.wasRunning = false;
+  jobs.push_back(j);
+  if (!meters[ref]) meters[ref] = new Mutex;
+  return true;
+}
+
+bool Calibrator::reserve(std::string & err)
+{
+  if (reserved) return true;
+  for (unsigned i = 0; i < jobs.size(); ++i)
+    if (Busy(jobs[i].fc)) { err = jobs[i].fc->name() + " is already being calibrated"; return false; }
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    busy.insert(jobs[i].fc);
+    // writeRaw() only works with the PID loop off, and every valve on a
+    // meter has to be closed before any of them is measured
+    StartStoppable *ss = dynamic_cast<StartStoppable *>(jobs[i].fc);
+    jobs[i].wasRunning = ss && ss->isStarted();
+    if (jobs[i].wasRunning) ss->stop();
+    jobs[i].fc->writeRaw(0.);
+  }
+  reserved = true;
+  return true;
+}
+
+void Calibrator::release()
+{
+  if (!reserved) return;
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    jobs[i].fc->writeRaw(par.v_start);
+    if (jobs[i].wasRunning) dynamic_cast<StartStoppable *>(jobs[i].fc)->start();
+    busy.erase(jobs[i].fc);
+  }
+  reserved = false;
+}
+
+/* static */
+bool Calibrator::Busy(const Component *c)
+{
+  for (std::set<const Component *>::const_iterator it = busy.begin(); it != busy.end(); ++it) {
+    for (const Component *p = *it; p; p = p->parent())
+      if (p == c) return true; // c is it or above it
+    for (const Component *p = c; p; p = p->parent())
+      if (p == *it) return true; // c is under it
+  }
+  return false;
+}
+
+std::vector<Calibrator::Result> Calibrator::run()
+{
+  std::vector<Result> ret;
+  if (!reserved || par.v_end < par.v_start) {
+    Result r;
+    r.error = reserved ? "v_end is below v_start" : "not reserved";
+    ret.resize(jobs.size(), r);
+    for (unsigned i = 0; i < jobs.size(); ++i) ret[i].name = jobs[i].fc->name();
+    return ret;
+  }
+  std::vector<Worker *> workers;
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    workers.push_back(new Worker(par, jobs[i].fc, jobs[i].own, jobs[i].ref, meters[jobs[i].ref]));
+    Log() << "Calibrating " << jobs[i].fc->name() << " against " << jobs[i].ref->name() << "\n";
+    workers.back()->start();
+  }
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    workers[i]->join();
+    ret.push_back(workers[i]->result);
+    delete workers[i];
+    Log() << "Calibration of " << ret.back().name << (ret.back().ok ? " done" : " failed: ") << ret.back().error
+          << ", " << ret.back().table.size() << " points in " << ret.back().seconds << "s\n";
+  }
+  return ret;
+}
@@ -0,0 +1,138 @@
+#ifndef Calibrator_H
+#define Calibrator_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "Calib.h"
+
+class Component;
+class FlowController;
+class Sensor;
+class Mutex;
+
+/**
+   @brief Server-side automatic calibration of flow controllers.
+
+   Does what @SimpleOlfClient/Calibrate.m does from Matlab, but without
+   the fixed waits and network round trips.  For each controller the
+   valve voltage is swept with writeRaw() (RTLCoprocess::setValveV() for
+   PID flows) and at each step the controller's own sensor and the
+   reference meter are watched in windows until they have settled, then
+   averaged over a few more windows to give one point of the calibration
+   table (sensor volts -> reference flow).
+
+   A step counts as settled when settleWindows consecutive window means
+   of every watched sensor agree to within z standard errors or within
+   tol of full scale, whichever is looser.  The window statistics come
+   from the DAQ tasks' running sample sums (see DAQAccum) so every sample
+   taken in the RT path is used; sensors not on a periodic DAQ task are
+   polled instead.
+
+   Controllers using different reference meters run fully in parallel.
+   Controllers sharing a meter take turns at it, one whole sweep each:
+   the meter sees the flow through every valve routed to it, so while
+   one is swept the others are held closed (0V).
+
+   The controllers are reserve()d first, with the olfactometer locked:
+   their PID loops are stopped, their valves closed and they are marked
+   busy (see Busy()) so the protocol refuses other connections' commands
+   on them until release() puts their loops back.
+
+   Typical usage:
+
+   @code
+   Calibrator cal;
+   olf.lock();
+   cal.add(pidflow1, calibref, err);
+   cal.add(pidflow2, calibref, err);
+   cal.reserve(err);
+   olf.unlock();
+   std::vector<Calibrator::Result> res = cal.run(); // blocks
+   olf.lock();
+   cal.release();
+   olf.unlock();
+   @endcode
+*/
+class Calibrator
+{
+public:
+  struct Params
+  {
+    Params();
+    double v_start, v_end, v_step; ///< the valve voltage sweep
+    double window_s; ///< length of one settle/measure window
+    double min_settle_s; ///< never call a step settled sooner than this
+    double max_settle_s; ///< take the point anyway after this, flagged as unsettled
+    double z; ///< agreement, in standard errors of the window means
+    double tol; ///< agreement, as a fraction of the sensor's full scale
+    unsigned settle_windows; ///< consecutive windows that must agree
+    unsigned measure_windows; ///< windows averaged into a point
+  };
+
+  struct Result
+  {
+    Result() : ok(false), unsettled(0), seconds(0.) {}
+    std::string name;
+    bool ok;
+    std::string error;
+    Calib::Table table; ///< sensor volts -> reference flow
+    Calib::Table valveTable; ///< valve volts -> reference flow, for feed-forward
+    /// 1/variance of each reference mean, in table order, for
+    /// Calib::setTable().  Empty if some point had no measurable noise.
+    std::vector<double> weights;
+    unsigned unsettled; ///< points taken after max_settle_s
+    double seconds; ///< wall time this controller took
+  };
+
+  Calibrator(const Params & p = Params());
+  ~Calibrator();
+
+  const Params & params() const { return par; }
+  /// sets one of the Params fields by name, for the protocol layer.
+  /// Returns false if the name is unknown or the value is out of range.
+  bool setParam(const std::string & name, double value);
+
+  /// queue fc for calibration against the meter (or sensor, or component
+  /// containing a sensor) ref.  fc must also be a Calib.  Returns false
+  /// and sets err if either is unsuitable.
+  bool add(FlowController *fc, Component *ref, std::string & err);
+  unsigned numQueued() const { return jobs.size(); }
+
+  /// marks everything queued busy, stops their PID loops and closes
+  /// their valves.  Returns false with err set if one is already busy.
+  /// Call with the olfactometer locked.
+  bool reserve(std::string & err);
+  /// restarts the PID loops reserve() stopped and clears busy.  Call
+  /// with the olfactometer locked.  The d'tor calls it if need be.
+  void release();
+  /// true if c, something under it or something above it is being
+  /// calibrated.  Call with the olfactometer locked.
+  static bool Busy(const Component *c);
+
+  /// calibrates everything queued, blocking until done, once reserve()d.
+  /// Results are in add() order.  Does not apply them, see
+  /// Calib::setTable().
+  std::vector<Result> run();
+
+  class Probe;
+  class Worker;
+private:
+  struct Job
+  {
+    FlowController *fc;
+    Sensor *own, *ref;
+    bool wasRunning; ///< its PID loop, before reserve()
+  };
+  Params par;
+  std::vector<Job> jobs;
+  bool reserved;
+  static std::set<const Component *> busy;
+  std::map<Sensor *, Mutex *> meters; ///< one token per reference meter
+
+  Calibrator(const Calibrator &);
+  Calibrator & operator=(const Calibrator &);
+};
+
+#endif
@@ -47,7 +47,7 @@ double ComediChan::dataRead(bool *ok) const
     return 0.;
   }
   if (!myok) err = "Read error.";
-  else ret = (samp/static_cast<double>(m_maxdata) * (m_rangeMax-m_rangeMin)) + m_rangeMin;
+  else ret = sampleToVolts(samp);
   if (ok) *ok = myok;
   return ret;
 }
@@ -97,3 +97,33 @@ void ComediChan::setDIOOutput()
   if (m_isdio && !daq)
     comedi_dio_config(m_dev, m_subdev, m_chan, COMEDI_OUTPUT);
 }
+
+bool DIOBatch::set(const ComediChan & c, bool high)
+{
+  if (!canSet(c)) return false;
+  const unsigned bit = 0x1 << c.chan();
+  MaskBits & mb = c.getDAQ() ? daqs[c.getDAQ()] : devs[std::make_pair(c.dev(), c.subDev())];
+  mb.first |= bit;
+  if (high) mb.second |= bit;
+  else mb.second &= ~bit;
+  return true;
+}
+
+bool DIOBatch::commit()
+{
+  bool ok = true;
+  std::vector<DAQTaskProxy::Bits> w;
+  for (std::map<DAQTaskProxy *, MaskBits>::iterator it = daqs.begin(); it != daqs.end(); ++it) {
+    DAQTaskProxy::Bits b = { it->first, it->second.first, it->second.second };
+    w.push_back(b);
+    if (w.size() == Cmd::DAQBitsMax) ok = DAQTaskProxy::writeBits(w) && ok, w.clear();
+  }
+  ok = DAQTaskProxy::writeBits(w) && ok;
+  for (std::map<std::pair<comedi_t *, unsigned>, MaskBits>::iterator it = devs.begin(); it != devs.end(); ++it) {
+    unsigned bits = it->second.second;
+    if (comedi_dio_bitfield(it->first.first, it->first.second, it->second.first, &bits) < 0) ok = false;
+  }
+  daqs.clear();
+  devs.clear();
+  return ok;
+}
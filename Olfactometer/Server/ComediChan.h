@@ -3,6 +3,7 @@
 
 #include <comedilib.h>
 #include <string>
+#include <map>
 class DAQTaskProxy;
 
 class ComediChan
@@ -15,6 +16,8 @@ public:
   const std::string & error() const { return err; }
 
   double dataRead(bool *ok = 0) const;
+  /// converts a (possibly averaged) raw sample to volts
+  double sampleToVolts(double samp) const { return samp/static_cast<double>(m_maxdata) * (m_rangeMax-m_rangeMin) + m_rangeMin; }
   bool   dataWrite(double);
   int    dioRead(bool *ok = 0) const;
   bool   dioWrite(int bit);
@@ -54,6 +57,34 @@ protected:
   bool m_isai, m_isao, m_isdio;
 };
 
+/// DIO line writes that are to happen together, eg. one valve closing
+/// as another opens.  Lines on DAQ tasks go to the kernel in one command
+/// and land in a single tick of each task (see DAQTaskProxy::writeBits()),
+/// other lines go out with one comedi_dio_bitfield() per subdevice.
+class DIOBatch
+{
+public:
+  /// whether set() takes c: a DIO line, and one a bitfield can hold
+  static bool canSet(const ComediChan & c) { return c.isDIO() && c.chan() < sizeof(unsigned)*8; }
+  /// adds a line, false (and not added) if !canSet(c)
+  bool set(const ComediChan & c, bool high);
+  /// writes everything added and empties the batch
+  bool commit();
+  bool empty() const { return daqs.empty() && devs.empty(); }
+
+  /// (mask, bits) per DAQ task of the lines added so far, for when
+  /// something other than commit() is to write them (see TrialSequencer)
+  typedef std::pair<unsigned, unsigned> MaskBits;
+  typedef std::map<DAQTaskProxy *, MaskBits> DAQBits;
+  const DAQBits & daqBits() const { return daqs; }
+  /// true if every line added so far is on a DAQ task
+  bool daqsOnly() const { return devs.empty(); }
+
+private:
+  DAQBits daqs;
+  std::map<std::pair<comedi_t *, unsigned>, MaskBits> devs;
+};
+
 
 
 #endif
@@ -11,6 +11,8 @@
 #include "ConfParse.h"
 #include "PWMValveProxy.h"
 #include "DAQTaskProxy.h"
+#include "TrialSequencer.h"
+#include "AlarmEngine.h"
 
 // capture 3 is the ${var} form and capture 4 is the $var form..
 //static const boost::regex varRE ("\\$((\\{\\<(.*)\\>\\})|([^{0-9]+\\w*\\>))");
@@ -30,7 +32,7 @@ StringList  ComediOlfactometer::split(const std::string & str)
   return String::split(str, "[[:space:],]+");
 }
 
-ComediOlfactometer::ComediOlfactometer() { clearSetup(); }
+ComediOlfactometer::ComediOlfactometer() : reg(this) { clearSetup(); }
 ComediOlfactometer::~ComediOlfactometer() { } 
 
 void ComediOlfactometer::clearSetup()
@@ -118,12 +120,77 @@ ComediOlfactometer::doDaqTaskSetup(const Settings & ini)
         *p_rngmax = ToDouble(caps[2].str());
       }
 
-      daqTasks[taskname] = new DAQTaskProxy(taskname, coprocess, rate, sdev, fromTo.first, fromTo.second, range, aref, dioOutput, p_rngmin, p_rngmax);
+      ThreadAttrs thread;
+      ret = Conf::Parse::threadAttrs(ini, taskname, thread);
+      if (ret.length()) {
+        Error() << "Configuration file error: rtdaq_task '" << taskname << "' specified in configuration file has error: '" << ret << "'\n";
+        return false;
+      }
+
+      const String onChange = String(ini.get(taskname, Conf::Keys::write_on_change)).lower(),
+                   refresh = ini.get(taskname, Conf::Keys::refresh_ms);
+      const bool writeOnChange = onChange == "yes" || onChange == "1" || onChange == "true";
+      unsigned refreshMs = 0;
+      if (onChange.length() && !writeOnChange && onChange != "no" && onChange != "0" && onChange != "false")
+        ret = Conf::Keys::write_on_change + ": expected yes or no";
+      else if (writeOnChange && (!rate || sdev->type == COMEDI_SUBD_AI || sdev->type == COMEDI_SUBD_DI
+                                 || (sdev->type == COMEDI_SUBD_DIO && !dioOutput)))
+        ret = Conf::Keys::write_on_change + ": only for periodic output tasks";
+      else if (refresh.length() && (refreshMs = refresh.toUInt(&ok), !ok))
+        ret = Conf::Keys::refresh_ms + ": invalid number '" + refresh + "'";
+      if (ret.length()) {
+        Error() << "Configuration file error: rtdaq_task '" << taskname << "' specified in configuration file has error: '" << ret << "'\n";
+        return false;
+      }
+
+      daqTasks[taskname] = new DAQTaskProxy(taskname, coprocess, rate, sdev, fromTo.first, fromTo.second, range, aref, dioOutput, p_rngmin, p_rngmax, &thread, writeOnChange, refreshMs);
+      const String over = ini.get(taskname, Conf::Keys::oversample);
+      if (over.length()) {
+        const unsigned n = over.toUInt(&ok);
+        if (!ok || !daqTasks[taskname]->setOversample(n)) {
+          Error() << "Configuration file error: rtdaq_task '" << taskname << "' has an invalid " << Conf::Keys::oversample << " of '" << over << "', expected 1 to 64 on a periodic analog input task\n";
+          return false;
+        }
+      }
       if (!daqTasks[taskname]->start()) {
         Error() << "Internal error: rtdaq_task '" << taskname << "' could not be started!\n";
         return false;        
       }
-      if (rate) 
+      // chan:divisor ..., channels read every divisor'th period
+      const StringList divs = split(ini.get(taskname, Conf::Keys::chan_divisors));
+      std::map<unsigned, unsigned> chanDivs;
+      for (StringList::const_iterator d = divs.begin(); d != divs.end(); ++d) {
+        StringList cd = String::split(*d, ":");
+        bool ok1 = cd.size() == 2, ok2 = ok1;
+        const unsigned ch = ok1 ? cd.front().toUInt(&ok1) : 0, div = ok2 ? cd.back().toUInt(&ok2) : 0;
+        if (ok1 && ok2) chanDivs[ch] = div;
+        if (!ok1 || !ok2 || !daqTasks[taskname]->setChanDivisor(ch, div)) {
+          Error() << "Configuration file error: rtdaq_task '" << taskname << "' has an invalid " << Conf::Keys::chan_divisors << " entry '" << *d << "', expected chan:divisor for a channel of a periodic analog input task (the task's divisors' lcm can't be too big either)\n";
+          return false;
+        }
+      }
+      // chan:filter ..., see DAQTaskProxy::DesignFilter() (whose biquad
+      // coefficients take the commas)
+      const StringList filts = String::split(ini.get(taskname, Conf::Keys::chan_filters), "[[:space:];]+");
+      for (StringList::const_iterator f = filts.begin(); f != filts.end(); ++f) {
+        const std::string::size_type colon = f->find(':');
+        bool okc = colon != std::string::npos;
+        const unsigned ch = okc ? String(f->substr(0, colon)).toUInt(&okc) : 0;
+        DAQFilter filt;
+        std::string err = okc ? "" : "expected chan:filter";
+        // a channel with a divisor is filtered at its own rate
+        const double chanRate = double(rate) / (chanDivs.count(ch) ? chanDivs[ch] : 1);
+        if (okc && DAQTaskProxy::DesignFilter(f->substr(colon + 1), chanRate, filt, err)
+            && !daqTasks[taskname]->setChanFilter(ch, filt))
+          err = "filters only work on the channels of a periodic analog input task";
+        if (err.length()) {
+          Error() << "Configuration file error: rtdaq_task '" << taskname << "': " << Conf::Keys::chan_filters << " entry '" << *f << "': " << err << "\n";
+          return false;
+        }
+      }
+      if (rate && writeOnChange) 
+        Log() << "RT-DAQ write on change task " << taskname << " started at " << rate << "Hz\n";
+      else if (rate) 
         Log() << "RT-DAQ active periodic task " << taskname << " started at " << rate << "Hz\n";
       else
         Log() << "RT-DAQ passive multiplexing task " << taskname << " created.";
@@ -390,6 +457,13 @@ bool ComediOlfactometer::buildPWM(const Settings &ini, Component *parent, const
     return false;
   }
   PWMVParams params;
+  err = Conf::Parse::threadAttrs(ini, name, params.thread);
+  if (err.length()) {
+    std::ostringstream os;
+    os << "Configuration file error: " << name << ": " << err << "\n";
+    error_out = os.str();
+    return false;
+  }
   params.windowSizeMicros = 1000000;
   params.dutyCycle = 50;
   params.dev = sdev->minor;
@@ -408,6 +482,105 @@ bool ComediOlfactometer::buildPWM(const Settings &ini, Component *parent, const
 }
 
 
+bool ComediOlfactometer::setChanOptions(const Settings &ini, const std::string &section, DAQTaskProxy *daq, unsigned chan, std::string & error_out) const
+{
+  const String div = ini.get(section, Conf::Keys::rate_divisor);
+  bool ok = true;
+  const unsigned d = div.length() ? div.toUInt(&ok) : 1;
+  const String filter = ini.get(section, Conf::Keys::filter);
+  if (ok && d && filter.length()) {
+    DAQFilter f;
+    std::string err;
+    // it runs at the channel's rate
+    if (!DAQTaskProxy::DesignFilter(filter, double(daq->rateHz()) / d, f, err) || !daq->setChanFilter(chan, f)) {
+      if (!err.length()) err = "it only works on a periodic analog input task";
+      error_out = "Configuration file error: " + section + ": " + Conf::Keys::filter + ": " + err + "\n";
+      return false;
+    }
+  }
+  if (!div.length()) return true;
+  if (!ok || !d || !daq->setChanDivisor(chan, d)) {
+    std::ostringstream os;
+    os << "Configuration file error: " << section << ": " << Conf::Keys::rate_divisor << " " << div
+       << " can't be set on " << daq->name() << ", it takes a positive number for a channel of a periodic analog input task (and the task's divisors' lcm can't be too big)\n";
+    error_out = os.str();
+    return false;
+  }
+  return true;
+}
+
+DAQTaskProxy *ComediOlfactometer::daqTask(const std::string & name) const
+{
+  std::map<std::string, DAQTaskProxy *>::const_iterator it = daqTasks.find(name);
+  return it != daqTasks.end() ? it->second : 0;
+}
+
+bool ComediOlfactometer::buildTriggers(const Settings &ini, TrialSequencer *seq, std::string & error_out) const
+{
+  const StringList names = split(ini.get(Conf::Sections::Layout, Conf::Keys::triggers));
+  unsigned slot = 0;
+  for (StringList::const_iterator it = names.begin(); it != names.end(); ++it, ++slot) {
+    const std::string & name = *it;
+    TrialSequencer::TriggerSpec spec;
+    spec.input = ini.get(name, Conf::Keys::input);
+    const String edge = ini.get(name, Conf::Keys::edge),
+                 once = String(ini.get(name, Conf::Keys::once)).lower(),
+                 start = String(ini.get(name, Conf::Keys::start_program)).lower();
+    std::string err;
+    if (!spec.input.length()) err = Conf::Keys::input + ": missing, expected daq_task:chan";
+    else if (edge.length() && !TrialSequencer::ParseEdge(edge, spec.edge)) err = Conf::Keys::edge + ": expected rising, falling or both";
+    else if (once.length() && once != "yes" && once != "1" && once != "true" && once != "no" && once != "0" && once != "false")
+      err = Conf::Keys::once + ": expected yes or no";
+    else if (start.length() && start != "yes" && start != "1" && start != "true" && start != "no" && start != "0" && start != "false")
+      err = Conf::Keys::start_program + ": expected yes or no";
+    spec.once = once == "yes" || once == "1" || once == "true";
+    spec.startProgram = start == "yes" || start == "1" || start == "true";
+    // statements are ;-separated, it's all one line
+    std::string acts = ini.get(name, Conf::Keys::actions);
+    for (std::string::size_type b = 0, e; b < acts.length(); b = e + 1) {
+      e = acts.find(';', b);
+      if (e == std::string::npos) e = acts.length();
+      spec.actions.push_back(acts.substr(b, e - b));
+    }
+    if (!err.length()) seq->setTrigger(slot, spec, err);
+    if (err.length()) {
+      error_out = "Configuration file error: trigger " + name + ": " + err + "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ComediOlfactometer::buildAlarms(const Settings &ini, AlarmEngine *alarms, std::string & error_out) const
+{
+  const StringList names = split(ini.get(Conf::Sections::Layout, Conf::Keys::alarms));
+  for (StringList::const_iterator it = names.begin(); it != names.end(); ++it) {
+    const std::string & name = *it;
+    AlarmEngine::RuleSpec spec;
+    spec.signal = ini.get(name, Conf::Keys::signal);
+    spec.signal2 = ini.get(name, Conf::Keys::signal2);
+    spec.cause = ini.get(name, Conf::Keys::cause);
+    const std::string combine = ini.get(name, Conf::Keys::combine),
+                      forMs = ini.get(name, Conf::Keys::for_ms);
+    std::string err;
+    bool ok = true;
+    if (forMs.length()) spec.forMs = String(forMs).toUInt(&ok);
+    if (!ok) err = Conf::Keys::for_ms + ": expected a whole number of milliseconds";
+    else if (combine.length() && !AlarmEngine::ParseCombine(combine, spec.combine))
+      err = Conf::Keys::combine + ": expected minus or ratio";
+    else if (!AlarmEngine::ParseTest(ini.get(name, Conf::Keys::test), spec, err))
+      err = Conf::Keys::test + ": " + err;
+    else if (spec.signal2.length() && !combine.length())
+      err = Conf::Keys::signal2 + " needs a " + Conf::Keys::combine;
+    else alarms->addRule(name, spec, err);
+    if (err.length()) {
+      error_out = "Configuration file error: alarm " + name + ": " + err + "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
 bool
 ComediOlfactometer::doSetup(Settings & ini, RTLCoprocess *coprocess) 
 {
@@ -423,6 +596,29 @@ ComediOlfactometer::doSetup(Settings & ini, RTLCoprocess *coprocess)
          || !doLayoutSetup(ini) )// the rest 
       { clearSetup(); return false; }
 
+    // the trial program runner, unless the layout took its name
+    if (coprocess && !find(TrialSequencer::DefaultName))
+      new TrialSequencer(this, TrialSequencer::DefaultName, coprocess);
+    if (ini.get(Conf::Sections::Layout, Conf::Keys::triggers).length()) {
+      TrialSequencer *seq = dynamic_cast<TrialSequencer *>(find(TrialSequencer::DefaultName));
+      std::string errstr;
+      if (!seq) errstr = "Configuration file error: triggers need the RT Coprocess (kernel module) loaded and running!\n";
+      if (!seq || !buildTriggers(ini, seq, errstr)) {
+        Error() << errstr;
+        clearSetup();
+        return false;
+      }
+    }
+    if (ini.get(Conf::Sections::Layout, Conf::Keys::alarms).length()) {
+      std::string errstr;
+      if (!coprocess) errstr = "Configuration file error: alarms need the RT Coprocess (kernel module) loaded and running!\n";
+      if (!coprocess || !buildAlarms(ini, new AlarmEngine(this, AlarmEngine::DefaultName, coprocess), errstr)) {
+        Error() << errstr;
+        clearSetup();
+        return false;
+      }
+    }
+
     // verify that all children do not contain spaces
     std::list<Component *> childList = children(true);
     for (std::list<Component *>::const_iterator it = childList.begin();
@@ -438,6 +634,7 @@ ComediOlfactometer::doSetup(Settings & ini, RTLCoprocess *coprocess)
     }
 
     //Debug() << "Olfactometer name: " << name() << "\n";
+    reg.rebuild();
   } catch (const boost::bad_expression & e) {
 
     Error() << "Configuration file error: " << e.what() << "\n";    
@@ -475,14 +672,34 @@ ComediBank::~ComediBank()
 bool
 ComediBank::setOdor(unsigned o)
 {
-  unsigned oldOdor = currentOdor();
-  if (Bank::setOdor(o) && valves.write(o)) 
+  return setOdors(OdorSettings(1, std::make_pair(this, o)));
+}
+
+/*static*/
+bool
+ComediBank::setOdors(const OdorSettings & s)
+{
+  MutExIOBank::Switches sw, old;
+  bool ok = true;
+  for (unsigned i = 0; i < s.size(); ++i) {
+    ComediBank *b = s[i].first;
+    old.push_back(std::make_pair(&b->valves, b->currentOdor()));
+    if (ok && (ok = b->Bank::setOdor(s[i].second)))
+      sw.push_back(std::make_pair(&b->valves, s[i].second));
+  }
+  if (ok && MutExIOBank::switchAll(sw))
     return true;
   // else...
-  valves.write(oldOdor);
+  for (unsigned i = 0; i < old.size(); ++i) s[i].first->Bank::setOdor(old[i].second);
+  MutExIOBank::switchAll(old);
   return false;
 }
 
+bool ComediBank::addOdor(unsigned o, DIOBatch & b) const
+{
+  return o < numOdors() && valves.addSwitch(o, b);
+}
+
 bool ComediBank::save()
 {
   ini.put(name(), Conf::Keys::odor_table, Conf::Gen::odorTable(odorTable()));
@@ -500,17 +717,20 @@ ComediSensor::~ComediSensor() {}
 
 double ComediSensor::read() 
 {
-  double v = readRaw();
+  return voltsToUnits(readRaw());
+}
+
+double ComediSensor::voltsToUnits(double v) const
+{
   return (v-rangeMin())/(rangeMax()-rangeMin()) * (max()-min()) + min();
 }
 
-double CalibComediSensor::read() 
+double CalibComediSensor::voltsToUnits(double v) const
 {
-  double v = readRaw();
   Calib *c = !dynamic_cast<PIDFlowController *>(parent()) ? dynamic_cast<Calib *>(parent()) : 0;
   if (c)  v = c->inverse(v);  // apply possible calibration settings, if any
 
-  return (v-rangeMin())/(rangeMax()-rangeMin()) * (max()-min()) + min();
+  return ComediSensor::voltsToUnits(v);
 }
 
 double ComediSensor::readRaw() 
@@ -706,6 +926,7 @@ bool ComediOlfactometer::buildFlowController(Settings & ini, Component *parent,
       wrrngmin = ToDouble(caps[1].str()), wrrngmax = ToDouble(caps[2].str());
     }
 
+    if (daqin && !setChanOptions(ini, fcname, daqin, chan_rd, error_out)) return false;
     ComediChan comedi_in(handle_rd, minor_rd, sdev_rd->id, chan_rd, 0,  0, &rdrngmin, &rdrngmax, daqin);
     ComediChan comedi_out(handle_wr, minor_wr, sdev_wr->id, chan_wr, 0, 0, &wrrngmin, &wrrngmax, daqout);
 
@@ -877,6 +1098,7 @@ bool ComediOlfactometer::buildFlowMeter(const Settings & ini, Component *parent,
   FlowMeter *fm = 0;
   ComediChan comedi_in(handle_rd, minor_rd, sdev_rd->id, chan_rd, 0,  0, &rdrngmin, &rdrngmax, daqin);
 
+  if (daqin && !setChanOptions(ini, fcname, daqin, chan_rd, error_out)) return false;
   Sensor *s  = new ComediSensor(0, fcname + "_Sensor", comedi_in);
 
   fm = new FlowMeter(s, parent, fcname);
@@ -949,6 +1171,7 @@ bool ComediOlfactometer::buildSensor(const Settings &ini, Component *parent, con
   }
   double rdrngmin = ToDouble(caps[1].str()), rdrngmax = ToDouble(caps[2].str());
   ComediChan comedi_in(handle_rd, minor_rd, sdev_rd->id, chan_rd, 0,  0, &rdrngmin, &rdrngmax, daqin);
+  if (daqin && !setChanOptions(ini, name, daqin, chan_rd, error_out)) return false;
   ComediSensor *s = new ComediSensor(parent, name, comedi_in);
   s->setMin(unit_min);
   s->setMax(unit_max);
@@ -985,12 +1208,10 @@ MutExIOBank::MutExIOBank(Component *parent, const std::string & name,
   : Actuator(parent, name), ios(iozz) 
 {
   std::vector<ComediChan>::iterator it;
-  for (it = ios.begin(); it != ios.end(); ++it) {    
+  for (it = ios.begin(); it != ios.end(); ++it) 
     it->setDIOOutput();
-    if (it == ios.begin()) it->dataWrite(it->rangeMax()); // set line 0 high by default
-    else it->dataWrite(it->rangeMin());
-  }
   m_lastWrittenRaw = m_lastWritten = 0;
+  if (!ios.empty()) writeRaw(0); // set line 0 high by default, the rest low
   setUnit("Chan.");
   setMin(0);
   setMax(numIOS()-1);
@@ -1005,14 +1226,50 @@ MutExIOBank::~MutExIOBank()
 
 bool MutExIOBank::writeRaw(double d) 
 {
-  unsigned id = static_cast<unsigned>(d), cur = unsigned(m_lastWritten);
+  return switchAll(Switches(1, std::make_pair(this, static_cast<unsigned>(d))));
+}
+
+/*static*/
+bool MutExIOBank::switchAll(const Switches & s)
+{
+  DIOBatch batch;
+  std::vector<bool> batched(s.size(), true);
+  for (unsigned i = 0; i < s.size(); ++i) {
+    MutExIOBank *b = s[i].first;
+    if (s[i].second >= b->numIOS()) return false;
+    for (unsigned j = 0; batched[i] && j < b->numIOS(); ++j)
+      batched[i] = DIOBatch::canSet(b->ios[j]);
+    for (unsigned j = 0; batched[i] && j < b->numIOS(); ++j)
+      batch.set(b->ios[j], j == s[i].second);
+  }
+  bool ok = batch.commit();
+  for (unsigned i = 0; i < s.size(); ++i) {
+    MutExIOBank *b = s[i].first;
+    if (!batched[i]) ok = b->writeLines(s[i].second) && ok;
+    else if (ok) b->m_lastWrittenRaw = b->m_lastWritten = s[i].second; // save new valve id 
+  }
+  return ok;
+}
+
+bool MutExIOBank::addSwitch(unsigned id, DIOBatch & b) const
+{
   if (id >= numIOS()) return false;
-  ios[cur].dataWrite(ios[cur].rangeMin()); // set old line low
-  ios[id].dataWrite(ios[id].rangeMax()); // set new line high
-  m_lastWrittenRaw = m_lastWritten = id; // save new valve id 
+  for (unsigned j = 0; j < numIOS(); ++j)
+    if (!DIOBatch::canSet(ios[j])) return false;
+  for (unsigned j = 0; j < numIOS(); ++j)
+    b.set(ios[j], j == id);
   return true;
 }
 
+bool MutExIOBank::writeLines(unsigned id)
+{
+  unsigned cur = unsigned(m_lastWritten);
+  bool ok = ios[id].dataWrite(ios[id].rangeMax()); // set new line high
+  if (cur != id) ok = ios[cur].dataWrite(ios[cur].rangeMin()) && ok; // set old line low
+  if (ok) m_lastWrittenRaw = m_lastWritten = id; // save new valve id 
+  return ok;
+}
+
 double MutExIOBank::readRaw() { return m_lastWrittenRaw; }
 
 bool MutExIOBank::setLoggingEnabled(bool b, DataType t)
@@ -17,6 +17,10 @@
 #include "DataLogable.h"
 #include "Saveable.h"
 #include "Calib.h"
+#include "Registry.h"
+
+class TrialSequencer;
+class AlarmEngine;
 
 // inheritence order is important! we need Olfactometer d'tor called before probedcomedidevices d'tor!
 class ComediOlfactometer : public ProbedComediDevices, public Olfactometer
@@ -29,12 +33,17 @@ public:
 
   /// may return null if no datalog exists
   DataLog *dataLog() { return coprocess; }
+  /// the rtdaq_tasks= task called name, or null
+  DAQTaskProxy *daqTask(const std::string & name) const;
+  /// the components by name and id, for the protocol's lookups
+  Registry & registry() { return reg; }
 
 private:
   std::map<std::string, ComediDevice *> useBoards;
   std::map<std::string, DAQTaskProxy *> daqTasks;
   
   RTLCoprocess *coprocess;
+  Registry reg;
 
   // all of these throw a setup exception
   bool doGeneralSetup(const Settings &);
@@ -53,6 +62,13 @@ private:
   bool buildFlowMeter(const Settings &, Component *parent, const std::string &fcname, std::string & error_out) const;
   bool buildPWM(const Settings &, Component *parent, const std::string &name, std::string & error_out) const;
   bool buildSensor(const Settings &, Component *parent, const std::string &name, std::string & error_out) const;
+  /** applies section's rate_divisor= and filter= to chan of daq, if it has them */
+  bool setChanOptions(const Settings &, const std::string &section, DAQTaskProxy *daq, unsigned chan, std::string & error_out) const;
+  /** sets up the Layout section's triggers= on the sequencer, in slot
+      order */
+  bool buildTriggers(const Settings &, TrialSequencer *seq, std::string & error_out) const;
+  /** adds the Layout section's alarms= rules to the engine */
+  bool buildAlarms(const Settings &, AlarmEngine *alarms, std::string & error_out) const;
 
   friend struct BuildBanks;
 };
@@ -78,6 +94,8 @@ public:
   
   virtual double read();
   virtual double readRaw();
+  /// what read() does to the readRaw() volts to get units
+  virtual double voltsToUnits(double v) const;
 };
 
 class ComediActuator : public Actuator, public ComediDataLogable
@@ -115,7 +133,7 @@ class CalibComediSensor : public ComediSensor
 public:
   CalibComediSensor(Component *parent, const std::string & name, const ComediChan & aio_template);
 
-  virtual double read();
+  virtual double voltsToUnits(double v) const;
 };
 
 class CalibFlowController : public FlowController, public Calib, public Saveable
@@ -148,11 +166,25 @@ public:
 
   unsigned numIOS() const { return ios.size(); }
 
+  /// bank, line to switch it to
+  typedef std::vector<std::pair<MutExIOBank *, unsigned> > Switches;
+  /// switches one or more banks together: every line of every bank is
+  /// written in the same DIOBatch, so there's no moment with a bank's
+  /// old line closed and its new one not yet open, and banks switched
+  /// together switch in the same DAQ tick.  Banks with lines that aren't
+  /// DIO open the new line and then close the old one.
+  static bool switchAll(const Switches & s);
+  /// adds the line writes that switch to line id to b without writing
+  /// anything, false if id is out of range or a line isn't DIO
+  bool addSwitch(unsigned id, DIOBatch & b) const;
+
   // from datalogable
   bool setLoggingEnabled(bool, DataType); // nb: datatype will always be raw no matter what you pass in
   bool loggingEnabled(DataType) const;
 
 private:
+  /// the fallback for non-DIO lines, two writes, make before break
+  bool writeLines(unsigned id);
   std::vector<ComediChan> ios;
 };
 
@@ -183,6 +215,14 @@ public:
              Settings &);
   virtual ~ComediBank();
   bool setOdor(unsigned odor);
+  /// sets several banks' odors at once, their valves switching
+  /// together (see MutExIOBank::switchAll()).  All or nothing: on an
+  /// error every bank is put back.
+  typedef std::vector<std::pair<ComediBank *, unsigned> > OdorSettings;
+  static bool setOdors(const OdorSettings & s);
+  /// the valve writes for odor, added to b but not made, see
+  /// MutExIOBank::addSwitch()
+  bool addOdor(unsigned odor, DIOBatch & b) const;
   bool save();
 //   bool write(double d) { return writeRaw(d); }
 //   bool writeRaw(double d) { return setOdor(static_cast<unsigned>(d)); }
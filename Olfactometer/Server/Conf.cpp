@@ -14,6 +14,7 @@ namespace Conf
     const std::string description("description");    
     const std::string connection_timeout_seconds("connection_timeout_seconds");
     const std::string name("name");    
+    const std::string lock_memory("lock_memory");
     const std::string comediboards("comediboards");    
     const std::string rtdaq_tasks("rtdaq_tasks");    
     const std::string banks("banks");    
@@ -41,21 +42,61 @@ namespace Conf
     const std::string gas_panic_beeps("gas_panic_beeps");
     const std::string calib_table("calib_table");
     const std::string curve_fit_coeffs("curve_fit_coeffs");
+    const std::string calib_lut("calib_lut");
+    const std::string valve_table("valve_table");
+    const std::string feed_forward("feed_forward");
+    const std::string gain_schedule("gain_schedule");
+    const std::string controller("controller");
+    const std::string model_gain("model_gain");
+    const std::string model_tau_s("model_tau_s");
+    const std::string model_dead_s("model_dead_s");
     const std::string Kp("Kp");
     const std::string Ki("Ki");
     const std::string Kd("Kd");
     const std::string update_rate_hz("update_rate_hz");
     const std::string num_Ki_points("num_Ki_points");
+    const std::string integrator("integrator");
+    const std::string anti_windup("anti_windup");
+    const std::string anti_windup_gain("anti_windup_gain");
+    const std::string d_on_measurement("d_on_measurement");
+    const std::string d_filter_ms("d_filter_ms");
+    const std::string fault_action("fault_action");
+    const std::string fault_debounce_ms("fault_debounce_ms");
+    const std::string fault_frac("fault_frac");
+    const std::string fault_min_flow("fault_min_flow");
     const std::string range("range");
     const std::string aref("aref");
     const std::string boardspec("boardspec");
     const std::string rate_hz("rate_hz");
+    const std::string cpus("cpus");
+    const std::string stack_kb("stack_kb");
+    const std::string prefault_stack("prefault_stack");
+    const std::string write_on_change("write_on_change");
+    const std::string refresh_ms("refresh_ms");
+    const std::string chan_divisors("chan_divisors");
+    const std::string rate_divisor("rate_divisor");
+    const std::string oversample("oversample");
+    const std::string chan_filters("chan_filters");
+    const std::string filter("filter");
     const std::string dio("dio");
     const std::string pwm_valves("pwm_valves");
     const std::string unit_range("unit_range"); 
     const std::string units("units");
     const std::string odor_table("odor_table");
     const std::string write_range_clip("write_range_clip");    
+    const std::string triggers("triggers");
+    const std::string input("input");
+    const std::string edge("edge");
+    const std::string once("once");
+    const std::string start_program("start_program");
+    const std::string actions("actions");
+    const std::string alarms("alarms");
+    const std::string signal("signal");
+    const std::string signal2("signal2");
+    const std::string combine("combine");
+    const std::string test("test");
+    const std::string for_ms("for_ms");
+    const std::string cause("cause");
  };
 
 };
@@ -18,6 +18,7 @@ namespace Conf
     extern const std::string description;
     extern const std::string connection_timeout_seconds;
     extern const std::string name;
+    extern const std::string lock_memory;
     
     // Devices Section keys
     extern const std::string comediboards;
@@ -27,6 +28,22 @@ namespace Conf
     extern const std::string boardspec;
     extern const std::string rate_hz;
 
+    // RT thread placement keys, valid in DAQ Device, PID and PWM sections
+    extern const std::string cpus;
+    extern const std::string stack_kb;
+    extern const std::string prefault_stack;
+
+    // DAQ Device Section keys for periodic output tasks
+    extern const std::string write_on_change;
+    extern const std::string refresh_ms;
+    // DAQ Device Section keys for periodic analog input tasks
+    extern const std::string chan_divisors;
+    extern const std::string oversample;
+    extern const std::string chan_filters;
+    // Sensor, flow meter and flow controller section keys, for a readchan on such a task
+    extern const std::string rate_divisor;
+    extern const std::string filter;
+
     // Other keys
     extern const std::string banks;
     extern const std::string carrier;
@@ -50,11 +67,28 @@ namespace Conf
     extern const std::string writechan;
     extern const std::string calib_table;
     extern const std::string curve_fit_coeffs;
+    extern const std::string calib_lut;
+    extern const std::string valve_table;
+    extern const std::string feed_forward;
+    extern const std::string gain_schedule;
+    extern const std::string controller;
+    extern const std::string model_gain;
+    extern const std::string model_tau_s;
+    extern const std::string model_dead_s;
     extern const std::string Kp;
     extern const std::string Ki;
     extern const std::string Kd;
     extern const std::string update_rate_hz;
     extern const std::string num_Ki_points;
+    extern const std::string integrator;
+    extern const std::string anti_windup;
+    extern const std::string anti_windup_gain;
+    extern const std::string d_on_measurement;
+    extern const std::string d_filter_ms;
+    extern const std::string fault_action;
+    extern const std::string fault_debounce_ms;
+    extern const std::string fault_frac;
+    extern const std::string fault_min_flow;
     extern const std::string range;
     extern const std::string aref;
     extern const std::string dio;
@@ -64,6 +98,23 @@ namespace Conf
     extern const std::string odor_table;
     extern const std::string write_range_clip;
 
+    // Trigger section keys, see ComediOlfactometer::buildTriggers()
+    extern const std::string triggers;
+    extern const std::string input;
+    extern const std::string edge;
+    extern const std::string once;
+    extern const std::string start_program;
+    extern const std::string actions;
+
+    // Alarm rule section keys, see ComediOlfactometer::buildAlarms()
+    extern const std::string alarms;
+    extern const std::string signal;
+    extern const std::string signal2;
+    extern const std::string combine;
+    extern const std::string test;
+    extern const std::string for_ms;
+    extern const std::string cause;
+
     // Monitor Section keys
     extern const std::string gas_panic_secs;
     extern const std::string gas_panic_actions;
@@ -141,6 +141,63 @@ namespace Conf
       return coeffs;
     }
       
+    std::map<double, std::vector<double> > gainSchedule(const std::string & str)
+    {
+      std::map<double, std::vector<double> > ret;
+      StringList pts = String::split(str, "\\s+");
+      for (StringList::iterator it = pts.begin(); it != pts.end(); ++it) {
+        StringList pair = String::split(*it, "->");
+        if (pair.size() != 2) continue;
+        bool ok;
+        double f = pair.front().toDouble(&ok);
+        std::vector<double> g = calibCoeffs(pair.back());
+        if (ok && g.size() == 3) ret[f] = g;
+      }
+      return ret;
+    }
+
+    std::string cpuList(const std::string & str, unsigned long & mask)
+    {
+      static const boost::regex re ("^([[:digit:]]+)(-([[:digit:]]+))?$");
+      const unsigned maxcpu = sizeof(mask)*8;
+      mask = 0;
+      StringList toks = String::split(str, "[[:space:],]+");
+      for (StringList::iterator it = toks.begin(); it != toks.end(); ++it) {
+        boost::cmatch caps;
+        if (!boost::regex_match(it->c_str(), caps, re)) 
+          return std::string("invalid cpu list entry '") + *it + "'";
+        unsigned from = ToUInt(caps[1].str()), to = from;
+        if (caps[3].matched) to = ToUInt(caps[3].str());
+        if (from > to || to >= maxcpu) 
+          return std::string("cpu range invalid: ") + *it;
+        for (unsigned i = from; i <= to; ++i) mask |= 0x1UL<<i;
+      }
+      return "";
+    }
+
+    std::string threadAttrs(const Settings & ini, const std::string & section, ThreadAttrs & out)
+    {
+      Memset(&out, 0, sizeof(out));
+      String cpus = ini.get(section, Keys::cpus),
+             stack = ini.get(section, Keys::stack_kb),
+             prefault = String(ini.get(section, Keys::prefault_stack)).lower();
+      if (cpus.length()) {
+        std::string err = cpuList(cpus, out.cpu_mask);
+        if (err.length()) return Keys::cpus + ": " + err;
+      }
+      if (stack.length()) {
+        bool ok;
+        out.stack_size = stack.toUInt(&ok) * 1024UL;
+        if (!ok) return Keys::stack_kb + ": invalid number '" + stack + "'";
+      }
+      if (prefault.length()) {
+        if (prefault == "yes" || prefault == "1" || prefault == "true") out.prefault_stack = 1;
+        else if (prefault != "no" && prefault != "0" && prefault != "false") 
+          return Keys::prefault_stack + ": expected yes or no";
+      }
+      return "";
+    }
+
     Bank::OdorTable odorTable(const std::string & str)
     {
       Bank::OdorTable ret;
@@ -191,6 +248,19 @@ namespace Conf
       return str;      
     }
 
+    std::string gainSchedule(const std::map<double, std::vector<double> > & gs)
+    {
+      String ret = "";
+      std::map<double, std::vector<double> >::const_iterator it;
+      for (it = gs.begin(); it != gs.end(); ++it) {
+        ret += String::Str(it->first) + "->";
+        for (unsigned i = 0; i < it->second.size(); ++i)
+          ret += (i ? "," : "") + String::Str(it->second[i]);
+        ret += " ";
+      }
+      return ret;
+    }
+
   };
 
 
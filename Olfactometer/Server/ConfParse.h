@@ -8,6 +8,8 @@
 #include <map>
 #include <vector>
 #include "ComediOlfactometer.h"
+#include "Settings.h"
+#include "SysDep.h"
 
 class DAQTaskProxy;
 
@@ -35,6 +37,16 @@ namespace Conf
     extern Bank::OdorTable odorTable(const std::string & confstr);
     extern std::map<double, double> calibTable(const std::string & confstr);
     extern std::vector<double> calibCoeffs(const std::string & confstr);
+    /** parses a gain schedule of the form flow->Kp,Ki,Kd flow->Kp,Ki,Kd ...
+        into flow -> {Kp,Ki,Kd} */
+    extern std::map<double, std::vector<double> > gainSchedule(const std::string & confstr);
+    /** parses a cpu list such as "2", "2,3" or "1-3" into a mask, 
+        bit n = cpu n.  Returns empty string on success. */
+    extern std::string cpuList(const std::string & confstr, unsigned long & mask_out);
+    /** reads the optional cpus=, stack_kb= and prefault_stack= keys
+        of an RT task section into out (which is zeroed first).
+        Returns empty string on success. */
+    extern std::string threadAttrs(const Settings & ini, const std::string & section, ThreadAttrs & out);
     
   };
 
@@ -44,6 +56,8 @@ namespace Conf
     /// the inverse of Conf::Parse::odorTable
     extern std::string calibTable(const std::map<double, double> &);
     extern std::string calibCoeffs(const std::vector<double> & v);
+    /// the inverse of Conf::Parse::gainSchedule
+    extern std::string gainSchedule(const std::map<double, std::vector<double> > &);
   };
 };
 
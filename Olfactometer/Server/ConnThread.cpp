@@ -10,6 +10,12 @@
 #include "Saveable.h"
 #include "DataLog.h"
 #include "Calib.h"
+#include "Calibrator.h"
+#include "AutoTuner.h"
+#include "SysId.h"
+#include "WaveShape.h"
+#include "TrialSequencer.h"
+#include "AlarmEngine.h"
 #include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -54,8 +60,10 @@ ConnThread::ThreadMap ConnThread::threads; // all the threads
 #define CRITICAL() (::Critical() << LOGPREFIX)
 
 ConnThread::ConnThread(int s, const std::string & rh, Olfactometer & theOlf, int t_out)
-  : sock(s), remoteHost(rh), olf(theOlf), timeout_ms(DEFAULT_CONN_TIMEOUT)
+  : sock(s), remoteHost(rh), olf(theOlf), reg(0), timeout_ms(DEFAULT_CONN_TIMEOUT)
 {
+  ComediOlfactometer *colf = dynamic_cast<ComediOlfactometer *>(&olf);
+  if (colf) reg = &colf->registry();
   if (t_out) setTimeout(t_out);
 
   lineBuf = new char[MAX_LINE_LEN+1];
@@ -300,6 +308,9 @@ const ConnThread::ProtocolHandler ConnThread::protocolHandlers[] =
     { cmd     : Protocol    :: List, // LIST
       nArgs   : ProtocolHandler::NOARGCHK,  synopsis : "[logables|startstoppables|controllables|readables|writables|saveables|calib|enableables]",
       handler : &ConnThread :: doList },
+    { cmd     : Protocol    :: GetState, // GET STATE
+      nArgs   : ProtocolHandler::NOARGCHK,  synopsis : "[component]",
+      handler : &ConnThread :: doGetState },
     { cmd     : Protocol    :: GetControlParams, // GET CONTROL PARAMS
       nArgs   : 1,  synopsis : "controllable_obj",
       handler : &ConnThread :: doGetControlParams },
@@ -318,6 +329,58 @@ const ConnThread::ProtocolHandler ConnThread::protocolHandlers[] =
     { cmd     : Protocol    :: SetCalib, // SET CALIB
       nArgs   : 1,  synopsis : "pidflowcontroller (requires input of voltage_sensor=flow_ml_min, one per line)",
       handler : &ConnThread :: doSetCalib },
+    { cmd     : Protocol    :: Calibrate, // CALIBRATE
+      nArgs   : -1,  synopsis : "flowcontroller=reference [flowcontroller2=reference ...] [v_start|v_end|v_step|window_s|min_settle_s|max_settle_s|z|tol|settle_windows|measure_windows=value ...]",
+      handler : &ConnThread :: doCalibrate },
+    { cmd     : Protocol    :: AutoTune, // AUTOTUNE
+      nArgs   : -1,  synopsis : "pidflowcontroller [rule=zn|tl] [amp|hyst_frac|cycles|settle_s|timeout_s|setpoint|schedule=value ...]",
+      handler : &ConnThread :: doAutoTune },
+    { cmd     : Protocol    :: Identify, // IDENTIFY
+      nArgs   : -1,  synopsis : "pidflowcontroller [controller=pid|smith] [from|to|order|max_dead_s|tau_c|apply=value ...]",
+      handler : &ConnThread :: doIdentify },
+    // before START/STOP, which they would otherwise match
+    { cmd     : Protocol    :: SetWaveform, // SET WAVEFORM
+      nArgs   : -1,  synopsis : "pidflowcontroller_or_mix [shape=table|ramp|sine|square|pulse] [interp=linear|step] [shape_param=value ...] (table requires input of seconds=flow_ml_min, one per line)",
+      handler : &ConnThread :: doSetWaveform },
+    { cmd     : Protocol    :: StartWaveform, // START WAVEFORM
+      nArgs   : -1,  synopsis : "pidflowcontroller_or_mix [loops|delay_s=value ...]",
+      handler : &ConnThread :: doStartWaveform },
+    { cmd     : Protocol    :: StopWaveform, // STOP WAVEFORM
+      nArgs   : 1,  synopsis : "pidflowcontroller_or_mix",
+      handler : &ConnThread :: doStopWaveform },
+    { cmd     : Protocol    :: GetWaveform, // GET WAVEFORM
+      nArgs   : 1,  synopsis : "pidflowcontroller_or_mix",
+      handler : &ConnThread :: doGetWaveform },
+    { cmd     : Protocol    :: SetProgram, // SET PROGRAM
+      nArgs   : 0,  synopsis : "(requires input of the program, one statement per line: odor bank odor | flow pidflowcontroller_or_mix flow_ml_min | pwm pwmvalve duty [window_s] | wait seconds | mark value | loop [n] | end)",
+      handler : &ConnThread :: doSetProgram },
+    { cmd     : Protocol    :: RunProgram, // RUN PROGRAM
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doRunProgram },
+    { cmd     : Protocol    :: StopProgram, // STOP PROGRAM
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doStopProgram },
+    { cmd     : Protocol    :: GetProgram, // GET PROGRAM
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doGetProgram },
+    { cmd     : Protocol    :: ArmProgram, // ARM PROGRAM
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doArmProgram },
+    { cmd     : Protocol    :: SetTrigger, // SET TRIGGER
+      nArgs   : -2,  synopsis : "slot input=daq_task:chan [edge=rising|falling|both] [once=yes|no] [program=yes|no] (requires input of the actions, one statement per line: odor bank odor | flow pidflowcontroller_or_mix flow_ml_min | pwm pwmvalve duty [window_s] | mark value)",
+      handler : &ConnThread :: doSetTrigger },
+    { cmd     : Protocol    :: ClearTrigger, // CLEAR TRIGGER
+      nArgs   : 1,  synopsis : "slot",
+      handler : &ConnThread :: doClearTrigger },
+    { cmd     : Protocol    :: GetTriggers, // GET TRIGGERS
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doGetTriggers },
+    { cmd     : Protocol    :: GetAlarms, // GET ALARMS
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doGetAlarms },
+    { cmd     : Protocol    :: WatchAlarms, // WATCH ALARMS
+      nArgs   : 0,  synopsis : "(no args)",
+      handler : &ConnThread :: doWatchAlarms },
     { cmd     : Protocol    :: Start, // START
       nArgs   : 1,  synopsis : "startable_object",
       handler : &ConnThread :: doStart },
@@ -683,7 +746,22 @@ bool ConnThread::doSetOdor(StringList &argv)
   }
   
   olf.lock();
-  // loop through bank odornum pairs and set the odor for each bank.. note that if we get some error at some point we will undo the damage done..
+  // valve banks all switch together, in one DAQ tick
+  ComediBank::OdorSettings together;
+  for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+    ComediBank *b = dynamic_cast<ComediBank *>(olf.find(*it++));
+    bool ok = false;
+    unsigned odor = it->toInt(&ok);
+    if (!b || !ok) { together.clear(); break; }
+    together.push_back(std::make_pair(b, odor));
+  }
+  if (!together.empty()) {
+    bool ok = ComediBank::setOdors(together);
+    olf.unlock();
+    if (!ok) Protocol::SendError(sock, "invalid odor or odor set error.");
+    return ok;
+  }
+  // otherwise loop through bank odornum pairs and set the odor for each bank.. note that if we get some error at some point we will undo the damage done..
   while (argv.size() && !undoIt) 
   { 
       String bankname = argv.front(); argv.pop_front();
@@ -785,6 +863,10 @@ bool ConnThread::doSetOdorFlow(StringList &argv)
     Protocol::SendError(sock, String("Mix ") + mixname + " not found.");
     return false;
   }
+  if (calibrating(m)) {
+    olf.unlock();
+    return false;
+  }
   ok = m->setOdorFlow(flow);
   olf.unlock();
   if (!ok) {
@@ -857,6 +939,10 @@ bool ConnThread::doSetMixtureRatio(StringList &argv)
     mr[name] = ratio;
   }
   olf.lock();
+  if (calibrating(m)) {
+    olf.unlock();
+    return false;
+  }
   bool ok = m->setMixtureRatios(mr);
   olf.unlock();
   if (!ok) {
@@ -933,6 +1019,10 @@ bool ConnThread::doOverrideBankFlow(StringList &argv)
     Protocol::SendError(sock, String("Bank ") + bankname + " not found.");
     return false;
   }
+  if (calibrating(b)) {
+    olf.unlock();
+    return false;
+  }
   ok = b->setFlow(flow);
   olf.unlock();
   if (!ok) {
@@ -1010,6 +1100,10 @@ bool ConnThread::doOverrideCarrierFlow(StringList &argv)
     Protocol::SendError(sock, String("Internal error!  Mix ") + mixname + " has no carrier defined!");
     return false;
   }
+  if (calibrating(c)) {
+    olf.unlock();
+    return false;
+  }
   ok = c->setFlow(flow);
   olf.unlock();
   if (!ok) {
@@ -1096,6 +1190,10 @@ bool ConnThread::doOverrideFlow(StringList &argv)
     Protocol::SendError(sock, String("Internal error!  Mix or bank ") + name + " has no flow controller defined!");
     return false;
   }
+  if (calibrating(c)) {
+    olf.unlock();
+    return false;
+  }
   ok = c->setFlow(flow);
   olf.unlock();
   if (!ok) {
@@ -1111,7 +1209,8 @@ bool ConnThread::doEnable(StringList &argv)
   String name = argv.front();
   olf.lock();
   
-  Enableable *e = dynamic_cast<Enableable *>(olf.find(name));
+  const Registry::Entry *ent = lookup(name);
+  Enableable *e = ent ? ent->enableable : 0;
   if ( !e ) {
     olf.unlock();
     Protocol::SendError(sock, String("Component ") + name + " is not 'enableable' or does not exist.");
@@ -1127,7 +1226,8 @@ bool ConnThread::doDisable(StringList &argv)
   String name = argv.front();
   olf.lock();
   
-  Enableable *e = dynamic_cast<Enableable *>(olf.find(name));
+  const Registry::Entry *ent = lookup(name);
+  Enableable *e = ent ? ent->enableable : 0;
   if ( !e ) {
     olf.unlock();
     Protocol::SendError(sock, String("Component ") + name + " is not 'enableable' or does not exist.");
@@ -1142,7 +1242,8 @@ bool ConnThread::doIsEnabled(StringList &argv)
 {
   String name = argv.front();
   olf.lock();
-  Enableable *e = dynamic_cast<Enableable *>(olf.find(name));
+  const Registry::Entry *ent = lookup(name);
+  Enableable *e = ent ? ent->enableable : 0;
   if (!e) {
     olf.unlock();
     Protocol::SendError(sock, String("Enableable ") + name + " not found.");
@@ -1258,12 +1359,12 @@ bool ConnThread::doMonitor(StringList &argv)
 }
 
 // caller must hold olf. lock!!
-String ConnThread::dumpOdorTable(Bank *b) const
+String ConnThread::dumpOdorTable(Bank *b, const char *linePrefix) const
 {
   std::ostringstream oss;
   Bank::OdorTable odorTable = b->odorTable();
   for (Bank::OdorTable::iterator it = odorTable.begin(); it != odorTable.end(); ++it) 
-    oss << it->first << "\t" 
+    oss << linePrefix << it->first << "\t" 
         << it->second.name << "\t" 
         << it->second.metadata << "\n";  
   return oss.str();
@@ -1286,6 +1387,10 @@ bool ConnThread::doSetDesiredTotalFlow(StringList &argv)
     Protocol::SendError(sock, String("Mix ") + mixname + " not found.");
     return false;
   }
+  if (calibrating(m)) {
+    olf.unlock();
+    return false;
+  }
   ok = m->setDesiredTotalFlow(flow);
   olf.unlock();
   if (!ok) {
@@ -1409,17 +1514,90 @@ bool ConnThread::doList(StringList &args)
   return true;
 }
 
+/* One line per component, depth first from the root (by default the
+   olfactometer itself), with what GET BANK ODOR, GET COMMANDED FLOW,
+   GET ACTUAL FLOW, IS ENABLED, GET CONTROL PARAMS, etc. would say about
+   it, all read under one lock so they agree with each other:
+
+     name type=Type parent=Parent [key=value ...]
+
+   A bank's line is followed by its odor table, one odor per line as GET
+   ODOR TABLE sends it but with a leading tab.  */
+bool ConnThread::doGetState(StringList &args)
+{
+  if (args.size() > 1) {
+    Protocol::SendError(sock, String("Argument/usage error --  synopsis: ") + Protocol::GetState + " [component]");
+    return false;
+  }
+  std::ostringstream ss;
+  olf.lock();
+  Component *root = &olf;
+  if (!args.empty()) {
+    const Registry::Entry *e = lookup(args.front());
+    if (!e) {
+      olf.unlock();
+      Protocol::SendError(sock, (args.front() + " not found.").c_str());
+      return false;
+    }
+    root = e->comp;
+  }
+  std::list<Component *> cl = root->children(true);
+  cl.push_front(root);
+  for (std::list<Component *>::iterator it = cl.begin(); it != cl.end(); ++it) {
+    Component *c = *it;
+    ss << c->name() << " type=" << c->typeName()
+       << " parent=" << (c->parent() ? c->parent()->name() : std::string("NONE"));
+    Mix *m = dynamic_cast<Mix *>(c);
+    if (m) {
+      ss << " desired_total_flow=" << m->desiredTotalFlow() << " odor_flow=" << m->odorFlow()
+         << " commanded_odor_flow=" << m->commandedOdorFlow() << " actual_odor_flow=" << m->actualOdorFlow()
+         << " mix_ratio=";
+      Mix::MixtureRatio mr = m->mixtureRatios();
+      for (Mix::MixtureRatio::const_iterator r = mr.begin(); r != mr.end(); ++r)
+        ss << (r != mr.begin() ? "," : "") << r->first << ":" << r->second;
+    }
+    Bank *b = dynamic_cast<Bank *>(c);
+    if (b) {
+      ss << " odor=" << b->currentOdor() << " num_odors=" << b->numOdors();
+      if (b->getFlowController())
+        ss << " commanded_flow=" << b->commandedFlow() << " actual_flow=" << b->actualFlow();
+    }
+    FlowMeter *fm = dynamic_cast<FlowMeter *>(c);
+    if (fm) {
+      FlowController *fc = dynamic_cast<FlowController *>(fm);
+      if (fc) ss << " commanded_flow=" << fc->commandedFlow();
+      ss << " actual_flow=" << fm->flow();
+    }
+    Enableable *en = dynamic_cast<Enableable *>(c);
+    if (en) ss << " enabled=" << (en->isEnabled() ? "yes" : "no");
+    StartStoppable *st = dynamic_cast<StartStoppable *>(c);
+    if (st) ss << " running=" << (st->isStarted() ? "yes" : "no");
+    Controller *ctl = dynamic_cast<Controller *>(c);
+    if (ctl) {
+      std::vector<double> p = ctl->controlParams();
+      ss << " control_params=";
+      for (unsigned i = 0; i < p.size(); ++i)
+        ss << (i ? "," : "") << p[i];
+    }
+    ss << "\n";
+    if (b) ss << dumpOdorTable(b, "\t");
+  }
+  olf.unlock();
+  xmit(ss.str());
+  return true;
+}
+
 bool ConnThread::doGetControlParams(StringList &args)
 {
     String cname = args.front();
     olf.lock();
-    Component * c = olf.find(cname, true);
-    if (!c) {
+    const Registry::Entry *e = lookup(cname);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, String("Component ") + cname + " not found.");
       return false;
     }
-    Controller *pc = dynamic_cast<Controller *>(c);
+    Controller *pc = e->controller;
     if (!pc) {
       olf.unlock();
       Protocol::SendError(sock, String("Component ") + cname + " is not an object that has control parameters associated with it.");
@@ -1438,18 +1616,22 @@ bool ConnThread::doSetControlParams(StringList &args)
 {
     String cname = args.front();
     olf.lock();
-    Component * c = olf.find(cname, true);
-    if (!c) {
+    const Registry::Entry *e = lookup(cname);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, String("Component ") + cname + " not found.");
       return false;
     }
-    Controller *pc = dynamic_cast<Controller *>(c);
+    Controller *pc = e->controller;
     if (!pc) {
       olf.unlock();
       Protocol::SendError(sock, String("Component ") + cname + " is not an object that uses control parameters.");
       return false;      
     }
+    if (calibrating(e->comp)) {
+      olf.unlock();
+      return false;
+    }
     args.pop_front();
     std::vector<double> cp(pc->numControlParams());
     if (args.size() != cp.size()) {
@@ -1482,13 +1664,13 @@ bool ConnThread::doGetCoeffs(StringList &args)
     String cname = args.front();
     std::ostringstream ss;
     olf.lock();
-    Component * comp = olf.find(cname, true);
-    if (!comp) {
+    const Registry::Entry *e = lookup(cname);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, String("Component ") + cname + " not found.");
       return false;
     }
-    Calib *c = dynamic_cast<Calib *>(comp);
+    Calib *c = e->calib;
     if (!c) {
       olf.unlock();
       Protocol::SendError(sock, cname + " is not a calibratable component.");
@@ -1521,9 +1703,9 @@ bool ConnThread::doSetCoeffs(StringList &args)
       return false;
     }    
     olf.lock();
-    Component * comp = olf.find(cname, true);
-    Calib *c = 0;
-    if (!comp || !(c = dynamic_cast<Calib *>(comp))) {
+    const Registry::Entry *e = lookup(cname);
+    Calib *c = e ? e->calib : 0;
+    if (!c) {
       olf.unlock();
       Protocol::SendError(sock, String("Component ") + cname + " not found or is not a calibratable object.");
       return false;
@@ -1541,8 +1723,9 @@ bool ConnThread::doGetCalib(StringList &argv)
 {
     String cname = argv.front();
     olf.lock();
-    Calib *c = 0;
-    if ( !(c = dynamic_cast<Calib *>(olf.find(cname))) ) {
+    const Registry::Entry *e = lookup(cname);
+    Calib *c = e ? e->calib : 0;
+    if (!c) {
       olf.unlock();
       Protocol::SendError(sock, (cname + " not found.").c_str());
       return false;
@@ -1562,8 +1745,9 @@ bool ConnThread::doSetCalib(StringList &argv)
 {
     String cname = argv.front();
     olf.lock();
-    Calib *c = 0;
-    if ( !(c = dynamic_cast<Calib *>(olf.find(cname))) ) {
+    const Registry::Entry *e = lookup(cname);
+    Calib *c = e ? e->calib : 0;
+    if (!c) {
       olf.unlock();
       Protocol::SendError(sock, (cname + " not found.").c_str());
       return false;
@@ -1612,22 +1796,710 @@ bool ConnThread::doSetCalib(StringList &argv)
     return status;
 }
 
-bool ConnThread::doStart(StringList &argv)
+bool ConnThread::doCalibrate(StringList &argv)
+{
+    Calibrator cal;
+    olf.lock();
+    for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+      StringList kv = String::split(*it, "=");
+      if (kv.size() != 2) {
+        olf.unlock();
+        Protocol::SendError(sock, (*it + " is not of the form flowcontroller=reference or param=value.").c_str());
+        return false;
+      }
+      String lhs = kv.front(), rhs = kv.back();
+      FlowController *fc = dynamic_cast<FlowController *>(olf.find(lhs));
+      if (fc) {
+        std::string err;
+        if (!cal.add(fc, olf.find(rhs), err)) {
+          olf.unlock();
+          Protocol::SendError(sock, (lhs + ": " + err).c_str());
+          return false;
+        }
+        continue;
+      }
+      bool ok;
+      double val = rhs.toDouble(&ok);
+      if (!ok || !cal.setParam(lhs, val)) {
+        olf.unlock();
+        Protocol::SendError(sock, (*it + " is neither a flow controller nor a valid calibration parameter.").c_str());
+        return false;
+      }
+    }
+    if (!cal.numQueued()) {
+      olf.unlock();
+      Protocol::SendError(sock, "Nothing to calibrate, pass at least one flowcontroller=reference.");
+      return false;
+    }
+    std::string err;
+    if (!cal.reserve(err)) {
+      olf.unlock();
+      Protocol::SendError(sock, err.c_str());
+      return false;
+    }
+    olf.unlock();
+
+    // this takes minutes, other connections keep working meanwhile,
+    // except on the controllers being calibrated
+    std::vector<Calibrator::Result> res = cal.run();
+    olf.lock();
+    cal.release();
+    olf.unlock();
+
+    unsigned nfailed = 0;
+    for (unsigned i = 0; i < res.size(); ++i) {
+      Calibrator::Result & r = res[i];
+      PolynomialFit::Fit fit;
+      if (r.ok) {
+        olf.lock();
+        const Registry::Entry *e = lookup(r.name);
+        Calib *c = e ? e->calib : 0;
+        if (!c || !c->setTable(r.table, r.weights.size() ? &r.weights : 0, Calib::robustFitOptions())) r.ok = false, r.error = "curve fit of the results failed";
+        else {
+          fit = c->fitInfo();
+          c->setValveTable(r.valveTable);
+        }
+        olf.unlock();
+      }
+      if (!r.ok) ++nfailed;
+      std::ostringstream ss;
+      ss << r.name << " " << (r.ok ? "ok" : "failed") << " points=" << r.table.size()
+         << " unsettled=" << r.unsettled << " seconds=" << r.seconds;
+      if (fit.ok)
+        ss << " degree=" << fit.degree << " r2=" << fit.r2 << " rms=" << fit.rms << " outliers=" << fit.numOutliers;
+      if (!r.ok) ss << " " << r.error;
+      ss << "\n";
+      xmit(ss.str());
+    }
+    if (nfailed) {
+      Protocol::SendError(sock, (String::Str(nfailed) + " of " + String::Str(res.size()) + " calibrations failed.").c_str());
+      return false;
+    }
+    return true;
+}
+
+bool ConnThread::doAutoTune(StringList &argv)
+{
+    if (argv.empty()) {
+      Protocol::SendError(sock, "Need a pid flow controller to tune.");
+      return false;
+    }
+    String name = argv.front();
+    argv.pop_front();
+    olf.lock();
+    PIDFlowController *pfc = dynamic_cast<PIDFlowController *>(olf.find(name));
+    if (!pfc) {
+      olf.unlock();
+      Protocol::SendError(sock, (name + " not found or not a pid flow controller.").c_str());
+      return false;
+    }
+    if (calibrating(pfc)) {
+      olf.unlock();
+      return false;
+    }
+    olf.unlock();
+    AutoTuner tuner(pfc);
+    for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+      StringList kv = String::split(*it, "=");
+      if (kv.size() != 2 || !tuner.setParam(kv.front(), kv.back())) {
+        Protocol::SendError(sock, (*it + " is not a valid auto-tune parameter=value.").c_str());
+        return false;
+      }
+    }
+
+    // this takes a while, other connections keep working meanwhile
+    AutoTuner::Result r = tuner.run();
+
+    for (unsigned i = 0; i < r.points.size(); ++i) {
+      const AutoTuner::Point & p = r.points[i];
+      std::ostringstream ss;
+      ss << "flow=" << p.flow << " Ku=" << p.Ku << " Pu=" << p.Pu << " a=" << p.a
+         << " Kp=" << p.gains[0] << " Ki=" << p.gains[1] << " Kd=" << p.gains[2] << "\n";
+      xmit(ss.str());
+    }
+    if (!r.ok) {
+      Protocol::SendError(sock, (name + ": " + r.error).c_str());
+      return false;
+    }
+    return true;
+}
+
+bool ConnThread::doIdentify(StringList &argv)
 {
+    ComediOlfactometer * colf = dynamic_cast<ComediOlfactometer *>(&olf);
+    if (!colf || !colf->dataLog()) {
+      Protocol::SendError(sock, "INTERNAL ERROR: Olfactometer object has no datalog!");
+      return false;
+    }
     String name = argv.front();
+    argv.pop_front();
     olf.lock();
+    PIDFlowController *pfc = dynamic_cast<PIDFlowController *>(olf.find(name));
+    if (!pfc) {
+      olf.unlock();
+      Protocol::SendError(sock, (name + " not found or not a pid flow controller.").c_str());
+      return false;
+    }
+    if (calibrating(pfc)) {
+      olf.unlock();
+      return false;
+    }
+    olf.unlock();
+    double from = -1., to = -1., maxDead = -1., tauC = -1.;
+    unsigned order = 0;
+    bool apply = false, smith = pfc->smithPredictor();
+    for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+      StringList kv = String::split(*it, "=");
+      bool ok = kv.size() == 2;
+      if (ok && kv.front() == "controller") {
+        if (kv.back() == "smith") smith = true;
+        else if (kv.back() == "pid") smith = false;
+        else ok = false;
+        if (ok) continue;
+      }
+      const double v = ok ? kv.back().toDouble(&ok) : 0.;
+      if (ok) {
+        const String & k = kv.front();
+        if (k == "from") from = v;
+        else if (k == "to") to = v;
+        else if (k == "order" && (v == 0. || v == 1. || v == 2.)) order = static_cast<unsigned>(v);
+        else if (k == "max_dead_s" && v >= 0.) maxDead = v;
+        else if (k == "tau_c" && v > 0.) tauC = v;
+        else if (k == "apply") apply = v != 0.;
+        else ok = false;
+      }
+      if (!ok) {
+        Protocol::SendError(sock, (*it + " is not a valid identify parameter=value.").c_str());
+        return false;
+      }
+    }
+
+    // the log is left alone, so GET DATA LOG still sees the same events
+    std::list<DataEvent> evts;
+    olf.lock();
+    colf->dataLog()->getEvents(evts, 0, colf->dataLog()->numEvents(), false);
+    olf.unlock();
+    std::vector<SysId::Datum> data;
+    for (std::list<DataEvent>::const_iterator it = evts.begin(); it != evts.end(); ++it) {
+      const double t = it->ts_ns / 1e9;
+      if (it->id != pfc->id() || (from >= 0. && t < from) || (to >= 0. && t > to)) continue;
+      const bool isFlow = !::strcmp(it->meta, "flow");
+      if (!isFlow && ::strcmp(it->meta, "vout")) continue;
+      SysId::Datum d = { t, isFlow, it->datum };
+      data.push_back(d);
+    }
+    SysId::Series series;
+    std::string err;
+    if (!SysId::MakeSeries(data, series, err)) {
+      Protocol::SendError(sock, (name + ": " + err).c_str());
+      return false;
+    }
+    SysId::Model m = SysId::Identify(series, order, maxDead);
+    if (!m.ok) {
+      Protocol::SendError(sock, (name + ": " + m.msg).c_str());
+      return false;
+    }
+    SysId::Tuning tu = SysId::SIMC(m, series.T, tauC, smith);
+    std::vector<double> g = pfc->loopGains(tu.Kc, tu.Ti);
+
+    std::ostringstream ss;
+    ss.precision(6);
+    ss << "from=" << std::fixed << series.t0 << " to=" << series.t0 + series.T * (series.y.size() - 1);
+    ss.unsetf(std::ios::floatfield);
+    ss << " samples=" << series.y.size() << " T=" << series.T << "\n";
+    ss << "model=" << (m.order == 1 ? "fopdt" : "sopdt") << " K=" << m.K << " tau1=" << m.tau1;
+    if (m.order == 2) ss << " tau2=" << m.tau2;
+    ss << " theta=" << m.theta << " rms=" << m.rms << " fit_pct=" << m.fitPct << "\n";
+    if (smith)
+      ss << "controller=smith model_gain=" << m.K << " model_tau_s=" << tu.tau << " model_dead_s=" << tu.theta << "\n";
+    ss << "Kc=" << tu.Kc << " Ti=" << tu.Ti << " tau_c=" << tu.tauC
+       << " Kp=" << g[0] << " Ki=" << g[1] << " Kd=" << g[2] << "\n";
+    if (tu.predictor && !smith)
+      ss << "dead time dominates (theta > tau), controller=smith will outperform PI\n";
+    xmit(ss.str());
+
+    if (apply) {
+      if (smith ? !pfc->setSmithModel(m.K, tu.tau, tu.theta)
+                : pfc->smithPredictor() && !pfc->clearSmithModel()) {
+        Protocol::SendError(sock, (name + ": could not change the controller structure").c_str());
+        return false;
+      }
+      std::vector<double> cp = pfc->controlParams(); // for numIntgrlPts
+      std::copy(g.begin(), g.end(), cp.begin());
+      pfc->setGainSchedule(PIDFlowController::GainSchedule());
+      if (!pfc->Controller::setControlParams(cp)) {
+        Protocol::SendError(sock, (name + ": could not apply the gains").c_str());
+        return false;
+      }
+    }
+    return true;
+}
+
+bool ConnThread::waveTargets(const String & name, WaveTargets & out)
+{
+    out.clear();
     Component *c = olf.find(name);
-    if (!c) {
+    if (PIDFlowController *pfc = dynamic_cast<PIDFlowController *>(c)) {
+      if (calibrating(pfc)) return false;
+      out.push_back(std::make_pair(pfc, 1.));
+      return true;
+    }
+    Mix *m = dynamic_cast<Mix *>(c);
+    if (!m) {
+      Protocol::SendError(sock, (name + " not found or not a pid flow controller or mix.").c_str());
+      return false;
+    }
+    // the odor flow, split over the banks as Mix::setOdorFlow() does
+    const Mix::MixtureRatio r = m->mixtureRatios();
+    double sum = 0.;
+    for (Mix::MixtureRatio::const_iterator it = r.begin(); it != r.end(); ++it) sum += it->second;
+    for (Mix::MixtureRatio::const_iterator it = r.begin(); it != r.end(); ++it) {
+      Bank *b = m->getBank(it->first);
+      PIDFlowController *pfc = b ? dynamic_cast<PIDFlowController *>(b->getFlowController()) : 0;
+      if (!pfc) {
+        Protocol::SendError(sock, (name + ": bank " + it->first + " has no pid flow controller.").c_str());
+        return false;
+      }
+      if (it->second > 0.) out.push_back(std::make_pair(pfc, it->second / sum));
+    }
+    if (out.empty()) {
+      Protocol::SendError(sock, (name + " has no mixture ratio set.").c_str());
+      return false;
+    }
+    return !calibrating(m);
+}
+
+bool ConnThread::doSetWaveform(StringList &argv)
+{
+    String name = argv.front();
+    argv.pop_front();
+    String shape = "table", interp;
+    std::map<std::string, double> params;
+    for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+      StringList kv = String::split(*it, "=");
+      bool ok = kv.size() == 2;
+      if (ok && kv.front() == "shape") shape = kv.back();
+      else if (ok && kv.front() == "interp" && (kv.back() == "linear" || kv.back() == "step")) interp = kv.back();
+      else if (ok) params[kv.front()] = kv.back().toDouble(&ok);
+      if (!ok) {
+        Protocol::SendError(sock, (*it + " is not a valid waveform parameter=value.").c_str());
+        return false;
+      }
+    }
+
+    WaveShape::Points pts;
+    bool step = false;
+    std::string err;
+    if (shape == "table") {
+      if (!params.empty()) {
+        Protocol::SendError(sock, "A table waveform takes no shape parameters.");
+        return false;
+      }
+      Protocol::SendReady(sock);
+      for (; ;) {
+        std::string line;
+        int r = recvLine(line); // ignoring errors, as SET CALIB does
+
+        // end of input  check
+        if (line.length() == 0 || line[0] == '\n' || line[0] == '\r') 
+          break;
+
+        if (r != RecvOK)  return false;
+        StringList fields = String::split(line, "[[:space:]=]+");
+        bool ok = fields.size() == 2;
+        double t = ok ? fields.front().toDouble(&ok) : 0.;
+        double f = ok ? fields.back().toDouble(&ok) : 0.;
+        if (!ok) {
+          Protocol::SendError(sock, "Need exactly two numbers per line, seconds and flow!");
+          return false;
+        }
+        pts.push_back(std::make_pair(t, f));
+      }
+    } else if (!WaveShape::Build(shape, params, pts, step, err)) {
+      Protocol::SendError(sock, (name + ": " + err).c_str());
+      return false;
+    }
+    if (!interp.empty()) step = interp == "step";
+
+    olf.lock();
+    WaveTargets targets;
+    if (!waveTargets(name, targets)) {
+      olf.unlock();
+      return false;
+    }
+    for (unsigned i = 0; i < targets.size(); ++i) {
+      WaveShape::Points scaled(pts);
+      for (unsigned j = 0; j < scaled.size(); ++j) scaled[j].second *= targets[i].second;
+      if (!targets[i].first->setWaveform(scaled, step, err)) {
+        olf.unlock();
+        Protocol::SendError(sock, (targets[i].first->name() + ": " + err).c_str());
+        return false;
+      }
+    }
+    olf.unlock();
+    return true;
+}
+
+bool ConnThread::doStartWaveform(StringList &argv)
+{
+    String name = argv.front();
+    argv.pop_front();
+    unsigned loops = 1;
+    double delay = 0.;
+    for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+      StringList kv = String::split(*it, "=");
+      bool ok = kv.size() == 2;
+      const double v = ok ? kv.back().toDouble(&ok) : 0.;
+      if (ok) {
+        if (kv.front() == "loops" && v >= 0.) loops = static_cast<unsigned>(v);
+        else if (kv.front() == "delay_s" && v >= 0.) delay = v;
+        else ok = false;
+      }
+      if (!ok) {
+        Protocol::SendError(sock, (*it + " is not a valid waveform start parameter=value.").c_str());
+        return false;
+      }
+    }
+    olf.lock();
+    WaveTargets targets;
+    if (!waveTargets(name, targets)) {
+      olf.unlock();
+      return false;
+    }
+    // the first controller picks the start time and the rest use it, so
+    // a mix's banks play in step.  The delay needs to cover the fifo
+    // round trips to all of them.
+    const Timer::Time MinDelay = 20000000; // 20ms
+    Timer::Time startAt = 0, d = static_cast<Timer::Time>(delay * 1e9);
+    if (targets.size() > 1 && d < MinDelay) d = MinDelay;
+    for (unsigned i = 0; i < targets.size(); ++i) {
+      if (!targets[i].first->startWaveform(loops, startAt, d)) {
+        for (unsigned j = 0; j < i; ++j) targets[j].first->stopWaveform();
+        olf.unlock();
+        Protocol::SendError(sock, (targets[i].first->name() + ": could not start the waveform, is one loaded and the controller running?").c_str());
+        return false;
+      }
+    }
+    olf.unlock();
+    return true;
+}
+
+bool ConnThread::doStopWaveform(StringList &argv)
+{
+    String name = argv.front();
+    olf.lock();
+    WaveTargets targets;
+    if (!waveTargets(name, targets)) {
+      olf.unlock();
+      return false;
+    }
+    bool ok = true;
+    for (unsigned i = 0; i < targets.size(); ++i) 
+      ok = targets[i].first->stopWaveform() && ok;
+    olf.unlock();
+    if (!ok) Protocol::SendError(sock, (name + ": could not stop the waveform.").c_str());
+    return ok;
+}
+
+bool ConnThread::doGetWaveform(StringList &argv)
+{
+    static const char * const states[] = { "empty", "loaded", "armed", "playing", "done", "aborted" };
+    String name = argv.front();
+    olf.lock();
+    WaveTargets targets;
+    if (!waveTargets(name, targets)) {
+      olf.unlock();
+      return false;
+    }
+    std::ostringstream ss;
+    for (unsigned i = 0; i < targets.size(); ++i) {
+      PIDFlowController *pfc = targets[i].first;
+      Waveform::Control c;
+      if (!pfc->getWaveform(c)) {
+        olf.unlock();
+        Protocol::SendError(sock, (pfc->name() + ": could not query the waveform.").c_str());
+        return false;
+      }
+      const unsigned st = static_cast<unsigned>(c.state) < sizeof(states)/sizeof(*states) ? c.state : 0;
+      ss << pfc->name() << " state=" << states[st] << " points=" << c.n << " loops=" << c.loops
+         << " loops_done=" << c.loopsDone << " t=" << static_cast<double>(c.pos) / pfc->rateHz()
+         << " flow_set=" << c.flow_set << "\n";
+    }
+    olf.unlock();
+    xmit(ss.str());
+    return true;
+}
+
+TrialSequencer *ConnThread::sequencer()
+{
+    TrialSequencer *t = dynamic_cast<TrialSequencer *>(olf.find(TrialSequencer::DefaultName));
+    if (!t) Protocol::SendError(sock, "There is no trial sequencer, is the RT coprocess running?");
+    return t;
+}
+
+bool ConnThread::doSetProgram(StringList &)
+{
+    std::vector<std::string> program;
+    Protocol::SendReady(sock);
+    for (; ;) {
+      std::string line;
+      int r = recvLine(line); // ignoring errors, as SET CALIB does
+
+      // end of input  check
+      if (line.length() == 0 || line[0] == '\n' || line[0] == '\r') 
+        break;
+
+      if (r != RecvOK)  return false;
+      program.push_back(String::trimWS(line));
+    }
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    std::string err;
+    bool ok = t && t->load(program, err);
+    olf.unlock();
+    if (t && !ok) Protocol::SendError(sock, ("Program not loaded: " + err).c_str());
+    return ok;
+}
+
+bool ConnThread::doRunProgram(StringList &)
+{
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    std::string err;
+    bool ok = t && t->run(err);
+    olf.unlock();
+    if (t && !ok) Protocol::SendError(sock, err.c_str());
+    return ok;
+}
+
+bool ConnThread::doStopProgram(StringList &)
+{
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    bool ok = t && t->stop();
+    olf.unlock();
+    if (t && !ok) Protocol::SendError(sock, "Could not stop the program.");
+    return ok;
+}
+
+bool ConnThread::doGetProgram(StringList &)
+{
+    static const char * const states[] = { "empty", "loaded", "armed", "running", "done", "aborted", "failed" };
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    SeqProgram::Control c;
+    if (!t || !t->status(c)) {
+      olf.unlock();
+      if (t) Protocol::SendError(sock, "Could not query the trial sequencer.");
+      return false;
+    }
+    const unsigned st = static_cast<unsigned>(c.state) < sizeof(states)/sizeof(*states) ? c.state : 0;
+    std::ostringstream ss;
+    ss << "state=" << states[st] << " steps=" << c.steps << " step=" << c.pc
+       << " t=" << (t->rateHz() ? static_cast<double>(c.periods) / t->rateHz() : 0.)
+       << " rate_hz=" << t->rateHz();
+    if (c.state == SeqProgram::Failed) ss << " failed_at=" << c.failed_at;
+    ss << "\n";
+    const std::vector<std::string> & program = t->program();
+    for (unsigned i = 0; i < program.size(); ++i)
+      if (!program[i].empty()) ss << program[i] << "\n";
+    olf.unlock();
+    xmit(ss.str());
+    return true;
+}
+
+bool ConnThread::doArmProgram(StringList &)
+{
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    std::string err;
+    bool ok = t && t->arm(err);
+    olf.unlock();
+    if (t && !ok) Protocol::SendError(sock, err.c_str());
+    return ok;
+}
+
+bool ConnThread::doSetTrigger(StringList &argv)
+{
+    bool ok;
+    const unsigned slot = argv.front().toUInt(&ok);
+    if (!ok) {
+      Protocol::SendError(sock, (argv.front() + " is not a trigger slot.").c_str());
+      return false;
+    }
+    argv.pop_front();
+    TrialSequencer::TriggerSpec spec;
+    for (StringList::iterator it = argv.begin(); it != argv.end(); ++it) {
+      StringList kv = String::split(*it, "=");
+      ok = kv.size() == 2;
+      const String v = ok ? kv.back().lower() : String();
+      if (ok && kv.front() == "input") spec.input = kv.back();
+      else if (ok && kv.front() == "edge") ok = TrialSequencer::ParseEdge(v, spec.edge);
+      else if (ok && (kv.front() == "once" || kv.front() == "program")
+               && (v == "yes" || v == "no" || v == "1" || v == "0" || v == "true" || v == "false"))
+        (kv.front() == "once" ? spec.once : spec.startProgram) = v == "yes" || v == "1" || v == "true";
+      else ok = false;
+      if (!ok) {
+        Protocol::SendError(sock, (*it + " is not a valid trigger parameter=value.").c_str());
+        return false;
+      }
+    }
+    if (spec.input.empty()) {
+      Protocol::SendError(sock, "A trigger needs an input=daq_task:chan.");
+      return false;
+    }
+    Protocol::SendReady(sock);
+    for (; ;) {
+      std::string line;
+      int r = recvLine(line); // ignoring errors, as SET CALIB does
+
+      // end of input  check
+      if (line.length() == 0 || line[0] == '\n' || line[0] == '\r') 
+        break;
+
+      if (r != RecvOK)  return false;
+      spec.actions.push_back(String::trimWS(line));
+    }
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    std::string err;
+    ok = t && t->setTrigger(slot, spec, err);
+    olf.unlock();
+    if (t && !ok) Protocol::SendError(sock, ("Trigger not set: " + err).c_str());
+    return ok;
+}
+
+bool ConnThread::doClearTrigger(StringList &argv)
+{
+    bool ok;
+    const unsigned slot = argv.front().toUInt(&ok);
+    if (!ok) {
+      Protocol::SendError(sock, (argv.front() + " is not a trigger slot.").c_str());
+      return false;
+    }
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    ok = t && t->clearTrigger(slot);
+    olf.unlock();
+    if (t && !ok) Protocol::SendError(sock, "Could not clear the trigger.");
+    return ok;
+}
+
+bool ConnThread::doGetTriggers(StringList &)
+{
+    olf.lock();
+    TrialSequencer *t = sequencer();
+    if (!t) {
+      olf.unlock();
+      return false;
+    }
+    std::ostringstream ss;
+    for (unsigned slot = 0; slot < Trigger::MaxTriggers; ++slot) {
+      TrialSequencer::TriggerSpec spec;
+      Trigger st;
+      if (!t->getTrigger(slot, spec, st)) continue;
+      ss << slot << " input=" << spec.input << " edge=" << TrialSequencer::EdgeName(spec.edge)
+         << " once=" << (spec.once ? "yes" : "no") << " program=" << (spec.startProgram ? "yes" : "no")
+         << " armed=" << (st.armed ? "yes" : "no") << " fired=" << st.fired
+         << " last_ns=" << st.last_ns << " actions=";
+      for (unsigned i = 0; i < spec.actions.size(); ++i)
+        if (!spec.actions[i].empty()) ss << (i ? "; " : "") << spec.actions[i];
+      ss << "\n";
+    }
+    olf.unlock();
+    xmit(ss.str());
+    return true;
+}
+
+const Registry::Entry *ConnThread::lookup(const std::string & name) const
+{
+  return reg ? reg->find(name) : 0;
+}
+
+bool ConnThread::calibrating(const Component *c)
+{
+  if (!Calibrator::Busy(c)) return false;
+  Protocol::SendError(sock, (c->name() + " is being calibrated, try again when its CALIBRATE is done.").c_str());
+  return true;
+}
+
+AlarmEngine *ConnThread::alarms()
+{
+    AlarmEngine *a = dynamic_cast<AlarmEngine *>(olf.find(AlarmEngine::DefaultName));
+    if (!a) Protocol::SendError(sock, "There are no alarms, see alarms= in the Layout section.");
+    return a;
+}
+
+bool ConnThread::doGetAlarms(StringList &)
+{
+    olf.lock();
+    AlarmEngine *a = alarms();
+    if (!a) {
+      olf.unlock();
+      return false;
+    }
+    const std::vector<AlarmEngine::Status> st = a->status();
+    olf.unlock();
+    std::ostringstream ss;
+    for (unsigned i = 0; i < st.size(); ++i) {
+      const AlarmEngine::RuleSpec & r = st[i].spec;
+      ss << st[i].rule << " active=" << (st[i].active ? "yes" : "no") << " count=" << st[i].count
+         << " value=" << st[i].value << " signal=" << r.signal;
+      if (r.combine == AlarmEngine::Minus) ss << " combine=minus signal2=" << r.signal2;
+      else if (r.combine == AlarmEngine::Ratio) ss << " combine=ratio signal2=" << r.signal2;
+      if (r.test == AlarmEngine::NoResponse) ss << " cause=" << r.cause;
+      else ss << " for_ms=" << r.forMs;
+      ss << " test=" << AlarmEngine::TestString(r) << "\n";
+    }
+    xmit(ss.str());
+    return true;
+}
+
+bool ConnThread::doWatchAlarms(StringList &)
+{
+    olf.lock();
+    AlarmEngine *a = alarms();
+    olf.unlock();
+    if (!a) return false;
+    std::vector<AlarmEngine::Event> evts;
+    unsigned since = a->events(~0U, evts); // just the newest one's number, we start from now
+    Protocol::SendOK(sock);
+    static const struct timespec ts = { tv_sec : 0, tv_nsec : 50000000 };
+    while (1) {
+      ::pthread_testcancel();
+      since = a->events(since, evts);
+      for (unsigned i = 0; i < evts.size(); ++i) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%f %s %s %f\n", evts[i].ts_ns / 1000000000.000000,
+                 evts[i].rule.c_str(), evts[i].raised ? "alarm" : "clear", evts[i].value);
+        xmit(buf);
+      }
+      ::clock_nanosleep(CLOCK_REALTIME, 0, &ts, 0);
+    }
+    // never reached!
+    return false;
+}
+
+bool ConnThread::doStart(StringList &argv)
+{
+    String name = argv.front();
+    olf.lock();
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    StartStoppable *s = dynamic_cast<StartStoppable *>(c);
+    StartStoppable *s = e->startStoppable;
     if ( !s ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a start/stopable object.").c_str());
       return false;
     }
+    if (calibrating(e->comp)) {
+      olf.unlock();
+      return false;
+    }
     bool res = s->start();
     olf.unlock();
     if (!res) {
@@ -1641,18 +2513,22 @@ bool ConnThread::doStop(StringList &argv)
 {
     String name = argv.front();
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    StartStoppable *s = dynamic_cast<StartStoppable *>(c);
+    StartStoppable *s = e->startStoppable;
     if ( !s ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a start/stopable object.").c_str());
       return false;
     }
+    if (calibrating(e->comp)) {
+      olf.unlock();
+      return false;
+    }
     bool res = s->stop();
     olf.unlock();
     if (!res) {
@@ -1666,13 +2542,13 @@ bool ConnThread::doRunning(StringList &argv)
 {
     String name = argv.front();
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    StartStoppable *s = dynamic_cast<StartStoppable *>(c);
+    StartStoppable *s = e->startStoppable;
     if ( !s ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a start/stopable object.").c_str());
@@ -1689,20 +2565,13 @@ bool ConnThread::doRead(StringList &argv)
 {
     String name = argv.front();
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    Readable *r = dynamic_cast<Readable *>(c);
-    if ( !r ) {
-      // component itself not a sensor/actuator, but try and find one in the
-      // child list
-      std::list<Component *> chlds = c->children(false);
-      for (std::list<Component *>::iterator it = chlds.begin();  it != chlds.end() && !r; ++it)
-        r = dynamic_cast<Readable *>(*it);
-    }
+    Readable *r = e->readable;
     if ( !r ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a readable and/or it does not contain any readables as subcomponents.").c_str());
@@ -1720,20 +2589,13 @@ bool ConnThread::doReadRaw(StringList &argv)
 {
     String name = argv.front();
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    Readable *r = dynamic_cast<Readable *>(c);
-    if ( !r ) {
-      // component itself not a sensor/actuator, but try and find one in the
-      // child list
-      std::list<Component *> chlds = c->children(false);
-      for (std::list<Component *>::iterator it = chlds.begin();  it != chlds.end() && !r; ++it)
-        r = dynamic_cast<Readable *>(*it);
-    }
+    Readable *r = e->readable;
     if ( !r ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a readable and/or it does not contain any readables as subcomponents.").c_str());
@@ -1758,25 +2620,22 @@ bool ConnThread::doWrite(StringList &argv)
       return false;
     }
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    Writeable *w = dynamic_cast<Writeable *>(c);
-    if ( !w ) {
-      // component itself not an actuator, but try and find one in the
-      // child list
-      std::list<Component *> chlds = c->children(false);
-      for (std::list<Component *>::iterator it = chlds.begin();  it != chlds.end() && !w; ++it)
-        w = dynamic_cast<Writeable *>(*it);
-    }
+    Writeable *w = e->writeable;
     if ( !w ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not an writeable and/or it does not contain any writeables as subcomponents.").c_str());
       return false;
     }
+    if (calibrating(e->comp)) {
+      olf.unlock();
+      return false;
+    }
     ok = w->write(val);
     olf.unlock();
     if (!ok) {
@@ -1798,25 +2657,22 @@ bool ConnThread::doWriteRaw(StringList &argv)
       return false;
     }
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    Writeable *w = dynamic_cast<Writeable *>(c);
-    if ( !w) {
-      // component itself not an actuator, but try and find one in the
-      // child list
-      std::list<Component *> chlds = c->children(false);
-      for (std::list<Component *>::iterator it = chlds.begin();  it != chlds.end() && !w; ++it)
-        w = dynamic_cast<Writeable *>(*it);
-    }
+    Writeable *w = e->writeable;
     if ( !w ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not an writeable and/or it does not contain any writeables as subcomponents.").c_str());
       return false;
     }
+    if (calibrating(e->comp)) {
+      olf.unlock();
+      return false;
+    }
     ok = w->writeRaw(val);
     olf.unlock();
     if (!ok) {
@@ -1831,20 +2687,13 @@ bool ConnThread::doSave(StringList &argv)
 {
     String name = argv.front(); argv.pop_front();
     olf.lock();
-    Component *c = olf.find(name);
-    if (!c) {
+    const Registry::Entry *e = lookup(name);
+    if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
     }
-    Saveable *s = dynamic_cast<Saveable *>(c);
-    if ( !s ) {
-      // component itself not a Saveable, but try and find one in the
-      // child list
-      std::list<Component *> chlds = c->children(false);
-      for (std::list<Component *>::iterator it = chlds.begin();  it != chlds.end() && !s; ++it)
-        s = dynamic_cast<Saveable *>(*it);
-    }
+    Saveable *s = e->saveable;
     if ( !s ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a saveable and/or it does not contain any saveables as subcomponents.").c_str());
@@ -1879,13 +2728,13 @@ bool ConnThread::doIsDataLogging(StringList &args)
     return false;    
   }
   olf.lock();
-  Component *c = olf.find(name);
-  if (!c) {
+  const Registry::Entry *e = lookup(name);
+  if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
   }
-  DataLogable *d = dynamic_cast<DataLogable *>(c);
+  DataLogable *d = e->dataLogable;
   if ( !d ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a data-logable component.").c_str());
@@ -1919,13 +2768,13 @@ bool ConnThread::doSetDataLogging(StringList &args)
     return false;    
   }  
   olf.lock();
-  Component *c = olf.find(name);
-  if (!c) {
+  const Registry::Entry *e = lookup(name);
+  if (!e) {
       olf.unlock();
       Protocol::SendError(sock, (name + " not found.").c_str());
       return false;
   }
-  DataLogable *d = dynamic_cast<DataLogable *>(c);
+  DataLogable *d = e->dataLogable;
   if ( !d ) {
       olf.unlock();
       Protocol::SendError(sock, (name + " is not a data-logable component.").c_str());
@@ -1992,7 +2841,8 @@ bool ConnThread::doGetDataLog(StringList &args)
   /* NB the below code is slightly ugly but it's optimized to minimize
      CPU load, etc.  
       - Using snprintf seems faster than ostringstream for some reason
-      - Using an id cache for the slow component name lookup by id..   */
+      - Using an id cache so each id's name is copied out of the
+        registry just once..   */
   std::map<unsigned, std::string> idCache;
   std::map<unsigned, std::string>::const_iterator idc_it;
   std::list<DataEvent>::iterator it;
@@ -2003,7 +2853,7 @@ bool ConnThread::doGetDataLog(StringList &args)
   for (it = evts.begin(); it != evts.end(); ++it) {
     const DataEvent & e = *it;
     if ( (idc_it = idCache.find(e.id)) == idCache.end() ) {
-      idCache[e.id] = Component::nameFromId(e.id);
+      idCache[e.id] = reg ? reg->nameOf(e.id) : Component::nameFromId(e.id);
       idc_it = idCache.find(e.id);
     }
     bufpos += snprintf(buf+bufpos, bufsz-bufpos, "%f %s %s %f\n", 
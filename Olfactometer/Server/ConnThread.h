@@ -4,10 +4,15 @@
 #include <map>
 #include <pthread.h>
 #include <string>
+#include <vector>
 #include "Common.h"
+#include "Registry.h"
 
 class Olfactometer;
 class Bank;
+class PIDFlowController;
+class TrialSequencer;
+class AlarmEngine;
 
 class ConnThread
 {
@@ -79,12 +84,32 @@ private:
   bool doMonitor(StringList &argv);
   bool doSetDesiredTotalFlow(StringList &argv);
   bool doList(StringList &argv);
+  bool doGetState(StringList &argv);
   bool doGetControlParams(StringList &argv);
   bool doSetControlParams(StringList &argv);
   bool doGetCoeffs(StringList &argv);
   bool doSetCoeffs(StringList &argv);
   bool doGetCalib(StringList &argv);
   bool doSetCalib(StringList &argv);
+  bool doCalibrate(StringList &argv);
+  bool doAutoTune(StringList &argv);
+  bool doIdentify(StringList &argv);
+  bool doSetWaveform(StringList &argv);
+  bool doStartWaveform(StringList &argv);
+  bool doStopWaveform(StringList &argv);
+  bool doGetWaveform(StringList &argv);
+  TrialSequencer *sequencer(); ///< sends an error if there isn't one
+  bool doSetProgram(StringList &argv);
+  bool doRunProgram(StringList &argv);
+  bool doStopProgram(StringList &argv);
+  bool doGetProgram(StringList &argv);
+  bool doArmProgram(StringList &argv);
+  bool doSetTrigger(StringList &argv);
+  bool doClearTrigger(StringList &argv);
+  bool doGetTriggers(StringList &argv);
+  AlarmEngine *alarms(); ///< sends an error if there isn't one
+  bool doGetAlarms(StringList &argv);
+  bool doWatchAlarms(StringList &argv);
   bool doStart(StringList &args);
   bool doStop(StringList &args);
   bool doRunning(StringList &args);
@@ -104,6 +129,7 @@ private:
   double startTime;
   std::string remoteHost;
   Olfactometer & olf;
+  Registry *reg; ///< olf's, null if it hasn't one
   int timeout_ms;
 
   enum PollStatus { PollError = 0, PollAgain, PollTimedOut, PollOK, PollOk = PollOK };
@@ -120,7 +146,20 @@ private:
   bool xmitBuf(const void *buf, size_t num, bool isBinary = false, bool logXmission = true);
 
   // caller must hold olf. lock!!
-  String dumpOdorTable(Bank *b) const;
+  String dumpOdorTable(Bank *b, const char *linePrefix = "") const;
+  /// name's component and interfaces, or null if there's no such
+  /// component.  Caller must hold olf. lock!!
+  const Registry::Entry *lookup(const std::string & name) const;
+  /// true, having sent the error, if c or something under it is being
+  /// calibrated (see Calibrator::reserve()).  Caller must hold olf. lock!!
+  bool calibrating(const Component *c);
+
+  /// the pid flow controllers a waveform command on name drives, with
+  /// the fraction of the waveform each gets: name itself, or each bank
+  /// of a mix by its mixture ratio.  Sends the error if there are none.
+  /// Caller must hold olf. lock!!
+  typedef std::vector<std::pair<PIDFlowController *, double> > WaveTargets;
+  bool waveTargets(const String & name, WaveTargets & out);
 
   typedef std::map<pthread_t, ConnThread *> ThreadMap;
   static pthread_mutex_t mut; // mutex for 'threads' below..
@@ -1,6 +1,8 @@
 #include "DAQTaskProxy.h"
 #include "RTLCoprocess.h"
 #include <string>
+#include <string.h>
+#include <math.h>
 
 DAQTaskProxy::DAQTaskProxy(const std::string & name_in, 
                            RTLCoprocess *coprocess, 
@@ -11,13 +13,15 @@ DAQTaskProxy::DAQTaskProxy(const std::string & name_in,
                            unsigned range, 
                            unsigned aref,
                            bool dio_out,
-                           const double * rangeOvrMin, const double *rangeOvrMax)
+                           const double * rangeOvrMin, const double *rangeOvrMax,
+                           const ThreadAttrs *thread,
+                           bool writeOnChange, unsigned refreshMs)
   : nam(name_in)
 {
   this->coprocess = coprocess;
   unsigned mask = 0;
   for (unsigned i = fromchan; i <= tochan && i < sdev->nChans; ++i) mask |= 0x1<<i;
-  handle = coprocess->createDAQ(name(), rate_hz, sdev->minor, sdev->id, mask, range, aref, dio_out, rangeOvrMin, rangeOvrMax);
+  handle = coprocess->createDAQ(name(), rate_hz, sdev->minor, sdev->id, mask, range, aref, dio_out, rangeOvrMin, rangeOvrMax, thread, writeOnChange, refreshMs);
   m_fromChan = fromchan;
   m_toChan = tochan;
   m_sdev = sdev->id;
@@ -52,6 +56,98 @@ bool DAQTaskProxy::writeSample(unsigned chan, lsampl_t samp)
   return coprocess->putSample(handle, chan, samp);
 }
 
+/*static*/
+bool DAQTaskProxy::writeBits(const std::vector<Bits> & w)
+{
+  if (w.empty()) return true;
+  std::vector<RTLCoprocess::Bits> b(w.size());
+  for (unsigned i = 0; i < w.size(); ++i) {
+    if (w[i].daq->coprocess != w[0].daq->coprocess || w[i].daq->handle == RTLCoprocess::Failure) return false;
+    b[i].h = w[i].daq->handle;
+    b[i].mask = w[i].mask;
+    b[i].bits = w[i].bits;
+  }
+  return w[0].daq->coprocess->putBits(b);
+}
+
+bool DAQTaskProxy::getAccum(DAQAccum & out)
+{
+  return coprocess->getAccum(handle, out);
+}
+
+bool DAQTaskProxy::setChanDivisor(unsigned chan, unsigned divisor)
+{
+  return coprocess->setChanDivisor(handle, chan, divisor);
+}
+
+bool DAQTaskProxy::setOversample(unsigned n)
+{
+  return coprocess->setOversample(handle, n);
+}
+
+bool DAQTaskProxy::setChanFilter(unsigned chan, const DAQFilter & f)
+{
+  return coprocess->setChanFilter(handle, chan, f);
+}
+
+/*static*/
+bool DAQTaskProxy::DesignFilter(const std::string & spec, double rateHz, DAQFilter & f, std::string & err)
+{
+  ::memset(&f, 0, sizeof(f));
+  StringList p = String::split(spec, ":");
+  const String kind = p.size() ? p.front().lower() : String();
+  double b[3], a[2];
+  bool ok = p.size() == 2;
+  if (kind == "none" && p.size() == 1) {
+    return true;
+  } else if (kind == "lowpass" && ok) {
+    const double fc = p.back().toDouble(&ok);
+    if (!ok || !(fc > 0.) || !(fc < rateHz / 2.)) {
+      err = "lowpass cutoff " + p.back() + " must be between 0 and half the task's rate";
+      return false;
+    }
+    // RBJ cookbook biquad, Q = 1/sqrt(2)
+    const double w0 = 2. * M_PI * fc / rateHz, cw = ::cos(w0), alpha = ::sin(w0) / (2. * M_SQRT1_2),
+                 a0 = 1. + alpha;
+    b[0] = b[2] = (1. - cw) / 2. / a0;
+    b[1] = (1. - cw) / a0;
+    a[0] = -2. * cw / a0;
+    a[1] = (1. - alpha) / a0;
+  } else if (kind == "biquad" && ok) {
+    StringList c = String::split(p.back(), ",");
+    ok = c.size() == 5;
+    double *v[5] = { b, b+1, b+2, a, a+1 };
+    for (unsigned i = 0; ok && i < 5; ++i, c.pop_front()) *v[i] = c.front().toDouble(&ok);
+    if (!ok) {
+      err = "biquad takes 5 coefficients, b0,b1,b2,a1,a2";
+      return false;
+    }
+  } else {
+    err = "filter " + spec + " is not none, lowpass:HZ or biquad:b0,b1,b2,a1,a2";
+    return false;
+  }
+  const double scale = double(1 << DAQFilter::FracBits), lim = double(1U << (31 - DAQFilter::FracBits));
+  for (unsigned i = 0; i < 5; ++i) {
+    const double v = i < 3 ? b[i] : a[i-3];
+    if (!(v > -lim && v < lim)) {
+      err = "filter coefficients must lie within +/-8";
+      return false;
+    }
+    (i < 3 ? f.b[i] : f.a[i-3]) = static_cast<int>(v * scale + (v < 0. ? -0.5 : 0.5));
+  }
+  // a filter meant to pass DC unchanged (any lowpass) should do so exactly
+  // once quantized too, else a steady input settles a few LSBs off.  Its
+  // DC gain is sum(b) / (1 + a1 + a2), so put what rounding lost into b1.
+  const long long one = 1LL << DAQFilter::FracBits,
+                  den = one + f.a[0] + f.a[1],
+                  num = static_cast<long long>(f.b[0]) + f.b[1] + f.b[2];
+  if (num != den && ::fabs(b[0] + b[1] + b[2] - (1. + a[0] + a[1])) * scale < 4.) {
+    const double b1 = double(f.b[1]) + double(den - num);
+    if (b1 > -lim * scale && b1 < lim * scale) f.b[1] = static_cast<int>(b1);
+  }
+  return true;
+}
+
 bool DAQTaskProxy::setDataLogging(unsigned chan, bool b, unsigned id)
 {
   return coprocess->setLogging(handle, b, chan, id);
@@ -2,6 +2,7 @@
 #define DAQTaskProxy_H
 
 #include <string>
+#include <vector>
 #include "RTLCoprocess.h"
 #include <comedilib.h>
 #include "ComediDevice.h"
@@ -15,7 +16,9 @@ public:
                unsigned fromchan, unsigned tochan, 
                unsigned range = 0, unsigned aref = 0,
                bool ifDIOIsOutput = true,
-               const double * rangeOvrMin = 0, const double *rangeOvrMax = 0);
+               const double * rangeOvrMin = 0, const double *rangeOvrMax = 0,
+               const ThreadAttrs *thread = 0,
+               bool writeOnChange = false, unsigned refreshMs = 0);
   ~DAQTaskProxy();
 
   bool start();
@@ -31,6 +34,30 @@ public:
 
   lsampl_t readSample(unsigned chan, bool *ok = 0);
   bool writeSample(unsigned chan, lsampl_t samp);
+  /// one task's part of a writeBits(): its lines in mask set to bits
+  struct Bits { DAQTaskProxy *daq; unsigned mask, bits; };
+  /// sets lines on one or more output tasks (all on the same coprocess)
+  /// in one go, see RTLCoprocess::putBits()
+  static bool writeBits(const std::vector<Bits> & w);
+  /// running sums of all samples read so far, only meaningful for 
+  /// periodic (rate_hz > 0) input tasks
+  bool getAccum(DAQAccum & out);
+  /// has chan read only every divisor'th period, periodic analog input
+  /// tasks only
+  bool setChanDivisor(unsigned chan, unsigned divisor);
+  /// reads each period's channels n times and averages them, periodic
+  /// analog input tasks only, before start()
+  bool setOversample(unsigned n);
+  /// has chan's samples filtered before they're read, periodic analog
+  /// input tasks only
+  bool setChanFilter(unsigned chan, const DAQFilter & f);
+  /** Designs f from spec, for a task reading at rateHz:
+        none                      no filter
+        lowpass:HZ                2nd order Butterworth lowpass
+        biquad:b0,b1,b2,a1,a2     as given (a0 is 1)
+      False with err set if spec is bad or the filter won't fit
+      DAQFilter's fixed point. */
+  static bool DesignFilter(const std::string & spec, double rateHz, DAQFilter & f, std::string & err);
 
   bool setDataLogging(unsigned chan, bool, unsigned id);
   bool getDataLogging(unsigned chan);
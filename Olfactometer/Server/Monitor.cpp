@@ -1,7 +1,9 @@
 #include "Monitor.h"
+#include "PIDFlowController.h"
 #include "Log.h"
 #include "Conf.h"
 #include <time.h>
+#include <algorithm>
 
 static inline bool RoughlyEqual(double a, double b, double thresh = 0.1)
 {
@@ -11,7 +13,7 @@ static inline bool RoughlyEqual(double a, double b, double thresh = 0.1)
 }
 
 Monitor::Monitor()
-  : olf(0), running(false)
+  : olf(0), coprocess(0), running(false), rtFaultsPolled(false), rtFaultBeeps(0)
 {}
 
 Monitor::~Monitor() { stop(); }
@@ -25,7 +27,7 @@ void Monitor::stop()
   }
 }
 
-bool Monitor::start(const Settings &settings, Olfactometer * o)
+bool Monitor::start(const Settings &settings, Olfactometer * o, RTLCoprocess *c)
 {
   if (running) {
     Error() << "Monitor already running!\n";
@@ -36,6 +38,9 @@ bool Monitor::start(const Settings &settings, Olfactometer * o)
     return false;
   }
   olf = o;
+  coprocess = c;
+  rtFaultsPolled = false;
+  rtFaultBeeps = 0;
   bool ok;
   gas_panic_secs = String::toInt(settings.get(Conf::Sections::Monitor, Conf::Keys::gas_panic_secs), &ok);
   if (!ok) gas_panic_secs = 1;
@@ -74,15 +79,56 @@ void *Monitor::threadFuncWrapper(void * arg)
 
 void Monitor::threadFunc()
 {
-  for (;;) { // loop infinitely.. note we do get cancelled in d'tor or stop()
+  for (unsigned tick = 0; ; ++tick) { // loop infinitely.. note we do get cancelled in d'tor or stop()
     ::pthread_testcancel();
     
-    checkGasPanic();
+    checkRTFaults();
+
+    // the rest is once a second
+    if (tick % (1000/PollMs) == 0) {
+      checkGasPanic();
+      if (rtFaultBeeps > 0) {
+        --rtFaultBeeps;
+        beepAlarm();
+      }
+    }
 
-    // we sleep and poll every second..
-    static const struct timespec oneSec = { tv_sec : 1, tv_nsec : 0 };
-    ::clock_nanosleep(CLOCK_REALTIME, 0, &oneSec, 0);
+    static const struct timespec poll = { tv_sec : 0, tv_nsec : PollMs*1000000 };
+    ::clock_nanosleep(CLOCK_REALTIME, 0, &poll, 0);
+  }
+}
+
+void Monitor::checkRTFaults()
+{
+  std::vector<RTLCoprocess::PIDFault> faults;
+  if (!coprocess || !coprocess->getPIDFaults(faults)) return;
+  // the coprocess has already acted on these, we just tell people
+  std::vector<RTLCoprocess::Handle> tripped;
+  rtFaultCounts.resize(faults.size());
+  for (unsigned h = 0; h < faults.size(); ++h) {
+    if (rtFaultsPolled && faults[h].count != rtFaultCounts[h]) tripped.push_back(h);
+    rtFaultCounts[h] = faults[h].count;
+  }
+  rtFaultsPolled = true;
+  if (tripped.empty()) return;
+
+  olf->lock();
+  std::list<Component *> comps = olf->children(true);
+  std::list<Component *>::iterator it;
+  for (it = comps.begin(); it != comps.end(); ++it) {
+    PIDFlowController *pfc = dynamic_cast<PIDFlowController *>(*it);
+    if (!pfc || pfc->rtCoprocess() != coprocess
+        || std::find(tripped.begin(), tripped.end(), pfc->rtHandle()) == tripped.end())
+      continue;
+    if (pfc->faultStops()) {
+      Error() << "Flow controller " << pfc->name() << " appears to have no gas input supply, its flow was stopped! Please fix!\n";
+      pfc->setFlow(0); // the coprocess already has, this brings our commanded flow in line
+    } else {
+      Error() << "Flow controller " << pfc->name() << " appears to have no gas input supply! Please fix!\n";
+    }
   }
+  olf->unlock();
+  if (gas_panic_doBeep) rtFaultBeeps = gas_panic_beeps;
 }
 
 void Monitor::checkGasPanic()
@@ -96,6 +142,9 @@ void Monitor::checkGasPanic()
   std::list<Component *>::iterator it;
   for (it = comps.begin(); it != comps.end(); ++it) {
     fc = dynamic_cast<FlowController *>(*it);
+    // checkRTFaults() covers these, and sooner
+    PIDFlowController *pfc = dynamic_cast<PIDFlowController *>(fc);
+    if (pfc && pfc->faultDetect()) continue;
     if (fc 
         && !RoughlyEqual(fc->commandedFlow(), 0, 0.01)
         && RoughlyEqual(fc->flow(), 0, fc->errorMagnitude()/2) ) {
@@ -133,12 +182,7 @@ void Monitor::doGasPanic()
 {
   if (gas_panic_doBeep && gasPanic.alarm_count < gas_panic_beeps) 
   {
-    for (int freq = 220; freq < 220*2; ++freq) {
-        beep(freq, 1);
-        static const struct timespec ts = { tv_sec  : 0, 
-                                            tv_nsec : 1000000000/100 };
-        ::nanosleep(&ts, 0);
-    }
+    beepAlarm();
     ++gasPanic.alarm_count;
   } 
   /* test if we already beeped enough times, and if so, stop the offending 
@@ -156,6 +200,16 @@ void Monitor::doGasPanic()
   }
 }
 
+void Monitor::beepAlarm()
+{
+  for (int freq = 220; freq < 220*2; ++freq) {
+      beep(freq, 1);
+      static const struct timespec ts = { tv_sec  : 0, 
+                                          tv_nsec : 1000000000/100 };
+      ::nanosleep(&ts, 0);
+  }
+}
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -2,29 +2,45 @@
 #define Monitor_H
 
 #include "Olfactometer.h"
+#include "RTLCoprocess.h"
 #include "Settings.h"
 #include "Common.h"
 #include <pthread.h>
 #include <list>
+#include <vector>
 
+/**
+   Watches for flow controllers that aren't getting any gas.  The
+   coprocess's PID flow controllers detect that themselves, within their
+   fault debounce (see PIDFCParams::fault_debounce); the monitor polls
+   their fault flags every PollMs, logs each trip and beeps.  Flow
+   controllers without RT fault detection get the old once a second
+   commanded vs. actual flow check, gas_panic_* in the ini.
+*/
 class Monitor
 {
 public:
+  enum { PollMs = 100 };
+
   Monitor();
   ~Monitor();
 
-  bool start(const Settings & settings, Olfactometer *olf);
+  /// coprocess may be null, then there are no RT faults to poll
+  bool start(const Settings & settings, Olfactometer *olf, RTLCoprocess *coprocess = 0);
   void stop();
 
 private: /* funcs */
   static void *threadFuncWrapper(void *);
   void threadFunc();
 
+  void checkRTFaults();
   void checkGasPanic();
   void doGasPanic();
+  void beepAlarm();
 
 private: /* data */
   Olfactometer *olf;
+  RTLCoprocess *coprocess;
   bool running;
   pthread_t thr;
   int gas_panic_secs;
@@ -39,6 +55,12 @@ private: /* data */
     int alarm_count;
   } gasPanic;
 
+  /// the fault counts at the last poll, by PID handle, and the alarm
+  /// beeps still to go for the trips seen since
+  std::vector<unsigned> rtFaultCounts;
+  bool rtFaultsPolled;
+  int rtFaultBeeps;
+
 };
 
 
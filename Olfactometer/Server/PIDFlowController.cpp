@@ -7,6 +7,7 @@
 #include <comedilib.h>
 #include "Common.h"
 #include <sstream>
+#include <math.h>
 #include <algorithm>
 
 
@@ -17,7 +18,8 @@ PIDFlowController(Settings & ini,
                   const ComediChan *he, const ComediChan *se,
                   Component *parent, const std::string &fcname)
   : FlowController(0, 0, parent, fcname), DOEnableable(this, he, se),
-    valid(false), ini(ini)
+    feedForward(false), smithK(0.), smithTau(0.), smithTheta(0.),
+    valid(false), lutMode(LUTFit), maxdata_ai(rd.maxData()), ini(ini)
     
 {  
   this->coprocess = coprocess;
@@ -141,6 +143,81 @@ PIDFlowController(Settings & ini,
     error_str = String("Configuration file error: ") + fcname + " missing valid " + Conf::Keys::num_Ki_points + "\n";
     return;
   }
+  std::string integ = ini.get(fcname, Conf::Keys::integrator);
+  if (integ == "exponential") params.controlParams.integrator = PID::ControlParams::Exponential;
+  else if (integ.length() && integ != "window") {
+    error_str = String("Configuration file error: ") + fcname + " has an invalid " + Conf::Keys::integrator + " of " + integ + ", expected window or exponential\n";
+    return;
+  }
+  std::string aw = ini.get(fcname, Conf::Keys::anti_windup);
+  if (aw == "conditional") params.controlParams.antiWindup = PID::ControlParams::Conditional;
+  else if (aw == "backcalc") {
+    params.controlParams.antiWindup = PID::ControlParams::BackCalculation;
+    std::string g = ini.get(fcname, Conf::Keys::anti_windup_gain);
+    params.controlParams.Kaw = g.length() ? String(g).toDouble(&valid) : 0.5;
+    if (!valid || params.controlParams.Kaw <= 0. || params.controlParams.Kaw > 1.) {
+      error_str = String("Configuration file error: ") + fcname + ": " + Conf::Keys::anti_windup_gain + " must be in (0,1]\n";
+      return;
+    }
+  } else if (aw.length() && aw != "none") {
+    error_str = String("Configuration file error: ") + fcname + " has an invalid " + Conf::Keys::anti_windup + " of " + aw + ", expected none, conditional or backcalc\n";
+    return;
+  }
+  std::string dm = ini.get(fcname, Conf::Keys::d_on_measurement);
+  if (dm == "yes" || dm == "1" || dm == "true") params.controlParams.dOnMeasurement = true;
+  else if (dm.length() && dm != "no" && dm != "0" && dm != "false") {
+    error_str = String("Configuration file error: ") + fcname + ": " + Conf::Keys::d_on_measurement + ": expected yes or no\n";
+    return;
+  }
+  std::string df = ini.get(fcname, Conf::Keys::d_filter_ms);
+  if (df.length()) {
+    params.controlParams.dFilterMs = String(df).toDouble(&valid);
+    if (!valid || params.controlParams.dFilterMs < 0.) {
+      error_str = String("Configuration file error: ") + fcname + ": " + Conf::Keys::d_filter_ms + " must be a number >= 0\n";
+      return;
+    }
+  }
+  std::string fault_err;
+  if (!faultParams(fault_err)) {
+    error_str = String("Configuration file error: ") + fcname + ": " + fault_err + "\n";
+    return;
+  }
+  schedule = Conf::Parse::gainSchedule(ini.get(fcname, Conf::Keys::gain_schedule));
+  std::string thread_err = Conf::Parse::threadAttrs(ini, fcname, params.thread);
+  if (thread_err.length()) {
+    error_str = String("Configuration file error: ") + fcname + ": " + thread_err + "\n";
+    return;
+  }
+  std::string lut = ini.get(fcname, Conf::Keys::calib_lut);
+  if (lut == "off") lutMode = LUTOff;
+  else if (lut == "table") lutMode = LUTTable;
+  else if (lut.length() && lut != "fit") {
+    error_str = String("Configuration file error: ") + fcname + " has an invalid " + Conf::Keys::calib_lut + " of " + lut + ", expected fit, table or off\n";
+    return;
+  }
+  std::string ff = ini.get(fcname, Conf::Keys::feed_forward);
+  if (ff == "yes" || ff == "1" || ff == "true") feedForward = true;
+  else if (ff.length() && ff != "no" && ff != "0" && ff != "false") {
+    error_str = String("Configuration file error: ") + fcname + ": " + Conf::Keys::feed_forward + ": expected yes or no\n";
+    return;
+  }
+  if (!buildFeedForward())
+    Warning() << "PID FlowController " << fcname << " has " << Conf::Keys::feed_forward << " on but no usable " << Conf::Keys::valve_table << ", feed-forward is off until one is calibrated\n";
+  std::string ctl = ini.get(fcname, Conf::Keys::controller);
+  if (ctl == "smith") {
+    bool okK, okT, okD;
+    const double K = String(ini.get(fcname, Conf::Keys::model_gain)).toDouble(&okK),
+      tau = String(ini.get(fcname, Conf::Keys::model_tau_s)).toDouble(&okT),
+      theta = String(ini.get(fcname, Conf::Keys::model_dead_s)).toDouble(&okD);
+    std::string err = "missing " + Conf::Keys::model_gain + ", " + Conf::Keys::model_tau_s + " or " + Conf::Keys::model_dead_s;
+    if (!okK || !okT || !okD || !smithParams(K, tau, theta, err)) {
+      error_str = String("Configuration file error: ") + fcname + ": " + Conf::Keys::controller + " smith: " + err + "\n";
+      return;
+    }
+  } else if (ctl.length() && ctl != "pid") {
+    error_str = String("Configuration file error: ") + fcname + " has an invalid " + Conf::Keys::controller + " of " + ctl + ", expected pid or smith\n";
+    return;
+  }
   if (!rd.getDAQ()) {
     error_str = String("Configuration file error: ") + fcname + " needs a rt_daq_task for its read channel specification!\n";
     return;
@@ -158,6 +235,8 @@ PIDFlowController(Settings & ini,
     return;
   }
 
+  if (!uploadLUT())
+    Warning() << "PID FlowController " << fcname << " could not upload its calibration lookup table, using the cubic\n";
 
   if (!start()) {
     error_str = String("Internal Error: Could not start PID Flow Controller ") + fcname + " as the realtime coprocess returned a failure status.\n";
@@ -207,8 +286,233 @@ bool PIDFlowController::getControlParams(std::vector<double> & ret1, unsigned &
 
 bool PIDFlowController::setControlParams(const std::vector<double> & kpkikd, unsigned n) 
 {
-  return handle != RTLCoprocess::Failure &&
-    coprocess->setControlParams(handle, kpkikd, n);
+  if (handle == RTLCoprocess::Failure || kpkikd.size() < 3 
+      || !coprocess->setControlParams(handle, kpkikd, n)) 
+    return false;
+  // keep our copy current for saveParams() and valveDirection()
+  params.controlParams.Kp = kpkikd[0];
+  params.controlParams.Ki = kpkikd[1];
+  params.controlParams.Kd = kpkikd[2];
+  params.controlParams.numIntgrlPts = n;
+  return true;
+}
+
+int PIDFlowController::valveDirection() const
+{
+  if (valveTable.size() >= 2)
+    return valveTable.rbegin()->second >= valveTable.begin()->second ? 1 : -1;
+  // u = Kp * (actual - set) is added to the valve voltage
+  return params.controlParams.Kp > 0. ? -1 : 1;
+}
+
+std::vector<double> PIDFlowController::loopGains(double Kc, double Ti) const
+{
+  // doPID() is a velocity form with e = actual - set and T in ms
+  const double T = 1. / params.rate_hz;
+  std::vector<double> g(3, 0.);
+  g[0] = -Kc * T / Ti;
+  g[2] = -Kc * T * 1e3;
+  return g;
+}
+
+bool PIDFlowController::smithParams(double K, double tau, double theta, std::string & err)
+{
+  const double T = 1. / params.rate_hz;
+  if (K == 0. || !(tau > 0.) || !(theta >= 0.)) {
+    err = "the model needs a nonzero gain, a time constant > 0 and a dead time >= 0";
+    return false;
+  }
+  const unsigned delay = static_cast<unsigned>(theta / T + 0.5);
+  if (delay >= PIDFCParams::SmithMaxDelay) {
+    std::ostringstream os;
+    os << "a dead time of " << theta << "s is more than " << (PIDFCParams::SmithMaxDelay - 1) << " periods at " << params.rate_hz << "Hz";
+    err = os.str();
+    return false;
+  }
+  params.ctl_type = PIDFCParams::SmithPredictor;
+  params.smith_a = exp(-T / tau);
+  params.smith_b = K * (1. - params.smith_a);
+  params.smith_delay = delay;
+  smithK = K, smithTau = tau, smithTheta = theta;
+  return true;
+}
+
+bool PIDFlowController::setSmithModel(double K, double tau, double theta)
+{
+  const PIDFCParams old = params;
+  const double oldK = smithK, oldTau = smithTau, oldTheta = smithTheta;
+  std::string err;
+  if (handle != RTLCoprocess::Failure && smithParams(K, tau, theta, err)
+      && coprocess->setSmithModel(handle, params.ctl_type, params.smith_a, params.smith_b, params.smith_delay))
+    return true;
+  params = old;
+  smithK = oldK, smithTau = oldTau, smithTheta = oldTheta;
+  return false;
+}
+
+bool PIDFlowController::clearSmithModel()
+{
+  if (handle == RTLCoprocess::Failure
+      || !coprocess->setSmithModel(handle, PIDFCParams::PlainPID, params.smith_a, params.smith_b, params.smith_delay))
+    return false;
+  params.ctl_type = PIDFCParams::PlainPID;
+  return true;
+}
+
+bool PIDFlowController::startRelayTune(const RelayTune & t)
+{
+  return handle != RTLCoprocess::Failure && coprocess->startRelayTune(handle, t);
+}
+
+bool PIDFlowController::getRelayTune(RelayTune & out)
+{
+  return handle != RTLCoprocess::Failure && coprocess->getRelayTune(handle, out);
+}
+
+bool PIDFlowController::setWaveform(const WaveShape::Points & pts, bool step, std::string & err)
+{
+  std::ostringstream os;
+  if (pts.size() < 2 || pts.size() > Waveform::MaxPts) {
+    os << "need 2 to " << Waveform::MaxPts << " points";
+    err = os.str();
+    return false;
+  }
+  std::vector<unsigned> at;
+  std::vector<float> flow;
+  const double t0 = pts[0].first;
+  for (unsigned i = 0; i < pts.size(); ++i) {
+    if (i && pts[i].first < pts[i-1].first) { err = "times must not decrease"; return false; }
+    if (pts[i].second < min() || pts[i].second > max()) {
+      os << "flow " << pts[i].second << " is outside " << min() << " - " << max();
+      err = os.str();
+      return false;
+    }
+    at.push_back(static_cast<unsigned>((pts[i].first - t0) * params.rate_hz + 0.5));
+    flow.push_back(pts[i].second);
+  }
+  if (!at.back()) { err = "the waveform is shorter than one control period"; return false; }
+  if (handle == RTLCoprocess::Failure
+      || !coprocess->setWaveform(handle, at, flow, step ? Waveform::Step : Waveform::Linear)) {
+    err = "the RT loop refused the waveform, is one playing?";
+    return false;
+  }
+  return true;
+}
+
+bool PIDFlowController::startWaveform(unsigned loops, Timer::Time & startAt, Timer::Time delay)
+{
+  Waveform::Control c;
+  c.action = Waveform::Control::Start;
+  c.loops = loops;
+  c.startAt = startAt;
+  c.delay = delay;
+  if (handle == RTLCoprocess::Failure || !coprocess->controlWaveform(handle, c)) return false;
+  startAt = c.startAt;
+  return true;
+}
+
+bool PIDFlowController::stopWaveform()
+{
+  Waveform::Control c;
+  c.action = Waveform::Control::Abort;
+  return handle != RTLCoprocess::Failure && coprocess->controlWaveform(handle, c);
+}
+
+bool PIDFlowController::getWaveform(Waveform::Control & out)
+{
+  return handle != RTLCoprocess::Failure && coprocess->getWaveform(handle, out);
+}
+
+bool PIDFlowController::setGainSchedule(const GainSchedule & gs)
+{
+  schedule = gs;
+  return scheduleGains(commandedFlow());
+}
+
+bool PIDFlowController::faultParams(std::string & err)
+{
+  const std::string fcname = name();
+  std::string act = ini.get(fcname, Conf::Keys::fault_action);
+  // unset is off, so a rig only gets it by asking, and the Monitor's
+  // gas panic check goes on watching this controller
+  if (!act.length() || act == "off") {
+    params.fault_debounce = 0;
+    return true;
+  }
+  if (act == "alarm") params.fault_action = PIDFCParams::FaultAlarm;
+  else if (act == "stopflow") params.fault_action = PIDFCParams::FaultStop;
+  else {
+    err = "invalid " + Conf::Keys::fault_action + " of " + act + ", expected stopflow, alarm or off";
+    return false;
+  }
+  // the Monitor section's gas_panic_actions has the last say on stopping
+  // the flow, as it always has
+  if (params.fault_action == PIDFCParams::FaultStop) {
+    StringList acts = String::split(ini.get(Conf::Sections::Monitor, Conf::Keys::gas_panic_actions), "[[:space:],]+");
+    if (std::find(acts.begin(), acts.end(), String("stopflow")) == acts.end()) {
+      Warning() << fcname << ": " << Conf::Keys::fault_action << " is stopflow but "
+                << Conf::Keys::gas_panic_actions << " hasn't stopflow, only alarming\n";
+      params.fault_action = PIDFCParams::FaultAlarm;
+    }
+  }
+  bool ok = true;
+  std::string v = ini.get(fcname, Conf::Keys::fault_debounce_ms);
+  double ms;
+  if (v.length()) ms = String(v).toDouble(&ok);
+  else {
+    // as long as the Monitor's gas panic check would have waited
+    int secs = String::toInt(ini.get(Conf::Sections::Monitor, Conf::Keys::gas_panic_secs), &ok);
+    if (!ok || secs < 1) secs = 1;
+    ms = secs * 1000.;
+    ok = true;
+  }
+  if (!ok || ms <= 0.) {
+    err = Conf::Keys::fault_debounce_ms + " must be a number > 0";
+    return false;
+  }
+  // it has to outlast the flow's response to a setpoint step, dead time
+  // and all, or every step up trips it
+  params.fault_debounce = static_cast<unsigned>(::ceil(ms * params.rate_hz / 1000.));
+  if (!params.fault_debounce) params.fault_debounce = 1;
+  v = ini.get(fcname, Conf::Keys::fault_frac);
+  params.fault_frac = v.length() ? String(v).toDouble(&ok) : 0.1;
+  if (!ok || params.fault_frac <= 0. || params.fault_frac >= 1.) {
+    err = Conf::Keys::fault_frac + " must be in (0,1)";
+    return false;
+  }
+  v = ini.get(fcname, Conf::Keys::fault_min_flow);
+  if (v.length()) {
+    params.fault_min_set = String(v).toDouble(&ok);
+    if (!ok || params.fault_min_set < 0.) {
+      err = Conf::Keys::fault_min_flow + " must be a number >= 0";
+      return false;
+    }
+  } else {
+    // 2% of full scale: below that the sensor's noise is most of the reading
+    static const boost::regex rangeRE("^[[:digit:].]+-([[:digit:].]+)$");
+    boost::cmatch caps;
+    const std::string rng = ini.get(fcname, Conf::Keys::mass_range_ml);
+    params.fault_min_set = boost::regex_match(rng.c_str(), caps, rangeRE) ? ToDouble(caps[1].str()) * 0.02 : 0.;
+  }
+  return true;
+}
+
+bool PIDFlowController::scheduleGains(double flow)
+{
+  if (schedule.empty()) return true;
+  GainSchedule::const_iterator hi = schedule.lower_bound(flow), lo = hi;
+  std::vector<double> g;
+  if (hi == schedule.end()) g = schedule.rbegin()->second;
+  else if (hi == schedule.begin()) g = hi->second;
+  else {
+    --lo;
+    const double frac = (flow - lo->first) / (hi->first - lo->first);
+    g.resize(3);
+    for (unsigned i = 0; i < 3; ++i) g[i] = lo->second[i] + (hi->second[i] - lo->second[i]) * frac;
+  }
+  if (g[0] == params.controlParams.Kp && g[1] == params.controlParams.Ki && g[2] == params.controlParams.Kd)
+    return true;
+  return setControlParams(g, params.controlParams.numIntgrlPts);
 }
 
 PIDFlowSensorProxy::PIDFlowSensorProxy(PIDFlowController *parent,
@@ -242,6 +546,7 @@ double PIDFlowSensorProxy::readRaw()
 
 bool PIDFlowActuatorProxy::write(double d) 
 { 
+  if (pfc) pfc->scheduleGains(d);
   bool ret = pfc && pfc->coprocess->setFlow(pfc->handle, d);
   if (ret) m_lastWritten = d;
   return ret;
@@ -268,11 +573,81 @@ bool PIDFlowController::setCoeffs(const Coeffs & c)
   if (c.size() != 4) return false;
   if (coprocess->setCoeffs(handle, c[0], c[1], c[2], c[3])) {
     coeffs = c;
+    if (!uploadLUT())
+      Warning() << "PID FlowController " << name() << " could not upload its calibration lookup table, using the cubic\n";
     return true;
   }
   return false;
 }
 
+bool PIDFlowController::setValveTable(const Table & t)
+{
+  valveTable = t;
+  if (!buildFeedForward()) {
+    Warning() << "PID FlowController " << name() << " valve table is not usable for feed-forward\n";
+    return false;
+  }
+  return handle == RTLCoprocess::Failure
+    || coprocess->setFeedForward(handle, params.ff_n, params.ff_flow, params.ff_v);
+}
+
+bool PIDFlowController::buildFeedForward()
+{
+  params.ff_n = 0;
+  if (!feedForward) return true;
+  // walk up the valve voltages keeping only points where flow increases,
+  // which gives an invertible (monotonic) flow -> valve volts curve
+  std::vector<double> f, v;
+  for (Table::const_iterator it = valveTable.begin(); it != valveTable.end(); ++it)
+    if (f.empty() || it->second > f.back()) f.push_back(it->second), v.push_back(it->first);
+  if (f.size() < 2) return false;
+  // thin to the kernel's table size by resampling evenly in flow
+  const unsigned n = std::min<unsigned>(f.size(), PIDFCParams::FFMaxPts);
+  for (unsigned i = 0, j = 1; i < n; ++i) {
+    const double fl = n == f.size() ? f[i] : f.front() + (f.back() - f.front()) * i / (n - 1);
+    while (j < f.size() - 1 && f[j] < fl) ++j;
+    params.ff_flow[i] = fl;
+    params.ff_v[i] = n == f.size() ? v[i] : v[j-1] + (v[j] - v[j-1]) * (fl - f[j-1]) / (f[j] - f[j-1]);
+  }
+  params.ff_n = n;
+  return true;
+}
+
+bool PIDFlowController::uploadLUT()
+{
+  std::vector<float> tab;
+  unsigned shift = 0;
+  Table pts;
+  if (lutMode == LUTTable) {
+    pts = calibTable;
+    if (pts.size() < 2) {
+      Warning() << "PID FlowController " << name() << " has fewer than 2 calib_table points, tabulating the cubic instead\n";
+      pts.clear();
+    }
+  }
+  if (lutMode != LUTOff) {
+    // as coarse as needed to fit, eg. every 16th sample on a 16 bit board
+    const unsigned long maxd = maxdata_ai;
+    while (((maxd + (1UL << shift) - 1) >> shift) + 1 > CalibLUT::MaxEntries) ++shift;
+    const unsigned n = ((maxd + (1UL << shift) - 1) >> shift) + 1;
+    tab.resize(n);
+    for (unsigned i = 0; i < n; ++i) {
+      // same mapping as the kernel's ais2v()
+      const double v = double(i << shift) / double(maxd ? maxd : 1) * (params.vmax_ai - params.vmin_ai) + params.vmin_ai;
+      if (pts.empty()) { tab[i] = xform(v); continue; }
+      // piecewise linear through the table, extending its end segments
+      Table::const_iterator hi = pts.upper_bound(v);
+      if (hi == pts.begin()) ++hi;
+      else if (hi == pts.end()) --hi;
+      Table::const_iterator lo = hi; --lo;
+      tab[i] = lo->second + (hi->second - lo->second) * (v - lo->first) / (hi->first - lo->first);
+    }
+  }
+  if (coprocess->setCalibLUT(handle, tab, shift)) return true;
+  coprocess->setCalibLUT(handle, std::vector<float>(), 0);
+  return false;
+}
+
 std::vector<double> PIDFlowController::controlParams() const
 {
   std::vector<double> ret;
@@ -297,6 +672,16 @@ bool PIDFlowController::saveParams()
   ini.put(name(), Conf::Keys::Kp, String::Str(params.controlParams.Kp));
   ini.put(name(), Conf::Keys::Ki, String::Str(params.controlParams.Ki));
   ini.put(name(), Conf::Keys::Kd, String::Str(params.controlParams.Kd));
+  ini.put(name(), Conf::Keys::num_Ki_points, String::Str(params.controlParams.numIntgrlPts));
+  if (schedule.size())
+    ini.put(name(), Conf::Keys::gain_schedule, Conf::Gen::gainSchedule(schedule));
+  if (smithPredictor()) {
+    ini.put(name(), Conf::Keys::controller, "smith");
+    ini.put(name(), Conf::Keys::model_gain, String::Str(smithK));
+    ini.put(name(), Conf::Keys::model_tau_s, String::Str(smithTau));
+    ini.put(name(), Conf::Keys::model_dead_s, String::Str(smithTheta));
+  } else if (ini.get(name(), Conf::Keys::controller).length())
+    ini.put(name(), Conf::Keys::controller, "pid");
   return ini.save();
 }
 
@@ -316,3 +701,9 @@ bool PIDFlowController::getVClip(double & min, double & max)
 {
   return coprocess->getVClip(handle, min, max);
 }
+
+/// from our own interface -- the valve voltage the loop last wrote
+bool PIDFlowController::getValveV(double & v)
+{
+  return coprocess->getLastOutV(handle, v);
+}
@@ -16,6 +16,8 @@
 #include "RTProxy.h"
 #include "DataLogableProxy.h"
 #include "Calib.h"
+#include "WaveShape.h"
+#include "Timer.h"
 
 class PIDFlowController : public FlowController, public StartStoppable, public Controller, public Saveable, public Calib, virtual public RTProxy, virtual public DataLogableProxy, public DOEnableable
 {
@@ -43,13 +45,70 @@ public:
   /// from Saveable interface -- saves: control params, calib table and calib coeffs to ini file
   bool save(); 
 
-  /// from Calib interface -- sends 4 calibration coefficients to kernel coproc
+  /// from Calib interface -- sends 4 calibration coefficients to kernel coproc,
+  /// and the raw sample lookup table built from them (see uploadLUT())
   bool setCoeffs(const Coeffs & c);
 
+  /// from Calib interface -- also rebuilds and sends the feed-forward table
+  bool setValveTable(const Table & t);
+
+  /// PID loop rate, Hz
+  unsigned rateHz() const { return params.rate_hz; }
+  /// +1 if more valve volts give more flow, -1 if less.  From the valve
+  /// table if there is one, else from the sign of Kp (assumed to be
+  /// stabilizing, see PID::doPID()), else +1.
+  int valveDirection() const;
+
+  /// textbook PI gains -> this loop's {Kp,Ki,Kd}.  Kc is valve volts per
+  /// unit of (set - actual) flow, so it has the valve's direction, Ti is
+  /// in seconds.  See AutoTuner for the mapping.
+  std::vector<double> loopGains(double Kc, double Ti) const;
+
+  /// Smith predictor (see PIDFCParams::ctl_type) with a first order plus
+  /// dead time model of the valve -> flow process: gain K (flow per
+  /// valve volt), time constant tau and dead time theta in seconds.
+  /// The PID should then be tuned for the process without the dead time.
+  bool setSmithModel(double K, double tau, double theta);
+  /// back to the plain PID
+  bool clearSmithModel();
+  bool smithPredictor() const { return params.ctl_type == PIDFCParams::SmithPredictor; }
+  void smithModel(double & K, double & tau, double & theta) const { K = smithK, tau = smithTau, theta = smithTheta; }
+
+  /// relay auto-tune experiment in the RT loop, see RelayTune and AutoTuner
+  bool startRelayTune(const RelayTune & t);
+  bool getRelayTune(RelayTune & out);
+
+  /// replaces the setpoint waveform the RT loop plays, see Waveform.
+  /// Times are seconds from the first point and are rounded to control
+  /// periods, flows must be within min() and max().  With step the
+  /// setpoint holds each point until the next rather than ramping.
+  bool setWaveform(const WaveShape::Points & pts, bool step, std::string & err);
+  /// starts playback (the loop must be running) for loops passes, 0 for
+  /// until stopped.  If startAt is 0 it begins delay ns from now and
+  /// startAt is set to when, so other controllers can be started with
+  /// the same startAt to play in step.
+  bool startWaveform(unsigned loops, Timer::Time & startAt, Timer::Time delay = 0);
+  /// stops playback, leaving the setpoint where it got to
+  bool stopWaveform();
+  bool getWaveform(Waveform::Control & out);
+
+  /// flow -> {Kp,Ki,Kd}.  If not empty, the control params are
+  /// interpolated from it whenever the setpoint changes.
+  typedef std::map<double, std::vector<double> > GainSchedule;
+  const GainSchedule & gainSchedule() const { return schedule; }
+  bool setGainSchedule(const GainSchedule & gs);
+
   /// from our own interface -- sets the output voltage clipping
   bool setVClip(double min, double max);
   /// from our own interface -- query the output voltage clipping
   bool getVClip(double & min, double & max);
+  /// from our own interface -- the valve voltage the loop last wrote
+  bool getValveV(double & v);
+  /// the coprocess watches the flow for faults (see
+  /// PIDFCParams::fault_debounce), and zeroes the setpoint when one trips
+  /// rather than just flagging it
+  bool faultDetect() const { return params.fault_debounce; }
+  bool faultStops() const { return params.fault_action == PIDFCParams::FaultStop; }
 
 protected:
   /// from controller
@@ -60,11 +119,37 @@ protected:
   /// saves the control params to the settings file
   bool saveParams();
 
+  /// how the kernel goes from a raw AI sample to flow, from the calib_lut key
+  enum LUTMode {
+    LUTOff,   ///< ais2v() then evaluate the cubic, in floating point
+    LUTFit,   ///< the cubic tabulated by raw sample (the default)
+    LUTTable  ///< the calib_table, piecewise linear, tabulated by raw sample
+  };
+  /// builds the raw sample -> flow table for lutMode and sends it to the
+  /// kernel.  On failure the kernel is left evaluating the cubic.
+  bool uploadLUT();
+  /// fills params.ff_* from the valve table, inverted, if feed_forward is
+  /// on.  Returns false if it is on but the table can't be inverted.
+  bool buildFeedForward();
+  bool feedForward;
+  /// fills params' Smith predictor fields for the model, or returns
+  /// false with err set if the model is unusable at our rate
+  bool smithParams(double K, double tau, double theta, std::string & err);
+  double smithK, smithTau, smithTheta;
+  /// fills params.fault_* from the fault_* keys, or returns false with
+  /// err set
+  bool faultParams(std::string & err);
+  /// sets the control params for flow from the schedule, if any
+  bool scheduleGains(double flow);
+  GainSchedule schedule;
+
   bool valid;
   std::string error_str;
   // in RTProxy superclass RTLCoprocess *coprocess;
   // in RTProxy superclass RTLCoprocess::Handle handle;
   PIDFCParams params;
+  LUTMode lutMode;
+  lsampl_t maxdata_ai;
 
   Settings & ini;
 };
@@ -1,70 +1,230 @@
 #include "PolynomialFit.h"
-#include "lmmin.h"
-#include "lm_eval.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
 
-static inline double POW(double a, unsigned b) 
+namespace {
+
+  typedef std::vector<double> Vec;
+
+  /** Solves min || diag(sqrt(w)) (A b - y) || for b, A being m x n
+      column major, with Householder reflections.  A is overwritten.
+      Returns false if A is (numerically) rank deficient. */
+  bool SolveQR(Vec & A, const Vec & y, const Vec & w, unsigned n, Vec & b)
+  {
+    const unsigned m = y.size();
+    if (m < n || !n) return false;
+    Vec r(m), diag(n);
+    for (unsigned i = 0; i < m; ++i) {
+      const double sw = sqrt(w[i]);
+      for (unsigned j = 0; j < n; ++j) A[j*m + i] *= sw;
+      r[i] = sw * y[i];
+    }
+    double rmax = 0.;
+    for (unsigned k = 0; k < n; ++k) {
+      double *a = &A[k*m];
+      double norm = 0.;
+      for (unsigned i = k; i < m; ++i) norm += a[i]*a[i];
+      norm = sqrt(norm);
+      rmax = std::max(rmax, norm);
+      if (norm <= rmax * 1e-12 || norm == 0.) return false;
+      // reflect a[k..m) onto alpha*e_k, keeping v = a - alpha*e_k in a[k..m)
+      const double alpha = a[k] > 0. ? -norm : norm;
+      a[k] -= alpha;
+      double vv = 0.;
+      for (unsigned i = k; i < m; ++i) vv += a[i]*a[i];
+      for (unsigned j = k+1; j < n; ++j) {
+        double *c = &A[j*m], s = 0.;
+        for (unsigned i = k; i < m; ++i) s += a[i]*c[i];
+        s *= 2./vv;
+        for (unsigned i = k; i < m; ++i) c[i] -= s*a[i];
+      }
+      double s = 0.;
+      for (unsigned i = k; i < m; ++i) s += a[i]*r[i];
+      s *= 2./vv;
+      for (unsigned i = k; i < m; ++i) r[i] -= s*a[i];
+      diag[k] = alpha;
+    }
+    // back substitute R b = Q^T y, R's upper triangle is above A's diagonal
+    b.assign(n, 0.);
+    for (unsigned k = n; k-- > 0; ) {
+      double s = r[k];
+      for (unsigned j = k+1; j < n; ++j) s -= A[j*m + k] * b[j];
+      b[k] = s / diag[k];
+    }
+    return true;
+  }
+
+  /// SolveQR() on the m x n Vandermonde matrix of t
+  bool SolveQR(const Vec & t, const Vec & y, const Vec & w, unsigned n, Vec & b)
+  {
+    const unsigned m = t.size();
+    if (m < n) return false;
+    Vec A(m*n);
+    for (unsigned i = 0; i < m; ++i) {
+      double p = 1.;
+      for (unsigned j = 0; j < n; ++j, p *= t[i]) A[j*m + i] = p;
+    }
+    return SolveQR(A, y, w, n, b);
+  }
+
+  double EvalT(const Vec & b, double t)
+  {
+    double ret = 0.;
+    for (unsigned i = b.size(); i-- > 0; ) ret = ret*t + b[i];
+    return ret;
+  }
+
+  /// weighted rss of the points in use
+  double RSS(const Vec & b, const Vec & t, const Vec & y, const Vec & w)
+  {
+    double rss = 0.;
+    for (unsigned i = 0; i < t.size(); ++i) {
+      const double e = y[i] - EvalT(b, t[i]);
+      rss += w[i]*e*e;
+    }
+    return rss;
+  }
+
+  /// fits degree deg, or picks the best degree <= deg by AICc.  b is in t
+  bool FitUsed(unsigned deg, bool autoDeg, const Vec & t, const Vec & y, const Vec & w, Vec & b)
+  {
+    if (!autoDeg) return SolveQR(t, y, w, deg+1, b);
+    const double n = t.size();
+    double best = 0.;
+    bool found = false;
+    Vec cand;
+    for (unsigned d = 1; d <= deg; ++d) {
+      const double k = d + 1;
+      if (n - k - 1 <= 0. || !SolveQR(t, y, w, d+1, cand)) break;
+      const double rss = RSS(cand, t, y, w);
+      if (rss <= 0.) { b = cand; return true; } // exact, can't do better
+      const double aicc = n * log(rss/n) + 2.*k + 2.*k*(k+1.)/(n-k-1.);
+      if (!found || aicc < best) best = aicc, b = cand, found = true;
+    }
+    // too few points for the criterion: fall back to the plain fit
+    return found || SolveQR(t, y, w, deg+1, b);
+  }
+
+  double Binomial(unsigned n, unsigned k)
+  {
+    double r = 1.;
+    for (unsigned i = 1; i <= k; ++i) r = r * (n - k + i) / i;
+    return r;
+  }
+}
+
+double PolynomialFit::Eval(const Coefficients & c, double x)
 {
-  double ret = 1.0;
-  while (b--) ret *= a;  
-  return ret;
+  return EvalT(c, x);
 }
 
-static double fit_function( void *arg, double t, double* p ) 
+PolynomialFit::Fit
+PolynomialFit::WeightedFit(unsigned deg, const Data & pts, const Weights *weights, const Options & opts)
 {
-  unsigned degree = reinterpret_cast<unsigned>(arg);
-  double ret = 0.0;
-  for (unsigned i = 0; i <= degree; ++i) 
-    ret += p[i] * POW(t, i);
+  Fit ret;
+  const unsigned m = pts.size();
+  if (!deg) { ret.msg = "degree 0 is invalid"; return ret; }
+  if (weights && weights->size() != m) { ret.msg = "number of weights doesn't match number of points"; return ret; }
+
+  Vec x(m), y(m), w(m);
+  Data::const_iterator it;
+  unsigned i;
+  for (i = 0, it = pts.begin(); it != pts.end(); ++it, ++i) {
+    x[i] = it->first;
+    y[i] = it->second;
+    w[i] = weights ? (*weights)[i] : 1.;
+    if (!(w[i] >= 0.)) { ret.msg = "weights must be nonnegative"; return ret; }
+  }
+  // scale x into [-1,1] so the Vandermonde columns are comparable
+  const double xmin = m ? x.front() : 0., xmax = m ? x.back() : 0.;
+  const double c = (xmax + xmin) / 2., s = xmax > xmin ? (xmax - xmin) / 2. : 1.;
+
+  ret.outlier.assign(m, false);
+  for (i = 0; i < m; ++i) if (w[i] == 0.) ret.outlier[i] = true;
+
+  Vec b;
+  for (unsigned pass = 0; ; ++pass) {
+    Vec tu, yu, wu;
+    for (i = 0; i < m; ++i)
+      if (!ret.outlier[i]) tu.push_back((x[i]-c)/s), yu.push_back(y[i]), wu.push_back(w[i]);
+    if (!FitUsed(deg, opts.autoDegree, tu, yu, wu, b)) {
+      ret.msg = "not enough distinct points for a fit of that degree";
+      return ret;
+    }
+    if (opts.outlierSigmas <= 0. || pass >= opts.maxOutlierPasses) break;
+
+    // robust scale of the weighted residuals
+    Vec e(m, 0.), ae;
+    for (i = 0; i < m; ++i) {
+      if (ret.outlier[i]) continue;
+      e[i] = sqrt(w[i]) * (y[i] - EvalT(b, (x[i]-c)/s));
+      ae.push_back(fabs(e[i]));
+    }
+    std::nth_element(ae.begin(), ae.begin() + ae.size()/2, ae.end());
+    const double sigma = 1.4826 * ae[ae.size()/2];
+    if (sigma <= 0.) break;
+    // keep a couple of degrees of freedom no matter what
+    unsigned used = ae.size(), dropped = 0;
+    for (i = 0; i < m && used - dropped > b.size() + 2; ++i)
+      if (!ret.outlier[i] && fabs(e[i]) > opts.outlierSigmas * sigma)
+        ret.outlier[i] = true, ++dropped;
+    if (!dropped) break;
+    ret.numOutliers += dropped;
+  }
+
+  // back to coefficients of x: t^j = sum_i C(j,i) x^i (-c)^(j-i) / s^j
+  ret.degree = b.size() - 1;
+  ret.coeffs.assign(b.size(), 0.);
+  for (unsigned j = 0; j < b.size(); ++j)
+    for (i = 0; i <= j; ++i)
+      ret.coeffs[i] += b[j] * Binomial(j, i) * pow(-c, double(j - i)) / pow(s, double(j));
+
+  // goodness of fit over the points used
+  double sw = 0., swy = 0., tss = 0., sq = 0.;
+  unsigned nused = 0;
+  ret.residuals.resize(m);
+  for (i = 0; i < m; ++i) {
+    ret.residuals[i] = y[i] - EvalT(b, (x[i]-c)/s);
+    if (ret.outlier[i]) continue;
+    sw += w[i]; swy += w[i]*y[i];
+    ret.rss += w[i] * ret.residuals[i] * ret.residuals[i];
+    sq += ret.residuals[i] * ret.residuals[i];
+    ++nused;
+  }
+  const double ybar = sw > 0. ? swy/sw : 0.;
+  for (i = 0; i < m; ++i)
+    if (!ret.outlier[i]) tss += w[i] * (y[i]-ybar) * (y[i]-ybar);
+  ret.rms = nused ? sqrt(sq / nused) : 0.;
+  ret.r2 = tss > 0. ? 1. - ret.rss/tss : 1.;
+  ret.ok = true;
   return ret;
 }
 
-static 
-void dont_print( int n_par, double* par, int m_dat, double* fvec, 
-                 void *data, int iflag, int iter, int nfev )
+bool PolynomialFit::LeastSquares(const std::vector<double> & A, const std::vector<double> & y,
+                                 unsigned n, std::vector<double> & x, const Weights *weights)
 {
-  (void)n_par; (void)par; (void)m_dat; (void) fvec; (void)data; (void)iflag;
-  (void)iter; (void)nfev;
-  // do nothing..
+  const unsigned m = y.size();
+  if (A.size() != m*n || (weights && weights->size() != m)) return false;
+  Vec cm(m*n); // to column major
+  for (unsigned i = 0; i < m; ++i)
+    for (unsigned j = 0; j < n; ++j) cm[j*m + i] = A[i*n + j];
+  return SolveQR(cm, y, weights ? *weights : Vec(m, 1.), n, x);
 }
 
-PolynomialFit::Coefficients 
+PolynomialFit::Coefficients
 PolynomialFit::FitData(unsigned deg, const Data & pts,
                        bool verbose,
                        std::string * msg, unsigned * num_evals)
 {
-  Coefficients ret;
-  unsigned num_pts = pts.size();
-  if (!deg || !num_pts) return ret;
-  ret.resize(deg+1);
-
-  // start off with 1, 1, 1.. etc coefficients?
-  for (unsigned i = 0; i < ret.size(); ++i) ret[i] = 1.0;
-
-  lm_data_type mydata;
-  std::vector<double> t_pts;
-  std::vector<double> y_pts;
-  t_pts.resize(num_pts);
-  y_pts.resize(num_pts);
-  mydata.user_t = &t_pts[0];
-  mydata.user_y = &y_pts[0];
-  mydata.user_func = fit_function;
-  mydata.user_arg = reinterpret_cast<void *>(deg);
-  int i; 
-  Data::const_iterator it;
-  for (i = 0, it = pts.begin(); it != pts.end(); ++it, ++i) {
-    t_pts[i] = it->first;
-    y_pts[i] = it->second;
+  Fit f = WeightedFit(deg, pts);
+  if (verbose) {
+    if (!f.ok) fprintf(stderr, "PolynomialFit: %s\n", f.msg.c_str());
+    for (unsigned i = 0; i < f.coeffs.size(); ++i)
+      fprintf(stderr, "PolynomialFit: c%u = %g\n", i, f.coeffs[i]);
+    fprintf(stderr, "PolynomialFit: %u points, rms residual %g, R^2 %g\n", unsigned(pts.size()), f.rms, f.r2);
   }
-
-  lm_control_type control; 
-  lm_initialize_control( &control );
-  control.maxcall = 10000; // 10,000 max evals?
-  
-  // perform the fit..
-  lm_minimize(num_pts, ret.size(), &ret[0], lm_evaluate_default, verbose ? lm_print_default : dont_print, &mydata, &control);
-
-  if (msg) *msg = lm_shortmsg[control.info];
-  if (num_evals) *num_evals = control.nfev;
-  
-  return ret;
+  if (msg) *msg = f.ok ? "success" : f.msg;
+  if (num_evals) *num_evals = pts.size();
+  return f.coeffs;
 }
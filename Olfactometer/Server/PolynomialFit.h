@@ -1,7 +1,7 @@
 #ifndef PolynomialFit_H
 #define PolynomialFit_H
 
-/// @file PolynomialFit.h -- a wrapper to Joachim Wuttke's  lmfit C library
+/// @file PolynomialFit.h -- weighted linear least squares polynomial fits
 
 #include <vector>
 #include <map>
@@ -12,24 +12,87 @@ namespace PolynomialFit
 
   typedef std::map<double, double> Data;
   typedef std::vector<double> Coefficients;
+  /// per point weights, in the (ascending x) order of the Data map.
+  /// Use 1/variance of each y if known.
+  typedef std::vector<double> Weights;
+
+  /// how WeightedFit() should go about it
+  struct Options
+  {
+    Options() : autoDegree(false), outlierSigmas(0.), maxOutlierPasses(3) {}
+    /// if true, degree is the maximum degree and the one with the
+    /// lowest corrected Akaike information criterion (AICc) is picked,
+    /// so a higher degree is only used if it fits materially better
+    bool autoDegree;
+    /// if nonzero, repeatedly drop points whose weighted residual is
+    /// more than this many robust standard deviations (1.4826 * median
+    /// absolute residual) from the fit and refit
+    double outlierSigmas;
+    unsigned maxOutlierPasses;
+  };
+
+  /// the result of a fit and how good it is
+  struct Fit
+  {
+    Fit() : ok(false), degree(0), rss(0.), rms(0.), r2(0.), numOutliers(0) {}
+    bool ok;
+    std::string msg; ///< why not ok
+    Coefficients coeffs; ///< lowest to highest degree
+    unsigned degree;
+    double rss; ///< weighted residual sum of squares over the points used
+    double rms; ///< unweighted root mean square residual over the points used
+    double r2;  ///< weighted coefficient of determination over the points used
+    std::vector<double> residuals; ///< y - fit(x) for every point, in Data order
+    std::vector<bool> outlier; ///< which points were dropped, in Data order
+    unsigned numOutliers;
+  };
+
+  /**
+     Weighted least squares fit of a polynomial to the data points,
+     solved directly with a Householder QR decomposition of the
+     Vandermonde matrix (of x scaled to [-1,1], for conditioning).
+     Deterministic and O(points * degree^2).
+
+     @param degree the degree (or maximum degree, see Options::autoDegree) of the curve -- 1 is linear, 2 quadratic, 3 cubic, etc (0 is invalid)
+     @param dataPoints the data -- a map of x->y values
+     @param weights if not NULL, one nonnegative weight per point
+  */
+  extern Fit WeightedFit(unsigned degree, const Data & dataPoints,
+                         const Weights *weights = 0,
+                         const Options & opts = Options());
 
   /**
      Find the polynomial curve of degree `degree' that fits the data points
-     `dataPoints'.  
-     
+     `dataPoints'.  Unweighted WeightedFit() of exactly that degree.
+
      @param degree the degree desired of the curve --  1 is linear, 2 quadratic, 3 cubic, etc (0 is invalid)
      @param dataPoints the data -- a map of x->y values.
-     @param verbose -- if true, print really verbose stuff as the curvefit is done and once it finishes, if false, be silent
+     @param verbose -- if true, print the fit and its residuals when done
      @param statusMsg if not NULL, a string to write a status message to when done
-     @param numEvaluations if not NULL, an unsigned integer to store the number of evaluations performed during the curve fit
-     @returns a vector of coefficients in the order of lowest to highest degree.
+     @param numEvaluations if not NULL, set to the number of polynomial evaluations done (one per point)
+     @returns a vector of coefficients in the order of lowest to highest degree, empty on failure.
   */
   extern Coefficients FitData(unsigned degree, const Data & dataPoints,
                               bool verbose = false,
-                              std::string *statusMsg = 0, 
+                              std::string *statusMsg = 0,
                               unsigned *numEvaluations = 0);
+
+  /**
+     The solver behind the fits, for other linear models: minimizes
+     || diag(sqrt(w)) (A x - y) || for x by Householder QR.
+
+     @param A the m x n design matrix, row major (row i is observation i)
+     @param y the m observations
+     @param weights if not NULL, one nonnegative weight per observation
+     @returns false if the sizes don't match or A is numerically rank deficient
+  */
+  extern bool LeastSquares(const std::vector<double> & A, const std::vector<double> & y,
+                           unsigned n, std::vector<double> & x,
+                           const Weights *weights = 0);
+
+  /// evaluates the polynomial with coefficients lowest to highest degree at x
+  extern double Eval(const Coefficients & c, double x);
 }
 
 
 #endif
-
@@ -3,13 +3,22 @@
 #include <stdlib.h>
 #include <sys/utsname.h>
 #include <fstream>
+#include <algorithm>
 #include <stdio.h>
 #include "Log.h"
 #include "Mutex.h"
 #include "rtl_coprocess/DataEvent.h"
+#ifdef COMEDI_SIM
+#include "rtl_coprocess/ModuleSim.h"
+#include <unistd.h>
+#endif
 
 RTLCoprocess::RTLCoprocess(const char *m)
-  : modname(m)
+  : modname(m), 
+#ifdef COMEDI_SIM
+    hosted(false),
+#endif
+    eventHook(0)
 {}
 
 bool RTLCoprocess::reload()
@@ -18,6 +27,7 @@ bool RTLCoprocess::reload()
   return load();  
 }
 
+#ifndef COMEDI_SIM
 bool RTLCoprocess::load()
 { 
   String mod(modname), cmd = "/sbin/modprobe";
@@ -79,6 +89,67 @@ bool RTLCoprocess::modLoaded() const
   return ret;
 }
 
+bool RTLCoprocess::transact(Cmd & c)
+{
+  return c.writeFifo(&fifo) && c.readFifo(&fifo);
+}
+
+bool RTLCoprocess::readEvent(DataEvent & e)
+{
+  return fifo_datalog.read(&e, sizeof(e)) == int(sizeof(e));
+}
+
+const OlfCoprocessShm *RTLCoprocess::coprocessShm() const
+{
+  return shm.isAttached() ? static_cast<const OlfCoprocessShm *>(shm) : 0;
+}
+#else
+// SIM=1: the coprocess is linked in, see rtl_coprocess/ModuleSim.h
+bool RTLCoprocess::load()
+{
+  if (!hosted && ModuleInit()) return false;
+  hosted = true;
+  data_events.clear();
+  num_data_events = 0;
+  stopDataEventGrabberThread = false;
+  Thread::start();
+  return true;
+}
+
+bool RTLCoprocess::unload()
+{
+  if (!hosted) return true;
+  stopDataEventGrabberThread = true;
+  Thread::stop(); // before the pipe it reads goes
+  ModuleCleanup();
+  hosted = false;
+  return true;
+}
+
+bool RTLCoprocess::modLoaded() const
+{
+  return hosted;
+}
+
+bool RTLCoprocess::transact(Cmd & c)
+{
+  if (!hosted) return false;
+  ModuleDoCmd(&c);
+  return true;
+}
+
+bool RTLCoprocess::readEvent(DataEvent & e)
+{
+  const OlfCoprocessShm *s = coprocessShm();
+  return s && ::read(s->datalog_fifo, &e, sizeof(e)) == int(sizeof(e));
+}
+
+const OlfCoprocessShm *RTLCoprocess::coprocessShm() const
+{
+  return hosted ? ModuleShm() : 0;
+}
+#endif
+
 RTLCoprocess::~RTLCoprocess()
 {
   unload();
@@ -92,19 +163,20 @@ RTLCoprocess::Handle RTLCoprocess::createPID(unsigned dlid, const PIDFCParams &p
   Cmd c;
   c.cmd = Cmd::Create;
   c.object = Cmd::PID;
-  c.pidParams = params;
+  Cmd::PIDCreate & a = c.pidCreate();
+  a.params = params;
   c.datalog.id = dlid;
-  ::snprintf(c.daqname_in, sizeof(c.daqname_in), "%s", daq_ai_name.c_str());
-  ::snprintf(c.daqname_out, sizeof(c.daqname_out), "%s", daq_ao_name.c_str());
-  c.daqname_in[sizeof(c.daqname_in)-1] = 0;
-  c.daqname_out[sizeof(c.daqname_out)-1] = 0;
+  ::snprintf(a.daqname_in, sizeof(a.daqname_in), "%s", daq_ai_name.c_str());
+  ::snprintf(a.daqname_out, sizeof(a.daqname_out), "%s", daq_ao_name.c_str());
+  a.daqname_in[sizeof(a.daqname_in)-1] = 0;
+  a.daqname_out[sizeof(a.daqname_out)-1] = 0;
 
   // NB: there was a bug where multiple threads would write to the kernel
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
   // write the command to kernel and read the response
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok)
+  if (transact(c) && c.status == Cmd::Ok)
     return c.handle;
   return Failure;
 }
@@ -114,17 +186,18 @@ RTLCoprocess::Handle RTLCoprocess::createPWM(unsigned dlid, const PWMVParams &pa
   Cmd c;
   c.cmd = Cmd::Create;
   c.object = Cmd::PWM;
-  c.pwmParams = params;
+  Cmd::PWMCreate & a = c.pwmCreate();
+  a.params = params;
   c.datalog.id = dlid;
-  ::snprintf(c.daqname_out, sizeof(c.daqname_out), "%s", daq.c_str());
-  c.daqname_out[sizeof(c.daqname_out)-1] = 0;
+  ::snprintf(a.daqname_out, sizeof(a.daqname_out), "%s", daq.c_str());
+  a.daqname_out[sizeof(a.daqname_out)-1] = 0;
   
   // NB: there was a bug where multiple threads would write to the kernel
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
   // write the command to kernel and read the response
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok)
+  if (transact(c) && c.status == Cmd::Ok)
     return h2pwm(c.handle);
   return Failure;
 }
@@ -149,7 +222,7 @@ bool RTLCoprocess::destroy(Handle h)
   MutexLocker locker (fifo_mut);
 
   // write the command to kernel and read the response
-  return c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status != Cmd::Error;
+  return transact(c) && c.status != Cmd::Error;
 }
 
 
@@ -167,9 +240,9 @@ double RTLCoprocess::getFlow(Handle h, bool *ok)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok ) {
+  if ( transact(c) && c.status == Cmd::Ok ) {
     if (ok) *ok = true;
-    return c.pidParams.flow_actual;  
+    return c.pidParams().flow_actual;  
   }
   if (ok) *ok = false;
   return 0.0;
@@ -187,11 +260,11 @@ bool RTLCoprocess::setFlow(Handle h, double flow)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) 
+  if ( !transact(c) || c.status != Cmd::Ok ) 
     return false;
   c.cmd = Cmd::Modify;
-  c.pidParams.flow_set = flow;
-  return  c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok;
+  c.pidParams().flow_set = flow;
+  return  transact(c) && c.status == Cmd::Ok;
 }
 
 bool RTLCoprocess::setValveV(Handle h, double v)
@@ -206,11 +279,11 @@ bool RTLCoprocess::setValveV(Handle h, double v)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) 
+  if ( !transact(c) || c.status != Cmd::Ok ) 
     return false;
   c.cmd = Cmd::Modify;
-  c.pidParams.last_v_out = v;
-  return  c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok;
+  c.pidParams().last_v_out = v;
+  return  transact(c) && c.status == Cmd::Ok;
 }
 
 bool RTLCoprocess::getControlParams(Handle h,
@@ -230,15 +303,15 @@ bool RTLCoprocess::getControlParams(Handle h,
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) {
+  if ( !transact(c) || c.status != Cmd::Ok ) {
     Error() << "Internal error in RTLCoprocess::getControlParams() could not query controlParams for " << h << "\n";    
     return false;
   }
   kpkikd_out.resize(3);
-  kpkikd_out[0] = c.pidParams.controlParams.Kp;
-  kpkikd_out[1] = c.pidParams.controlParams.Ki;
-  kpkikd_out[2] = c.pidParams.controlParams.Kd;
-  num_ctrl_pts_out = c.pidParams.controlParams.numIntgrlPts;
+  kpkikd_out[0] = c.pidParams().controlParams.Kp;
+  kpkikd_out[1] = c.pidParams().controlParams.Ki;
+  kpkikd_out[2] = c.pidParams().controlParams.Kd;
+  num_ctrl_pts_out = c.pidParams().controlParams.numIntgrlPts;
   return true;
 }
 bool RTLCoprocess::setControlParams(Handle h,
@@ -258,16 +331,16 @@ bool RTLCoprocess::setControlParams(Handle h,
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) {
+  if ( !transact(c) || c.status != Cmd::Ok ) {
     Error() << "Internal error in RTLCoprocess::setControlParams() could not query controlParams for " << h << "\n";    
     return false;
   }
   c.cmd = Cmd::Modify;
-  c.pidParams.controlParams.Kp = kpkikd[0];
-  c.pidParams.controlParams.Ki = kpkikd[1];
-  c.pidParams.controlParams.Kd = kpkikd[2];
-  c.pidParams.controlParams.numIntgrlPts = num_ctrl_pts;
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) {
+  c.pidParams().controlParams.Kp = kpkikd[0];
+  c.pidParams().controlParams.Ki = kpkikd[1];
+  c.pidParams().controlParams.Kd = kpkikd[2];
+  c.pidParams().controlParams.numIntgrlPts = num_ctrl_pts;
+  if ( !transact(c) || c.status != Cmd::Ok ) {
     Error() << "Internal error in RTLCoprocess::setControlParams() could not modify controlParams for " << h << "\n";    
     return false;
   }
@@ -293,7 +366,7 @@ bool RTLCoprocess::start(Handle h)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  return c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok;
+  return transact(c) && c.status == Cmd::Ok;
 }
 
 
@@ -316,10 +389,23 @@ bool RTLCoprocess::stop(Handle h)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  return c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok;
+  return transact(c) && c.status == Cmd::Ok;
 }
 
 
+bool RTLCoprocess::getPIDFaults(std::vector<PIDFault> & out) const
+{
+  const OlfCoprocessShm *s = coprocessShm();
+  if (!s) return false;
+  out.resize(OlfCoprocessShm_MAX_PIDS);
+  for (unsigned k = 0; k < OlfCoprocessShm_MAX_PIDS; ++k) { // by kernel index
+    const OlfPIDFault & f = s->pid_fault[k];
+    out[h2pid(k)].count = f.count;
+    out[h2pid(k)].faulted = f.faulted;
+  }
+  return true;
+}
+
 bool RTLCoprocess::getLastOutV(Handle h, double & out)
 {
   if (!ispidh(h)) return false;
@@ -332,9 +418,9 @@ bool RTLCoprocess::getLastOutV(Handle h, double & out)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) 
+  if ( !transact(c) || c.status != Cmd::Ok ) 
     return false;
-  out = c.pidParams.last_v_out;
+  out = c.pidParams().last_v_out;
   return true;
 }
 bool RTLCoprocess::getLastInV(Handle h, double & out)
@@ -349,9 +435,9 @@ bool RTLCoprocess::getLastInV(Handle h, double & out)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !c.writeFifo(&fifo) || !c.readFifo(&fifo) || c.status != Cmd::Ok ) 
+  if ( !transact(c) || c.status != Cmd::Ok ) 
     return false;
-  out = c.pidParams.last_v_in;
+  out = c.pidParams().last_v_in;
   return true;
 }
 bool RTLCoprocess::setCoeffs(Handle h, double a, double b, double c, double d)
@@ -366,18 +452,300 @@ bool RTLCoprocess::setCoeffs(Handle h, double a, double b, double c, double d)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !cmd.writeFifo(&fifo) || !cmd.readFifo(&fifo) || cmd.status != Cmd::Ok ) 
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
+    return false;
+  cmd.cmd = Cmd::Modify;
+  cmd.pidParams().a = a;
+  cmd.pidParams().b = b;
+  cmd.pidParams().c = c;
+  cmd.pidParams().d = d;
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
+    return false;
+  return true;
+}
+
+bool RTLCoprocess::setFeedForward(Handle h, unsigned n, const double *flow, const double *v)
+{
+  if (!ispidh(h) || n > PIDFCParams::FFMaxPts) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Query;
+  cmd.object = Cmd::PID;
+  cmd.handle = h;
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
+    return false;
+  cmd.cmd = Cmd::Modify;
+  cmd.pidParams().ff_n = n;
+  std::copy(flow, flow + n, cmd.pidParams().ff_flow);
+  std::copy(v, v + n, cmd.pidParams().ff_v);
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
+    return false;
+  return true;
+}
+
+bool RTLCoprocess::setSmithModel(Handle h, int ctl_type, double a, double b, unsigned delay)
+{
+  if (!ispidh(h) || delay >= PIDFCParams::SmithMaxDelay) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Query;
+  cmd.object = Cmd::PID;
+  cmd.handle = h;
+
+  MutexLocker locker (fifo_mut);
+
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
     return false;
   cmd.cmd = Cmd::Modify;
-  cmd.pidParams.a = a;
-  cmd.pidParams.b = b;
-  cmd.pidParams.c = c;
-  cmd.pidParams.d = d;
-  if ( !cmd.writeFifo(&fifo) || !cmd.readFifo(&fifo) || cmd.status != Cmd::Ok ) 
+  cmd.pidParams().ctl_type = ctl_type;
+  cmd.pidParams().smith_a = a;
+  cmd.pidParams().smith_b = b;
+  cmd.pidParams().smith_delay = delay;
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
     return false;
   return true;
 }
 
+bool RTLCoprocess::startRelayTune(Handle h, const RelayTune & t)
+{
+  if (!ispidh(h)) return false;
+  Cmd c;
+  c.cmd = Cmd::Modify;
+  c.object = Cmd::PID;
+  c.handle = h;
+  c.pidTune() = t;
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  return transact(c) && c.status == Cmd::Ok;
+}
+
+bool RTLCoprocess::getRelayTune(Handle h, RelayTune & out)
+{
+  if (!ispidh(h)) return false;
+  Cmd c;
+  c.cmd = Cmd::Query;
+  c.object = Cmd::PID;
+  c.handle = h;
+  c.pidTune();
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  if (transact(c) && c.status == Cmd::Ok) {
+    out = c.pidTune();
+    return true;
+  }
+  return false;
+}
+
+bool RTLCoprocess::setWaveform(Handle h, const std::vector<unsigned> & at, const std::vector<float> & flow, int interp)
+{
+  if (!ispidh(h) || at.size() != flow.size() || at.size() < 2 || at.size() > Waveform::MaxPts) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Modify;
+  cmd.object = Cmd::PID;
+  cmd.handle = h;
+  Waveform::Chunk & ch = cmd.pidWaveLoad();
+  ch.total = at.size();
+  ch.interp = interp;
+
+  // the whole upload goes in under one lock so it can't interleave
+  // with another thread's
+  MutexLocker locker (fifo_mut);
+
+  unsigned off = 0;
+  do {
+    ch.offset = off;
+    ch.count = std::min<unsigned>(at.size() - off, Waveform::ChunkSize);
+    ch.commit = off + ch.count == at.size();
+    std::copy(at.begin() + off, at.begin() + off + ch.count, ch.at);
+    std::copy(flow.begin() + off, flow.begin() + off + ch.count, ch.flow);
+    if ( !transact(cmd) || cmd.status != Cmd::Ok )
+      return false;
+    off += ch.count;
+  } while (off < at.size());
+  return true;
+}
+
+bool RTLCoprocess::controlWaveform(Handle h, Waveform::Control & c)
+{
+  if (!ispidh(h)) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Modify;
+  cmd.object = Cmd::PID;
+  cmd.handle = h;
+  cmd.pidWave() = c;
+
+  MutexLocker locker (fifo_mut);
+
+  if (transact(cmd) && cmd.status == Cmd::Ok) {
+    c = cmd.pidWave();
+    return true;
+  }
+  return false;
+}
+
+bool RTLCoprocess::getWaveform(Handle h, Waveform::Control & out)
+{
+  if (!ispidh(h)) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Query;
+  cmd.object = Cmd::PID;
+  cmd.handle = h;
+  cmd.pidWave();
+
+  MutexLocker locker (fifo_mut);
+
+  if (transact(cmd) && cmd.status == Cmd::Ok) {
+    out = cmd.pidWave();
+    return true;
+  }
+  return false;
+}
+
+bool RTLCoprocess::loadSequence(const std::vector<SeqStep> & steps)
+{
+  if (steps.empty() || steps.size() > SeqProgram::MaxSteps) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Modify;
+  cmd.object = Cmd::SEQ;
+  SeqProgram::Chunk & ch = cmd.seqLoad();
+  ch.total = steps.size();
+
+  MutexLocker locker (fifo_mut);
+
+  unsigned off = 0;
+  do {
+    ch.offset = off;
+    ch.count = std::min<unsigned>(steps.size() - off, SeqProgram::ChunkSize);
+    ch.commit = off + ch.count == steps.size();
+    for (unsigned i = 0; i < ch.count; ++i) {
+      ch.step[i] = steps[off + i];
+      if (!kernelStep(ch.step[i])) return false;
+    }
+    if ( !transact(cmd) || cmd.status != Cmd::Ok )
+      return false;
+    off += ch.count;
+  } while (off < steps.size());
+  return true;
+}
+
+/*static*/
+bool RTLCoprocess::kernelStep(SeqStep & s)
+{
+  if (s.op == SeqStep::Bits) {
+    if (!isdaqh(s.handle)) return false;
+    s.handle = daq2h(s.handle);
+  } else if (s.op == SeqStep::Flow) {
+    if (!ispidh(s.handle)) return false;
+    s.handle = pid2h(s.handle);
+  } else if (s.op == SeqStep::PWM) {
+    if (!ispwmh(s.handle)) return false;
+    s.handle = pwm2h(s.handle);
+  }
+  return true;
+}
+
+bool RTLCoprocess::setTrigger(unsigned slot, const Trigger & t)
+{
+  Cmd cmd;
+  cmd.cmd = Cmd::Modify;
+  cmd.object = Cmd::TRIG;
+  Cmd::TrigSlot & ts = cmd.trig();
+  ts.slot = slot;
+  ts.t = t;
+  if (t.edge != Trigger::Off) {
+    if (!isdaqh(t.daq) || t.n > Trigger::MaxActions) return false;
+    ts.t.daq = daq2h(t.daq);
+    for (unsigned i = 0; i < t.n; ++i)
+      if (!kernelStep(ts.t.action[i])) return false;
+  }
+
+  MutexLocker locker (fifo_mut);
+
+  return transact(cmd) && cmd.status == Cmd::Ok;
+}
+
+bool RTLCoprocess::getTrigger(unsigned slot, Trigger & out)
+{
+  Cmd cmd;
+  cmd.cmd = Cmd::Query;
+  cmd.object = Cmd::TRIG;
+  cmd.trig().slot = slot;
+
+  MutexLocker locker (fifo_mut);
+
+  if (transact(cmd) && cmd.status == Cmd::Ok) {
+    out = cmd.trig().t;
+    if (out.edge != Trigger::Off) out.daq = h2daq(out.daq);
+    return true;
+  }
+  return false;
+}
+
+bool RTLCoprocess::controlSequence(const SeqProgram::Control & c)
+{
+  Cmd cmd;
+  cmd.cmd = Cmd::Modify;
+  cmd.object = Cmd::SEQ;
+  cmd.seq() = c;
+
+  MutexLocker locker (fifo_mut);
+
+  return transact(cmd) && cmd.status == Cmd::Ok;
+}
+
+bool RTLCoprocess::getSequence(SeqProgram::Control & out)
+{
+  Cmd cmd;
+  cmd.cmd = Cmd::Query;
+  cmd.object = Cmd::SEQ;
+  cmd.seq();
+
+  MutexLocker locker (fifo_mut);
+
+  if (transact(cmd) && cmd.status == Cmd::Ok) {
+    out = cmd.seq();
+    return true;
+  }
+  return false;
+}
+
+bool RTLCoprocess::setCalibLUT(Handle h, const std::vector<float> & flow, unsigned shift)
+{
+  if (!ispidh(h) || flow.size() > CalibLUT::MaxEntries) return false;
+  Cmd cmd;
+  cmd.cmd = Cmd::Modify;
+  cmd.object = Cmd::PID;
+  cmd.handle = h;
+  CalibLUT::Chunk & ch = cmd.pidLUT();
+  ch.total = flow.size();
+  ch.shift = shift;
+
+  // the whole upload goes in under one lock so it can't interleave
+  // with another thread's
+  MutexLocker locker (fifo_mut);
+
+  unsigned off = 0;
+  do {
+    ch.offset = off;
+    ch.count = std::min<unsigned>(flow.size() - off, CalibLUT::ChunkSize);
+    ch.commit = off + ch.count == flow.size();
+    std::copy(flow.begin() + off, flow.begin() + off + ch.count, ch.flow);
+    if ( !transact(cmd) || cmd.status != Cmd::Ok )
+      return false;
+    off += ch.count;
+  } while (off < flow.size());
+  return true;
+}
+
 bool RTLCoprocess::setVClip(Handle h, double min, double max)
 {
   if (!ispidh(h)) return false;
@@ -390,13 +758,13 @@ bool RTLCoprocess::setVClip(Handle h, double min, double max)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !cmd.writeFifo(&fifo) || !cmd.readFifo(&fifo) || cmd.status != Cmd::Ok
-       || min < cmd.pidParams.vmin_ao || max > cmd.pidParams.vmax_ao ) 
+  if ( !transact(cmd) || cmd.status != Cmd::Ok
+       || min < cmd.pidParams().vmin_ao || max > cmd.pidParams().vmax_ao ) 
     return false;
   cmd.cmd = Cmd::Modify;
-  cmd.pidParams.vclip_ao_min = min;
-  cmd.pidParams.vclip_ao_max = max;
-  if ( !cmd.writeFifo(&fifo) || !cmd.readFifo(&fifo) || cmd.status != Cmd::Ok ) 
+  cmd.pidParams().vclip_ao_min = min;
+  cmd.pidParams().vclip_ao_max = max;
+  if ( !transact(cmd) || cmd.status != Cmd::Ok ) 
     return false;
   return true;
 }
@@ -413,41 +781,45 @@ bool RTLCoprocess::getVClip(Handle h, double & min, double & max)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if ( !cmd.writeFifo(&fifo) || !cmd.readFifo(&fifo) || cmd.status != Cmd::Ok )
+  if ( !transact(cmd) || cmd.status != Cmd::Ok )
     return false;
-  min = cmd.pidParams.vclip_ao_min;
-  max = cmd.pidParams.vclip_ao_max;
+  min = cmd.pidParams().vclip_ao_min;
+  max = cmd.pidParams().vclip_ao_max;
   return true;
 }
 
 
-RTLCoprocess::Handle RTLCoprocess::createDAQ(const std::string & name, unsigned rate, unsigned minor, unsigned sdev, unsigned chan_mask, unsigned range, unsigned aref, bool dio_out, const double *rmin, const double *rmax)
+RTLCoprocess::Handle RTLCoprocess::createDAQ(const std::string & name, unsigned rate, unsigned minor, unsigned sdev, unsigned chan_mask, unsigned range, unsigned aref, bool dio_out, const double *rmin, const double *rmax, const ThreadAttrs *thread, bool on_change, unsigned refresh_ms)
 {
   Cmd c;
   c.cmd = Cmd::Create;
   c.object = Cmd::DAQ;
-  ::snprintf(c.daqname_in, sizeof(c.daqname_in), "%s", name.c_str());
-  c.daqname_in[sizeof(c.daqname_in)-1] = 0;
-  c.daqParams.minor = minor;
-  c.daqParams.subdev = sdev;
-  c.daqParams.chanmask = chan_mask;
-  c.daqParams.range = range;
-  c.daqParams.aref = aref;
-  c.daqParams.rate_hz = rate;
-  c.daqParams.dioMode = dio_out ? Cmd::Output : Cmd::Input;
+  Cmd::DAQCreate & a = c.daqCreate();
+  ::snprintf(a.name, sizeof(a.name), "%s", name.c_str());
+  a.name[sizeof(a.name)-1] = 0;
+  a.minor = minor;
+  a.subdev = sdev;
+  a.chanmask = chan_mask;
+  a.range = range;
+  a.aref = aref;
+  a.rate_hz = rate;
+  a.dioMode = dio_out ? Cmd::Output : Cmd::Input;
   if (rmin && rmax) {
-    c.daqParams.use_override = 1;
-    c.daqParams.override_min = static_cast<int>(*rmin * 1e6);
-    c.daqParams.override_max = static_cast<int>(*rmax * 1e6);
+    a.use_override = 1;
+    a.override_min = static_cast<int>(*rmin * 1e6);
+    a.override_max = static_cast<int>(*rmax * 1e6);
   } else
-    c.daqParams.use_override = 0;
+    a.use_override = 0;
+  if (thread) a.thread = *thread;
+  a.on_change = on_change;
+  a.refresh_ms = refresh_ms;
 
   // NB: there was a bug where multiple threads would write to the kernel
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
   // write the command to kernel and read the response
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok)
+  if (transact(c) && c.status == Cmd::Ok)
     return h2daq(c.handle);
   return Failure;  
 }
@@ -460,20 +832,89 @@ bool RTLCoprocess::getSample(Handle h, unsigned chan, lsampl_t & samp)
   c.cmd = Cmd::Query;
   c.object = Cmd::DAQ;
   c.handle = daq2h(h);
-  c.daqGetPut.chan = chan;
-  c.daqGetPut.doit = true;
+  c.daqGetPut().chan = chan;
 
   // NB: there was a bug where multiple threads would write to the kernel
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) {
-    samp = c.daqGetPut.sample;
+  if (transact(c) && c.status == Cmd::Ok) {
+    samp = c.daqGetPut().sample;
     return true;
   }
   return false;
 }
 
+bool RTLCoprocess::getAccum(Handle h, DAQAccum & out)
+{
+  if (!isdaqh(h)) return false;
+  Cmd c;
+  c.cmd = Cmd::Query;
+  c.object = Cmd::DAQ;
+  c.handle = daq2h(h);
+  c.daqAccum();
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  if (transact(c) && c.status == Cmd::Ok) {
+    out = c.daqAccum();
+    return true;
+  }
+  return false;
+}
+
+bool RTLCoprocess::setChanDivisor(Handle h, unsigned chan, unsigned divisor)
+{
+  if (!isdaqh(h)) return false;
+  Cmd c;
+  c.cmd = Cmd::Modify;
+  c.object = Cmd::DAQ;
+  c.handle = daq2h(h);
+  c.daqDivisor().chan = chan;
+  c.daqDivisor().divisor = divisor;
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  return transact(c) && c.status == Cmd::Ok;
+}
+
+bool RTLCoprocess::setOversample(Handle h, unsigned n)
+{
+  if (!isdaqh(h)) return false;
+  Cmd c;
+  c.cmd = Cmd::Modify;
+  c.object = Cmd::DAQ;
+  c.handle = daq2h(h);
+  c.daqOversample() = n;
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  return transact(c) && c.status == Cmd::Ok;
+}
+
+bool RTLCoprocess::setChanFilter(Handle h, unsigned chan, const DAQFilter & f)
+{
+  if (!isdaqh(h)) return false;
+  Cmd c;
+  c.cmd = Cmd::Modify;
+  c.object = Cmd::DAQ;
+  c.handle = daq2h(h);
+  c.daqFilter().chan = chan;
+  c.daqFilter().f = f;
+
+  // NB: there was a bug where multiple threads would write to the kernel
+  // fifo and thus hang the system...
+  MutexLocker locker (fifo_mut);
+
+  return transact(c) && c.status == Cmd::Ok;
+}
+
 bool RTLCoprocess::putSample(Handle h, unsigned chan, lsampl_t samp)
 {
   if (!isdaqh(h)) return false;
@@ -481,20 +922,39 @@ bool RTLCoprocess::putSample(Handle h, unsigned chan, lsampl_t samp)
   c.cmd = Cmd::Modify;
   c.object = Cmd::DAQ;
   c.handle = daq2h(h);
-  c.daqGetPut.chan = chan;
-  c.daqGetPut.sample = samp;
-  c.daqGetPut.doit = true;
+  c.daqGetPut().chan = chan;
+  c.daqGetPut().sample = samp;
 
   // NB: there was a bug where multiple threads would write to the kernel
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) 
+  if (transact(c) && c.status == Cmd::Ok) 
     return true;
   return false;
 }
 
 
+bool RTLCoprocess::putBits(const std::vector<Bits> & w)
+{
+  if (w.size() > Cmd::DAQBitsMax) return false;
+  Cmd c;
+  c.cmd = Cmd::Modify;
+  c.object = Cmd::DAQ;
+  Cmd::DAQBits & b = c.daqBits();
+  b.n = w.size();
+  for (unsigned i = 0; i < w.size(); ++i) {
+    if (!isdaqh(w[i].h)) return false;
+    b.w[i].handle = daq2h(w[i].h);
+    b.w[i].mask = w[i].mask;
+    b.w[i].bits = w[i].bits;
+  }
+
+  MutexLocker locker (fifo_mut);
+
+  return transact(c) && c.status == Cmd::Ok;
+}
+
 bool RTLCoprocess::setParams(Handle h, const PWMVParams &p)
 {
   if (!ispwmh(h)) return false;
@@ -507,10 +967,10 @@ bool RTLCoprocess::setParams(Handle h, const PWMVParams &p)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) {
-    c.pwmParams = p;
+  if (transact(c) && c.status == Cmd::Ok) {
+    c.pwmParams() = p;
     c.cmd = Cmd::Modify;
-    if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok)       
+    if (transact(c) && c.status == Cmd::Ok)       
       return true;
   }
   return false;  
@@ -528,8 +988,8 @@ bool RTLCoprocess::getParams(Handle h, PWMVParams &out)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) {
-    out = c.pwmParams;    
+  if (transact(c) && c.status == Cmd::Ok) {
+    out = c.pwmParams();    
     return true;
   }
   return false;    
@@ -548,13 +1008,13 @@ bool RTLCoprocess::setLogging(Handle h, bool b, int t)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) {
+  if (transact(c) && c.status == Cmd::Ok) {
     c.cmd = Cmd::Modify;
     if (b) 
       c.datalog.mask |= t;
     else
       c.datalog.mask &= ~t;
-    return c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok;
+    return transact(c) && c.status == Cmd::Ok;
   }
   return false;
 }
@@ -567,21 +1027,20 @@ bool RTLCoprocess::setLogging(Handle h, bool b, unsigned chan, int id)
   else if (ispidh(h)) return false;
   else if (isdaqh(h)) h = daq2h(h), c.object = Cmd::DAQ;
   c.handle = h;
-  c.daqGetPut.doit = false;
-  if (chan >= 32) return false;
+  if (chan >= Cmd::DAQLogChans) return false;
 
   // NB: there was a bug where multiple threads would write to the kernel
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) {
+  if (transact(c) && c.status == Cmd::Ok) {
     c.cmd = Cmd::Modify;
     if (b) 
       c.datalog.mask |= 1<<chan;
     else
       c.datalog.mask &= ~(1<<chan), id = -1;
-    c.datalog.ids[chan] = id;
-    return c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok;
+    c.daqLogIds().ids[chan] = id;
+    return transact(c) && c.status == Cmd::Ok;
   }
   return false;
 }
@@ -591,7 +1050,7 @@ bool RTLCoprocess::getLogging(Handle h, int t)
   Cmd c;
   c.cmd = Cmd::Query;
   if (ispwmh(h)) h = pwm2h(h), c.object = Cmd::PWM;
-  else if (isdaqh(h)) h = daq2h(h), c.object = Cmd::DAQ, c.daqGetPut.doit = false, t = 1<<t;
+  else if (isdaqh(h)) h = daq2h(h), c.object = Cmd::DAQ, t = 1<<t;
   else if (ispidh(h)) h = pid2h(h), c.object = Cmd::PID;
   c.handle = h;
 
@@ -599,7 +1058,7 @@ bool RTLCoprocess::getLogging(Handle h, int t)
   // fifo and thus hang the system...
   MutexLocker locker (fifo_mut);
 
-  if (c.writeFifo(&fifo) && c.readFifo(&fifo) && c.status == Cmd::Ok) {
+  if (transact(c) && c.status == Cmd::Ok) {
     return c.datalog.mask & t;
   }
   return false;
@@ -609,16 +1068,31 @@ void RTLCoprocess::run()
 {
   while (!stopDataEventGrabberThread) {
     DataEvent e;
-    fifo_datalog.read(&e, sizeof(e));
+    const bool got = readEvent(e);
     if (stopDataEventGrabberThread) break; // may have gotten a cancellation here
-    data_mut.lock();
-    data_events.push_back(e);
-    if (++num_data_events > max_data_events) 
-      data_events.pop_front(), --num_data_events;
-    data_mut.unlock();    
+    if (!got) continue;
+    addEvent(e);
+    hook_mut.lock();
+    if (eventHook) eventHook->dataEvent(e);
+    hook_mut.unlock();
   }
 }
 
+void RTLCoprocess::addEvent(const DataEvent & e)
+{
+  data_mut.lock();
+  data_events.push_back(e);
+  if (++num_data_events > max_data_events) 
+    data_events.pop_front(), --num_data_events;
+  data_mut.unlock();    
+}
+
+void RTLCoprocess::setEventHook(EventHook *h)
+{
+  MutexLocker l(hook_mut);
+  eventHook = h;
+}
+
 // from datalog
 unsigned RTLCoprocess::numEvents() const
 {
@@ -39,7 +39,7 @@ public:
   
   Handle createPID(unsigned datalog_id, const PIDFCParams &, const std::string & daq_ai = "", const std::string & daq_ao = "");
   Handle createPWM(unsigned datalog_id, const PWMVParams &, const std::string &daq);
-  Handle createDAQ(const std::string & name, unsigned rate, unsigned minor, unsigned sdev, unsigned chan_mask, unsigned range, unsigned aref, bool if_its_dio_is_it_output_mode = true, const double *rangeOvrMin = 0, const double * rangeOvrMax = 0);
+  Handle createDAQ(const std::string & name, unsigned rate, unsigned minor, unsigned sdev, unsigned chan_mask, unsigned range, unsigned aref, bool if_its_dio_is_it_output_mode = true, const double *rangeOvrMin = 0, const double * rangeOvrMax = 0, const ThreadAttrs *thread = 0, bool writeOnChange = false, unsigned refreshMs = 0);
   bool start(Handle);
   bool stop(Handle);
   bool destroy(Handle);
@@ -55,10 +55,66 @@ public:
   bool getVClip(Handle h, double & min, double & max);
   bool setVClip(Handle h, double min, double  max);
   bool setCoeffs(Handle h, double a, double b, double c, double d);
+  /// PID only -- replaces the raw sample -> flow table, see CalibLUT.
+  /// flow[i] is the flow at sample i << shift.  An empty table makes the
+  /// controller go back to evaluating the cubic.
+  bool setCalibLUT(Handle h, const std::vector<float> & flow, unsigned shift);
+  /// PID only -- replaces the feed-forward table, see PIDFCParams::ff_n
+  bool setFeedForward(Handle h, unsigned n, const double *flow, const double *v);
+  /// PID only -- selects the controller structure and its process model,
+  /// see PIDFCParams::ctl_type
+  bool setSmithModel(Handle h, int ctl_type, double a, double b, unsigned delay);
+  /// PID only -- starts a relay auto-tune experiment, or stops one if
+  /// t.state is RelayTune::Aborted.  The PID must be running.
+  bool startRelayTune(Handle h, const RelayTune & t);
+  /// PID only -- progress/results of the relay experiment
+  bool getRelayTune(Handle h, RelayTune & out);
+  /// PID only -- replaces the setpoint waveform, see Waveform.  at[i] is
+  /// in control periods, interp a Waveform::Interp.  Refused while one
+  /// is playing.
+  bool setWaveform(Handle h, const std::vector<unsigned> & at, const std::vector<float> & flow, int interp);
+  /// PID only -- starts or aborts waveform playback per c.action.  On a
+  /// start c.startAt comes back as the time it will begin.
+  bool controlWaveform(Handle h, Waveform::Control & c);
+  /// PID only -- waveform playback status
+  bool getWaveform(Handle h, Waveform::Control & out);
+  /// replaces the trial program, see SeqStep.  The handles in the steps
+  /// are this class's (a DAQ task's for Bits, a PID's for Flow, a PWM's
+  /// for PWM) and are converted here.  Refused while a program runs.
+  bool loadSequence(const std::vector<SeqStep> & steps);
+  /// starts or aborts the trial program per c.action
+  bool controlSequence(const SeqProgram::Control & c);
+  /// trial program status
+  bool getSequence(SeqProgram::Control & out);
+  /// sets (or with t.edge Trigger::Off, clears) trigger slot.  t.daq is
+  /// the input DAQ task's handle, the actions' handles are as for
+  /// loadSequence().
+  bool setTrigger(unsigned slot, const Trigger & t);
+  /// trigger slot's status, t.daq as given to setTrigger()
+  bool getTrigger(unsigned slot, Trigger & out);
+  /// a PID's fault flag, see OlfPIDFault
+  struct PIDFault { bool faulted; unsigned count; };
+  /// every PID slot's fault flag, out[i] for the PID with Handle i.  Read
+  /// straight from shared memory, so it's cheap to poll.
+  bool getPIDFaults(std::vector<PIDFault> & out) const;
   bool getLastOutV(Handle h, double & out);
   bool getLastInV(Handle h, double & out);
   bool getSample(Handle h, unsigned chan, lsampl_t & samp);
   bool putSample(Handle h, unsigned chan, lsampl_t samp);
+  /// DAQ only -- the lines in mask of DAQ task h set to bits
+  struct Bits { Handle h; unsigned mask, bits; };
+  /// DAQ only -- writes several DAQ tasks' lines in one command, so that
+  /// none of their periodic threads sees part of it, see
+  /// Kernel::DAQTask::putBits().  At most Cmd::DAQBitsMax tasks, each once.
+  bool putBits(const std::vector<Bits> & w);
+  /// DAQ only -- snapshot of the task's running sample sums, see DAQAccum
+  bool getAccum(Handle h, DAQAccum & out);
+  /// DAQ only -- has chan read every divisor'th tick, see Kernel::DAQTask::setChanDivisor()
+  bool setChanDivisor(Handle h, unsigned chan, unsigned divisor);
+  /// DAQ only, before start() -- see Kernel::DAQTask::setOversample()
+  bool setOversample(Handle h, unsigned n);
+  /// DAQ only -- see Kernel::DAQTask::setChanFilter()
+  bool setChanFilter(Handle h, unsigned chan, const DAQFilter & f);
   bool setParams(Handle h, const PWMVParams &);
   bool getParams(Handle h, PWMVParams &out);
   bool setLogging(Handle h, bool, int t);
@@ -71,6 +127,20 @@ public:
   unsigned getEvents(std::list<DataEvent> & out, unsigned start, unsigned num, bool = false);
   /// from DataLog superclass
   void clearEvents();
+  /// appends e to the data log, for events that don't come from the
+  /// kernel (see AlarmEngine)
+  void addEvent(const DataEvent & e);
+
+  /// Sees every data log event as the grabber thread gets it from the
+  /// kernel, in order.  Runs on the grabber thread, so it has to be quick.
+  struct EventHook
+  {
+    virtual ~EventHook() {}
+    virtual void dataEvent(const DataEvent & e) = 0;
+  };
+  /// replaces the event hook, null for none.  Once this returns the old
+  /// one isn't being called any more.
+  void setEventHook(EventHook *h);
 
 private:
   static Handle h2pwm(Handle h) { return (h+1) << 12; }
@@ -82,12 +152,26 @@ private:
   static bool ispidh(Handle h) { return (h&((0x1<<12)-1)) || !h; }
   static Handle h2pid(Handle h) { return h; }
   static Handle pid2h(Handle h) { return h; }
+  /// converts a SeqStep's handle to the kernel's, false if it's the wrong kind
+  static bool kernelStep(SeqStep & s);
+  /// sends c to the coprocess and reads its reply back into c, the
+  /// caller holds fifo_mut
+  bool transact(Cmd & c);
+  /// the next data log event from the coprocess, blocks till there's one
+  bool readEvent(DataEvent & e);
+  /// the coprocess's shared memory, null if it isn't loaded
+  const OlfCoprocessShm *coprocessShm() const;
 
   const String modname;
+#ifdef COMEDI_SIM
+  bool hosted; ///< ModuleInit() was called, see rtl_coprocess/ModuleSim.h
+#else
   RTShm<OlfCoprocessShm> shm;
   RTFifo fifo, fifo_datalog;
+#endif
   volatile bool stopDataEventGrabberThread;
-  mutable Mutex fifo_mut, data_mut;
+  mutable Mutex fifo_mut, data_mut, hook_mut;
+  EventHook *eventHook;
   std::list<DataEvent> data_events;
   volatile unsigned num_data_events;
   static const unsigned max_data_events = 65535;
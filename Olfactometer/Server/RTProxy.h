@@ -5,6 +5,11 @@
 
 class RTProxy
 {
+public:
+  /// the coprocess object this stands for, eg. for building a trial
+  /// program (see TrialSequencer)
+  RTLCoprocess *rtCoprocess() const { return coprocess; }
+  RTLCoprocess::Handle rtHandle() const { return handle; }
 protected:
   RTProxy() : coprocess(0), handle(RTLCoprocess::Failure) {}
   RTLCoprocess *coprocess;
@@ -0,0 +1,75 @@
+#include "Registry.h"
+#include "Olfactometer.h"
+#include "StartStoppable.h"
+#include "Saveable.h"
+#include "Controller.h"
+#include "DataLogable.h"
+#include "Calib.h"
+
+namespace {
+  /// c if it's a T, else its first direct child that is one
+  template <typename T> T *selfOrChild(Component *c)
+  {
+    T *t = dynamic_cast<T *>(c);
+    if (t) return t;
+    std::list<Component *> chlds = c->children(false);
+    for (std::list<Component *>::iterator it = chlds.begin(); it != chlds.end() && !t; ++it)
+      t = dynamic_cast<T *>(*it);
+    return t;
+  }
+}
+
+Registry::Registry(const Component *r)
+  : root(r), generation(0), built(false)
+{}
+
+void Registry::rebuild()
+{
+  MutexLocker l(mut);
+  build();
+}
+
+void Registry::build()
+{
+  byName.clear();
+  names.clear();
+  std::list<Component *> all = root->children(true);
+  for (std::list<Component *>::iterator it = all.begin(); it != all.end(); ++it) {
+    Component *c = *it;
+    if (c->id() >= names.size()) names.resize(c->id() + 1);
+    names[c->id()] = c->name();
+    if (byName.count(c->name())) continue;
+    // names should be unique, but if they aren't the first is whichever
+    // find() would have picked
+    c = root->find(c->name());
+    Entry e;
+    e.comp = c;
+    e.readable = selfOrChild<Readable>(c);
+    e.writeable = selfOrChild<Writeable>(c);
+    e.saveable = selfOrChild<Saveable>(c);
+    e.dataLogable = dynamic_cast<DataLogable *>(c);
+    e.startStoppable = dynamic_cast<StartStoppable *>(c);
+    e.calib = dynamic_cast<Calib *>(c);
+    e.controller = dynamic_cast<Controller *>(c);
+    e.enableable = dynamic_cast<Enableable *>(c);
+    byName[c->name()] = e;
+  }
+  generation = Component::treeGeneration();
+  built = true;
+}
+
+const Registry::Entry *Registry::find(const std::string & name)
+{
+  MutexLocker l(mut);
+  rebuildIfStale();
+  EntryMap::const_iterator it = byName.find(name);
+  return it == byName.end() ? 0 : &it->second;
+}
+
+std::string Registry::nameOf(unsigned id)
+{
+  MutexLocker l(mut);
+  rebuildIfStale();
+  if (id < names.size() && names[id].length()) return names[id];
+  return Component::nameFromId(id); // a component outside the tree
+}
@@ -0,0 +1,74 @@
+#ifndef Registry_H
+#define Registry_H
+
+#include <string>
+#include <vector>
+#include <tr1/unordered_map>
+#include "Component.h"
+#include "Mutex.h"
+
+class Readable;
+class Writeable;
+class Enableable;
+class DataLogable;
+class StartStoppable;
+class Saveable;
+class Calib;
+class Controller;
+
+/**
+   The olfactometer's components flattened: by name, what
+   root->find(name) would return along with the interfaces it has
+   already dynamic_cast to, and by id, the name.  So a protocol command
+   finds its target with one hash lookup instead of a recursive search
+   and a chain of casts.
+
+   It's rebuilt lazily, on the first lookup after the component tree
+   changes (see Component::treeGeneration()), which in practice is just
+   after ComediOlfactometer::doSetup().
+*/
+class Registry
+{
+public:
+  /// a component and its interfaces, null where it has none.  readable,
+  /// writeable and saveable fall back to its first direct child that
+  /// has them, as READ, WRITE and SAVE always have.
+  struct Entry
+  {
+    Component *comp;
+    Readable *readable;
+    Writeable *writeable;
+    Saveable *saveable;
+    DataLogable *dataLogable;
+    StartStoppable *startStoppable;
+    Calib *calib;
+    Controller *controller;
+    Enableable *enableable;
+  };
+
+  explicit Registry(const Component *root);
+
+  /// name's entry, or null if there's no such component.  It stays
+  /// valid as long as the tree doesn't change, so hold the
+  /// olfactometer's lock while using it.
+  const Entry *find(const std::string & name);
+  /// the name of the component with id, as Component::nameFromId()
+  std::string nameOf(unsigned id);
+
+  /// builds it now rather than on the next lookup
+  void rebuild();
+
+private:
+  void build(); ///< mut is held
+  void rebuildIfStale() { if (!built || generation != Component::treeGeneration()) build(); }
+
+  const Component *root;
+  typedef std::tr1::unordered_map<std::string, Entry> EntryMap;
+  EntryMap byName;
+  std::vector<std::string> names; ///< by id, "" if not in the tree
+  unsigned generation; ///< the tree's when last built
+  bool built;
+  Mutex mut;
+};
+
+#endif
@@ -38,6 +38,7 @@ extern int h_errno;
 #include "Monitor.h"
 #include "ConsoleUI.h"
 #include "GenConf.h"
+#include "Thread.h"
 #include "RTLCoprocess.h"
 
 #define DEFAULT_LISTEN "0.0.0.0" // listen on all interfaces by default
@@ -214,6 +215,15 @@ int main(int argc, char *argv[])
        coprocess_ptr = 0;
    }
 
+#ifdef COMEDI_SIM
+   {
+     // simulated boards follow the board names in the config file
+     std::string boards = settings.get(Conf::Sections::Devices, Conf::Keys::comediboards);
+     Log() << "Using " << simcomedi_set_boards(boards.c_str()) << " *simulated* comedi boards: " << boards << "\n";
+     if (coprocess_ptr) Log() << "Simulation build: the coprocess runs in-process, see rtl_coprocess/ModuleSim.h\n";
+   }
+#endif
+
    olf.doProbe();
    
    if (olf.nDevs() == 0) {
@@ -225,6 +235,13 @@ int main(int argc, char *argv[])
 
    DoGeneralSetup(conf, settings); // misc setup items, sets some global vars
 
+   if (String(settings.get(Conf::Sections::General, Conf::Keys::lock_memory)).lower() == "yes") {
+     // keep the server's pages (and those of the data logging and PID
+     // setpoint paths it drives) resident so they never page fault
+     if (Thread::lockMemory()) Log() << "Locked all process memory into RAM.\n";
+     else Warning() << "Could not lock process memory into RAM (lock_memory = yes), are we root?\n";
+   }
+
    if ( !olf.doSetup(settings, coprocess_ptr) ) {
      Error() << "Could not initialize olfactometer, exiting.\n";
      return 3;
@@ -242,7 +259,7 @@ int main(int argc, char *argv[])
      l << "\n";       
    }
 
-   if (!monitor.start(settings, &olf)) {
+   if (!monitor.start(settings, &olf, coprocess_ptr)) {
      Error() << "Could not start system monitor thread, exiting.\n";     
      return 4;
    }
@@ -0,0 +1,190 @@
+#include "SysId.h"
+#include "PolynomialFit.h"
+#include <math.h>
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+  typedef std::vector<double> Vec;
+
+  unsigned NumParams(unsigned order) { return 2*order + 1; }
+
+  /// the valve voltage at sample i, held at u[0] before the series starts
+  double U(const SysId::Series & s, int i) { return s.u[i > 0 ? i : 0]; }
+
+  /// least squares ARX fit of the given order and delay over rows k0..N-2
+  bool FitARX(const SysId::Series & s, unsigned order, unsigned d, unsigned k0, Vec & theta, double & rss)
+  {
+    const unsigned N = s.y.size(), n = NumParams(order), m = N - 1 - k0;
+    Vec A(m*n), y(m);
+    for (unsigned r = 0; r < m; ++r) {
+      const unsigned k = k0 + r;
+      double *row = &A[r*n];
+      for (unsigned j = 0; j < order; ++j) {
+        row[j] = s.y[k-j];
+        row[order+j] = U(s, int(k) - int(d) - int(j));
+      }
+      row[n-1] = 1.;
+      y[r] = s.y[k+1];
+    }
+    if (!PolynomialFit::LeastSquares(A, y, n, theta)) return false;
+    rss = 0.;
+    for (unsigned r = 0; r < m; ++r) {
+      double p = 0.;
+      for (unsigned j = 0; j < n; ++j) p += A[r*n + j] * theta[j];
+      rss += (y[r] - p) * (y[r] - p);
+    }
+    return true;
+  }
+
+  /// fills in the continuous parameters from m.arx, false if they don't make sense
+  bool ToContinuous(SysId::Model & m, double T)
+  {
+    std::ostringstream os;
+    const Vec & c = m.arx;
+    double asum, bsum;
+    if (m.order == 1) {
+      const double a = c[0];
+      if (!(a > 0. && a < 1.)) { os << "first order pole " << a << " is not in (0,1)"; m.msg = os.str(); return false; }
+      m.tau1 = -T / log(a);
+      m.tau2 = 0.;
+      asum = a, bsum = c[1];
+    } else {
+      const double disc = c[0]*c[0] + 4.*c[1];
+      if (disc < 0.) { m.msg = "second order poles are complex (underdamped)"; return false; }
+      const double p1 = (c[0] + sqrt(disc)) / 2., p2 = (c[0] - sqrt(disc)) / 2.;
+      if (!(p1 < 1. && p2 > 0.)) { os << "second order poles " << p1 << ", " << p2 << " are not in (0,1)"; m.msg = os.str(); return false; }
+      m.tau1 = -T / log(p1);
+      m.tau2 = -T / log(p2);
+      asum = c[0] + c[1], bsum = c[2] + c[3];
+    }
+    m.K = bsum / (1. - asum);
+    if (m.K == 0.) { m.msg = "the flow doesn't respond to the valve"; return false; }
+    m.theta = m.delay * T;
+    return true;
+  }
+
+  /// the model run from u alone, from the measured history at k0
+  double FitPct(const SysId::Model & m, const SysId::Series & s, unsigned k0)
+  {
+    const unsigned N = s.y.size(), o = m.order, n = NumParams(o);
+    Vec ys(s.y.begin(), s.y.begin() + k0 + 1);
+    ys.resize(N);
+    double mean = 0., err = 0., var = 0.;
+    for (unsigned k = k0; k + 1 < N; ++k) {
+      double p = m.arx[n-1];
+      for (unsigned j = 0; j < o; ++j) p += m.arx[j] * ys[k-j] + m.arx[o+j] * U(s, int(k) - int(m.delay) - int(j));
+      ys[k+1] = p;
+      mean += s.y[k+1];
+    }
+    mean /= (N - 1 - k0);
+    for (unsigned k = k0 + 1; k < N; ++k) {
+      err += (s.y[k] - ys[k]) * (s.y[k] - ys[k]);
+      var += (s.y[k] - mean) * (s.y[k] - mean);
+    }
+    return var > 0. ? 100. * (1. - sqrt(err / var)) : 0.;
+  }
+
+  SysId::Model FitOrder(const SysId::Series & s, unsigned order, unsigned maxD, unsigned k0)
+  {
+    SysId::Model best;
+    best.order = order;
+    double bestRss = -1.;
+    Vec th;
+    double rss;
+    for (unsigned d = 0; d <= maxD; ++d)
+      if (FitARX(s, order, d, k0, th, rss) && (bestRss < 0. || rss < bestRss))
+        bestRss = rss, best.arx = th, best.delay = d;
+    if (bestRss < 0.) { best.msg = "the data doesn't determine a model (not enough excitation?)"; return best; }
+    if (!ToContinuous(best, s.T)) return best;
+    const double n = s.y.size() - 1 - k0, k = NumParams(order) + 1; // + 1 for the delay
+    best.rms = sqrt(bestRss / n);
+    best.aicc = n * log(std::max(bestRss, 1e-300) / n) + 2.*k + 2.*k*(k+1.)/(n-k-1.);
+    best.fitPct = FitPct(best, s, k0);
+    best.ok = true;
+    return best;
+  }
+}
+
+bool SysId::MakeSeries(const std::vector<Datum> & data, Series & out, std::string & err)
+{
+  Vec t, y, u;
+  bool haveU = false;
+  double curU = 0.;
+  for (unsigned i = 0; i < data.size(); ++i) {
+    const Datum & d = data[i];
+    if (!d.isFlow) {
+      curU = d.v;
+      if (haveU && !u.empty()) u.back() = curU;
+      haveU = true;
+      continue;
+    }
+    if (!haveU) continue;
+    t.push_back(d.t), y.push_back(d.v), u.push_back(curU);
+  }
+  if (t.size() < 20) { err = "need both flow and vout logged (Raw and Cooked data), over at least 20 periods"; return false; }
+
+  Vec dt;
+  for (unsigned i = 1; i < t.size(); ++i) dt.push_back(t[i] - t[i-1]);
+  std::nth_element(dt.begin(), dt.begin() + dt.size()/2, dt.end());
+  const double T = dt[dt.size()/2];
+  if (!(T > 0.)) { err = "log timestamps don't advance"; return false; }
+
+  // longest run without a gap
+  unsigned b = 0, e = 1, start = 0;
+  for (unsigned i = 1; i <= t.size(); ++i)
+    if (i == t.size() || t[i] - t[i-1] > 2.5 * T) {
+      if (i - start > e - b) b = start, e = i;
+      start = i;
+    }
+  if (e - b < 20) { err = "the log has gaps every few periods"; return false; }
+
+  const unsigned f = (e - b + MaxSamples - 1) / MaxSamples;
+  out = Series();
+  out.T = T * f;
+  out.t0 = t[b];
+  for (unsigned i = b; i + f <= e; i += f) {
+    double sy = 0., su = 0.;
+    for (unsigned j = i; j < i + f; ++j) sy += y[j], su += u[j];
+    out.y.push_back(sy / f);
+    out.u.push_back(su / f);
+  }
+  return true;
+}
+
+SysId::Model SysId::Identify(const Series & s, unsigned order, double maxDeadS)
+{
+  Model ret;
+  const unsigned N = s.y.size();
+  if (order > 2) { ret.msg = "order must be 1 or 2"; return ret; }
+  if (N != s.u.size() || !(s.T > 0.)) { ret.msg = "bad series"; return ret; }
+  const double umin = *std::min_element(s.u.begin(), s.u.end()), umax = *std::max_element(s.u.begin(), s.u.end());
+  if (umax - umin < 1e-6) { ret.msg = "the valve voltage doesn't change in the window, log a setpoint step"; return ret; }
+
+  unsigned maxD = maxDeadS < 0. ? N / 4 : static_cast<unsigned>(maxDeadS / s.T + 0.5);
+  maxD = std::min(maxD, N / 2);
+  // the same rows for every fit, so their residuals compare.  Before
+  // the window the valve is taken to have been steady at u[0]
+  const unsigned k0 = 1;
+  if (N < k0 + 1 + 4 * NumParams(2)) { ret.msg = "the window is too short"; return ret; }
+
+  if (order) return FitOrder(s, order, maxD, k0);
+  Model m1 = FitOrder(s, 1, maxD, k0), m2 = FitOrder(s, 2, maxD, k0);
+  if (m2.ok && (!m1.ok || m2.aicc < m1.aicc)) return m2;
+  return m1;
+}
+
+SysId::Tuning SysId::SIMC(const Model & m, double T, double tauC, bool smith)
+{
+  Tuning r;
+  double tau = m.tau1, theta = m.theta;
+  if (m.order == 2) tau += m.tau2 / 2., theta += m.tau2 / 2.;
+  r.tau = tau, r.theta = theta;
+  r.tauC = tauC > 0. ? tauC : (theta > 0. ? theta : T);
+  const double seen = smith ? 0. : theta;
+  r.Kc = tau / (m.K * (r.tauC + seen));
+  r.Ti = std::min(tau, 4. * (r.tauC + seen));
+  r.predictor = theta > tau;
+  return r;
+}
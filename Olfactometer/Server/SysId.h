@@ -0,0 +1,116 @@
+#ifndef SysId_H
+#define SysId_H
+
+/// @file SysId.h -- process models of a flow loop identified from its data log
+
+#include <vector>
+#include <string>
+
+/**
+   Offline identification of the valve -> flow process a PID flow
+   controller drives, from the "vout" and "flow" data it logs every
+   period (see Kernel::PIDFlowController).  Any stretch of log with the
+   valve voltage moving works, a setpoint step being the usual one.
+
+   Discrete ARX models with an offset term,
+
+     first order:  y[k+1] = a y[k] + b u[k-d] + c
+     second order: y[k+1] = a1 y[k] + a2 y[k-1] + b1 u[k-d] + b2 u[k-d-1] + c
+
+   are fit by linear least squares (PolynomialFit::LeastSquares()) for
+   every dead time d up to a maximum, keeping the d with the smallest
+   residual, and then converted to the continuous first or second order
+   plus dead time (FOPDT / SOPDT) models the tuning rules want:
+   K e^(-theta s) / ((tau1 s + 1)(tau2 s + 1)).
+
+   Both orders are fit over the same samples and Identify() picks one
+   by AICc, so the second order model is only used if it is materially
+   better.  A second order fit whose poles aren't real and in (0,1)
+   (ie. not two real time constants) is rejected.
+
+   Used by the IDENTIFY protocol command and by the standalone sysid
+   tool, which reads saved GET DATA LOG output.
+*/
+namespace SysId
+{
+  /// one logged datum of the controller being identified
+  struct Datum
+  {
+    double t;    ///< seconds
+    bool isFlow; ///< "flow" if true, else "vout"
+    double v;
+  };
+
+  /// a controller's valve volts and flow on its control period grid
+  struct Series
+  {
+    Series() : T(0.), t0(0.) {}
+    double T;  ///< sample period, seconds
+    double t0; ///< time of y[0]
+    std::vector<double> u; ///< u[k] is the valve voltage written after y[k] was read
+    std::vector<double> y;
+  };
+
+  /**
+     Pairs the flows and valve voltages up into a Series, from the
+     longest stretch without gaps (eg. the loop being stopped).  Long
+     series are block averaged down to MaxSamples.
+
+     @param data in time order
+     @returns false with err set if there is too little or no usable data
+  */
+  extern bool MakeSeries(const std::vector<Datum> & data, Series & out, std::string & err);
+  enum { MaxSamples = 4000 };
+
+  struct Model
+  {
+    Model() : ok(false), order(0), K(0.), tau1(0.), tau2(0.), theta(0.), delay(0), rms(0.), fitPct(0.), aicc(0.) {}
+    bool ok;
+    std::string msg; ///< why not ok
+    unsigned order;  ///< 1 (FOPDT) or 2 (SOPDT)
+    double K;        ///< steady state gain, flow per valve volt
+    double tau1, tau2; ///< time constants, seconds, tau1 >= tau2 (0 for first order)
+    double theta;    ///< dead time, seconds
+    unsigned delay;  ///< dead time, samples
+    std::vector<double> arx; ///< a.., b.., c as in the class comment
+    double rms;      ///< one step ahead prediction error, flow units
+    double fitPct;   ///< 100 (1 - |y - ysim| / |y - mean y|) of the model simulated from u alone
+    double aicc;
+  };
+
+  /**
+     Fits the model of the given order (1 or 2), or with order 0 both,
+     returning the better one.
+
+     @param maxDeadS longest dead time considered, seconds, < 0 for a
+     quarter of the series
+  */
+  extern Model Identify(const Series & s, unsigned order = 0, double maxDeadS = -1.);
+
+  /// textbook PI settings for a model
+  struct Tuning
+  {
+    Tuning() : Kc(0.), Ti(0.), tauC(0.), tau(0.), theta(0.), predictor(false) {}
+    double Kc;   ///< valve volts per unit of (set - actual) flow
+    double Ti;   ///< seconds
+    double tauC; ///< closed loop time constant used
+    double tau, theta; ///< the first order plus dead time model the rules used
+    bool predictor; ///< dead time dominates: a Smith predictor would do much better than PI
+  };
+
+  /**
+     Skogestad's SIMC PI rules: Kc = tau1 / (K (tauC + theta)),
+     Ti = min(tau1, 4 (tauC + theta)).  The loop has no derivative
+     action, so a second order model is first reduced by his half rule
+     (half of tau2 goes to tau1, half to theta).  tauC <= 0 means
+     tauC = theta (or one sample period T if there is no dead time), the
+     recommended tight but robust setting.
+
+     With smith true the gains are for the PI inside a Smith predictor
+     built on (K, tau, theta), which sees the process without its dead
+     time: theta is taken as 0 in the rules, tauC still defaults to it.
+  */
+  extern Tuning SIMC(const Model & m, double T, double tauC = -1., bool smith = false);
+}
+
+#endif
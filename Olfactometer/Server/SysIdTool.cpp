@@ -0,0 +1,80 @@
+/*
+  sysid -- offline version of the IDENTIFY protocol command, for data
+  logs saved from GET DATA LOG (lines of: seconds component meta datum).
+
+  usage: sysid logfile pidflowcontroller [controller=pid|smith] [from|to|order|max_dead_s|tau_c|rate_hz=value ...]
+
+  rate_hz is the controller's update_rate_hz, needed to print its
+  Kp, Ki, Kd (the model and Kc, Ti don't depend on it).
+*/
+#include "SysId.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s logfile pidflowcontroller [controller=pid|smith] [from|to|order|max_dead_s|tau_c|rate_hz=value ...]\n", argv[0]);
+    return 1;
+  }
+  double from = -1., to = -1., maxDead = -1., tauC = -1., rate = 0.;
+  unsigned order = 0;
+  bool smith = false;
+  for (int i = 3; i < argc; ++i) {
+    if (!strcmp(argv[i], "controller=smith") || !strcmp(argv[i], "controller=pid")) {
+      smith = argv[i][11] == 's';
+      continue;
+    }
+    const char *eq = strchr(argv[i], '=');
+    char *end = 0;
+    const double v = eq ? strtod(eq + 1, &end) : 0.;
+    const std::string k = eq ? std::string(argv[i], eq - argv[i]) : "";
+    bool ok = eq && end != eq + 1 && !*end;
+    if (ok) {
+      if (k == "from") from = v;
+      else if (k == "to") to = v;
+      else if (k == "order" && (v == 0. || v == 1. || v == 2.)) order = static_cast<unsigned>(v);
+      else if (k == "max_dead_s" && v >= 0.) maxDead = v;
+      else if (k == "tau_c" && v > 0.) tauC = v;
+      else if (k == "rate_hz" && v > 0.) rate = v;
+      else ok = false;
+    }
+    if (!ok) { fprintf(stderr, "%s: %s is not a valid parameter=value\n", argv[0], argv[i]); return 1; }
+  }
+
+  FILE *f = fopen(argv[1], "r");
+  if (!f) { perror(argv[1]); return 1; }
+  std::vector<SysId::Datum> data;
+  char line[256], name[128], meta[16];
+  double t, v;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%lf %127s %15s %lf", &t, name, meta, &v) != 4 || strcmp(name, argv[2])) continue;
+    if ((from >= 0. && t < from) || (to >= 0. && t > to)) continue;
+    const bool isFlow = !strcmp(meta, "flow");
+    if (!isFlow && strcmp(meta, "vout")) continue;
+    SysId::Datum d = { t, isFlow, v };
+    data.push_back(d);
+  }
+  fclose(f);
+
+  SysId::Series s;
+  std::string err;
+  if (!SysId::MakeSeries(data, s, err)) { fprintf(stderr, "%s: %s\n", argv[0], err.c_str()); return 2; }
+  SysId::Model m = SysId::Identify(s, order, maxDead);
+  if (!m.ok) { fprintf(stderr, "%s: %s\n", argv[0], m.msg.c_str()); return 2; }
+  SysId::Tuning tu = SysId::SIMC(m, s.T, tauC, smith);
+
+  printf("from=%f to=%f samples=%u T=%g\n", s.t0, s.t0 + s.T * (s.y.size() - 1), unsigned(s.y.size()), s.T);
+  printf("model=%s K=%g tau1=%g", m.order == 1 ? "fopdt" : "sopdt", m.K, m.tau1);
+  if (m.order == 2) printf(" tau2=%g", m.tau2);
+  printf(" theta=%g rms=%g fit_pct=%g\n", m.theta, m.rms, m.fitPct);
+  if (smith) printf("controller=smith model_gain=%g model_tau_s=%g model_dead_s=%g\n", m.K, tu.tau, tu.theta);
+  printf("Kc=%g Ti=%g tau_c=%g", tu.Kc, tu.Ti, tu.tauC);
+  // as PIDFlowController::loopGains()
+  if (rate > 0.) printf(" Kp=%g Ki=0 Kd=%g", -tu.Kc / (rate * tu.Ti), -tu.Kc / rate * 1e3);
+  printf("\n");
+  if (tu.predictor && !smith) printf("dead time dominates (theta > tau), controller=smith will outperform PI\n");
+  return 0;
+}
@@ -0,0 +1,339 @@
+#include "TrialSequencer.h"
+#include "ComediOlfactometer.h"
+#include "PIDFlowController.h"
+#include "PWMValveProxy.h"
+#include <sstream>
+#include <algorithm>
+
+const char * const TrialSequencer::DefaultName = "Sequencer";
+
+TrialSequencer::TrialSequencer(Component *parent, const std::string & name, RTLCoprocess *c)
+  : Component(parent, name), coprocess(c), rate(0), newRate(0)
+{}
+
+TrialSequencer::~TrialSequencer()
+{
+  if (rate) stop();
+}
+
+bool TrialSequencer::load(const std::vector<std::string> & program, std::string & err)
+{
+  std::vector<SeqStep> steps;
+  std::vector<unsigned> loops;
+  DIOBatch odors;
+  newRate = 0;
+  for (unsigned i = 0; i < program.size(); ++i) {
+    if (!compileLine(program[i], steps, loops, odors, err)) {
+      std::ostringstream os;
+      os << "line " << i+1 << ": " << err;
+      err = os.str();
+      return false;
+    }
+  }
+  if (!flushOdors(odors, steps, err)) return false;
+  if (!loops.empty()) { err = "loop without an end"; return false; }
+  SeqStep s = SeqStep();
+  s.op = SeqStep::End;
+  steps.push_back(s);
+  if (steps.size() > SeqProgram::MaxSteps) {
+    std::ostringstream os;
+    os << "program is " << steps.size() << " steps, the most is " << SeqProgram::MaxSteps;
+    err = os.str();
+    return false;
+  }
+  const unsigned r = newRate ? newRate : static_cast<unsigned>(DefaultRateHz);
+  for (unsigned i = 0; i < steps.size(); ++i) {
+    if (steps[i].op != SeqStep::Wait) continue;
+    steps[i].a = std::max(1U, static_cast<unsigned>(steps[i].v * r + 0.5));
+    steps[i].v = 0.;
+  }
+  if (!coprocess || !coprocess->loadSequence(steps)) {
+    err = "the RT coprocess refused the program, is one running?";
+    return false;
+  }
+  source = program;
+  rate = r;
+  return true;
+}
+
+bool TrialSequencer::compileLine(const std::string & line, std::vector<SeqStep> & out,
+                                 std::vector<unsigned> & loops, DIOBatch & odors, std::string & err)
+{
+  std::istringstream is(line.substr(0, line.find('#')));
+  std::vector<String> tok;
+  std::string t;
+  while (is >> t) tok.push_back(t);
+  if (tok.empty()) return true;
+
+  const String op = tok[0].lower();
+  if (op != "odor" && !flushOdors(odors, out, err)) return false;
+
+  Component *root = parent();
+  SeqStep s = SeqStep();
+  bool ok = true;
+  if (op == "odor") {
+    if (tok.size() != 3) { err = "need: odor BANK ODOR"; return false; }
+    ComediBank *b = dynamic_cast<ComediBank *>(root->find(tok[1]));
+    if (!b) { err = tok[1] + " not found or not a valve bank"; return false; }
+    unsigned o = tok[2].toUInt(&ok);
+    if (!ok) { // by name then
+      const Bank::OdorTable ot = b->odorTable();
+      Bank::OdorTable::const_iterator it = ot.begin();
+      while (it != ot.end() && it->second.name != tok[2]) ++it;
+      if (it == ot.end()) { err = tok[1] + " has no odor " + tok[2]; return false; }
+      o = it->first;
+    }
+    if (!b->addOdor(o, odors)) { err = tok[1] + ": no odor " + tok[2] + ", or its valves aren't DIO lines"; return false; }
+    if (!odors.daqsOnly()) { err = tok[1] + ": its valves aren't on DAQ tasks"; return false; }
+    return true;
+  } else if (op == "flow") {
+    if (tok.size() != 3) { err = "need: flow NAME FLOW"; return false; }
+    const double f = tok[2].toDouble(&ok);
+    if (!ok) { err = "bad flow " + tok[2]; return false; }
+    Component *c = root->find(tok[1]);
+    // a mix's odor flow goes to its banks as Mix::setOdorFlow() splits it
+    std::vector<std::pair<PIDFlowController *, double> > targets;
+    if (PIDFlowController *pfc = dynamic_cast<PIDFlowController *>(c)) {
+      targets.push_back(std::make_pair(pfc, f));
+    } else if (Mix *m = dynamic_cast<Mix *>(c)) {
+      const Mix::MixtureRatio r = m->mixtureRatios();
+      double sum = 0.;
+      for (Mix::MixtureRatio::const_iterator it = r.begin(); it != r.end(); ++it) sum += it->second;
+      for (Mix::MixtureRatio::const_iterator it = r.begin(); it != r.end(); ++it) {
+        Bank *b = m->getBank(it->first);
+        PIDFlowController *pfc = b ? dynamic_cast<PIDFlowController *>(b->getFlowController()) : 0;
+        if (!pfc) { err = tok[1] + ": bank " + it->first + " has no pid flow controller"; return false; }
+        if (it->second > 0.) targets.push_back(std::make_pair(pfc, f * it->second / sum));
+      }
+      if (targets.empty()) { err = tok[1] + " has no mixture ratio set"; return false; }
+    } else {
+      err = tok[1] + " not found or not a pid flow controller or mix";
+      return false;
+    }
+    for (unsigned i = 0; i < targets.size(); ++i) {
+      PIDFlowController *pfc = targets[i].first;
+      if (targets[i].second < pfc->min() || targets[i].second > pfc->max()) {
+        std::ostringstream os;
+        os << pfc->name() << ": flow " << targets[i].second << " is outside " << pfc->min() << " - " << pfc->max();
+        err = os.str();
+        return false;
+      }
+      if (pfc->rtCoprocess() != coprocess || pfc->rtHandle() == RTLCoprocess::Failure) {
+        err = pfc->name() + " isn't running on the RT coprocess";
+        return false;
+      }
+      s.op = SeqStep::Flow;
+      s.handle = pfc->rtHandle();
+      s.v = targets[i].second;
+      out.push_back(s);
+    }
+    return true;
+  } else if (op == "pwm") {
+    if (tok.size() != 3 && tok.size() != 4) { err = "need: pwm NAME DUTY [WINDOW_S]"; return false; }
+    PWMValveProxy *pwm = dynamic_cast<PWMValveProxy *>(root->find(tok[1]));
+    if (!pwm) { err = tok[1] + " not found or not a pwm valve"; return false; }
+    const double duty = tok[2].toDouble(&ok);
+    if (!ok || duty < 0. || duty > 1.) { err = "duty must be 0 to 1"; return false; }
+    PWMVParams p = pwm->getParams();
+    if (tok.size() == 4) {
+      const double w = tok[3].toDouble(&ok);
+      if (!ok || !(w > 0.)) { err = "bad window " + tok[3]; return false; }
+      p.windowSizeMicros = static_cast<unsigned>(w * 1e6);
+    }
+    s.op = SeqStep::PWM;
+    s.handle = pwm->rtHandle();
+    s.a = p.windowSizeMicros;
+    s.b = static_cast<unsigned>(duty * 100.0);
+  } else if (op == "wait") {
+    if (tok.size() != 2) { err = "need: wait SECONDS"; return false; }
+    const double w = tok[1].toDouble(&ok);
+    if (!ok || w < 0.) { err = "bad wait " + tok[1]; return false; }
+    if (w == 0.) return true;
+    s.op = SeqStep::Wait;
+    s.v = w; // made periods once the rate is known, see load()
+  } else if (op == "mark") {
+    if (tok.size() != 2) { err = "need: mark VALUE"; return false; }
+    s.op = SeqStep::Mark;
+    s.v = tok[1].toDouble(&ok);
+    if (!ok) { err = "bad mark " + tok[1]; return false; }
+  } else if (op == "loop") {
+    if (tok.size() > 2) { err = "need: loop [N]"; return false; }
+    if (loops.size() >= SeqProgram::MaxDepth) { err = "loops nested too deep"; return false; }
+    s.op = SeqStep::Loop;
+    s.a = tok.size() == 2 ? tok[1].toUInt(&ok) : 0;
+    if (!ok) { err = "bad loop count " + tok[1]; return false; }
+    loops.push_back(out.size());
+  } else if (op == "end") {
+    if (tok.size() != 1) { err = "need: end"; return false; }
+    if (loops.empty()) { err = "end without a loop"; return false; }
+    s.op = SeqStep::Next;
+    s.b = loops.back();
+    loops.pop_back();
+  } else {
+    err = "unknown statement " + tok[0] + ", need odor, flow, pwm, wait, mark, loop or end";
+    return false;
+  }
+  out.push_back(s);
+  return true;
+}
+
+bool TrialSequencer::flushOdors(DIOBatch & odors, std::vector<SeqStep> & out, std::string & err)
+{
+  const DIOBatch::DAQBits & d = odors.daqBits();
+  for (DIOBatch::DAQBits::const_iterator it = d.begin(); it != d.end(); ++it) {
+    DAQTaskProxy *daq = it->first;
+    if (daq->rtCoprocess() != coprocess || daq->rtHandle() == RTLCoprocess::Failure) {
+      err = "DAQ task " + daq->name() + " isn't running on the RT coprocess";
+      return false;
+    }
+    SeqStep s = SeqStep();
+    s.op = SeqStep::Bits;
+    s.handle = daq->rtHandle();
+    s.a = it->second.first;
+    s.b = it->second.second;
+    out.push_back(s);
+    newRate = std::max(newRate, daq->rateHz());
+  }
+  odors = DIOBatch();
+  return true;
+}
+
+bool TrialSequencer::run(std::string & err)
+{
+  if (!rate) { err = "no program loaded"; return false; }
+  SeqProgram::Control c;
+  c.action = SeqProgram::Control::Start;
+  c.rate_hz = rate;
+  c.log_id = id();
+  if (!coprocess->controlSequence(c)) {
+    err = "the RT coprocess refused to run the program, is it already running, or was something it uses reconfigured?";
+    return false;
+  }
+  return true;
+}
+
+bool TrialSequencer::arm(std::string & err)
+{
+  if (!rate) { err = "no program loaded"; return false; }
+  SeqProgram::Control c;
+  c.action = SeqProgram::Control::Arm;
+  c.rate_hz = rate;
+  c.log_id = id();
+  if (!coprocess->controlSequence(c)) {
+    err = "the RT coprocess refused to arm the program, is it already running, or was something it uses reconfigured?";
+    return false;
+  }
+  return true;
+}
+
+/*static*/
+bool TrialSequencer::ParseEdge(const std::string & s, int & edge)
+{
+  const String e = String(s).lower();
+  if (e == "rising") edge = Trigger::Rising;
+  else if (e == "falling") edge = Trigger::Falling;
+  else if (e == "both") edge = Trigger::Both;
+  else return false;
+  return true;
+}
+
+/*static*/
+const char *TrialSequencer::EdgeName(int edge)
+{
+  switch (edge) {
+  case Trigger::Rising: return "rising";
+  case Trigger::Falling: return "falling";
+  case Trigger::Both: return "both";
+  }
+  return "off";
+}
+
+bool TrialSequencer::setTrigger(unsigned slot, const TriggerSpec & spec, std::string & err)
+{
+  std::ostringstream os;
+  if (slot >= Trigger::MaxTriggers) {
+    os << "trigger slot must be 0 to " << Trigger::MaxTriggers - 1;
+    err = os.str();
+    return false;
+  }
+  const std::string::size_type colon = spec.input.rfind(':');
+  ComediOlfactometer *olf = dynamic_cast<ComediOlfactometer *>(parent());
+  DAQTaskProxy *daq = olf && colon != std::string::npos ? olf->daqTask(spec.input.substr(0, colon)) : 0;
+  bool ok = daq;
+  const unsigned chan = ok ? String(spec.input.substr(colon + 1)).toUInt(&ok) : 0;
+  if (!ok || chan < daq->fromChan() || chan > daq->toChan()) {
+    err = "input " + spec.input + " is not a daq_task:chan";
+    return false;
+  }
+  if (daq->rtCoprocess() != coprocess || daq->rtHandle() == RTLCoprocess::Failure) {
+    err = "DAQ task " + daq->name() + " isn't running on the RT coprocess";
+    return false;
+  }
+
+  std::vector<SeqStep> steps;
+  std::vector<unsigned> loops;
+  DIOBatch odors;
+  for (unsigned i = 0; i < spec.actions.size(); ++i)
+    if (!compileLine(spec.actions[i], steps, loops, odors, err)) return false;
+  if (!flushOdors(odors, steps, err)) return false;
+  for (unsigned i = 0; i < steps.size(); ++i) {
+    const int op = steps[i].op;
+    if (op != SeqStep::Bits && op != SeqStep::Flow && op != SeqStep::PWM && op != SeqStep::Mark) {
+      err = "a trigger's actions are odor, flow, pwm and mark statements only";
+      return false;
+    }
+  }
+  if (steps.size() > Trigger::MaxActions) {
+    os << "the actions come to " << steps.size() << " steps, the most is " << Trigger::MaxActions;
+    err = os.str();
+    return false;
+  }
+
+  Trigger t;
+  t.daq = daq->rtHandle();
+  t.chan = chan;
+  t.edge = spec.edge;
+  t.once = spec.once;
+  t.start_program = spec.startProgram;
+  t.log_id = id();
+  t.n = steps.size();
+  std::copy(steps.begin(), steps.end(), t.action);
+  if (!coprocess->setTrigger(slot, t)) {
+    err = "the RT coprocess refused the trigger, is " + daq->name() + " a periodic digital input task?";
+    return false;
+  }
+  trigs[slot] = spec;
+  return true;
+}
+
+bool TrialSequencer::clearTrigger(unsigned slot)
+{
+  Trigger off;
+  if (!coprocess || !coprocess->setTrigger(slot, off)) return false;
+  trigs.erase(slot);
+  return true;
+}
+
+bool TrialSequencer::getTrigger(unsigned slot, TriggerSpec & spec, Trigger & status)
+{
+  std::map<unsigned, TriggerSpec>::iterator it = trigs.find(slot);
+  if (it == trigs.end() || !coprocess->getTrigger(slot, status)) return false;
+  if (status.edge == Trigger::Off) { // dropped with an object it named
+    trigs.erase(it);
+    return false;
+  }
+  spec = it->second;
+  return true;
+}
+
+bool TrialSequencer::stop()
+{
+  SeqProgram::Control c;
+  c.action = SeqProgram::Control::Abort;
+  return coprocess && coprocess->controlSequence(c);
+}
+
+bool TrialSequencer::status(SeqProgram::Control & out)
+{
+  return coprocess && coprocess->getSequence(out);
+}
@@ -0,0 +1,111 @@
+#ifndef TrialSequencer_H
+#define TrialSequencer_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include "Component.h"
+#include "RTLCoprocess.h"
+#include "rtl_coprocess/SeqProgram.h"
+#include "rtl_coprocess/Trigger.h"
+
+class DIOBatch;
+
+/**
+   Trial programs: timed odor, flow and PWM changes run by the
+   coprocess's sequencer (Kernel::Sequencer) on its own clock, so a
+   trial's valves switch within a DAQ task period of when the program
+   says rather than whenever a client's commands get there.  Every step
+   run is logged under this component's id, see Kernel::Sequencer.
+
+   A program is text, one statement per line, # starts a comment:
+
+     odor BANK ODOR            switch BANK's valves to ODOR (number or name)
+     flow NAME FLOW            a PID flow controller's setpoint, or a mix's
+                               odor flow split over its banks by mixture ratio
+     pwm NAME DUTY [WINDOW_S]  a PWM valve's duty cycle (0-1) and window
+     wait SECONDS
+     mark VALUE                a data log entry and nothing else
+     loop [N]                  run up to the matching end N times, without
+     end                       N until stopped
+
+   Consecutive odor statements switch together, in one tick of each DAQ
+   task involved (see Kernel::DAQTask::putBits()), so the banks' valves
+   must be DIO lines on DAQ tasks.  The program's period is that of the
+   fastest of those tasks, or DefaultRateHz if it switches no valves;
+   waits are rounded to it.
+
+   Triggers (see Trigger) react to an edge on a digital input line from
+   the coprocess: their odor, flow, pwm and mark statements run right
+   after the input task's scan that saw it, and they can start the
+   program if it's been arm()ed.  They're set from the protocol or the
+   ini (see ComediOlfactometer::buildTriggers()).
+
+   NB: programs and triggers go around the userspace objects, so what
+   those report (Bank::currentOdor(), commanded flows, PWM params)
+   isn't updated by them.
+*/
+class TrialSequencer : public Component
+{
+public:
+  enum { DefaultRateHz = 1000 };
+  /// what ComediOlfactometer::doSetup() calls the one it makes
+  static const char * const DefaultName;
+
+  TrialSequencer(Component *parent, const std::string & name, RTLCoprocess *);
+  ~TrialSequencer();
+
+  /// compiles program (names are looked up from parent()) and uploads
+  /// it, false with err set if it doesn't compile or the coprocess
+  /// refuses it (is one running?)
+  bool load(const std::vector<std::string> & program, std::string & err);
+  /// starts the loaded program from the top
+  bool run(std::string & err);
+  /// has the loaded program start from the top when a trigger with
+  /// startProgram fires
+  bool arm(std::string & err);
+  bool stop();
+  bool status(SeqProgram::Control & out);
+
+  /// the text of the program last loaded
+  const std::vector<std::string> & program() const { return source; }
+  /// its period, Hz
+  unsigned rateHz() const { return rate; }
+
+  /// a trigger's settings, see Trigger
+  struct TriggerSpec
+  {
+    TriggerSpec() : edge(Trigger::Rising), once(false), startProgram(false) {}
+    std::string input;                ///< daq_task:chan
+    int edge;                         ///< a Trigger::Edge
+    bool once, startProgram;
+    std::vector<std::string> actions; ///< odor, flow, pwm and mark statements
+  };
+  /// rising, falling or both to a Trigger::Edge, false if it's none of them
+  static bool ParseEdge(const std::string & s, int & edge);
+  static const char *EdgeName(int edge);
+  /// sets trigger slot, false with err set if spec doesn't compile or
+  /// the coprocess refuses it
+  bool setTrigger(unsigned slot, const TriggerSpec & spec, std::string & err);
+  bool clearTrigger(unsigned slot);
+  /// trigger slot's spec and status, false if it isn't set.  The
+  /// coprocess drops the triggers naming an object that's destroyed, and
+  /// their specs go when this finds them gone.
+  bool getTrigger(unsigned slot, TriggerSpec & spec, Trigger & status);
+
+  virtual std::string typeName() const { return "Sequencer"; }
+
+private:
+  bool compileLine(const std::string & line, std::vector<SeqStep> & out,
+                   std::vector<unsigned> & loops, DIOBatch & odors, std::string & err);
+  /// emits the odor statements gathered in odors as Bits steps
+  bool flushOdors(DIOBatch & odors, std::vector<SeqStep> & out, std::string & err);
+
+  RTLCoprocess *coprocess;
+  std::vector<std::string> source;
+  unsigned rate;
+  unsigned newRate; ///< the rate of the program being compiled
+  std::map<unsigned, TriggerSpec> trigs;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "WaveShape.h"
+#include <math.h>
+
+namespace {
+
+  typedef std::map<std::string, double> Params;
+
+  /// p[name], or def if it isn't there; false if it isn't there and there is no default
+  bool Get(const Params & p, const char *name, double & v, std::string & err, const double *def = 0)
+  {
+    Params::const_iterator it = p.find(name);
+    if (it != p.end()) { v = it->second; return true; }
+    if (def) { v = *def; return true; }
+    err = std::string("missing parameter ") + name;
+    return false;
+  }
+
+  /// false for any parameter the shape doesn't take
+  bool Only(const Params & p, const char * const names[], std::string & err)
+  {
+    for (Params::const_iterator it = p.begin(); it != p.end(); ++it) {
+      unsigned i = 0;
+      while (names[i] && it->first != names[i]) ++i;
+      if (!names[i]) { err = "unknown parameter " + it->first; return false; }
+    }
+    return true;
+  }
+
+  void Add(WaveShape::Points & out, double t, double f) { out.push_back(std::make_pair(t, f)); }
+}
+
+bool WaveShape::Build(const std::string & shape, const Params & p, Points & out, bool & step, std::string & err)
+{
+  out.clear();
+  if (shape == "ramp") {
+    static const char * const names[] = { "from", "to", "duration_s", 0 };
+    double from, to, d;
+    if (!Only(p, names, err) || !Get(p, "from", from, err) || !Get(p, "to", to, err) || !Get(p, "duration_s", d, err))
+      return false;
+    if (!(d > 0.)) { err = "duration_s must be > 0"; return false; }
+    Add(out, 0., from);
+    Add(out, d, to);
+    step = false;
+  } else if (shape == "sine") {
+    static const char * const names[] = { "offset", "amp", "period_s", 0 };
+    double off, amp, per;
+    if (!Only(p, names, err) || !Get(p, "offset", off, err) || !Get(p, "amp", amp, err) || !Get(p, "period_s", per, err))
+      return false;
+    if (!(per > 0.)) { err = "period_s must be > 0"; return false; }
+    for (unsigned i = 0; i <= SinePts; ++i)
+      Add(out, per * i / SinePts, off + amp * sin(2. * M_PI * i / SinePts));
+    step = false;
+  } else if (shape == "square") {
+    static const char * const names[] = { "low", "high", "period_s", "duty", 0 };
+    const double half = 0.5;
+    double lo, hi, per, duty;
+    if (!Only(p, names, err) || !Get(p, "low", lo, err) || !Get(p, "high", hi, err) || !Get(p, "period_s", per, err)
+        || !Get(p, "duty", duty, err, &half))
+      return false;
+    if (!(per > 0.)) { err = "period_s must be > 0"; return false; }
+    if (!(duty > 0. && duty < 1.)) { err = "duty must be in (0,1)"; return false; }
+    Add(out, 0., hi);
+    Add(out, duty * per, lo);
+    Add(out, per, lo);
+    step = true;
+  } else if (shape == "pulse") {
+    static const char * const names[] = { "base", "peak", "width_s", "delay_s", "duration_s", 0 };
+    const double zero = 0.;
+    double base, peak, w, delay, d;
+    if (!Only(p, names, err) || !Get(p, "base", base, err) || !Get(p, "peak", peak, err) || !Get(p, "width_s", w, err)
+        || !Get(p, "delay_s", delay, err, &zero))
+      return false;
+    const double end = delay + w;
+    if (!Get(p, "duration_s", d, err, &end)) return false;
+    if (!(w > 0.) || delay < 0. || d < end) { err = "need width_s > 0, delay_s >= 0 and duration_s >= delay_s + width_s"; return false; }
+    Add(out, 0., base);
+    if (delay > 0.) Add(out, delay, peak);
+    else out[0].second = peak;
+    Add(out, end, base);
+    if (d > end) Add(out, d, base);
+    step = true;
+  } else {
+    err = "unknown shape " + shape + ", need table, ramp, sine, square or pulse";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef WaveShape_H
+#define WaveShape_H
+
+/// @file WaveShape.h -- setpoint waveforms from a few parameters
+
+#include <vector>
+#include <map>
+#include <string>
+
+/**
+   Parametric setpoint waveforms for SET WAVEFORM, as (seconds, flow)
+   points ready for PIDFlowController::setWaveform().  Each shape is
+   one pass (one period for the periodic ones); START WAVEFORM's loops
+   repeats it.
+*/
+namespace WaveShape
+{
+  /// (seconds, flow) pairs, the times never decreasing
+  typedef std::vector<std::pair<double, double> > Points;
+
+  enum { SinePts = 64 }; ///< points per sine period, linearly interpolated
+
+  /**
+     Builds shape from its parameters:
+
+       ramp:   from, to, duration_s                       (linear)
+       sine:   offset, amp, period_s                      (linear, SinePts points)
+       square: low, high, period_s [duty = 0.5]           (step, high first)
+       pulse:  base, peak, width_s [delay_s = 0,
+               duration_s = delay_s + width_s]            (step)
+
+     A pass ends on its last point, which is only held once the last
+     pass is over, so for a train of pulses make duration_s the repeat
+     period.
+
+     @param step set to whether the points are to be held (Waveform::Step)
+     rather than interpolated
+     @returns false with err set for an unknown shape or a missing or
+     unusable parameter
+  */
+  extern bool Build(const std::string & shape, const std::map<std::string, double> & params,
+                    Points & out, bool & step, std::string & err);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CalibLUT_H
+#define CalibLUT_H
+
+/** A sensor calibration tabulated by raw AI sample, so the RT path can
+    go from a sample to a flow without converting to volts or evaluating
+    a polynomial.  Entry i is the flow at raw sample i << shift; samples
+    in between are linearly interpolated.  With shift 0 (12 bit boards)
+    every sample has its own entry and a lookup is a single load.
+
+    Tables are built in userspace (see PIDFlowController::setCoeffs())
+    and uploaded over the fifo in Chunk sized pieces, see Cmd::pidLUT. */
+struct CalibLUT
+{
+  enum {
+    MaxBits = 12,
+    MaxEntries = (1 << MaxBits) + 1, ///< 16 bit boards use shift 4
+    ChunkSize = 256
+  };
+
+  unsigned n; ///< entries in use, 0 means no table
+  unsigned shift;
+  float flow[MaxEntries];
+
+  /// one piece of a table upload.  The first chunk (offset 0) starts a
+  /// new table of total entries, the chunk with commit set makes it
+  /// current.  A commit with total 0 removes the table.
+  struct Chunk
+  {
+    unsigned offset, count, total, shift;
+    bool commit;
+    float flow[ChunkSize];
+  };
+};
+
+#endif
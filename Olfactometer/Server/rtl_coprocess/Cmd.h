@@ -4,6 +4,13 @@
 #include "RTFifo.h"
 #include "PIDFCParams.h"
 #include "PWMVParams.h"
+#include "DAQAccum.h"
+#include "DAQFilter.h"
+#include "CalibLUT.h"
+#include "RelayTune.h"
+#include "Waveform.h"
+#include "SeqProgram.h"
+#include "Trigger.h"
 
 #ifdef __KERNEL__
 #include "kcomedilib.h"
@@ -22,14 +29,12 @@ struct Cmd
     Cmd() : magic1(CMD_MAGIC), 
             cmd(Undefined), 
             status(Error), 
+            handle(0),
+            payload(NoPayload),
             magic2(~CMD_MAGIC) 
   { 
-      daqname_in[0] = daqname_out[0] = 0; 
       datalog.id = 0;
       datalog.mask = 0;
-      daqParams.dioMode = Unspecified; 
-      daqParams.use_override = 0; 
-      daqGetPut.doit = false; 
   }
 
     int magic1; ///< a header of sorts
@@ -46,8 +51,18 @@ struct Cmd
       Modify, ///< apply new params
       N_Command
     };
-    enum Object {   PID = N_Command, PWM, DAQ, N_Object  };
+    enum Object {   PID = N_Command, PWM, DAQ, SEQ, TRIG, N_Object  }; ///< SEQ is the one sequencer and TRIG its trigger table, Cmd::handle is unused for them
     enum Status {   Ok = N_Object, Error, N_Status };
+    /// which of the payloads below a command (or its reply) carries, see u
+    enum Payload {
+      NoPayload = 0,
+      WithPIDCreate, WithPWMCreate, WithDAQCreate,
+      WithPIDParams, WithPWMParams,
+      WithDAQGetPut, WithDAQAccum, WithDAQDivisor, WithDAQOversample, WithDAQFilter, WithDAQBits, WithDAQLogIds,
+      WithPIDLUT, WithPIDTune, WithPIDWaveLoad, WithPIDWave,
+      WithSeqLoad, WithSeq, WithTrig,
+      N_Payload
+    };
     typedef unsigned long Handle;
 
     Command cmd; 
@@ -55,51 +70,176 @@ struct Cmd
     Status  status; ///< userspace reads this field in response from kernel
     Handle  handle; /**< userspace sets this field on Query/Modify/Destroy
                        or reads this field in response from kernel on create */
-    char daqname_in[64]; ///< for referring to daq tasks by name in create/destroy
-    char daqname_out[64]; ///< for referring to daq tasks by name in create/destroy
+    Payload payload; ///< set by naming one, see u
   
-    struct PIDFCParams pidParams;
-    struct PWMVParams pwmParams;
+    struct {
+      unsigned id; ///< for PID and PWM Create
+      unsigned mask; ///< DataLogable::DataType bits, or for a DAQ task by channel
+    } datalog;
+
+    /// a footer of sorts, for the header: the payload follows
+    int magic2;
 
     enum DIOMode { Unspecified = 0, Input = 1, Output = 2 };
-    struct {
+    enum { DAQBitsMax = 8, DAQLogChans = sizeof(unsigned)*8 };
+
+    struct PIDCreate {
+        PIDFCParams params;
+        char daqname_in[64]; ///< the daq tasks to read and write through, by name, or ""
+        char daqname_out[64];
+    };
+    struct PWMCreate {
+        PWMVParams params;
+        char daqname_out[64];
+    };
+    struct DAQCreate {
+        char name[64];
         unsigned minor, subdev, chanmask, range, aref, rate_hz;
         int override_min, override_max, use_override;        
         DIOMode dioMode; 
-    } daqParams; /// for daq Create 
-    struct {
-        bool doit;
-        unsigned chan;
-        lsampl_t sample;
-    } daqGetPut; /// for daq Query or Modify which gets or puts samples
-  
-    struct {
-      unsigned id;
-      unsigned ids[sizeof(unsigned)*8];
-      unsigned mask;
-    } datalog;
+        ThreadAttrs thread; ///< cpu affinity/stack for the periodic thread
+        unsigned on_change, refresh_ms; ///< periodic write tasks: see DAQTask::setWriteOnChange()
+    };
+    struct DAQGetPut { unsigned chan; lsampl_t sample; };
+    struct DAQDivisor { unsigned chan, divisor; };
+    struct DAQChanFilter { unsigned chan; DAQFilter f; };
+    struct DAQBits {
+        unsigned n;
+        struct { Handle handle; unsigned mask, bits; } w[DAQBitsMax];
+    };
+    struct DAQLogIds { unsigned ids[DAQLogChans]; };
+    struct TrigSlot { unsigned slot; Trigger t; };
 
-    /// a footer of sorts
-    int magic2;
+    /** The payloads, one per command.  Naming one (c.pidParams() = p)
+        selects it, clearing it first if it wasn't already selected, and
+        only the selected one goes over the fifo, so a putSample() moves
+        a few dozen bytes rather than the biggest upload chunk.
+
+        Raw storage, as most of these have constructors and so can't be
+        union members themselves. */
+    union {
+      char pidCreate[sizeof(PIDCreate)];
+      char pwmCreate[sizeof(PWMCreate)];
+      char daqCreate[sizeof(DAQCreate)];
+      char pidParams[sizeof(PIDFCParams)];
+      char pwmParams[sizeof(PWMVParams)];
+      char daqGetPut[sizeof(DAQGetPut)];
+      char daqAccum[sizeof(::DAQAccum)];
+      char daqDivisor[sizeof(DAQDivisor)];
+      char daqOversample[sizeof(unsigned)];
+      char daqFilter[sizeof(DAQChanFilter)];
+      char daqBits[sizeof(DAQBits)];
+      char daqLogIds[sizeof(DAQLogIds)];
+      char pidLUT[sizeof(CalibLUT::Chunk)];
+      char pidTune[sizeof(RelayTune)];
+      char pidWaveLoad[sizeof(Waveform::Chunk)];
+      char pidWave[sizeof(Waveform::Control)];
+      char seqLoad[sizeof(SeqProgram::Chunk)];
+      char seq[sizeof(SeqProgram::Control)];
+      char trig[sizeof(TrigSlot)];
+      double align_d;
+      long long align_ll;
+      void *align_p;
+    } u;
+
+    /// for pid Create, with the daq tasks to use
+    PIDCreate & pidCreate() { return select<PIDCreate>(WithPIDCreate); }
+    /// for pwm Create, with the daq task to use
+    PWMCreate & pwmCreate() { return select<PWMCreate>(WithPWMCreate); }
+    /// for daq Create
+    DAQCreate & daqCreate() { return select<DAQCreate>(WithDAQCreate); }
+    /// for pid Modify, or reported by Query (and datalog.mask with it)
+    PIDFCParams & pidParams() { return select<PIDFCParams>(WithPIDParams); }
+    /// for pwm Modify, or reported by Query (and datalog.mask with it)
+    PWMVParams & pwmParams() { return select<PWMVParams>(WithPWMParams); }
+    /// for daq Query or Modify which gets or puts samples
+    DAQGetPut & daqGetPut() { return select<DAQGetPut>(WithDAQGetPut); }
+    /// for daq Query which gets the running sample sums
+    ::DAQAccum & daqAccum() { return select< ::DAQAccum>(WithDAQAccum); }
+    /// for daq Modify which sets a channel's rate divisor, see DAQTask::setChanDivisor()
+    DAQDivisor & daqDivisor() { return select<DAQDivisor>(WithDAQDivisor); }
+    /// for daq Modify (before Start) which sets the task's oversampling, see DAQTask::setOversample()
+    unsigned & daqOversample() { return select<unsigned>(WithDAQOversample); }
+    /// for daq Modify which sets a channel's filter, see DAQTask::setChanFilter()
+    DAQChanFilter & daqFilter() { return select<DAQChanFilter>(WithDAQFilter); }
+    /// for daq Modify which sets lines on up to DAQBitsMax daq tasks at
+    /// once (see DAQTask::putBits()), the handles are in w and Cmd::handle is unused
+    DAQBits & daqBits() { return select<DAQBits>(WithDAQBits); }
+    /// for daq Modify which sets the data log id of each channel in
+    /// datalog.mask, or reported by Query
+    DAQLogIds & daqLogIds() { return select<DAQLogIds>(WithDAQLogIds); }
+    /// for pid Modify which uploads a piece of a calibration table
+    CalibLUT::Chunk & pidLUT() { return select<CalibLUT::Chunk>(WithPIDLUT); }
+    /// for pid Modify which starts (or with state Aborted, stops) a relay experiment, or Query which reports on it
+    RelayTune & pidTune() { return select<RelayTune>(WithPIDTune); }
+    /// for pid Modify which uploads a piece of a setpoint waveform
+    Waveform::Chunk & pidWaveLoad() { return select<Waveform::Chunk>(WithPIDWaveLoad); }
+    /// for pid Modify which starts or aborts waveform playback, or Query which reports on it
+    Waveform::Control & pidWave() { return select<Waveform::Control>(WithPIDWave); }
+    /// for seq Modify which uploads a piece of a trial program
+    SeqProgram::Chunk & seqLoad() { return select<SeqProgram::Chunk>(WithSeqLoad); }
+    /// for seq Modify which starts or aborts the program, or Query which reports on it
+    SeqProgram::Control & seq() { return select<SeqProgram::Control>(WithSeq); }
+    /// for trig Modify which sets (or with edge Off, clears) a trigger, or Query which reports on one
+    TrigSlot & trig() { return select<TrigSlot>(WithTrig); }
 
   // public methods
 
   /// returns true iff magic1 and magic2 have the correct field values
   bool verify() const { return magic1 == CMD_MAGIC && magic2 == ~CMD_MAGIC; }
 
+  /// bytes before u, always sent
+  unsigned headerSize() const { return reinterpret_cast<const char *>(&u) - reinterpret_cast<const char *>(this); }
+  /// bytes of u in use
+  unsigned payloadSize() const { return PayloadSize(payload); }
+  static unsigned PayloadSize(Payload p) {
+    switch (p) {
+    case WithPIDCreate: return sizeof(PIDCreate);
+    case WithPWMCreate: return sizeof(PWMCreate);
+    case WithDAQCreate: return sizeof(DAQCreate);
+    case WithPIDParams: return sizeof(PIDFCParams);
+    case WithPWMParams: return sizeof(PWMVParams);
+    case WithDAQGetPut: return sizeof(DAQGetPut);
+    case WithDAQAccum: return sizeof(::DAQAccum);
+    case WithDAQDivisor: return sizeof(DAQDivisor);
+    case WithDAQOversample: return sizeof(unsigned);
+    case WithDAQFilter: return sizeof(DAQChanFilter);
+    case WithDAQBits: return sizeof(DAQBits);
+    case WithDAQLogIds: return sizeof(DAQLogIds);
+    case WithPIDLUT: return sizeof(CalibLUT::Chunk);
+    case WithPIDTune: return sizeof(RelayTune);
+    case WithPIDWaveLoad: return sizeof(Waveform::Chunk);
+    case WithPIDWave: return sizeof(Waveform::Control);
+    case WithSeqLoad: return sizeof(SeqProgram::Chunk);
+    case WithSeq: return sizeof(SeqProgram::Control);
+    case WithTrig: return sizeof(TrigSlot);
+    default: return 0;
+    }
+  }
+  /// what writeFifo() sends
+  unsigned size() const { return headerSize() + payloadSize(); }
+
   bool writeFifo(RTFifo *put) const {
-    int ret = put->write(this, sizeof(*this));
-    if (ret != sizeof(*this)) return false;
+    int ret = put->write(this, size());
+    if (ret != int(size())) return false;
     return true;
   }
   
+  /// reads the header, then the payload it says follows
   bool readFifo(RTFifo *get) {
-    int ret = get->read(this, sizeof(*this));
-    if (ret != sizeof(*this) || !verify()) return false;
+    int ret = get->read(this, headerSize());
+    if (ret != int(headerSize()) || !verify() || unsigned(payload) >= N_Payload) return false;
+    if (!payloadSize()) return true;
+    ret = get->read(&u, payloadSize());
+    if (ret != int(payloadSize())) return false;
     return true;
   }
   
-
+private:
+  template <typename T> T & select(Payload p) {
+    if (payload != p) Memset(&u, 0, sizeof(T)), payload = p;
+    return *reinterpret_cast<T *>(&u);
+  }
 };
 
 #endif
@@ -0,0 +1,18 @@
+#ifndef DAQAccum_H
+#define DAQAccum_H
+
+/** Free running sums of every sample a periodic DAQ task has read, for
+    averaging in the RT path.  The sums are never reset, so any number
+    of userspace clients can each take a snapshot at the start and end
+    of a window and difference them (unsigned wraparound included) to
+    get the mean and variance of each channel over that window, without
+    having to poll individual samples across the fifo.  */
+struct DAQAccum
+{
+  enum { MaxChans = 32 };
+  unsigned long long n; ///< number of scans accumulated
+  unsigned long long sum[MaxChans], sumsq[MaxChans]; ///< per channel, in raw sample units
+  unsigned long long cnt[MaxChans]; ///< samples in sum, per channel (channels with a rate divisor are read in fewer than n scans)
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef DAQFilter_H
+#define DAQFilter_H
+
+/** A DAQ task channel's biquad, in fixed point so the RT path never
+    touches the FPU:
+
+      y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+
+    The coefficients are scaled by 2^FracBits (so they must lie within
+    +/-8), and the filter keeps its state in raw sample units scaled by
+    2^StateBits.  Userspace designs them, see DAQTaskProxy::DesignFilter().
+    All zeros is no filter.  */
+struct DAQFilter
+{
+  enum { FracBits = 28, StateBits = 8 };
+  int b[3], a[2]; ///< b0 b1 b2, a1 a2
+};
+
+#endif
@@ -6,9 +6,11 @@ DAQTask::DAQTask(const char *name_in,
                  unsigned rate_hz,
                  unsigned minor, unsigned subdev, 
                  unsigned chan_mask, unsigned range, unsigned aref, DataLogger *l, const int *override_min, const int *override_max)
-  : Thread(), pleaseStop(false), dev(0), subdev(subdev), chan_mask(chan_mask), range(range), aref(aref), changed_mask(0), req_chanmask(0), logger(l)
+  : Thread(), pleaseStop(false), dev(0), subdev(subdev), chan_mask(chan_mask), range(range), aref(aref), changed_mask(0), req_chanmask(0), logger(l), edgeHook(0), edgeMask(0), edgeLast(0), edgePrimed(false), onChange(false), refreshNs(0), nPhases(1), phase(0), oversample(1), filtering(false), filterMask(0)
 {
-  for(unsigned i = 0; i < MAX_CHANS; ++i) datalogging[i] = -1;
+  for(unsigned i = 0; i < MAX_CHANS; ++i) datalogging[i] = -1, divisor[i] = 1;
+  Clr(raw); Clr(boxSum); Clr(boxN); Clr(filt);
+  Clr(accum);
   namestr = Strdup(name_in);
   rate = rate_hz;
   if (rate) timer.setPeriod(1000000000 / rate_hz);
@@ -91,7 +93,8 @@ bool DAQTask::putSample(unsigned chan, lsampl_t sample)
   if (!rate) { // asynch task is not 'running', so signal it to do stuff 
       req_chanmask |= 0x1<<chan;
       if (running()) { cond_req.signal();  cond_reply.wait(mut); }
-  }
+  } else if (onChange)
+      cond_req.signal();
   mut.unlock();
   return true;
 }
@@ -111,11 +114,140 @@ bool DAQTask::putScan(const lsampl_t *buf, unsigned num_in_buf)
   if (!rate) { // asynch task is not 'running', so signal it to do stuff 
       req_chanmask |= changed_mask;
       if (running()) { cond_req.signal();  cond_reply.wait(mut); }
-  }
+  } else if (onChange)
+      cond_req.signal();
   mut.unlock();
   return n;
 }
 
+/*static*/
+bool DAQTask::putBits(DAQTask * const *task, const unsigned *mask, const unsigned *bits, unsigned n)
+{
+  for (unsigned i = 0; i < n; ++i) {
+    if (!task[i] || !task[i]->is_write || (mask[i] & ~task[i]->chan_mask)) return false;
+    for (unsigned j = 0; j < i; ++j) 
+      if (task[j] == task[i]) return false; // would self-deadlock below
+  }
+  // both the fifo handler and the sequencer thread come through here,
+  // so take the locks in one order, by address
+  unsigned order[MAX_CHANS];
+  if (n > MAX_CHANS) return false;
+  for (unsigned i = 0; i < n; ++i) {
+    unsigned j = i;
+    for ( ; j && task[order[j-1]] > task[i]; --j) order[j] = order[j-1];
+    order[j] = i;
+  }
+  for (unsigned i = 0; i < n; ++i) task[order[i]]->mut.lock();
+  for (unsigned i = 0; i < n; ++i) {
+    DAQTask *t = task[i];
+    unsigned m = mask[i];
+    while (m) {
+      unsigned ch = Ffs(m);
+      m &= ~(0x1<<ch); // clear bit
+      if (ch >= t->nchans) continue;
+      t->scan[ch] = (bits[i] & (0x1<<ch)) ? t->maxdata : 0;
+      t->changed_mask |= 0x1<<ch;
+    }
+    if (t->rate && t->onChange && mask[i]) t->cond_req.signal();
+  }
+  for (unsigned i = n; i-- > 0; ) task[order[i]]->mut.unlock();
+
+  // passive tasks only write when asked, one at a time
+  for (unsigned i = 0; i < n; ++i) {
+    DAQTask *t = task[i];
+    if (t->rate || !mask[i]) continue;
+    t->mut.lock();
+    t->req_chanmask |= mask[i];
+    if (t->running()) { t->cond_req.signal();  t->cond_reply.wait(t->mut); }
+    t->mut.unlock();
+  }
+  return true;
+}
+
+bool DAQTask::watchEdges(EdgeHook *h, unsigned mask)
+{
+  if (mask && (!rate || !is_read || !is_dig || (mask & ~chan_mask))) return false;
+  mut.lock();
+  edgeHook = mask ? h : 0;
+  edgeMask = h ? mask : 0;
+  edgePrimed = false;
+  mut.unlock();
+  return true;
+}
+
+bool DAQTask::setWriteOnChange(unsigned refresh_ms)
+{
+  if (!rate || !is_write || is_read || running()) return false;
+  mut.lock();
+  onChange = true;
+  refreshNs = Timer::Time(refresh_ms) * 1000000;
+  mut.unlock();
+  return true;
+}
+
+bool DAQTask::setChanDivisor(unsigned chan, unsigned div)
+{
+  if (!rate || !is_read || is_dig || chan >= nchans || !(chan_mask & (0x1<<chan)) || !div)
+    return false;
+  MutexLocker l(mut);
+  unsigned d[MAX_CHANS];
+  Memcpy(d, divisor, sizeof(d));
+  d[chan] = div;
+  if (!buildScanList(d)) return false;
+  Memcpy(divisor, d, sizeof(divisor));
+  return true;
+}
+
+bool DAQTask::buildScanList(const unsigned *div)
+{
+  unsigned n = 1;
+  for (unsigned ch = 0; ch < nchans && ch < MAX_CHANS; ++ch) {
+    if (!(chan_mask & (0x1<<ch)) || div[ch] == 1) continue;
+    unsigned a = n, b = div[ch];
+    while (b) { const unsigned t = a % b; a = b; b = t; }
+    if (div[ch] / a > MaxScanPhases / n) return false; // lcm too big
+    n *= div[ch] / a;
+  }
+  Memset(scanList, 0, sizeof(scanList));
+  // channels with the same divisor take turns at its ticks, so they
+  // don't all land on the first one
+  for (unsigned ch = 0; ch < nchans && ch < MAX_CHANS; ++ch) {
+    if (!(chan_mask & (0x1<<ch))) continue;
+    const unsigned d = div[ch];
+    unsigned off = 0;
+    for (unsigned i = 0; i < ch; ++i)
+      if ((chan_mask & (0x1<<i)) && div[i] == d) ++off;
+    for (unsigned t = off % d; t < n; t += d) scanList[t] |= 0x1<<ch;
+  }
+  nPhases = n;
+  phase = 0;
+  return true;
+}
+
+bool DAQTask::setOversample(unsigned n)
+{
+  if (!rate || !is_read || is_dig || !n || n > MaxOversample || running()) return false;
+  MutexLocker l(mut);
+  oversample = n;
+  filtering = oversample > 1 || filterMask;
+  timer.setPeriod(1000000000 / (rate * n));
+  return true;
+}
+
+bool DAQTask::setChanFilter(unsigned chan, const DAQFilter & f)
+{
+  if (!rate || !is_read || is_dig || chan >= nchans || !(chan_mask & (0x1<<chan))) return false;
+  const bool on = f.b[0] || f.b[1] || f.b[2] || f.a[0] || f.a[1];
+  MutexLocker l(mut);
+  Cpy(filt[chan].c, f);
+  filt[chan].primed = false;
+  if (on) filterMask |= 0x1<<chan;
+  else filterMask &= ~(0x1<<chan);
+  filtering = oversample > 1 || filterMask;
+  boxSum[chan] = boxN[chan] = 0;
+  return true;
+}
+
 void DAQTask::uninitComedi()
 {
   if (dev) comedi_close(dev);
@@ -134,7 +266,7 @@ DAQTask::~DAQTask()
 void DAQTask::stop() 
 { 
   pleaseStop = true; 
-  if (!rate) {
+  if (!rate || onChange) {
     cond_req.signal(); 
     cond_reply.broadcast();
     join();
@@ -144,15 +276,43 @@ void DAQTask::stop()
 
 void DAQTask::run()
 {
-  if (rate) { // periodic mode
+  if (onChange) {
+    runOnChange();
+  } else if (rate) { // periodic mode
     timer.reset();
+    unsigned due = chan_mask, sub = 0;
     while (!pleaseStop) {
       mut.lock();
 
-      doIO(chan_mask);
+      // nPhases is 1 until a channel gets a divisor, and an oversampled
+      // task reads the same channels on each of a period's sub ticks
+      if (!sub) {
+        due = nPhases > 1 ? scanList[phase] : chan_mask;
+        if (++phase >= nPhases) phase = 0;
+      }
+      const bool last = ++sub >= oversample;
+      if (last) sub = 0;
+      doIO(due, last);
+      if (filtering && last) publish(due);
+      if (is_read && last) doAccum(due);
+
+      // edges go out unlocked, the hook may well write to this task
+      EdgeHook *hook = edgeHook;
+      unsigned rising = 0, falling = 0;
+      if (hook && edgeMask) {
+        unsigned now = 0, m = edgeMask;
+        while (m) {
+          unsigned ch = Ffs(m);
+          m &= ~(0x1<<ch); // clear bit
+          if (scan[ch]) now |= 0x1<<ch;
+        }
+        if (edgePrimed) rising = now & ~edgeLast, falling = edgeLast & ~now;
+        edgeLast = now, edgePrimed = true;
+      }
 
       //RTPrint("%s %u chans\n", name(), n);
       mut.unlock();
+      if (rising || falling) hook->edges(this, rising, falling);
       timer.waitNextPeriod();
     }
   } else { // passive mode, just a simple multiplexer
@@ -170,6 +330,40 @@ void DAQTask::run()
   }
 }
 
+void DAQTask::runOnChange()
+{
+  // no timeout is longer than this, which keeps now - tick below in 32 bits
+  static const Timer::Time IdleWaitNs = 250000000;
+  const unsigned long per = 1000000000 / rate;
+  Thread::setCancelState(false);
+  Timer::Time tick = Timer::absTime(), lastIO = tick;
+  mut.lock();
+  while (!pleaseStop) {
+    const Timer::Time now = Timer::absTime();
+    // back onto the grid, the last tick at or before now (no 64 bit
+    // divides in the kernel)
+    const unsigned long since = static_cast<unsigned long>(now - tick);
+    tick += since - since % per;
+    const bool refresh = refreshNs && now - lastIO >= refreshNs;
+    if (!changed_mask && !refresh) {
+      Timer::Time until = now + IdleWaitNs;
+      if (refreshNs && lastIO + refreshNs < until) until = lastIO + refreshNs;
+      cond_req.timedWait(mut, until);
+      continue;
+    }
+    // puts that come in while we sleep go out with this write
+    mut.unlock();
+    timer.sleepUntil(tick + per);
+    mut.lock();
+    if (pleaseStop) break;
+    // a DIO write always reads every line back, an analog one only
+    // writes what it's given
+    doIO(is_dig || refresh ? chan_mask : changed_mask);
+    lastIO = Timer::absTime();
+  }
+  mut.unlock();
+}
+
 void DAQTask::setDIOInput() 
 {
   if (subd_type != COMEDI_SUBD_DIO) return;
@@ -212,7 +406,7 @@ void DAQTask::configDIOChans()
   changed_mask = 0;
 }
 
-void DAQTask::doIO(unsigned mask)
+void DAQTask::doIO(unsigned mask, bool log)
 {
       const unsigned mask_backup = mask;
 
@@ -252,13 +446,19 @@ void DAQTask::doIO(unsigned mask)
           if ( is_write && comedi_data_write(dev, subdev, ch, range, aref, scan[ch]) < 1 ) 
             RTPrint("DAQTask *Error* in data write chan %u\n", ch);
           // then do read 
-          if ( is_read && comedi_data_read(dev, subdev, ch, range, aref, const_cast<lsampl_t *>(scan + ch)) < 1 ) 
+          lsampl_t v;
+          if ( is_read && comedi_data_read(dev, subdev, ch, range, aref, &v) < 1 ) 
             RTPrint("DAQTask *Error* in data read chan %u\n", ch);
+          else if (is_read) {
+            raw[ch] = v;
+            if (filtering) boxSum[ch] += v, ++boxN[ch]; // see publish()
+            else scan[ch] = v;
+          }
         }
       }
 
       // do logging
-      doDataLogging(mask_backup);
+      if (log) doDataLogging(mask_backup);
       changed_mask = 0; // clear our changed mask
 }
 
@@ -280,7 +480,9 @@ void DAQTask::doDataLogging(unsigned mask)
     if (ch < nchans && ch < MAX_CHANS && datalogging[ch] > -1 // is loggin enabled?
         && (is_read || (is_write && (0x1<<ch)&changed_mask)) ) { // did it change or is it a read channel?
       char metabuf[8];
-      double v = (double(scan[ch]) / double(maxdata)) * (range_max-range_min) + range_min;
+      // the raw read, not what the filter made of it
+      const lsampl_t s = is_read && !is_dig ? raw[ch] : scan[ch];
+      double v = (double(s) / double(maxdata)) * (range_max-range_min) + range_min;
       Snprintf(metabuf, 8, "RawCh%02u", ch);
       metabuf[7] = 0;
       logger->log(datalogging[ch], v, metabuf);
@@ -288,6 +490,58 @@ void DAQTask::doDataLogging(unsigned mask)
   }
 }
 
+void DAQTask::publish(unsigned mask)
+{
+  while (mask) {
+    unsigned ch = Ffs(mask);
+    mask &= ~(0x1<<ch);
+    if (ch >= nchans || !boxN[ch]) continue;
+    lsampl_t v = (boxSum[ch] + boxN[ch]/2) / boxN[ch];
+    boxSum[ch] = boxN[ch] = 0;
+    if (filterMask & (0x1<<ch)) v = biquad(filt[ch], v);
+    scan[ch] = v;
+  }
+}
+
+lsampl_t DAQTask::biquad(Biquad & f, lsampl_t in) const
+{
+  // integer only, 64 bit products of Q28 coefficients and Q8 samples
+  const int x = static_cast<int>(in) << DAQFilter::StateBits;
+  if (!f.primed) f.x1 = f.x2 = f.y1 = f.y2 = x, f.primed = true;
+  const long long acc = static_cast<long long>(f.c.b[0]) * x + static_cast<long long>(f.c.b[1]) * f.x1
+                        + static_cast<long long>(f.c.b[2]) * f.x2 - static_cast<long long>(f.c.a[0]) * f.y1
+                        - static_cast<long long>(f.c.a[1]) * f.y2;
+  // rounded rather than truncated, which would bias y down by half an LSB
+  // every period and the feedback would build that up
+  const int y = static_cast<int>((acc + (1LL << (DAQFilter::FracBits - 1))) >> DAQFilter::FracBits);
+  f.x2 = f.x1, f.x1 = x;
+  f.y2 = f.y1, f.y1 = y;
+  const int out = (y + (1 << (DAQFilter::StateBits - 1))) >> DAQFilter::StateBits;
+  if (out < 0) return 0;
+  return static_cast<lsampl_t>(out) > maxdata ? maxdata : static_cast<lsampl_t>(out);
+}
+
+void DAQTask::doAccum(unsigned mask)
+{
+  // integer only: no FPU, and exact no matter how long it runs
+  while (mask) {
+    unsigned ch = Ffs(mask);
+    mask &= ~(0x1<<ch);
+    if (ch >= nchans) continue;
+    const unsigned long long s = scan[ch];
+    accum.sum[ch] += s;
+    accum.sumsq[ch] += s*s;
+    ++accum.cnt[ch];
+  }
+  ++accum.n;
+}
+
+void DAQTask::getAccum(DAQAccum & out) const
+{
+  MutexLocker l(mut);
+  Cpy(out, accum);
+}
+
 void DAQTask::setDataLogging(unsigned chan, int id) 
 { 
   if (chan < MAX_CHANS) {
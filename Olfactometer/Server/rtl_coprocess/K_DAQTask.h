@@ -11,6 +11,8 @@
 #include "Condition.h"
 #include "Timer.h"
 #include "K_DataLogger.h"
+#include "DAQAccum.h"
+#include "DAQFilter.h"
 
 namespace Kernel {
 
@@ -28,7 +30,7 @@ public:
       If rate_hz is nonzero then isntead a periodic thread runs to acquire 
       samples and calls to getSample() gets the last sample read
       and putSample() enqueues a sample to be written when the 
-      periodic thread runs again. */
+      periodic thread runs again (see also setWriteOnChange()). */
   DAQTask(const char *name,
           unsigned rate_hz, 
           unsigned minor, unsigned subdev, 
@@ -45,6 +47,14 @@ public:
   /// write a whole scan at a time -- not sure how useful this is
   bool putScan(const lsampl_t *buf, unsigned num_in_buf = MAX_CHANS);
 
+  /** Sets the lines in mask[i] of task[i] to the matching bits[i] (a
+      set bit writes maxdata, a clear one 0), for every i together: all
+      the tasks are locked while they're updated, so no periodic task
+      does its IO with only some of the lines changed, and on a DIO task
+      the whole lot goes out in its one comedi_dio_bitfield() call.
+      Write tasks only, each at most once.  Linux context and RT safe. */
+  static bool putBits(DAQTask * const *task, const unsigned *mask, const unsigned *bits, unsigned n);
+
   bool isOk() const { return dev; }
   bool isRead() const { return is_read; }
   bool isWrite() const { return is_write; }
@@ -55,7 +65,17 @@ public:
   /** set this to a write (output) device -- note that this only does something for DIO chans.  
   */
   void setDIOOutput();
+  /** Has a periodic write task touch the hardware only when something
+      was put: its thread sleeps until putSample(), putScan() or putBits()
+      changes a line and then writes on the next tick of its rate_hz
+      grid, so outputs switch when they would have anyway.  A nonzero
+      refresh_ms reads a DIO task's lines back (rewrites an analog
+      task's channels) at least that often while idle.  Before start()
+      only. */
+  bool setWriteOnChange(unsigned refresh_ms = 0);
+  bool writesOnChange() const { return onChange; }
   using Thread::start;
+  using Thread::setThreadAttrs;
   using Thread::running;
   void stop();
 
@@ -68,9 +88,66 @@ public:
 
   unsigned numChans() const { return nchans; }
 
+  /// snapshot of the running sums of the samples read so far (periodic
+  /// read tasks only, passive tasks and write tasks never accumulate)
+  void getAccum(DAQAccum & out) const;
+
+  /// the most ticks the scan list repeats over, see setChanDivisor()
+  enum { MaxScanPhases = 512 };
+  /** Has a periodic analog read task read chan only every divisor'th
+      tick (1, the default, is every tick).  Each tick's channels are
+      worked out here, ahead of time, into a scan list that repeats
+      every lcm-of-the-divisors ticks, at most MaxScanPhases; channels
+      sharing a divisor are spread over its ticks rather than all read
+      on the same one.  Linux context safe. */
+  bool setChanDivisor(unsigned chan, unsigned divisor);
+  unsigned chanDivisor(unsigned chan) const { return chan < MAX_CHANS ? divisor[chan] : 0; }
+
+  enum { MaxOversample = 64 };
+  /** Has a periodic analog read task read its channels n times per
+      period, at n * rate_hz, and hand out (getSample(), getScan(), the
+      accumulators) the mean of each period's n reads: a boxcar (first
+      order CIC) decimator.  The data log keeps getting the raw reads,
+      once a period.  Before start() only. */
+  bool setOversample(unsigned n);
+  unsigned oversampling() const { return oversample; }
+  /** Runs chan's (decimated) samples through f before they're handed
+      out, all zeros takes it off.  The filter starts out settled on the
+      first sample, which assumes it passes DC unchanged (a lowpass).
+      Periodic analog read tasks only.  Linux context safe. */
+  bool setChanFilter(unsigned chan, const DAQFilter & f);
+
+  /// told about input line changes, see watchEdges()
+  struct EdgeHook
+  {
+    virtual ~EdgeHook() {}
+    /// called from the task's periodic thread (with the task unlocked)
+    /// with the watched lines that went high and low in the last scan
+    virtual void edges(DAQTask *task, unsigned rising, unsigned falling) = 0;
+  };
+  /** Has h told, right after each scan, about changes of the lines in
+      mask.  Periodic digital read tasks only.  The first scan after
+      this only sets the baseline.  A 0 mask (or h) stops it.  Linux
+      context safe. */
+  bool watchEdges(EdgeHook *h, unsigned mask);
+
 protected:
   void run();
 private:
+  void runOnChange(); ///< run() for setWriteOnChange() tasks
+  /// scanList for the divisors in div, false if they need too many phases
+  bool buildScanList(const unsigned *div);
+  /// a DAQFilter and its state
+  struct Biquad
+  {
+    DAQFilter c;
+    int x1, x2, y1, y2; ///< scaled by 2^DAQFilter::StateBits
+    bool primed;
+  };
+  lsampl_t biquad(Biquad & f, lsampl_t in) const; ///< RT
+  /// the mean of each channel in mask's reads since the last time, through
+  /// its filter, into scan
+  void publish(unsigned mask);
   void uninitComedi();
   void configDIOChans();
   DAQTask(const DAQTask &d) : Thread() { (void)d; }
@@ -93,9 +170,25 @@ private:
   // for rate=0 requests
   mutable Condition cond_req, cond_reply;
   mutable unsigned req_chanmask;
-  void doIO(unsigned mask); ///< the actual function that does the IO called from run()
+  void doIO(unsigned mask, bool log = true); ///< the actual function that does the IO called from run()
   void doDataLogging(unsigned mask);
+  void doAccum(unsigned mask);
   DataLogger *logger;
+  DAQAccum accum;
+  EdgeHook *edgeHook;
+  unsigned edgeMask, edgeLast; ///< watched lines, and their levels at the last scan
+  bool edgePrimed; ///< edgeLast is valid
+  bool onChange; ///< see setWriteOnChange()
+  Timer::Time refreshNs;
+  unsigned divisor[MAX_CHANS]; ///< see setChanDivisor()
+  unsigned scanList[MaxScanPhases]; ///< the channels due on each tick, when nPhases > 1
+  unsigned nPhases, phase;
+  unsigned oversample; ///< see setOversample()
+  bool filtering; ///< reads go through box and publish() rather than straight into scan
+  unsigned filterMask; ///< channels with a filt
+  lsampl_t raw[MAX_CHANS]; ///< the last analog reads, what's logged
+  unsigned boxSum[MAX_CHANS], boxN[MAX_CHANS];
+  Biquad filt[MAX_CHANS];
 };
 
 }
@@ -4,13 +4,37 @@
 #include "Timer.h"
 #include "Module.h"
 
+#ifndef __KERNEL__
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 namespace Kernel {
 
+#ifdef __KERNEL__
 DataLogger::DataLogger()
   : RTFifo(sizeof(struct DataEvent) * 1024)
 {}
 
 DataLogger::~DataLogger() {}
+#else
+DataLogger::DataLogger()
+{
+  if (::pipe(fds)) fds[0] = fds[1] = -1;
+  else ::fcntl(fds[1], F_SETFL, O_NONBLOCK);
+}
+
+DataLogger::~DataLogger()
+{
+  if (fds[1] > -1) ::close(fds[1]);
+  if (fds[0] > -1) ::close(fds[0]);
+}
+
+int DataLogger::write(const void *buf, unsigned nbytes)
+{
+  return ::write(fds[1], buf, nbytes);
+}
+#endif
 
 void DataLogger::log(unsigned id, double datum, const char *meta)
 {
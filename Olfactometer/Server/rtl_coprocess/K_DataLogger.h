@@ -1,11 +1,14 @@
 #ifndef K_DataLogger_H
 #define K_DataLogger_H
 
+#ifdef __KERNEL__
 #include "RTFifo.h"
+#endif
 
 namespace Kernel 
 {
 
+#ifdef __KERNEL__
   class DataLogger : public RTFifo
   {
   public:
@@ -18,6 +21,31 @@ namespace Kernel
     DataLogger(const DataLogger &) {}
     DataLogger & operator=(const DataLogger &) { return *this; }
   };
+#else
+  /** The in-process coprocess's (see ModuleSim.h) data logger: a pipe
+      stands in for the rt-fifo, the server reads DataEvents from
+      descr().  Like rtf_put(), log() drops events if it's full rather
+      than block the RT thread calling it. */
+  class DataLogger
+  {
+  public:
+    DataLogger();
+    ~DataLogger();
+
+    void log(unsigned id, double datum, const char *meta);
+
+    /// the read end, negative if the pipe couldn't be made
+    int descr() const { return fds[0]; }
+    operator int() const { return descr(); }
+
+  private:
+    int write(const void *buf, unsigned nbytes);
+    int fds[2];
+
+    DataLogger(const DataLogger &) {}
+    DataLogger & operator=(const DataLogger &) { return *this; }
+  };
+#endif
   
 }
 
@@ -1,14 +1,22 @@
 #include "K_PIDFlowController.h"
 #include "K_DAQTask.h"
 #include "Module.h"
+#include "Timer.h"
 #include "kcomedilib.h"
 
 namespace Kernel 
 {
 
 PIDFlowController::PIDFlowController(DataLogger *l, unsigned log_id, const PIDFCParams &p, DAQTask *dt_in, DAQTask *dt_out)
-  :  DataLogable(l, log_id), ok(false), dev_ai(0), dev_ao(0), params(p)
+  :  DataLogable(l, log_id), ok(false), dev_ai(0), dev_ao(0), params(p), lutCur(0), lutFilled(0), lastSamp(0), lastSetValid(false),
+     waveIdx(0), waveFilled(0), smithPos(0), smithPrimed(false), faultFlag(0), faultPeriods(0), faulted(false), evLogger(l), evId(log_id)
 {
+  lut[0].n = lut[1].n = 0;
+  wave.n = 0;
+  // smithLine only has room for this many, as in setParams()
+  if (params.smith_delay >= PIDFCParams::SmithMaxDelay) params.smith_delay = PIDFCParams::SmithMaxDelay - 1;
+  Clr(ffSet);
+  Clr(lastSet); Clr(spStep); Clr(shortfall);
   daq_ai = dt_in;
   daq_ao = dt_out;
   if (!initComedi()) { 
@@ -72,6 +80,12 @@ void PIDFlowController::uninitComedi()
 
 void PIDFlowController::start()
 {
+  smithPrimed = false;
+  lastSetValid = false;
+  // a waveform doesn't carry on across a stop
+  if (waveCtl.state == Waveform::Armed || waveCtl.state == Waveform::Playing)
+    waveCtl.state = Waveform::Aborted;
+  setThreadAttrs(params.thread);
   PID::start(this, params.rate_hz, &params.controlParams);
 }
 
@@ -82,25 +96,337 @@ PIDFlowController::voltsToFlow(double v) const
   return params.a*(v*v*v) + params.b*(v*v) + params.c*(v) + params.d;
 }
 
+double
+PIDFlowController::lutFlow(lsampl_t samp) const
+{
+  const CalibLUT & t = lut[lutCur];
+  const unsigned i = samp >> t.shift;
+  if (i + 1 >= t.n) return t.flow[t.n-1];
+  const float y0 = t.flow[i];
+  if (!t.shift) return y0;
+  const unsigned frac = samp & ((1U << t.shift) - 1);
+  return y0 + (t.flow[i+1] - y0) * static_cast<float>(frac) / static_cast<float>(1U << t.shift);
+}
+
+double
+PIDFlowController::ffValve(double flow) const
+{
+  const unsigned n = params.ff_n < PIDFCParams::FFMaxPts ? params.ff_n : PIDFCParams::FFMaxPts;
+  const double *f = params.ff_flow, *v = params.ff_v;
+  if (n == 1 || flow <= f[0]) return v[0];
+  if (flow >= f[n-1]) return v[n-1];
+  unsigned i = 1;
+  while (flow > f[i]) ++i;
+  return v[i-1] + (v[i] - v[i-1]) * (flow - f[i-1]) / (f[i] - f[i-1]);
+}
+
+void
+PIDFlowController::sampleIn(lsampl_t samp)
+{
+  lastSamp = samp;
+  if (lut[lutCur].n) {
+    // the table goes straight from the sample, last_v_in is only worked
+    // out when it's logged or read
+    params.flow_actual = lutFlow(samp);
+  } else {
+    params.last_v_in = ais2v(samp);
+    params.flow_actual = voltsToFlow(params.last_v_in);
+  }
+}
+
 double
 PIDFlowController::getE()
 {
   mut.lock();
-  params.last_v_in = readVolts(&ok);
+  lsampl_t samp;
+  ok = readSample(samp);
   if (!ok) {
       mut.unlock();
       Error("AI read error\n");
       return 0.0;
   }
-  params.flow_actual = voltsToFlow(params.last_v_in);
-  double e = params.flow_actual - params.flow_set;  
+  sampleIn(samp);
+  if (lut[lutCur].n && loggingEnabled(Raw)) params.last_v_in = ais2v(samp);
+  bool tuneEnded = false;
+  if (tune.state == RelayTune::Running) {
+    relayStep();
+    tuneEnded = tune.state != RelayTune::Running;
+  }
+  if (waveCtl.state == Waveform::Armed && Timer::absTime() >= waveCtl.startAt) {
+    waveCtl.state = Waveform::Playing;
+    waveCtl.pos = waveCtl.loopsDone = waveIdx = 0;
+  }
+  if (waveCtl.state == Waveform::Playing) waveStep();
+  double faultSet;
+  const bool tripped = faultStep(faultSet);
+  if (params.ff_n && params.flow_set != ffSet) {
+    // setpoint moved: move the valve by as much as the feed-forward says,
+    // keeping whatever correction the PID has built up.  On (re)start
+    // there is none yet so go straight to where it should end up.
+    const double ffNew = ffValve(params.flow_set);
+    params.last_v_out = lastSetValid ? params.last_v_out + ffNew - ffValve(ffSet) : ffNew;
+    ffSet = params.flow_set;
+  }
+  double fb = params.flow_actual;
+  if (params.ctl_type == PIDFCParams::SmithPredictor) {
+    if (!smithPrimed) {
+      // start from the model's steady state at the current valve voltage
+      const double x = params.smith_a < 1. ? params.smith_b * params.last_v_out / (1. - params.smith_a) : 0.;
+      for (unsigned i = 0; i < params.smith_delay; ++i) smithLine[i] = x;
+      smithX = smithXd = x;
+      smithPos = 0;
+      smithPrimed = true;
+    }
+    // what the flow will be once the dead time has passed
+    fb += smithX - smithXd;
+  }
+  double e = fb - params.flow_set;
+  // e = actual - set, so raising the setpoint lowers e
+  spStep = lastSetValid ? lastSet - params.flow_set : 0.;
+  lastSet = params.flow_set;
+  lastSetValid = true;
   mut.unlock();
+  // what the PID accumulated while the relay drove the valve is no use
+  // to it now
+  if (tuneEnded) resetState();
+  if (tripped) {
+    Error("PIDFlowController (log id %u): flow is under %d%% of its setpoint, faulted\n", evId, static_cast<int>(params.fault_frac*100.));
+    if (evLogger) evLogger->log(evId, faultSet, "fault");
+  }
+  if (params.ctl_type == PIDFCParams::SmithPredictor) logDatum(fb, Other, "pred");
   logDatum(params.last_v_in, Raw, "vin");
   logDatum(e, Other, "e");
   logDatum(params.flow_actual, Cooked, "flow");
   return e;
 }
 
+void PIDFlowController::smithStep(double v)
+{
+  smithX = params.smith_a * smithX + params.smith_b * v;
+  const unsigned d = params.smith_delay;
+  if (!d) { smithXd = smithX; return; }
+  smithXd = smithLine[smithPos];
+  smithLine[smithPos] = smithX;
+  if (++smithPos >= d) smithPos = 0;
+}
+
+bool PIDFlowController::faultStep(double & set)
+{
+  // a relay experiment moves the valve itself, don't second guess it
+  const bool low = params.fault_debounce && tune.state != RelayTune::Running
+    && params.flow_set > params.fault_min_set
+    && params.flow_actual < params.fault_frac * params.flow_set;
+  if (!low) {
+    faultPeriods = 0;
+    if (faulted) {
+      faulted = false;
+      if (faultFlag) faultFlag->faulted = 0;
+    }
+    return false;
+  }
+  if (faulted || ++faultPeriods < params.fault_debounce) return false;
+  faulted = true;
+  set = params.flow_set;
+  if (faultFlag) {
+    faultFlag->faulted = 1;
+    ++faultFlag->count;
+  }
+  if (params.fault_action == PIDFCParams::FaultStop) {
+    // the next period sees a setpoint of 0, which clears faulted again;
+    // the count is what tells userspace it happened
+    if (waveCtl.state == Waveform::Armed || waveCtl.state == Waveform::Playing)
+      waveCtl.state = Waveform::Aborted;
+    params.flow_set = 0.;
+  }
+  return true;
+}
+
+void PIDFlowController::relayStep()
+{
+  RelayTune & t = tune;
+  const double f = params.flow_actual, e = f - t.setpoint;
+  if (!t.periods++) {
+    t.relayHigh = e < 0.;
+    t.fmin = t.fmax = f;
+  }
+  if (f < t.fmin) t.fmin = f;
+  if (f > t.fmax) t.fmax = f;
+  if (t.relayHigh ? e > t.hyst : e < -t.hyst) {
+    t.relayHigh = !t.relayHigh;
+    if (t.relayHigh) { 
+      // the flow just fell through the band: one full cycle since the last
+      // time.  The first full cycle still has the start-up transient in it.
+      if (++t.nrise >= 3) {
+        t.sumA += (t.fmax - t.fmin) / 2.;
+        t.sumP += t.periods - t.lastRise;
+        ++t.ncycles;
+        t.a = t.sumA / t.ncycles;
+        t.Pu = t.sumP / t.ncycles / static_cast<double>(params.rate_hz);
+        if (t.ncycles >= t.cycles) t.state = RelayTune::Done;
+      }
+      t.lastRise = t.periods;
+      t.fmin = t.fmax = f;
+    }
+  }
+  if (t.state == RelayTune::Running && t.periods >= t.maxPeriods) t.state = RelayTune::Failed;
+  if (t.state != RelayTune::Running) params.last_v_out = t.bias; // back to where it started
+}
+
+void PIDFlowController::waveStep()
+{
+  Waveform::Control & c = waveCtl;
+  const Waveform & w = wave;
+  if (c.pos >= w.at[w.n-1]) { // end of a pass
+    ++c.loopsDone;
+    if (c.loops && c.loopsDone >= c.loops) {
+      c.state = Waveform::Done;
+      params.flow_set = w.flow[w.n-1];
+      return;
+    }
+    c.pos = waveIdx = 0;
+  }
+  // pos < at[n-1], so this stops at n-2 at the latest
+  while (c.pos >= w.at[waveIdx+1]) ++waveIdx;
+  double f = w.flow[waveIdx];
+  if (w.interp == Waveform::Linear)
+    f += (w.flow[waveIdx+1] - f) * static_cast<double>(c.pos - w.at[waveIdx])
+                                 / static_cast<double>(w.at[waveIdx+1] - w.at[waveIdx]);
+  params.flow_set = f;
+  ++c.pos;
+}
+
+bool PIDFlowController::setWave(Waveform::Control & c)
+{
+  mut.lock();
+  bool ret = true;
+  if (c.action == Waveform::Control::Abort) {
+    // the setpoint stays wherever playback got to
+    if (waveCtl.state == Waveform::Armed || waveCtl.state == Waveform::Playing)
+      waveCtl.state = Waveform::Aborted;
+  } else if (c.action == Waveform::Control::Start) {
+    if (!running() || waveCtl.state == Waveform::Empty) {
+      ret = false;
+    } else {
+      // integer arithmetic only, this is linux context
+      waveCtl.loops = c.loops;
+      waveCtl.startAt = c.startAt ? c.startAt : Timer::absTime() + c.delay;
+      waveCtl.pos = waveCtl.loopsDone = 0;
+      waveCtl.state = Waveform::Armed;
+      c.startAt = waveCtl.startAt;
+    }
+  }
+  mut.unlock();
+  return ret;
+}
+
+void PIDFlowController::getWave(Waveform::Control & out) const
+{
+  mut.lock();
+  Cpy(out, waveCtl);
+  out.n = waveCtl.state == Waveform::Empty ? 0 : wave.n;
+  Cpy(out.flow_set, params.flow_set);
+  mut.unlock();
+}
+
+void PIDFlowController::setFlowSet(double f)
+{
+  mut.lock();
+  if (waveCtl.state == Waveform::Armed || waveCtl.state == Waveform::Playing)
+    waveCtl.state = Waveform::Aborted;
+  params.flow_set = f;
+  mut.unlock();
+}
+
+bool PIDFlowController::loadWave(const Waveform::Chunk & c)
+{
+  bool ret = true;
+  mut.lock();
+  Waveform & w = wave;
+  if (waveCtl.state == Waveform::Armed || waveCtl.state == Waveform::Playing) {
+    ret = false; // abort it first
+  } else if (!c.offset) {
+    if (c.total < 2 || c.total > Waveform::MaxPts) ret = false;
+    else w.n = c.total, w.interp = c.interp, waveFilled = 0, waveCtl.state = Waveform::Empty;
+  }
+  if (ret && (c.count > Waveform::ChunkSize || c.offset != waveFilled || c.offset + c.count > w.n))
+    ret = false;
+  // the times must start at 0 and never go back, including across chunks
+  for (unsigned i = 0; ret && i < c.count; ++i) {
+    const unsigned prev = i ? c.at[i-1] : (c.offset ? w.at[c.offset-1] : 0);
+    if (c.at[i] < prev || (!c.offset && !i && c.at[i])) ret = false;
+  }
+  if (ret) {
+    Memcpy(w.at + c.offset, c.at, c.count * sizeof(unsigned));
+    Memcpy(w.flow + c.offset, c.flow, c.count * sizeof(float));
+    waveFilled += c.count;
+    if (c.commit) {
+      if (waveFilled == w.n && w.at[w.n-1] > 0) waveCtl.state = Waveform::Loaded;
+      else ret = false;
+    }
+  }
+  mut.unlock();
+  return ret;
+}
+
+bool PIDFlowController::setTune(const RelayTune & t)
+{
+  mut.lock();
+  bool ret = true, reset = false;
+  if (t.state == RelayTune::Aborted) {
+    if (tune.state == RelayTune::Running) {
+      tune.state = RelayTune::Aborted;
+      Cpy(params.last_v_out, tune.bias);
+      reset = true;
+    }
+  } else if (!running() || !t.cycles) {
+    ret = false;
+  } else {
+    // only copies here, the RT side does the arithmetic
+    Cpy(tune, t);
+    tune.periods = tune.ncycles = tune.nrise = tune.lastRise = 0;
+    Clr(tune.sumA); Clr(tune.sumP); Clr(tune.a); Clr(tune.Pu);
+    tune.state = RelayTune::Running;
+    reset = true;
+  }
+  mut.unlock();
+  // the PID starts over both when the relay takes the valve and when it
+  // gives it back (getE() does the latter when the experiment ends itself)
+  if (reset) resetState();
+  return ret;
+}
+
+void PIDFlowController::getTune(RelayTune & out) const
+{
+  mut.lock();
+  Cpy(out, tune);
+  mut.unlock();
+}
+
+bool PIDFlowController::loadLUT(const CalibLUT::Chunk & c)
+{
+  bool ret = true;
+  mut.lock();
+  CalibLUT & t = lut[!lutCur];
+  if (!c.offset) {
+    // a table must reach at least to the top of the AI range
+    if (c.total > CalibLUT::MaxEntries || c.shift >= 16
+        || (c.total && ((c.total-1) << c.shift) < max_ai)) ret = false;
+    else t.n = c.total, t.shift = c.shift, lutFilled = 0;
+  }
+  if (ret && (c.count > CalibLUT::ChunkSize || c.offset != lutFilled || c.offset + c.count > t.n))
+    ret = false;
+  if (ret) {
+    Memcpy(t.flow + c.offset, c.flow, c.count * sizeof(float));
+    lutFilled += c.count;
+    if (c.commit) {
+      if (lutFilled == t.n) lutCur = !lutCur;
+      else ret = false;
+    }
+  }
+  mut.unlock();
+  return ret;
+}
+
 bool PIDFlowController::writeVolts(double v)
 {
   lsampl_t samp = aov2s(v);
@@ -113,27 +439,32 @@ bool PIDFlowController::writeVolts(double v)
   return ret >= 1;
 }
 
-double PIDFlowController::readVolts(bool *ok) const
+bool PIDFlowController::readSample(lsampl_t & samp) const
 { 
-  lsampl_t samp = 0;
-  if (ok) *ok = true;
+  samp = 0;
   if (daq_ai) {
       samp = daq_ai->getSample(params.chan_ai);
-  } else if ( comedi_data_read(dev_ai, params.subdev_ai, params.chan_ai, 0, 0, &samp) < 1 ) {
-      if (ok) *ok = false;
-      return 0.0;
+      return true;
   }
-  return ais2v(samp); 
+  return comedi_data_read(dev_ai, params.subdev_ai, params.chan_ai, 0, 0, &samp) >= 1;
 }
 
 void PIDFlowController::setU(double u)
 {
   logDatum(u, Other, "u");
   mut.lock();
-  params.last_v_out += u;
+  const bool relay = tune.state == RelayTune::Running;
+  double want;
+  if (relay) // the relay drives the valve, not the PID
+    want = tune.bias + (tune.relayHigh ? tune.amp : -tune.amp) * tune.direction;
+  else
+    want = params.last_v_out + u;
+  params.last_v_out = want;
   if (params.last_v_out > params.vclip_ao_max) params.last_v_out = params.vclip_ao_max;
   else if (params.last_v_out < params.vclip_ao_min) params.last_v_out = params.vclip_ao_min;
+  shortfall = relay ? 0. : params.last_v_out - want;
   bool ret = writeVolts(params.last_v_out);
+  if (params.ctl_type == PIDFCParams::SmithPredictor) smithStep(params.last_v_out);
 
   mut.unlock();
   if ( !ret ) {
@@ -147,10 +478,17 @@ void PIDFlowController::setU(double u)
 struct ReadVFunctor : public Thread::Functor
 {
   PIDFlowController *p;
-  ReadVFunctor(PIDFlowController *p) : p(p) {}
+  bool hw; ///< read the hardware, else just convert the loop's last sample
+  ReadVFunctor(PIDFlowController *p, bool hw) : p(p), hw(hw) {}
   void operator()() { 
-    p->params.last_v_in = p->readVolts();
-    p->params.flow_actual = p->voltsToFlow(p->params.last_v_in);
+    lsampl_t samp = p->lastSamp;
+    if (hw && !p->readSample(samp)) {
+      p->params.flow_actual = p->voltsToFlow(p->params.last_v_in = 0.);
+      return;
+    }
+    if (hw) p->sampleIn(samp);
+    // sampleIn() leaves last_v_in alone when a table does the flow
+    p->params.last_v_in = p->ais2v(samp);
   }
 };
 
@@ -158,10 +496,10 @@ PIDFCParams PIDFlowController::getParams() const
 {
   PIDFCParams ret;
   mut.lock();
-  if (!running()) { // make sure to physically read hardware if PID loop is not running
-    ReadVFunctor f(const_cast<PIDFlowController *>(this));
-    Thread::doFuncInRT(f); // need to call readVFunctor in RT since we are in linux context here and we will be using doubles which use FPU regs
-  }
+  // physically read the hardware if the PID loop is not running, else
+  // just bring last_v_in up to date with the loop's last sample
+  ReadVFunctor f(const_cast<PIDFlowController *>(this), !running());
+  Thread::doFuncInRT(f); // need to call readVFunctor in RT since we are in linux context here and we will be using doubles which use FPU regs
   ret = params;
   mut.unlock();
   return ret;
@@ -189,7 +527,12 @@ bool PIDFlowController::setParams(const PIDFCParams & pin)
   Cpy(flow_actual_backup, params.flow_actual);
   Cpy(v_in_backup, params.last_v_in);
   Cpy(v_out_backup, params.last_v_out);
+  if (pin.ctl_type != params.ctl_type || pin.smith_delay != params.smith_delay
+      || Memcmp(&pin.smith_a, &params.smith_a, sizeof(double))
+      || Memcmp(&pin.smith_b, &params.smith_b, sizeof(double)))
+    smithPrimed = false; // new model, restart it from the valve's steady state
   params = pin;
+  if (params.smith_delay >= PIDFCParams::SmithMaxDelay) params.smith_delay = PIDFCParams::SmithMaxDelay - 1;
   Cpy(params.flow_actual, flow_actual_backup);
   Cpy(params.last_v_in, v_in_backup);
   if (!running()) {
@@ -2,8 +2,12 @@
 #define PIDFlowController_H
 
 #include "PIDFCParams.h"
+#include "Shm.h"
+#include "CalibLUT.h"
+#include "RelayTune.h"
+#include "Waveform.h"
 
-#ifdef __KERNEL__
+#if defined(__KERNEL__) || defined(COMEDI_SIM) /* see ModuleSim.h */
 #include "PID.h"
 #include "kcomedilib.h"
 #include "Mutex.h"
@@ -25,10 +29,33 @@ namespace Kernel
     void stop() { PID::stop(); }
     bool setParams(const PIDFCParams & params);
     PIDFCParams getParams() const;
+    /// takes one chunk of a calibration table upload, see CalibLUT.
+    /// Safe to call from linux context, copies only.
+    bool loadLUT(const CalibLUT::Chunk & c);
+    /// starts a relay experiment (the loop must be running), or stops one
+    /// if t.state is RelayTune::Aborted.  Linux context safe.
+    bool setTune(const RelayTune & t);
+    void getTune(RelayTune & out) const;
+    /// takes one chunk of a setpoint waveform upload, see Waveform.
+    /// Linux context safe.
+    bool loadWave(const Waveform::Chunk & c);
+    /// starts (the loop must be running and a table loaded) or aborts
+    /// waveform playback, per c.action.  On a start c.startAt is set to
+    /// the time playback will begin.  Linux context safe.
+    bool setWave(Waveform::Control & c);
+    void getWave(Waveform::Control & out) const;
+    /// a new flow_set, aborting any waveform playback.  RT only (see
+    /// Kernel::Sequencer), from linux context use setParams().
+    void setFlowSet(double flow);
+    /// where the loop reports faults, see PIDFCParams::fault_debounce.
+    /// Set by the module before start().
+    void setFaultFlag(OlfPIDFault *f) { faultFlag = f; }
     
     // nb: interited from parent: void stop();
     double getE();
     void setU(double);
+    double eSetpointStep() { return spStep; }
+    double uShortfall() { return shortfall; }
         
     bool isOk() const { return ok; }
 
@@ -36,18 +63,62 @@ namespace Kernel
     bool initComedi();
     void uninitComedi();
     double voltsToFlow(double v) const;
+    double lutFlow(lsampl_t samp) const;
+    double ffValve(double flow) const; ///< feed-forward valve volts for flow
+    void sampleIn(lsampl_t samp); ///< sets flow_actual, and last_v_in if there's no table
+    void relayStep(); ///< RT, one period of the relay experiment
+    void waveStep(); ///< RT, sets flow_set from the waveform for this period
+    void smithStep(double vout); ///< RT, advances the Smith predictor's model
+    /// RT, one period of fault detection: true if the fault tripped just
+    /// now, with set the setpoint it tripped at
+    bool faultStep(double & set);
     double ais2v(lsampl_t samp) const;
     double aos2v(lsampl_t samp) const;
     lsampl_t aiv2s(double v) const;
     lsampl_t aov2s(double v) const;
     bool writeVolts(double v); ///< write volts v to actual hardware
-    double readVolts(bool *ok = 0) const; ///< read volts from actual hardware
+    bool readSample(lsampl_t & samp) const; ///< read a sample from actual hardware
     bool ok;
     comedi_t *dev_ai, *dev_ao;
     lsampl_t max_ai, max_ao;
     DAQTask *daq_ai, *daq_ao;
     // NB don't access these in non-realtime kernel thread! Use Cpy() ot Clr() to assign or clear
     PIDFCParams params;
+    /// the current calibration table is lut[lutCur], the other one is
+    /// being uploaded into.  lut[lutCur].n == 0 means use the cubic.
+    CalibLUT lut[2];
+    unsigned lutCur, lutFilled;
+    lsampl_t lastSamp; ///< the last AI sample, see sampleIn()
+    double ffSet; ///< the flow_set the valve was last fed forward to, RT only
+    /// for PID's derivative on measurement and anti-windup, RT only: the
+    /// setpoint at the last getE() and what moving it did to e, and how
+    /// far the last setU() fell short of u because of the clip limits
+    double lastSet, spStep, shortfall;
+    bool lastSetValid;
+    RelayTune tune;
+    /// the setpoint waveform and its playback state.  waveCtl.pos and
+    /// waveIdx (the point at or before pos) are advanced by the RT side
+    /// only, waveFilled counts points uploaded so far.
+    Waveform wave;
+    Waveform::Control waveCtl;
+    unsigned waveIdx, waveFilled;
+    /// Smith predictor state, RT only.  smithLine holds the model's last
+    /// smith_delay outputs, smithX is its output now and smithXd the
+    /// one smith_delay periods ago.  Re-primed to the steady state of
+    /// the current valve voltage whenever smithPrimed is cleared.
+    float smithLine[PIDFCParams::SmithMaxDelay];
+    unsigned smithPos;
+    bool smithPrimed;
+    double smithX, smithXd;
+    /// fault detection state, RT only: faultPeriods counts the periods
+    /// the flow has been low for, faulted is set from the trip until it
+    /// isn't any more.  evLogger/evId log the trips whatever the
+    /// DataLogable's enabled types.
+    OlfPIDFault *faultFlag;
+    unsigned faultPeriods;
+    bool faulted;
+    DataLogger *evLogger;
+    unsigned evId;
 
     mutable Mutex mut;
     friend class WriteVFunctor;
@@ -56,7 +127,7 @@ namespace Kernel
 
 }
 #else
-#  error The Kernel::PIDFlowController is a kernel-only class for now!
-#endif /* __KERNEL__ */
+#  error The Kernel::PIDFlowController is a kernel-only class outside SIM=1 builds!
+#endif /* __KERNEL__ || COMEDI_SIM */
 
 #endif
@@ -44,6 +44,7 @@ void PWMValve::Callback::operator()()
 
 void PWMValve::start()
 {
+  setThreadAttrs(params.thread);
   PWM::start(&hcb, &lcb, 0, Thread::HighPriority);
 }
 
@@ -3,7 +3,7 @@
 
 #include "PWMVParams.h"
 
-#ifdef __KERNEL__
+#if defined(__KERNEL__) || defined(COMEDI_SIM) /* see ModuleSim.h */
 #  include "kcomedilib.h"
 #  include "PWM.h"
 #  include "K_DataLogable.h"
@@ -44,7 +44,7 @@ private:
 }
 
 #else
-#  error Kernel::PWMValve is a kernel-only class for now!
-#endif /* __KERNEL__ */
+#  error Kernel::PWMValve is a kernel-only class outside SIM=1 builds!
+#endif /* __KERNEL__ || COMEDI_SIM */
 
 #endif
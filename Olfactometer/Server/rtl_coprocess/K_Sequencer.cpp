@@ -0,0 +1,279 @@
+#include "K_Sequencer.h"
+#include "Module.h"
+#include "K_DAQTask.h"
+#include "K_PIDFlowController.h"
+#include "K_PWMValve.h"
+
+namespace Kernel
+{
+
+/// DataEvent meta for each SeqStep::Op
+static const char * const opNames[SeqStep::N_Op] = { "end", "bits", "flow", "pwm", "wait", "mark", "loop", "next" };
+
+Sequencer::Sequencer(DataLogger *l, DAQTask * const *daqs, PIDFlowController * const *pids,
+                     PWMValve * const *pwms, unsigned nhandles)
+  : Thread(), logger(l), daqs(daqs), pids(pids), pwms(pwms), nhandles(nhandles),
+    filled(0), waitLeft(0), depth(0), nBits(0), pleaseStop(false), go(false), unjoined(0)
+{
+  Clr(ctl);
+}
+
+Sequencer::~Sequencer()
+{
+  abort();
+}
+
+void Sequencer::abort()
+{
+  pleaseStop = true;
+  reap(); // it notices within a period
+  mut.lock();
+  if (ctl.state == SeqProgram::Running || ctl.state == SeqProgram::Armed) ctl.state = SeqProgram::Aborted;
+  mut.unlock();
+}
+
+void Sequencer::reap()
+{
+  if (unjoined) ::thread_join(static_cast<Thread_t>(unjoined));
+  unjoined = 0;
+}
+
+bool Sequencer::load(const SeqProgram::Chunk & c)
+{
+  bool ret = true;
+  mut.lock();
+  if (ctl.state == SeqProgram::Running || ctl.state == SeqProgram::Armed) {
+    ret = false; // abort it first
+  } else if (!c.offset) {
+    if (!c.total || c.total > SeqProgram::MaxSteps) ret = false;
+    else ctl.steps = c.total, filled = 0, ctl.state = SeqProgram::Empty;
+  }
+  if (ret && (c.count > SeqProgram::ChunkSize || c.offset != filled || c.offset + c.count > ctl.steps))
+    ret = false;
+  if (ret) {
+    Memcpy(prog + c.offset, c.step, c.count * sizeof(SeqStep));
+    filled += c.count;
+    if (c.commit) {
+      if (filled == ctl.steps && checkProgram()) ctl.state = SeqProgram::Loaded;
+      else ret = false;
+    }
+  }
+  mut.unlock();
+  return ret;
+}
+
+bool Sequencer::checkProgram() const
+{
+  unsigned loops[SeqProgram::MaxDepth], nloops = 0;
+  if (!filled || prog[filled-1].op != SeqStep::End) return false;
+  for (unsigned i = 0; i < filled; ++i) {
+    const SeqStep & s = prog[i];
+    switch (s.op) {
+    case SeqStep::Bits:
+    case SeqStep::Flow:
+      if (s.handle >= nhandles) return false;
+      break;
+    case SeqStep::PWM:
+      if (s.handle >= nhandles || s.b > 100) return false;
+      break;
+    case SeqStep::Loop:
+      if (nloops >= SeqProgram::MaxDepth) return false;
+      loops[nloops++] = i;
+      break;
+    case SeqStep::Next:
+      if (!nloops || s.b != loops[--nloops]) return false;
+      break;
+    case SeqStep::End:
+    case SeqStep::Wait:
+    case SeqStep::Mark:
+      break;
+    default:
+      return false;
+    }
+  }
+  return !nloops;
+}
+
+bool Sequencer::resolves() const
+{
+  for (unsigned i = 0; i < filled; ++i) {
+    const SeqStep & s = prog[i];
+    if (s.op == SeqStep::Bits
+        && (!daqs[s.handle] || !daqs[s.handle]->isWrite() || (s.a & ~daqs[s.handle]->chanMask())))
+      return false;
+    if (s.op == SeqStep::Flow && !pids[s.handle]) return false;
+    if (s.op == SeqStep::PWM && !pwms[s.handle]) return false;
+  }
+  return true;
+}
+
+bool Sequencer::refersTo(int op, unsigned handle) const
+{
+  bool ret = false;
+  mut.lock();
+  for (unsigned i = 0; i < filled && !ret; ++i)
+    ret = prog[i].op == op && prog[i].handle == handle;
+  mut.unlock();
+  return ret;
+}
+
+bool Sequencer::control(const SeqProgram::Control & c)
+{
+  if (c.action == SeqProgram::Control::Abort) {
+    abort();
+    return true;
+  }
+  const bool arm = c.action == SeqProgram::Control::Arm;
+  if ((c.action != SeqProgram::Control::Start && !arm) || running()) return false;
+  mut.lock();
+  bool ok = c.rate_hz && (ctl.state == SeqProgram::Loaded || ctl.state == SeqProgram::Done
+                          || ctl.state == SeqProgram::Aborted || ctl.state == SeqProgram::Failed)
+            && resolves();
+  if (ok) {
+    ctl.rate_hz = c.rate_hz;
+    ctl.log_id = c.log_id;
+    ctl.pc = ctl.periods = ctl.failed_at = 0;
+    waitLeft = depth = nBits = 0;
+    ctl.state = arm ? SeqProgram::Armed : SeqProgram::Running;
+    pleaseStop = go = false;
+  }
+  mut.unlock();
+  if (!ok) return false;
+  reap(); // the last program's thread, which ended by itself
+  start(Thread::HighPriority);
+  // not running(), a short program may already be over
+  unjoined = handle();
+  if (!unjoined) {
+    mut.lock();
+    ctl.state = SeqProgram::Failed;
+    mut.unlock();
+    return false;
+  }
+  return true;
+}
+
+void Sequencer::getStatus(SeqProgram::Control & out) const
+{
+  mut.lock();
+  Cpy(out, ctl);
+  mut.unlock();
+}
+
+void Sequencer::run()
+{
+  timer.setPeriod(1000000000 / ctl.rate_hz);
+  bool more = true;
+  while (more && !pleaseStop) {
+    mut.lock();
+    more = tick();
+    if (ctl.state != SeqProgram::Armed) ++ctl.periods;
+    mut.unlock();
+    if (more) timer.waitNextPeriod();
+  }
+}
+
+void Sequencer::fail(unsigned pc)
+{
+  ctl.state = SeqProgram::Failed;
+  ctl.failed_at = pc;
+  Error("Sequencer: step %u failed, program stopped\n", pc);
+}
+
+bool Sequencer::tick()
+{
+  if (ctl.state == SeqProgram::Armed) {
+    if (!go) return true;
+    ctl.state = SeqProgram::Running;
+  }
+  if (waitLeft) {
+    --waitLeft;
+    return true;
+  }
+  nBits = 0;
+  for (unsigned n = 0; n < SeqProgram::MaxStepsPerTick; ++n) {
+    const unsigned pc = ctl.pc;
+    const SeqStep & s = prog[pc];
+    if (s.op == SeqStep::Bits) {
+      // gather it up with the ones right after it
+      DAQTask *t = daqs[s.handle];
+      unsigned i = 0;
+      while (i < nBits && bitsTask[i] != t) ++i;
+      if (i == nBits) {
+        if (nBits == MaxBits && !flushBits()) { fail(pc); return false; }
+        i = nBits++;
+        bitsTask[i] = t, bitsMask[i] = bitsBits[i] = 0;
+      }
+      bitsMask[i] |= s.a;
+      bitsBits[i] = (bitsBits[i] & ~s.a) | (s.b & s.a);
+      if (logger) logger->log(ctl.log_id, static_cast<double>(pc), opNames[s.op]);
+      ++ctl.pc;
+      continue;
+    }
+    if (nBits && !flushBits()) { fail(pc - 1); return false; }
+    if (s.op == SeqStep::End) {
+      if (logger) logger->log(ctl.log_id, static_cast<double>(pc), opNames[s.op]);
+      ctl.state = SeqProgram::Done;
+      return false;
+    }
+    if (!exec(pc)) { fail(pc); return false; }
+    if (s.op == SeqStep::Wait) return true;
+  }
+  // a loop with no wait in it, most likely
+  fail(ctl.pc);
+  return false;
+}
+
+bool Sequencer::flushBits()
+{
+  const bool ok = DAQTask::putBits(bitsTask, bitsMask, bitsBits, nBits);
+  nBits = 0;
+  return ok;
+}
+
+bool Sequencer::exec(unsigned pc)
+{
+  const SeqStep & s = prog[pc];
+  unsigned next = pc + 1;
+  switch (s.op) {
+  case SeqStep::Flow:
+    if (!pids[s.handle]) return false;
+    pids[s.handle]->setFlowSet(s.v);
+    break;
+  case SeqStep::PWM: {
+    if (!pwms[s.handle]) return false;
+    PWMVParams p = pwms[s.handle]->getParams();
+    p.windowSizeMicros = s.a;
+    p.dutyCycle = s.b;
+    if (!pwms[s.handle]->setParams(p)) return false;
+    break;
+  }
+  case SeqStep::Wait:
+    waitLeft = s.a ? s.a - 1 : 0; // this period is the first of them
+    break;
+  case SeqStep::Mark:
+    break;
+  case SeqStep::Loop:
+    if (depth >= SeqProgram::MaxDepth) return false;
+    stack[depth].pc = next;
+    stack[depth].left = s.a;
+    ++depth;
+    break;
+  case SeqStep::Next: {
+    if (!depth) return false;
+    Frame & f = stack[depth-1];
+    if (!f.left || --f.left) next = f.pc; // 0 is forever
+    else --depth;
+    break;
+  }
+  default:
+    return false;
+  }
+  if (logger) {
+    if (s.op == SeqStep::Mark) logger->log(ctl.log_id, s.v, opNames[s.op]);
+    else logger->log(ctl.log_id, static_cast<double>(pc), opNames[s.op]);
+  }
+  ctl.pc = next;
+  return true;
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef K_Sequencer_H
+#define K_Sequencer_H
+
+#include "SeqProgram.h"
+
+#if defined(__KERNEL__) || defined(COMEDI_SIM) /* see ModuleSim.h */
+#include "Thread.h"
+#include "Mutex.h"
+#include "Timer.h"
+#include "K_DataLogger.h"
+
+namespace Kernel
+{
+  class DAQTask;
+  class PIDFlowController;
+  class PWMValve;
+
+  /** Runs a trial program (see SeqStep) in a periodic RT thread, so the
+      valve, flow and PWM changes of a trial happen on the sequencer's
+      clock rather than when userspace gets around to them.  Every step
+      executed is logged with the step's index as the datum and its op
+      as the meta (Mark steps log their value instead), so the data log
+      shows exactly when each one happened.
+
+      The thread only runs while a program does.  Steps refer to the
+      module's objects by handle: they're looked up in the arrays passed
+      to the constructor, which belong to the module, and the module
+      abort()s the sequencer before destroying one the program
+      refersTo(). */
+  class Sequencer : protected Thread
+  {
+  public:
+    Sequencer(DataLogger *logger, DAQTask * const *daqs, PIDFlowController * const *pids,
+              PWMValve * const *pwms, unsigned nhandles);
+    ~Sequencer();
+
+    /// takes one chunk of a program upload, see SeqProgram::Chunk.  The
+    /// program is checked when committed.  Linux context safe.
+    bool load(const SeqProgram::Chunk & c);
+    /// starts or arms (every handle the program uses must exist) or
+    /// aborts the program, per c.action.  Linux context safe.
+    bool control(const SeqProgram::Control & c);
+    /// starts an armed program on the sequencer's next period, see
+    /// Kernel::Triggers.  RT safe, and a noop unless it's armed.
+    void trigger() { go = true; }
+    void getStatus(SeqProgram::Control & out) const;
+    /// stops a running program and waits for the thread to finish
+    void abort();
+    /// the loaded program has a step on handle, a DAQ task if op is
+    /// SeqStep::Bits, a PID if Flow, a PWM valve if PWM
+    bool refersTo(int op, unsigned handle) const;
+
+  protected:
+    void run();
+
+  private:
+    bool tick(); ///< RT, one period of the program, false once it's over
+    bool exec(unsigned pc); ///< RT, runs step pc, except Bits (see tick())
+    bool flushBits(); ///< RT, writes the Bits steps gathered so far
+    bool checkProgram() const; ///< nesting and handle ranges of prog
+    bool resolves() const; ///< every handle in prog names an existing object
+    void fail(unsigned pc); ///< RT
+    /// joins the last thread started, if not yet joined, whether it was
+    /// stopped or ran off the end of its program.  Linux context.
+    void reap();
+
+    DataLogger *logger;
+    DAQTask * const *daqs;
+    PIDFlowController * const *pids;
+    PWMValve * const *pwms;
+    unsigned nhandles;
+
+    SeqStep prog[SeqProgram::MaxSteps];
+    unsigned filled;
+    SeqProgram::Control ctl;
+    unsigned waitLeft;
+    struct Frame { unsigned pc, left; } stack[SeqProgram::MaxDepth];
+    unsigned depth;
+    /// consecutive Bits steps, written together by flushBits()
+    enum { MaxBits = 8 };
+    DAQTask *bitsTask[MaxBits];
+    unsigned bitsMask[MaxBits], bitsBits[MaxBits], nBits;
+
+    volatile bool pleaseStop, go;
+    Thread::Handle unjoined; ///< see reap()
+    Timer timer;
+    mutable Mutex mut;
+
+    Sequencer(const Sequencer &) : Thread() {}
+    Sequencer & operator=(const Sequencer &) { return *this; }
+  };
+}
+
+#else
+#  error Kernel::Sequencer is a kernel-only class outside SIM=1 builds!
+#endif /* __KERNEL__ || COMEDI_SIM */
+
+#endif
@@ -0,0 +1,178 @@
+#include "K_Triggers.h"
+#include "Module.h"
+#include "Timer.h"
+#include "K_PIDFlowController.h"
+#include "K_PWMValve.h"
+#include "K_Sequencer.h"
+
+namespace Kernel
+{
+
+Triggers::Triggers(DataLogger *l, DAQTask * const *daqs, PIDFlowController * const *pids,
+                   PWMValve * const *pwms, unsigned nhandles, Sequencer *seq)
+  : logger(l), daqs(daqs), pids(pids), pwms(pwms), nhandles(nhandles), seq(seq)
+{
+  for (unsigned i = 0; i < Trigger::MaxTriggers; ++i) Clr(trig[i]);
+}
+
+Triggers::~Triggers()
+{
+  clear();
+}
+
+void Triggers::clear()
+{
+  mut.lock();
+  for (unsigned i = 0; i < Trigger::MaxTriggers; ++i) {
+    if (trig[i].edge && daqs[trig[i].daq]) daqs[trig[i].daq]->watchEdges(0, 0);
+    Clr(trig[i]);
+  }
+  mut.unlock();
+}
+
+bool Triggers::refersTo(const Trigger & t, int op, unsigned handle)
+{
+  if (op == SeqStep::Bits && t.daq == handle) return true;
+  for (unsigned i = 0; i < t.n; ++i)
+    if (t.action[i].op == op && t.action[i].handle == handle) return true;
+  return false;
+}
+
+unsigned Triggers::drop(int op, unsigned handle)
+{
+  unsigned n = 0;
+  mut.lock();
+  for (unsigned i = 0; i < Trigger::MaxTriggers; ++i) {
+    if (!trig[i].edge || !refersTo(trig[i], op, handle)) continue;
+    DAQTask *task = daqs[trig[i].daq];
+    Clr(trig[i]);
+    if (task) rewatch(task);
+    ++n;
+  }
+  mut.unlock();
+  return n;
+}
+
+bool Triggers::check(const Trigger & t) const
+{
+  if (t.edge < Trigger::Rising || t.edge > Trigger::Both || t.daq >= nhandles || !daqs[t.daq]
+      || t.chan >= DAQTask::MAX_CHANS || t.n > Trigger::MaxActions)
+    return false;
+  for (unsigned i = 0; i < t.n; ++i) {
+    const SeqStep & s = t.action[i];
+    if (s.op != SeqStep::Mark && s.handle >= nhandles) return false;
+    switch (s.op) {
+    case SeqStep::Bits:
+      if (!daqs[s.handle] || !daqs[s.handle]->isWrite() || (s.a & ~daqs[s.handle]->chanMask())) return false;
+      break;
+    case SeqStep::Flow:
+      if (!pids[s.handle]) return false;
+      break;
+    case SeqStep::PWM:
+      if (!pwms[s.handle] || s.b > 100) return false;
+      break;
+    case SeqStep::Mark:
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Triggers::rewatch(DAQTask *task)
+{
+  unsigned mask = 0;
+  for (unsigned i = 0; i < Trigger::MaxTriggers; ++i)
+    if (trig[i].edge && daqs[trig[i].daq] == task) mask |= 0x1 << trig[i].chan;
+  return task->watchEdges(mask ? this : 0, mask);
+}
+
+bool Triggers::set(unsigned slot, const Trigger & t)
+{
+  if (slot >= Trigger::MaxTriggers || (t.edge && !check(t))) return false;
+  mut.lock();
+  DAQTask *old = trig[slot].edge ? daqs[trig[slot].daq] : 0;
+  Trigger was;
+  Cpy(was, trig[slot]);
+  bool ok = true;
+  if (!t.edge) {
+    Clr(trig[slot]);
+  } else {
+    Cpy(trig[slot], t);
+    trig[slot].armed = true;
+    trig[slot].fired = 0;
+    trig[slot].last_ns = 0;
+    if (!(ok = rewatch(daqs[t.daq]))) { // not a periodic digital input
+      Cpy(trig[slot], was);
+      rewatch(daqs[t.daq]);
+    }
+  }
+  if (ok && old && (!t.edge || old != daqs[t.daq])) rewatch(old);
+  mut.unlock();
+  return ok;
+}
+
+bool Triggers::get(unsigned slot, Trigger & out) const
+{
+  if (slot >= Trigger::MaxTriggers) return false;
+  mut.lock();
+  Cpy(out, trig[slot]);
+  mut.unlock();
+  return true;
+}
+
+void Triggers::edges(DAQTask *task, unsigned rising, unsigned falling)
+{
+  mut.lock();
+  for (unsigned i = 0; i < Trigger::MaxTriggers; ++i) {
+    const Trigger & t = trig[i];
+    if (!t.armed || daqs[t.daq] != task) continue;
+    const unsigned bit = 0x1 << t.chan;
+    if (((t.edge & Trigger::Rising) && (rising & bit)) || ((t.edge & Trigger::Falling) && (falling & bit)))
+      if (!fire(i)) Error("Trigger %u: an action failed\n", i);
+  }
+  mut.unlock();
+}
+
+bool Triggers::fire(unsigned slot)
+{
+  Trigger & t = trig[slot];
+  DAQTask *tasks[Trigger::MaxActions];
+  unsigned masks[Trigger::MaxActions], bits[Trigger::MaxActions], nb = 0;
+  bool ok = true;
+  // the valves first, they're what's waiting on us
+  for (unsigned i = 0; i < t.n; ++i) {
+    const SeqStep & s = t.action[i];
+    if (s.op != SeqStep::Bits) continue;
+    unsigned j = 0;
+    while (j < nb && tasks[j] != daqs[s.handle]) ++j;
+    if (j == nb) tasks[nb] = daqs[s.handle], masks[nb] = bits[nb] = 0, ++nb;
+    masks[j] |= s.a;
+    bits[j] = (bits[j] & ~s.a) | (s.b & s.a);
+  }
+  if (nb) ok = DAQTask::putBits(tasks, masks, bits, nb);
+  for (unsigned i = 0; i < t.n; ++i) {
+    const SeqStep & s = t.action[i];
+    if (s.op == SeqStep::Flow) {
+      if (pids[s.handle]) pids[s.handle]->setFlowSet(s.v);
+      else ok = false;
+    } else if (s.op == SeqStep::PWM) {
+      if (!pwms[s.handle]) { ok = false; continue; }
+      PWMVParams p = pwms[s.handle]->getParams();
+      p.windowSizeMicros = s.a;
+      p.dutyCycle = s.b;
+      ok = pwms[s.handle]->setParams(p) && ok;
+    } else if (s.op == SeqStep::Mark && logger) {
+      logger->log(t.log_id, s.v, "mark");
+    }
+  }
+  if (t.start_program && seq) seq->trigger();
+  ++t.fired;
+  t.last_ns = Timer::absTime();
+  if (t.once) t.armed = false;
+  if (logger) logger->log(t.log_id, static_cast<double>(slot), "trig");
+  return ok;
+}
+
+}
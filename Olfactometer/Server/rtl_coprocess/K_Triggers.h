@@ -0,0 +1,71 @@
+#ifndef K_Triggers_H
+#define K_Triggers_H
+
+#include "Trigger.h"
+
+#if defined(__KERNEL__) || defined(COMEDI_SIM) /* see ModuleSim.h */
+#include "Mutex.h"
+#include "K_DAQTask.h"
+#include "K_DataLogger.h"
+
+namespace Kernel
+{
+  class PIDFlowController;
+  class PWMValve;
+  class Sequencer;
+
+  /** The coprocess's table of Triggers.  It watches the input lines the
+      triggers name (see DAQTask::watchEdges()) and runs a trigger's
+      actions from the input task's own thread, right after the scan
+      that saw the edge.
+
+      Like Sequencer, triggers refer to the module's objects by handle,
+      looked up in the module's arrays, and the module drop()s the ones
+      naming an object before destroying it. */
+  class Triggers : public DAQTask::EdgeHook
+  {
+  public:
+    Triggers(DataLogger *logger, DAQTask * const *daqs, PIDFlowController * const *pids,
+             PWMValve * const *pwms, unsigned nhandles, Sequencer *seq);
+    ~Triggers();
+
+    /// replaces the trigger in slot (t.edge Off just clears it) and arms
+    /// it.  Linux context safe.
+    bool set(unsigned slot, const Trigger & t);
+    bool get(unsigned slot, Trigger & out) const;
+    /// clears every trigger
+    void clear();
+    /// clears the triggers that watch or act on handle, a DAQ task if op
+    /// is SeqStep::Bits, a PID if Flow, a PWM valve if PWM, and returns
+    /// how many it cleared.  Linux context safe.
+    unsigned drop(int op, unsigned handle);
+
+    /// from DAQTask::EdgeHook, RT
+    void edges(DAQTask *task, unsigned rising, unsigned falling);
+
+  private:
+    bool check(const Trigger & t) const; ///< every handle in t names an existing object
+    static bool refersTo(const Trigger & t, int op, unsigned handle);
+    bool rewatch(DAQTask *task); ///< updates task's watched lines from the table
+    bool fire(unsigned slot); ///< RT, runs trigger slot's actions
+
+    DataLogger *logger;
+    DAQTask * const *daqs;
+    PIDFlowController * const *pids;
+    PWMValve * const *pwms;
+    unsigned nhandles;
+    Sequencer *seq;
+
+    Trigger trig[Trigger::MaxTriggers];
+    mutable Mutex mut;
+
+    Triggers(const Triggers &) : DAQTask::EdgeHook() {}
+    Triggers & operator=(const Triggers &) { return *this; }
+  };
+}
+
+#else
+#  error Kernel::Triggers is a kernel-only class outside SIM=1 builds!
+#endif /* __KERNEL__ || COMEDI_SIM */
+
+#endif
@@ -10,7 +10,15 @@
 #include "Mutex.h"
 #include "K_DataLogger.h"
 #include "K_DataLogable.h"
+#include "K_Sequencer.h"
+#include "K_Triggers.h"
+#ifndef __KERNEL__
+#include "ModuleSim.h"
+#endif
 
+static void DoCmd(Cmd *); 
+
+#ifdef __KERNEL__
 class CmdFifo: public RTFifo
 {
 public:
@@ -40,8 +48,6 @@ CmdFifo::~CmdFifo()
   if (c) delete c, c = 0;
 }
 
-static void DoCmd(Cmd *); 
-
 int CmdFifo::handler() 
 {
     struct F { F() { ModuleIncUseCount(); } ~F() { ModuleDecUseCount(); } } modCtr; // increment the use count while in this scope
@@ -50,20 +56,28 @@ int CmdFifo::handler()
     //RTPrint("%s handler called!\n", name);
     int num = fionread();
     if (num) {
-        if (num == sizeof(struct Cmd)) {
-          if (!c && !(c = new Cmd)) {
-            Error("CmdFifo::handler() -- failed to allocate Cmd buffer\n");
-            return -1;
-          }
+        if (!c && !(c = new Cmd)) {
+          Error("CmdFifo::handler() -- failed to allocate Cmd buffer\n");
+          return -1;
+        }
+        // a header and the payload it names, see Cmd::u
+        if (num >= int(c->headerSize()) && num <= int(sizeof(Cmd))) {
           if ( !c->readFifo(this) ) {
             Error("Cmd::readFifo returned error\n");
             return -1;
           }
+          if (int(c->size()) != num) {
+            Error("number of bytes available in fifo %s was %d != %u\n", name, num, c->size());
+            return -1;
+          }
 
           DoCmd(c);
+          if ( !c->writeFifo(userPairBuddy()) ) {
+            Error("Error writing userspace reply to putfifo\n");
+          }
 
         } else {
-          Error("number of bytes available in fifo %s is %d != %d\n", name, num, sizeof(Cmd));
+          Error("number of bytes available in fifo %s is %d, not a command\n", name, num);
           return -1;
         }
     } else {
@@ -71,9 +85,15 @@ int CmdFifo::handler()
     }
     return 0;
 }
+#endif
 
 #define HANDLE_MAX (sizeof(unsigned long)*8)
+#ifdef __KERNEL__
 static RTFifo *getfifo = 0, *putfifo = 0;
+#else
+int debug = 0;
+static Mutex cmdMut; ///< what CmdFifo::mut is to the fifo
+#endif
 static unsigned long pidsAllocated = 0; ///< bitmask for below array
 static Kernel::PIDFlowController *pids[HANDLE_MAX] = { 0 };
 static unsigned long pwmsAllocated = 0; ///< bitmask for below array
@@ -87,20 +107,32 @@ static void FreePWM(int idx);
 static int ReserveDAQ();
 static void FreeDAQ(int idx);
 static void DestroyAllPWMPIDDAQ();
+static void Unreference(int op, unsigned handle);
 static Kernel::DAQTask *FindDAQ(const char *name);
+#ifdef __KERNEL__
 static RTShm<OlfCoprocessShm> *rt_shm = 0;
+#else
+static OlfCoprocessShm sim_shm; ///< nobody else to share it with
+#endif
 static OlfCoprocessShm *shm = 0;
+// every PID handle needs its fault slot
+typedef char PIDFaultSlotsCheck[OlfCoprocessShm_MAX_PIDS >= HANDLE_MAX ? 1 : -1];
 static Kernel::DataLogger *dataLogger = 0;
+static Kernel::Sequencer *sequencer = 0;
+static Kernel::Triggers *triggers = 0;
 
 int ModuleInit(void)
 {
   Msg("Initializing...\n");
 
+#ifdef __KERNEL__
   // fifos
   getfifo = new CmdFifo("getcmdfifo");
   putfifo = new CmdFifo("putcmdfifo");
   dataLogger = new Kernel::DataLogger;
-  if (!getfifo || !putfifo || !dataLogger || !RTFifo::makeUserPair(getfifo, putfifo)) {
+  sequencer = new Kernel::Sequencer(dataLogger, daqs, pids, pwms, HANDLE_MAX);
+  triggers = new Kernel::Triggers(dataLogger, daqs, pids, pwms, HANDLE_MAX, sequencer);
+  if (!getfifo || !putfifo || !dataLogger || !sequencer || !triggers || !RTFifo::makeUserPair(getfifo, putfifo)) {
     ModuleCleanup();
     return 1;
   }
@@ -119,20 +151,59 @@ int ModuleInit(void)
   Msg("%s attached at: 0x%p\n", OlfCoprocessShm_NAME, shm);
 
   getfifo->enableHandler();
+#else
+  // no fifos, the server calls ModuleDoCmd() and reads the data log pipe
+  dataLogger = new Kernel::DataLogger;
+  sequencer = new Kernel::Sequencer(dataLogger, daqs, pids, pwms, HANDLE_MAX);
+  triggers = new Kernel::Triggers(dataLogger, daqs, pids, pwms, HANDLE_MAX, sequencer);
+  if (!dataLogger || dataLogger->descr() < 0 || !sequencer || !triggers) {
+    ModuleCleanup();
+    return 1;
+  }
+  shm = &sim_shm;
+  Clr(*shm);
+  shm->magic = OlfCoprocessShm_MAGIC;
+  shm->datalog_fifo = *dataLogger;
+  Msg("Running in-process, datalogging pipe %d\n", static_cast<int>(*dataLogger));
+#endif
   return 0;
 }
 
 void ModuleCleanup(void)
 {
+  // the daq threads may be calling into triggers until they're gone
+  if (triggers) triggers->clear();
+  if (sequencer) sequencer->abort();
   DestroyAllPWMPIDDAQ();
+  if (triggers) delete triggers, triggers = 0;
+  if (sequencer) delete sequencer, sequencer = 0;
+#ifdef __KERNEL__
   if (getfifo) delete getfifo, getfifo = 0;
   if (putfifo) delete putfifo, putfifo = 0;
+#endif
   if (dataLogger) delete dataLogger, dataLogger = 0;
+#ifdef __KERNEL__
   if (rt_shm) delete rt_shm, rt_shm = 0;
+#else
+  if (shm) shm->magic = 0, shm = 0;
+#endif
   Msg("Cleaned up!\n"); 
 }
 
 
+#ifndef __KERNEL__
+void ModuleDoCmd(Cmd *c)
+{
+  MutexLocker locker(cmdMut);
+  DoCmd(c);
+}
+
+OlfCoprocessShm *ModuleShm(void)
+{
+  return shm;
+}
+#endif
+
 static void getDataLogableBits(Cmd *c, DataLogable *d);
 static void setDataLogableFromBits(Cmd *c, DataLogable *d);
 
@@ -145,11 +216,12 @@ void DoCmd(Cmd *c)
     if (c->object == Cmd::PID) {
       int idx = ReservePID();
       
-      Kernel::DAQTask *daqin = FindDAQ(c->daqname_in), *daqout = FindDAQ(c->daqname_out);
+      Cmd::PIDCreate & a = c->pidCreate();
+      Kernel::DAQTask *daqin = FindDAQ(a.daqname_in), *daqout = FindDAQ(a.daqname_out);
       if (idx < 0) {
         Error("Too many PID flow controllers already allocated!\n");
         c->status = Cmd::Error;
-      } else if ( !(pids[idx] = new Kernel::PIDFlowController(dataLogger, c->datalog.id, c->pidParams, daqin, daqout)) ) {
+      } else if ( !(pids[idx] = new Kernel::PIDFlowController(dataLogger, c->datalog.id, a.params, daqin, daqout)) ) {
         FreePID(idx);
         Error("Failed memory allocation for PID flow controller!\n");
         c->status = Cmd::Error;        
@@ -158,6 +230,9 @@ void DoCmd(Cmd *c)
         Error("Failed to construct PID flow controller -- are comedi params correct?\n");
         c->status = Cmd::Error;        
       } else {
+        // the slot's count carries on from its last user, readers go by changes
+        shm->pid_fault[idx].faulted = 0;
+        pids[idx]->setFaultFlag(&shm->pid_fault[idx]);
         c->handle = idx;
       }
     } else if (c->object == Cmd::PWM) {
@@ -166,8 +241,9 @@ void DoCmd(Cmd *c)
         Error("Too many PWM valves already allocated!\n");
         c->status = Cmd::Error;
       }
-      Kernel::DAQTask *daq = FindDAQ(c->daqname_out);
-      if ( !(pwms[idx] = new Kernel::PWMValve(dataLogger, c->datalog.id, c->pwmParams, daq)) ) {
+      Cmd::PWMCreate & a = c->pwmCreate();
+      Kernel::DAQTask *daq = FindDAQ(a.daqname_out);
+      if ( !(pwms[idx] = new Kernel::PWMValve(dataLogger, c->datalog.id, a.params, daq)) ) {
         FreePWM(idx);
         Error("Failed memory allocation for PWM valve!\n");
         c->status = Cmd::Error;        
@@ -184,16 +260,17 @@ void DoCmd(Cmd *c)
         Error("Too many DAQ tasks already allocated!\n");
         c->status = Cmd::Error;
       }
+      Cmd::DAQCreate & a = c->daqCreate();
       int *override_min = 0, *override_max = 0;
-      if (c->daqParams.use_override) 
-        override_min = &c->daqParams.override_min, override_max = &c->daqParams.override_max;
-      if ( !(daqs[idx] = new Kernel::DAQTask(c->daqname_in,
-                                             c->daqParams.rate_hz,
-                                             c->daqParams.minor, 
-                                             c->daqParams.subdev,
-                                             c->daqParams.chanmask,
-                                             c->daqParams.range, 
-                                             c->daqParams.aref,
+      if (a.use_override) 
+        override_min = &a.override_min, override_max = &a.override_max;
+      if ( !(daqs[idx] = new Kernel::DAQTask(a.name,
+                                             a.rate_hz,
+                                             a.minor, 
+                                             a.subdev,
+                                             a.chanmask,
+                                             a.range, 
+                                             a.aref,
                                              dataLogger,
                                              override_min, 
                                              override_max)) ) {
@@ -207,13 +284,20 @@ void DoCmd(Cmd *c)
       } else {
         c->handle = idx;
 
+        daqs[idx]->setThreadAttrs(a.thread);
+
         // if they specified a DIO input/output mode.. note this has no effect
         // on non-dio subdevices
-        if (c->daqParams.dioMode == Cmd::Input)
+        if (a.dioMode == Cmd::Input)
           daqs[idx]->setDIOInput();
-        else if (c->daqParams.dioMode == Cmd::Output)
+        else if (a.dioMode == Cmd::Output)
           daqs[idx]->setDIOOutput();
 
+        if (a.on_change && !daqs[idx]->setWriteOnChange(a.refresh_ms)) {
+          FreeDAQ(idx);
+          Error("Only a periodic output DAQ task can write on change!\n");
+          c->status = Cmd::Error;
+        }
       }
     } else { // object != PID or PWM
       Error("Invalid object specified in RTFifo Command\n");
@@ -226,6 +310,7 @@ void DoCmd(Cmd *c)
         Error("Invalid handle %lu\n", c->handle);
         c->status = Cmd::Error;
       } else {
+        Unreference(SeqStep::Flow, c->handle);
         FreePID(c->handle);
       }
     } else if (c->object == Cmd::PWM) {
@@ -233,6 +318,7 @@ void DoCmd(Cmd *c)
         Error("Invalid handle %lu\n", c->handle);
         c->status = Cmd::Error;
       } else {
+        Unreference(SeqStep::PWM, c->handle);
         FreePWM(c->handle);
       }
     } else if (c->object == Cmd::DAQ) {
@@ -240,6 +326,7 @@ void DoCmd(Cmd *c)
         Error("Invalid handle %lu\n", c->handle);
         c->status = Cmd::Error;
       } else {
+        Unreference(SeqStep::Bits, c->handle);
         FreeDAQ(c->handle);
       }
     } else { // object != PID or PWM
@@ -314,8 +401,27 @@ void DoCmd(Cmd *c)
         c->status = Cmd::Error;
       } else {
         Kernel::PIDFlowController *p = pids[c->handle];
-        bool ret = p->setParams(c->pidParams);
-        if (!ret) {
+        if (c->payload == Cmd::WithPIDLUT) { // they wanted to upload a calibration table
+          if (!p->loadLUT(c->pidLUT())) {
+            Error("Error loading calibration table chunk at %u for PID handle %lu\n", c->pidLUT().offset, c->handle);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload == Cmd::WithPIDTune) { // they wanted to start or stop auto-tuning
+          if (!p->setTune(c->pidTune())) {
+            Error("Cannot start relay auto-tune for PID handle %lu, is it running?\n", c->handle);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload == Cmd::WithPIDWaveLoad) { // they wanted to upload a setpoint waveform
+          if (!p->loadWave(c->pidWaveLoad())) {
+            Error("Error loading waveform chunk at %u for PID handle %lu\n", c->pidWaveLoad().offset, c->handle);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload == Cmd::WithPIDWave) { // they wanted to start or abort waveform playback
+          if (!p->setWave(c->pidWave())) {
+            Error("Cannot start waveform for PID handle %lu, is it loaded and running?\n", c->handle);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload != Cmd::WithPIDParams || !p->setParams(c->pidParams())) {
           Error("Error setting PID params to for PID handle %lu\n",  c->handle);
           c->status = Cmd::Error;
         } else 
@@ -327,33 +433,83 @@ void DoCmd(Cmd *c)
         c->status = Cmd::Error;
       } else {
         Kernel::PWMValve *p = pwms[c->handle];
-        bool ret = p->setParams(c->pwmParams);
+        bool ret = c->payload == Cmd::WithPWMParams && p->setParams(c->pwmParams());
         if (!ret) {
           Error("Error setting PWM params to for PWM handle %lu\n",  c->handle);
           c->status = Cmd::Error;
         } else
           setDataLogableFromBits(c, p);
       }
+    } else if (c->object == Cmd::SEQ) {
+      if (c->payload == Cmd::WithSeqLoad) { // they wanted to upload a piece of a program
+        if (!sequencer->load(c->seqLoad())) {
+          Error("Error loading trial program chunk at %u\n", c->seqLoad().offset);
+          c->status = Cmd::Error;
+        }
+      } else if (c->payload != Cmd::WithSeq || !sequencer->control(c->seq())) {
+        Error("Cannot start trial program, is one loaded and not running?\n");
+        c->status = Cmd::Error;
+      }
+    } else if (c->object == Cmd::TRIG) {
+      if (c->payload != Cmd::WithTrig || !triggers->set(c->trig().slot, c->trig().t)) {
+        Error("Cannot set trigger %u, is its input a periodic digital input task?\n", c->trig().slot);
+        c->status = Cmd::Error;
+      }
+    } else if (c->object == Cmd::DAQ && c->payload == Cmd::WithDAQBits) { // they wanted to set lines on several tasks at once
+      const Cmd::DAQBits & b = c->daqBits();
+      Kernel::DAQTask *tasks[Cmd::DAQBitsMax];
+      unsigned masks[Cmd::DAQBitsMax], bits[Cmd::DAQBitsMax], n = b.n;
+      if (n > Cmd::DAQBitsMax) n = Cmd::DAQBitsMax;
+      for (unsigned i = 0; i < n; ++i) {
+        const Cmd::Handle h = b.w[i].handle;
+        tasks[i] = h < HANDLE_MAX ? daqs[h] : 0;
+        masks[i] = b.w[i].mask;
+        bits[i] = b.w[i].bits;
+      }
+      if (!Kernel::DAQTask::putBits(tasks, masks, bits, n)) {
+        Error("Error status when writing bits to %u daq tasks\n", n);
+        c->status = Cmd::Error;
+      }
     } else if (c->object == Cmd::DAQ) {
       if (c->handle >= HANDLE_MAX || !daqs[c->handle]) {
         Error("Invalid handle %lu\n", c->handle);
         c->status = Cmd::Error;
       } else {
         Kernel::DAQTask *d = daqs[c->handle];
-        if (c->daqGetPut.doit) { // they wanted to put a sample
-          bool ret = d->putSample(c->daqGetPut.chan, c->daqGetPut.sample);
+        if (c->payload == Cmd::WithDAQGetPut) { // they wanted to put a sample
+          bool ret = d->putSample(c->daqGetPut().chan, c->daqGetPut().sample);
           if (!ret) {
             Error("Error status when writing to daq task %lu chan %u\n", 
-                  c->handle, c->daqGetPut.chan);
+                  c->handle, c->daqGetPut().chan);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload == Cmd::WithDAQOversample) { // they wanted each period's reads averaged
+          if (!d->setOversample(c->daqOversample())) {
+            Error("Cannot oversample daq task %lu by %u, is it a periodic analog input task that's not started yet?\n",
+                  c->handle, c->daqOversample());
             c->status = Cmd::Error;
           }
-        } else { // they wanted to set datalog stuff
-          for (unsigned i = 0; i < d->numChans() && i < 32; ++i) {
-            int id = c->datalog.ids[i];            
+        } else if (c->payload == Cmd::WithDAQFilter) { // they wanted a channel filtered
+          if (!d->setChanFilter(c->daqFilter().chan, c->daqFilter().f)) {
+            Error("Cannot set a filter on daq task %lu chan %u\n", c->handle, c->daqFilter().chan);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload == Cmd::WithDAQDivisor) { // they wanted a channel read less often
+          if (!d->setChanDivisor(c->daqDivisor().chan, c->daqDivisor().divisor)) {
+            Error("Cannot set rate divisor %u on daq task %lu chan %u\n",
+                  c->daqDivisor().divisor, c->handle, c->daqDivisor().chan);
+            c->status = Cmd::Error;
+          }
+        } else if (c->payload == Cmd::WithDAQLogIds) { // they wanted to set datalog stuff
+          for (unsigned i = 0; i < d->numChans() && i < Cmd::DAQLogChans; ++i) {
+            int id = c->daqLogIds().ids[i];            
             if (!(c->datalog.mask & 1<<i)) id = -1;
             d->setDataLogging(i, id);
             Debug("Set data logging ch %u id %d\n", i, id);
           }
+        } else {
+          Error("Invalid payload %d for daq task %lu\n", int(c->payload), c->handle);
+          c->status = Cmd::Error;
         }
       }
     } else { // object != PID or PWM
@@ -368,8 +524,14 @@ void DoCmd(Cmd *c)
         c->status = Cmd::Error;
       } else {
         Kernel::PIDFlowController *p = pids[c->handle];
-        c->pidParams = p->getParams();
-        getDataLogableBits(c, p);
+        if (c->payload == Cmd::WithPIDTune) // they wanted the auto-tune status
+          p->getTune(c->pidTune());
+        else if (c->payload == Cmd::WithPIDWave) // they wanted the waveform status
+          p->getWave(c->pidWave());
+        else {
+          c->pidParams() = p->getParams();
+          getDataLogableBits(c, p);
+        }
       }
     } else if (c->object == Cmd::PWM) {
       if (c->handle >= HANDLE_MAX || !pwms[c->handle]) {
@@ -377,22 +539,32 @@ void DoCmd(Cmd *c)
         c->status = Cmd::Error;
       } else {
         Kernel::PWMValve *p = pwms[c->handle];
-        c->pwmParams = p->getParams();
+        c->pwmParams() = p->getParams();
         getDataLogableBits(c, p);
       }
+    } else if (c->object == Cmd::SEQ) {
+      sequencer->getStatus(c->seq());
+    } else if (c->object == Cmd::TRIG) {
+      if (!triggers->get(c->trig().slot, c->trig().t)) {
+        Error("Invalid trigger slot %u\n", c->trig().slot);
+        c->status = Cmd::Error;
+      }
     } else if (c->object == Cmd::DAQ) {
       if (c->handle >= HANDLE_MAX || !daqs[c->handle]) {
         Error("Invalid handle %lu\n", c->handle);
         c->status = Cmd::Error;
       } else {
         Kernel::DAQTask *d = daqs[c->handle];
-        if (c->daqGetPut.doit) { // they wanted a sample
-          c->daqGetPut.sample = d->getSample(c->daqGetPut.chan);
+        if (c->payload == Cmd::WithDAQGetPut) { // they wanted a sample
+          c->daqGetPut().sample = d->getSample(c->daqGetPut().chan);
+        } else if (c->payload == Cmd::WithDAQAccum) { // they wanted the running sums
+          d->getAccum(c->daqAccum());
         } else { // they wanted datalog id stuff
           c->datalog.mask = 0;
-          for (unsigned i = 0; i < d->numChans(); ++i) {
+          Cmd::DAQLogIds & l = c->daqLogIds();
+          for (unsigned i = 0; i < d->numChans() && i < Cmd::DAQLogChans; ++i) {
             int id = d->getDataLogging(i);
-            c->datalog.ids[i] = id;
+            l.ids[i] = id;
             if (id > -1) c->datalog.mask |= 1<<i;
             Debug("Get data logging ch %u id %d\n", i, id);
           }         
@@ -404,6 +576,8 @@ void DoCmd(Cmd *c)
     }
     break;
   case Cmd::DestroyAll:
+    triggers->clear();
+    sequencer->abort();
     DestroyAllPWMPIDDAQ();
     break;
   default:
@@ -411,10 +585,6 @@ void DoCmd(Cmd *c)
     c->status = Cmd::Error;
     break;
   }
-
-  if ( !c->writeFifo(putfifo) ) {
-    Error("Error writing userspace reply to putfifo\n");
-  }
 }
 
 static int ReservePID()
@@ -430,6 +600,7 @@ static void FreePID(int idx)
 {
   if (pids[idx]) delete pids[idx];
   pids[idx] = 0;
+  if (shm) shm->pid_fault[idx].faulted = 0;
   pidsAllocated &= ~(0x1<<idx); // clear allocated  
 }
 
@@ -466,6 +637,14 @@ static void FreeDAQ(int idx)
   daqsAllocated &= ~(0x1<<idx); // clear allocated  
 }
 
+// before freeing handle: the triggers and the program that use it
+// can't outlive it, the rest carry on
+static void Unreference(int op, unsigned handle)
+{
+  triggers->drop(op, handle);
+  if (sequencer->refersTo(op, handle)) sequencer->abort();
+}
+
 static void DestroyAllPWMPIDDAQ()
 {
   while(pidsAllocated) {
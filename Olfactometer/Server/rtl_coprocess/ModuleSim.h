@@ -0,0 +1,39 @@
+#ifndef ModuleSim_H
+#define ModuleSim_H
+/**
+   @file ModuleSim.h
+   @brief The coprocess hosted in the server process, for make SIM=1 builds
+
+   With simulated boards there's no need for RTLinux: a SIM=1 server
+   links Module.cpp and the Kernel:: objects itself, built for userspace
+   (ControlLib's userspace Thread, Mutex and Timer stand in for the RT
+   ones), and RTLCoprocess calls in here instead of loading the module
+   and talking to it through the fifos.  So there's only one simulator,
+   and the flow loops and rt daq tasks run against the same boards and
+   plants the server itself reads and writes.
+*/
+#include "Cmd.h"
+#include "Shm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /// creates the data logger, sequencer and triggers, nonzero on error
+  extern int ModuleInit(void);
+  /// destroys every object and what ModuleInit() made
+  extern void ModuleCleanup(void);
+  /// what ModuleInit() would have put in the shared memory region,
+  /// datalog_fifo being the read end of the data log pipe.  Null when
+  /// not initialized.
+  extern OlfCoprocessShm *ModuleShm(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/// does c and leaves the reply in it, as writing c to the command fifo
+/// and reading it back would.  Thread safe.
+extern void ModuleDoCmd(Cmd *c);
+
+#endif
@@ -10,6 +10,7 @@ struct PIDFCParams
 
         unsigned dev_ai, subdev_ai, chan_ai, dev_ao, subdev_ao, chan_ao;
         unsigned rate_hz; ///< pid update rate in hz
+        ThreadAttrs thread; ///< cpu affinity/stack for the PID thread
 
         /// NB dont' copy or init these in nonrt kernel to avoid FPU problems
         double
@@ -22,6 +23,35 @@ struct PIDFCParams
           vclip_ao_min, vclip_ao_max,
 
           a, b, c, d; ///< coeffs for cubic curve
+
+        /// Feed-forward: when flow_set changes the valve jumps straight to
+        /// the voltage this table predicts for it, and the PID only has to
+        /// take up the residual.  ff_n == 0 turns it off.
+        enum { FFMaxPts = 32 };
+        unsigned ff_n;
+        double ff_flow[FFMaxPts], ff_v[FFMaxPts]; ///< increasing flow -> valve volts
+
+        /// Controller structure.  SmithPredictor runs a delay-free model
+        /// of the valve -> flow process alongside the PID and feeds it
+        /// flow_actual + model(now) - model(smith_delay periods ago), so
+        /// the PID can be tuned for the process without its dead time.
+        /// The model is x[k+1] = smith_a x[k] + smith_b vout[k], worked
+        /// out in userspace (see PIDFlowController::setSmithModel()).
+        enum ControllerType { PlainPID = 0, SmithPredictor };
+        enum { SmithMaxDelay = 1024 };
+        int ctl_type;
+        unsigned smith_delay; ///< dead time in periods, < SmithMaxDelay
+        double smith_a, smith_b;
+
+        /// Fault detection, run by the loop every period: once flow_set
+        /// is above fault_min_set but flow_actual has stayed below
+        /// fault_frac of it for fault_debounce periods (no gas? a stuck
+        /// valve?) the fault trips, see OlfPIDFault.  FaultStop also
+        /// drops flow_set to 0.  fault_debounce == 0 turns it off.
+        enum FaultAction { FaultAlarm = 0, FaultStop };
+        int fault_action;
+        unsigned fault_debounce;
+        double fault_min_set, fault_frac;
   
         // these need to be here to hopefully prevent kernel FPE
         PIDFCParams() { Memset(this, 0, sizeof(*this)); }
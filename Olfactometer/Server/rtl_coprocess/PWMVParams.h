@@ -1,11 +1,14 @@
 #ifndef PWMVParams_H
 #define PWMVParams_H
 
+#include "SysDep.h"
+
 struct PWMVParams
 {
   unsigned windowSizeMicros; /**< the window size in microseconds */
   unsigned dutyCycle; /**< number from 0 -> 100 for percent duty cycle */
   unsigned dev, subdev, chan;  ///< comedi params
+  ThreadAttrs thread; ///< cpu affinity/stack for the PWM thread
 };
 
 #endif
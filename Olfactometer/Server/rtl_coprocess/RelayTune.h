@@ -0,0 +1,45 @@
+#ifndef RelayTune_H
+#define RelayTune_H
+
+#include "SysDep.h"
+
+/** A relay feedback (Astrom-Hagglund) experiment run inside a PID flow
+    controller's RT loop, see Cmd::pidTune.  While it runs the PID output
+    is ignored and the valve is switched between bias + amp and bias - amp
+    whenever the flow crosses the setpoint (with hysteresis), which makes
+    the loop oscillate at its ultimate period.  The RT side times the
+    switches and tracks the flow peaks; userspace works out the ultimate
+    gain from a and turns it and Pu into gains (see AutoTuner).
+
+    NB: like PIDFCParams, init and copy with Clr() and Cpy() only. */
+struct RelayTune
+{
+  enum State { Idle = 0, Running, Done, Failed, Aborted };
+
+  // set by userspace to start
+  double setpoint;  ///< flow to oscillate about
+  double bias;      ///< valve volts mid relay
+  double amp;       ///< relay amplitude, valve volts
+  double hyst;      ///< relay hysteresis, flow units
+  int direction;    ///< +1 if more valve volts give more flow, else -1
+  unsigned cycles;  ///< oscillations to average, after discarding the first
+  unsigned maxPeriods; ///< give up after this many control periods
+
+  // reported back
+  int state;
+  unsigned periods; ///< control periods since the start
+  unsigned ncycles; ///< oscillations measured so far
+  double a;   ///< mean flow amplitude (half peak to peak)
+  double Pu;  ///< mean oscillation period, seconds
+
+  // RT bookkeeping
+  int relayHigh;
+  unsigned nrise, lastRise;
+  double fmin, fmax, sumA, sumP;
+
+  RelayTune() { Memset(this, 0, sizeof(*this)); }
+  RelayTune(const RelayTune &o) { *this = o; }
+  RelayTune & operator=(const RelayTune &o) { Cpy(*this, o); return *this; }
+};
+
+#endif
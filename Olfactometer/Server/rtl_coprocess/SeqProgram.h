@@ -0,0 +1,83 @@
+#ifndef SeqProgram_H
+#define SeqProgram_H
+
+#include "SysDep.h"
+
+/** One instruction of a trial program run by the coprocess's sequencer
+    (see Kernel::Sequencer).  Which fields mean what depends on op:
+
+      Bits  a = mask, b = bits of DAQ task handle, like Cmd::daqBits.
+            Consecutive Bits steps take effect together, see
+            DAQTask::putBits().
+      Flow  v = flow_set for PID handle
+      PWM   a = windowSizeMicros, b = dutyCycle for PWM handle
+      Wait  a = sequencer periods to wait before the next step
+      Mark  v = a value for the data log, nothing else happens
+      Loop  a = times to run the steps up to the matching Next, 0 for
+            until aborted
+      Next  b = index of the matching Loop
+      End   the program is done
+
+    Handles are the kernel's own indices (not RTLCoprocess handles).  The
+    compiler in userspace is TrialSequencer.
+
+    NB: the same copy rules as PIDFCParams apply to v. */
+struct SeqStep
+{
+  enum Op { End = 0, Bits, Flow, PWM, Wait, Mark, Loop, Next, N_Op };
+
+  int op;
+  unsigned handle;
+  unsigned a, b;
+  double v;
+};
+
+/// A program's upload and run control, see Cmd::seqLoad and Cmd::seq
+struct SeqProgram
+{
+  enum {
+    MaxSteps = 1024,
+    ChunkSize = 64,
+    MaxDepth = 8,          ///< nested Loops
+    MaxStepsPerTick = 256  ///< more steps than this with no Wait between them fail the program
+  };
+  enum State { Empty = 0, Loaded, Armed, Running, Done, Aborted, Failed };
+
+  /// one piece of a program upload, like Waveform::Chunk.  The first
+  /// chunk (offset 0) starts a new program of total steps, the chunk
+  /// with commit set makes it runnable.  Refused while a program runs.
+  struct Chunk
+  {
+    unsigned offset, count, total;
+    bool commit;
+    SeqStep step[ChunkSize];
+  };
+
+  /** Start/abort and status of the sequencer.
+
+      NB: like PIDFCParams, init and copy with Clr() and Cpy() only. */
+  struct Control
+  {
+    /// Arm is Start, but the program waits (state Armed) until a
+    /// Trigger with start_program fires
+    enum Action { Status = 0, Start, Abort, Arm };
+
+    // set by userspace
+    int action;
+    unsigned rate_hz; ///< sequencer periods per second, for Start/Arm
+    unsigned log_id;  ///< data log id for the step markers, for Start/Arm
+
+    // reported back
+    int state;
+    unsigned steps;   ///< steps in the program
+    unsigned pc;      ///< the next step to execute
+    unsigned periods; ///< periods since the start (or the trigger)
+    unsigned failed_at; ///< for state Failed, the step that failed
+
+    Control() { Memset(this, 0, sizeof(*this)); }
+    Control(const Control &o) { *this = o; }
+    Control & operator=(const Control &o) { Cpy(*this, o); return *this; }
+  };
+};
+
+#endif
@@ -1,13 +1,24 @@
 #ifndef OlfCoprocessShm_H
 #define OlfCoprocessShm_H
 
-#define OlfCoprocessShm_MAGIC ((int)0xf3231337)
+#define OlfCoprocessShm_MAGIC ((int)0xf3231338)
 #define OlfCoprocessShm_NAME "OlfCoprocessShm"
+/// one fault slot per PID handle, >= the module's HANDLE_MAX
+#define OlfCoprocessShm_MAX_PIDS 64
+
+/// A PID flow controller's fault flag.  Only its own RT loop writes it
+/// (see Kernel::PIDFlowController), the userspace Monitor polls it.
+struct OlfPIDFault
+{
+  volatile int faulted;    ///< the fault tripped and its condition still holds
+  volatile unsigned count; ///< times it has tripped, so a poll misses none
+};
 
 struct OlfCoprocessShm
 {
   int magic;
   unsigned cmd_fifo, datalog_fifo;
+  OlfPIDFault pid_fault[OlfCoprocessShm_MAX_PIDS]; ///< by PID handle
 };
 
 #endif
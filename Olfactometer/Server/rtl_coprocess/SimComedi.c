@@ -0,0 +1,494 @@
+#include "SysDep.h"
+#include "SimComedi.h"
+
+#ifdef __KERNEL__
+#  include <linux/errno.h>
+#else
+#  include <errno.h>
+#endif
+
+#define SIM_MAX_BOARDS 16
+#define SIM_MAX_SUBDEVS 4
+#define SIM_MAX_CHANS 32
+#define SIM_MAX_RANGES 4
+#define SIM_NAMELEN 32
+#define SIM_HIST 16 /* number of AO writes remembered per channel, for dead time */
+#define SIM_DEFAULT_BOARDS "pcmuio96, pcmad16, pcmda12"
+
+/* default plant: a sluggish MFC behind a bit of tubing */
+#define SIM_DEFAULT_GAIN_MILLI 1000
+#define SIM_DEFAULT_TAU_US 150000
+#define SIM_DEFAULT_DEADTIME_US 30000
+#define SIM_DEFAULT_NOISE_LSB 2
+
+struct SimRangeDef
+{
+  comedi_range r;
+  comedi_krange kr;
+};
+
+struct SimSubdevDef
+{
+  int type;
+  unsigned nchans;
+  lsampl_t maxdata;
+  unsigned nranges;
+  struct SimRangeDef range[SIM_MAX_RANGES];
+};
+
+struct SimBoardDef
+{
+  const char *name, *driver;
+  unsigned nsubdevs;
+  struct SimSubdevDef subdev[SIM_MAX_SUBDEVS];
+};
+
+#define V(lo,hi) { { lo, hi, UNIT_volt }, { (int)((lo)*1000000), (int)((hi)*1000000), UNIT_volt } }
+#define DIO24 { COMEDI_SUBD_DIO, 24, 1, 1, { V(0, 5) } }
+
+/* the board table -- last entry is the catch-all for unknown board names */
+static const struct SimBoardDef boardDefs[] = {
+  { "pcmuio48", "pcmuio", 2, { DIO24, DIO24 } },
+  { "pcmuio96", "pcmuio", 4, { DIO24, DIO24, DIO24, DIO24 } },
+  { "pcmad16", "pcmad", 1,
+    { { COMEDI_SUBD_AI, 16, 0xffff, 4, { V(0, 5), V(0, 10), V(-5, 5), V(-10, 10) } } } },
+  { "pcmda12", "pcmda12", 1,
+    { { COMEDI_SUBD_AO, 8, 0xfff, 3, { V(0, 5), V(0, 10), V(-5, 5) } } } },
+  { 0, "comedi_sim", 3,
+    { { COMEDI_SUBD_AI, 16, 0xffff, 2, { V(0, 5), V(-10, 10) } },
+      { COMEDI_SUBD_AO, 8, 0xffff, 2, { V(0, 5), V(-10, 10) } },
+      DIO24 } }
+};
+#undef DIO24
+#undef V
+
+static const unsigned nBoardDefs = sizeof(boardDefs)/sizeof(*boardDefs);
+
+struct SimPlant
+{
+  int connected;
+  unsigned ao_minor, ao_subdev, ao_chan;
+  int gain_milli;
+  unsigned tau_us, deadtime_us, noise_lsb;
+  unsigned rng; /* noise generator state */
+  AbsTime_t t_last; /* the time up to which y is valid */
+  double y; /* plant output in volts */
+};
+
+struct SimChan
+{
+  lsampl_t data; /* last sample written, AO only */
+  unsigned ao_range;
+  /* ring of the last few AO writes: when they happened and the volts */
+  AbsTime_t hist_ts[SIM_HIST];
+  lsampl_t hist_samp[SIM_HIST];
+  unsigned hist_head, hist_n;
+  struct SimPlant plant; /* AI only */
+};
+
+struct SimSubdev
+{
+  const struct SimSubdevDef *def;
+  unsigned dio_bits, dio_outputs;
+  struct SimChan chan[SIM_MAX_CHANS];
+};
+
+struct SimComediBoard
+{
+  const struct SimBoardDef *def;
+  char name[SIM_NAMELEN];
+  unsigned minor;
+  struct SimSubdev subdev[SIM_MAX_SUBDEVS];
+};
+
+static struct SimComediBoard boards[SIM_MAX_BOARDS];
+static unsigned nBoards = 0;
+static int sim_errno = 0;
+static Mut_t mut = 0;
+
+static const struct SimBoardDef *findDef(const char *name)
+{
+  unsigned i;
+  for (i = 0; i < nBoardDefs-1; ++i)
+    if (!Strcmp(boardDefs[i].name, name)) return &boardDefs[i];
+  return &boardDefs[nBoardDefs-1];
+}
+
+static struct SimSubdev *getSubdev(comedi_t *dev, unsigned subdev)
+{
+  if (!dev || subdev >= dev->def->nsubdevs) { sim_errno = EINVAL; return 0; }
+  return &dev->subdev[subdev];
+}
+
+static struct SimChan *getChan(comedi_t *dev, unsigned subdev, unsigned chan)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  if (!s || chan >= s->def->nchans) { sim_errno = EINVAL; return 0; }
+  return &s->chan[chan];
+}
+
+static struct SimSubdev *findSubdevOfType(int type, unsigned *minor, unsigned *subdev)
+{
+  unsigned b, s;
+  for (b = 0; b < nBoards; ++b)
+    for (s = 0; s < boards[b].def->nsubdevs; ++s)
+      if (boards[b].def->subdev[s].type == type) {
+        *minor = b; *subdev = s;
+        return &boards[b].subdev[s];
+      }
+  return 0;
+}
+
+static void wireDefaultPlants(void)
+{
+  unsigned ai_minor, ai_subdev, ao_minor, ao_subdev, ch;
+  struct SimSubdev *ai = findSubdevOfType(COMEDI_SUBD_AI, &ai_minor, &ai_subdev),
+                   *ao = findSubdevOfType(COMEDI_SUBD_AO, &ao_minor, &ao_subdev);
+  if (!ai || !ao) return;
+  for (ch = 0; ch < ai->def->nchans && ch < ao->def->nchans; ++ch)
+    simcomedi_set_plant(ai_minor, ai_subdev, ch, ao_minor, ao_subdev, ch,
+                        SIM_DEFAULT_GAIN_MILLI, SIM_DEFAULT_TAU_US,
+                        SIM_DEFAULT_DEADTIME_US, SIM_DEFAULT_NOISE_LSB);
+}
+
+static int isSep(char c) { return c == ',' || c == ' ' || c == '\t'; }
+
+int simcomedi_set_boards(const char *list)
+{
+  const char *p = list;
+  if (!mut) mut = mut_create();
+  mut_lock(mut);
+  Memset(boards, 0, sizeof(boards));
+  nBoards = 0;
+  while (*p && nBoards < SIM_MAX_BOARDS) {
+    unsigned len = 0, i;
+    struct SimComediBoard *b = &boards[nBoards];
+    while (*p && isSep(*p)) ++p;
+    while (p[len] && !isSep(p[len])) ++len;
+    if (!len) break;
+    for (i = 0; i < len && i < SIM_NAMELEN-1; ++i) b->name[i] = p[i];
+    b->name[i] = 0;
+    b->def = findDef(b->name);
+    b->minor = nBoards++;
+    for (i = 0; i < b->def->nsubdevs; ++i) b->subdev[i].def = &b->def->subdev[i];
+    p += len;
+  }
+  mut_unlock(mut);
+  wireDefaultPlants();
+  return nBoards;
+}
+
+int simcomedi_set_plant(unsigned ai_minor, unsigned ai_subdev, unsigned ai_chan,
+                        unsigned ao_minor, unsigned ao_subdev, unsigned ao_chan,
+                        int gain_milli, unsigned tau_us, unsigned deadtime_us,
+                        unsigned noise_lsb)
+{
+  struct SimChan *ai, *ao;
+  if (ai_minor >= nBoards || ao_minor >= nBoards) return -1;
+  ai = getChan(&boards[ai_minor], ai_subdev, ai_chan);
+  ao = getChan(&boards[ao_minor], ao_subdev, ao_chan);
+  if (!ai || !ao
+      || boards[ai_minor].def->subdev[ai_subdev].type != COMEDI_SUBD_AI
+      || boards[ao_minor].def->subdev[ao_subdev].type != COMEDI_SUBD_AO)
+    return -1;
+  mut_lock(mut);
+  Memset(&ai->plant, 0, sizeof(ai->plant)); /* y = 0.0 */
+  ai->plant.ao_minor = ao_minor;
+  ai->plant.ao_subdev = ao_subdev;
+  ai->plant.ao_chan = ao_chan;
+  ai->plant.gain_milli = gain_milli;
+  ai->plant.tau_us = tau_us ? tau_us : 1;
+  ai->plant.deadtime_us = deadtime_us;
+  ai->plant.noise_lsb = noise_lsb;
+  ai->plant.rng = 0x2545F491 ^ (ai_minor<<16) ^ (ai_subdev<<8) ^ ai_chan;
+  ai->plant.t_last = abstime_get();
+  ai->plant.connected = 1;
+  mut_unlock(mut);
+  return 0;
+}
+
+int simcomedi_clear_plant(unsigned ai_minor, unsigned ai_subdev, unsigned ai_chan)
+{
+  struct SimChan *ai;
+  if (ai_minor >= nBoards) return -1;
+  if ( !(ai = getChan(&boards[ai_minor], ai_subdev, ai_chan)) ) return -1;
+  mut_lock(mut);
+  ai->plant.connected = 0;
+  mut_unlock(mut);
+  return 0;
+}
+
+int simcomedi_set_dio_input(unsigned minor, unsigned subdev, unsigned chan, unsigned bit)
+{
+  struct SimSubdev *s;
+  if (minor >= nBoards) return -1;
+  if ( !(s = getSubdev(&boards[minor], subdev)) || chan >= s->def->nchans ) return -1;
+  if (s->def->type != COMEDI_SUBD_DIO && s->def->type != COMEDI_SUBD_DI) return -1;
+  mut_lock(mut);
+  if (bit) s->dio_bits |= 0x1<<chan;
+  else s->dio_bits &= ~(0x1<<chan);
+  mut_unlock(mut);
+  return 0;
+}
+
+/*--------------------------------------------------------------------------
+  Plant model
+ --------------------------------------------------------------------------*/
+
+/* exp(-x) for x >= 0 without libm, so that this also works in the kernel */
+static double expNeg(double x)
+{
+  double r = 1., term = 1.;
+  unsigned i, k = 0;
+  if (x > 40.) return 0.;
+  while (x > 0.125) { x *= 0.5; ++k; }
+  for (i = 1; i < 7; ++i) { term *= -x / i; r += term; }
+  while (k--) r *= r;
+  return r;
+}
+
+static double sampToVolts(lsampl_t s, lsampl_t maxdata, const comedi_range *r)
+{
+  return ((double)s / (double)maxdata) * (r->max - r->min) + r->min;
+}
+
+/* the AO voltage that was in effect at time t */
+static double aoVoltsAt(const struct SimChan *ao, const struct SimSubdevDef *def, AbsTime_t t)
+{
+  unsigned i;
+  const comedi_range *r = &def->range[ao->ao_range].r;
+  for (i = 0; i < ao->hist_n; ++i) {
+    unsigned idx = (ao->hist_head + SIM_HIST - 1 - i) % SIM_HIST; /* newest first */
+    if (ao->hist_ts[idx] <= t) return sampToVolts(ao->hist_samp[idx], def->maxdata, r);
+  }
+  return 0.;
+}
+
+/* the first AO write after time t, or 'limit' if none before limit */
+static AbsTime_t aoNextChange(const struct SimChan *ao, AbsTime_t t, AbsTime_t limit)
+{
+  unsigned i;
+  AbsTime_t ret = limit;
+  for (i = 0; i < ao->hist_n; ++i) {
+    unsigned idx = (ao->hist_head + SIM_HIST - 1 - i) % SIM_HIST;
+    if (ao->hist_ts[idx] > t && ao->hist_ts[idx] < ret) ret = ao->hist_ts[idx];
+  }
+  return ret;
+}
+
+/* advance the plant's output y to time 'now', integrating the exact step
+   response over each piece of the (delayed) piecewise constant AO input */
+static void plantAdvance(struct SimPlant *p, AbsTime_t now)
+{
+  const struct SimSubdevDef *aodef = boards[p->ao_minor].def->subdev + p->ao_subdev;
+  const struct SimChan *ao = &boards[p->ao_minor].subdev[p->ao_subdev].chan[p->ao_chan];
+  const AbsTime_t L = (AbsTime_t)p->deadtime_us * 1000LL;
+  const double K = p->gain_milli / 1000., tau_ns = p->tau_us * 1000.;
+  AbsTime_t t = p->t_last;
+  while (t < now) {
+    AbsTime_t tn = aoNextChange(ao, t - L, now - L) + L;
+    double yss = K * aoVoltsAt(ao, aodef, t - L);
+    if (tn <= t) tn = now; /* paranoia */
+    p->y = yss + (p->y - yss) * expNeg((tn - t) / tau_ns);
+    t = tn;
+  }
+  p->t_last = now;
+}
+
+static lsampl_t plantSample(struct SimPlant *p, lsampl_t maxdata, const comedi_range *r)
+{
+  double v;
+  long s;
+  plantAdvance(p, abstime_get());
+  v = (p->y - r->min) / (r->max - r->min) * maxdata;
+  s = (long)(v + 0.5);
+  if (p->noise_lsb) {
+    p->rng = p->rng * 1103515245 + 12345;
+    s += (long)((p->rng >> 16) % (2*p->noise_lsb + 1)) - (long)p->noise_lsb;
+  }
+  if (s < 0) s = 0;
+  if (s > (long)maxdata) s = maxdata;
+  return (lsampl_t)s;
+}
+
+/*--------------------------------------------------------------------------
+  comedilib API
+ --------------------------------------------------------------------------*/
+comedi_t *simcomedi_open(const char *devfile)
+{
+  static const char prefix[] = "/dev/comedi";
+  unsigned i, minor = 0;
+  if (!nBoards) simcomedi_set_boards(SIM_DEFAULT_BOARDS);
+  for (i = 0; prefix[i]; ++i)
+    if (devfile[i] != prefix[i]) { sim_errno = ENOENT; return 0; }
+  if (!devfile[i]) { sim_errno = ENOENT; return 0; }
+  for (; devfile[i]; ++i) {
+    if (devfile[i] < '0' || devfile[i] > '9') { sim_errno = ENOENT; return 0; }
+    minor = minor*10 + (devfile[i]-'0');
+  }
+  if (minor >= nBoards) { sim_errno = ENODEV; return 0; }
+  return &boards[minor];
+}
+
+int simcomedi_close(comedi_t *dev) { (void)dev; return 0; }
+
+int simcomedi_errno(void) { return sim_errno; }
+
+const char *simcomedi_strerror(int e)
+{
+  switch (e) {
+  case ENODEV: return "No such device (simulated)";
+  case ENOENT: return "No such file or directory (simulated)";
+  case EINVAL: return "Invalid argument (simulated)";
+  case 0: return "Success";
+  }
+  return "Unknown error (simulated)";
+}
+
+const char *simcomedi_get_driver_name(comedi_t *dev) { return dev ? dev->def->driver : 0; }
+const char *simcomedi_get_board_name(comedi_t *dev) { return dev ? dev->name : 0; }
+int simcomedi_get_version_code(comedi_t *dev) { (void)dev; return 0x000706; }
+int simcomedi_get_n_subdevices(comedi_t *dev) { return dev ? (int)dev->def->nsubdevs : -1; }
+
+int simcomedi_get_subdevice_type(comedi_t *dev, unsigned subdev)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  return s ? s->def->type : -1;
+}
+
+int simcomedi_get_n_channels(comedi_t *dev, unsigned subdev)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  return s ? (int)s->def->nchans : -1;
+}
+
+lsampl_t simcomedi_get_maxdata(comedi_t *dev, unsigned subdev, unsigned chan)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  (void)chan;
+  return s ? s->def->maxdata : 0;
+}
+
+int simcomedi_get_n_ranges(comedi_t *dev, unsigned subdev, unsigned chan)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  (void)chan;
+  return s ? (int)s->def->nranges : -1;
+}
+
+comedi_range *simcomedi_get_range(comedi_t *dev, unsigned subdev, unsigned chan, unsigned range)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  (void)chan;
+  if (!s || range >= s->def->nranges) { sim_errno = EINVAL; return 0; }
+  return (comedi_range *)&s->def->range[range].r;
+}
+
+int simcomedi_get_krange(comedi_t *dev, unsigned subdev, unsigned chan, unsigned range, comedi_krange *kr)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  (void)chan;
+  if (!s || range >= s->def->nranges) { sim_errno = EINVAL; return -1; }
+  Memcpy(kr, &s->def->range[range].kr, sizeof(*kr));
+  return 0;
+}
+
+int simcomedi_data_read(comedi_t *dev, unsigned subdev, unsigned chan, unsigned range, unsigned aref, lsampl_t *data)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  struct SimChan *c = getChan(dev, subdev, chan);
+  (void)aref;
+  if (!s || !c) return -1;
+  if (range >= s->def->nranges) range = 0;
+  mut_lock(mut);
+  switch (s->def->type) {
+  case COMEDI_SUBD_AI:
+    *data = c->plant.connected
+      ? plantSample(&c->plant, s->def->maxdata, &s->def->range[range].r)
+      : 0;
+    break;
+  case COMEDI_SUBD_AO:
+    *data = c->data;
+    break;
+  case COMEDI_SUBD_DI:
+  case COMEDI_SUBD_DO:
+  case COMEDI_SUBD_DIO:
+    *data = (s->dio_bits >> chan) & 0x1;
+    break;
+  default:
+    *data = 0;
+    break;
+  }
+  mut_unlock(mut);
+  return 1;
+}
+
+int simcomedi_data_write(comedi_t *dev, unsigned subdev, unsigned chan, unsigned range, unsigned aref, lsampl_t data)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  struct SimChan *c = getChan(dev, subdev, chan);
+  (void)aref;
+  if (!s || !c) return -1;
+  if (range >= s->def->nranges) range = 0;
+  if (data > s->def->maxdata) data = s->def->maxdata;
+  mut_lock(mut);
+  switch (s->def->type) {
+  case COMEDI_SUBD_AO:
+    c->data = data;
+    c->ao_range = range;
+    c->hist_ts[c->hist_head] = abstime_get();
+    c->hist_samp[c->hist_head] = data;
+    c->hist_head = (c->hist_head + 1) % SIM_HIST;
+    if (c->hist_n < SIM_HIST) ++c->hist_n;
+    break;
+  case COMEDI_SUBD_DO:
+  case COMEDI_SUBD_DIO:
+    if (data) s->dio_bits |= 0x1<<chan;
+    else s->dio_bits &= ~(0x1<<chan);
+    break;
+  default:
+    mut_unlock(mut);
+    sim_errno = EINVAL;
+    return -1;
+  }
+  mut_unlock(mut);
+  return 1;
+}
+
+int simcomedi_dio_config(comedi_t *dev, unsigned subdev, unsigned chan, unsigned dir)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  if (!s || chan >= s->def->nchans || s->def->type != COMEDI_SUBD_DIO) return -1;
+  mut_lock(mut);
+  if (dir == COMEDI_OUTPUT) s->dio_outputs |= 0x1<<chan;
+  else s->dio_outputs &= ~(0x1<<chan);
+  mut_unlock(mut);
+  return 1;
+}
+
+int simcomedi_dio_read(comedi_t *dev, unsigned subdev, unsigned chan, unsigned *bit)
+{
+  lsampl_t samp;
+  int ret = simcomedi_data_read(dev, subdev, chan, 0, 0, &samp);
+  if (ret > 0) *bit = samp;
+  return ret;
+}
+
+int simcomedi_dio_write(comedi_t *dev, unsigned subdev, unsigned chan, unsigned bit)
+{
+  return simcomedi_data_write(dev, subdev, chan, 0, 0, bit ? 1 : 0);
+}
+
+int simcomedi_dio_bitfield(comedi_t *dev, unsigned subdev, unsigned write_mask, unsigned *bits)
+{
+  struct SimSubdev *s = getSubdev(dev, subdev);
+  if (!s || (s->def->type != COMEDI_SUBD_DIO && s->def->type != COMEDI_SUBD_DO
+             && s->def->type != COMEDI_SUBD_DI))
+    return -1;
+  mut_lock(mut);
+  if (s->def->type != COMEDI_SUBD_DI)
+    s->dio_bits = (s->dio_bits & ~write_mask) | (*bits & write_mask);
+  *bits = s->dio_bits;
+  mut_unlock(mut);
+  return 1;
+}
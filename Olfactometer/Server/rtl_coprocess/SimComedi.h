@@ -0,0 +1,158 @@
+#ifndef SimComedi_H
+#define SimComedi_H
+/**
+   @file SimComedi.h
+   @brief Simulated comedi boards and flow plants for running without hardware
+
+   This header is a stand-in for both userspace comedilib.h and the kernel
+   linux/comedilib.h.  It is only used when building with -DCOMEDI_SIM
+   (make SIM=1), in which case the comedi_*() calls made by ComediChan,
+   ProbeComedi, Kernel::DAQTask, Kernel::PIDFlowController and
+   Kernel::PWMValve end up in the simulator below instead of in comedi.
+
+   The simulator exposes one fake board per /dev/comediN minor, named
+   after the boards in the Devices comediboards= key of olfactometer.ini
+   (see simcomedi_set_boards()).  Known board names (pcmuio48, pcmuio96,
+   pcmad16, pcmda12) get a subdevice layout similar to the real board,
+   anything else gets a generic AI/AO/DIO board.
+
+   Each channel of the first AI subdevice is wired to a first-order-plus-
+   dead-time mass flow controller model, driven by the same channel of
+   the first AO subdevice:
+
+      y(s)/u(s) = K * exp(-L*s) / (tau*s + 1)
+
+   where u is the AO voltage and y the AI voltage.  The model is advanced
+   lazily on every AI read, so it costs nothing when nobody is reading.
+
+   A SIM=1 server doesn't load the rtl_coprocess module, it hosts the
+   coprocess itself (see ModuleSim.h), so the flow loops and rt daq tasks
+   and the server's own channel reads and writes all see the one
+   simulator.
+
+   NB: if built into the kernel the plant math would use the FPU, which
+   is fine from RT threads (they are created with FP enabled) but not
+   from plain kernel context.  Only comedi_data_read() on an AI channel
+   touches the FPU.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef unsigned int lsampl_t;
+  typedef unsigned short sampl_t;
+
+  typedef struct SimComediBoard comedi_t;
+
+  typedef struct
+  {
+    double min;
+    double max;
+    unsigned unit;
+  } comedi_range;
+
+  /** kernel comedilib's range struct, in microvolts */
+  typedef struct
+  {
+    int min;
+    int max;
+    unsigned flags;
+  } comedi_krange;
+
+  enum SimComediSubdType {
+    COMEDI_SUBD_UNUSED = 0, COMEDI_SUBD_AI, COMEDI_SUBD_AO, COMEDI_SUBD_DI,
+    COMEDI_SUBD_DO, COMEDI_SUBD_DIO, COMEDI_SUBD_COUNTER, COMEDI_SUBD_TIMER,
+    COMEDI_SUBD_MEMORY, COMEDI_SUBD_CALIB, COMEDI_SUBD_PROC,
+    COMEDI_SUBD_SERIAL
+  };
+
+  enum { UNIT_volt = 0, UNIT_mA, UNIT_none };
+  enum { COMEDI_INPUT = 0, COMEDI_OUTPUT = 1 };
+  enum { AREF_GROUND = 0, AREF_COMMON, AREF_DIFF, AREF_OTHER };
+
+  /*--------------------------------------------------------------------------
+    The comedilib subset used by the olfactometer.  Same semantics as
+    the real thing.
+   --------------------------------------------------------------------------*/
+  extern comedi_t *simcomedi_open(const char *devfile);
+  extern int simcomedi_close(comedi_t *);
+  extern int simcomedi_errno(void);
+  extern const char *simcomedi_strerror(int errnum);
+  extern const char *simcomedi_get_driver_name(comedi_t *);
+  extern const char *simcomedi_get_board_name(comedi_t *);
+  extern int simcomedi_get_version_code(comedi_t *);
+  extern int simcomedi_get_n_subdevices(comedi_t *);
+  extern int simcomedi_get_subdevice_type(comedi_t *, unsigned subdev);
+  extern int simcomedi_get_n_channels(comedi_t *, unsigned subdev);
+  extern lsampl_t simcomedi_get_maxdata(comedi_t *, unsigned subdev, unsigned chan);
+  extern int simcomedi_get_n_ranges(comedi_t *, unsigned subdev, unsigned chan);
+  extern comedi_range *simcomedi_get_range(comedi_t *, unsigned subdev, unsigned chan, unsigned range);
+  extern int simcomedi_get_krange(comedi_t *, unsigned subdev, unsigned chan, unsigned range, comedi_krange *);
+  extern int simcomedi_data_read(comedi_t *, unsigned subdev, unsigned chan, unsigned range, unsigned aref, lsampl_t *data);
+  extern int simcomedi_data_write(comedi_t *, unsigned subdev, unsigned chan, unsigned range, unsigned aref, lsampl_t data);
+  extern int simcomedi_dio_config(comedi_t *, unsigned subdev, unsigned chan, unsigned dir);
+  extern int simcomedi_dio_read(comedi_t *, unsigned subdev, unsigned chan, unsigned *bit);
+  extern int simcomedi_dio_write(comedi_t *, unsigned subdev, unsigned chan, unsigned bit);
+  extern int simcomedi_dio_bitfield(comedi_t *, unsigned subdev, unsigned write_mask, unsigned *bits);
+
+  /*--------------------------------------------------------------------------
+    Simulator control
+   --------------------------------------------------------------------------*/
+  /** Sets up one simulated board per minor from a comma or space separated
+      list of board names, eg "pcmuio96, pcmad16, pcmda12".  Resets all
+      channel and plant state.  Returns the number of boards created.  If
+      never called, the first comedi_open() uses the board list from the
+      stock olfactometer.ini. */
+  extern int simcomedi_set_boards(const char *board_list);
+
+  /** (Re)wires the flow plant on AI channel ai_minor/ai_subdev/ai_chan to
+      be driven by AO channel ao_minor/ao_subdev/ao_chan.  gain_milli is
+      the static gain K * 1000, tau_us and deadtime_us are the plant time
+      constant and transport delay and noise_lsb is the amplitude of the
+      uniform noise added to each AI sample.  Integer parameters so that
+      this may be called from non-FPU kernel context.
+      Returns 0 on success. */
+  extern int simcomedi_set_plant(unsigned ai_minor, unsigned ai_subdev,
+                                 unsigned ai_chan,
+                                 unsigned ao_minor, unsigned ao_subdev,
+                                 unsigned ao_chan,
+                                 int gain_milli, unsigned tau_us,
+                                 unsigned deadtime_us, unsigned noise_lsb);
+
+  /** Disconnects the plant on an AI channel, it then reads back 0 volts. */
+  extern int simcomedi_clear_plant(unsigned ai_minor, unsigned ai_subdev,
+                                   unsigned ai_chan);
+
+  /** Drives a DI/DIO input line from outside, eg to simulate a TTL
+      trigger. Returns 0 on success. */
+  extern int simcomedi_set_dio_input(unsigned minor, unsigned subdev,
+                                     unsigned chan, unsigned bit);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* map the comedilib names onto the simulator */
+#define comedi_open simcomedi_open
+#define comedi_close simcomedi_close
+#define comedi_errno simcomedi_errno
+#define comedi_strerror simcomedi_strerror
+#define comedi_get_driver_name simcomedi_get_driver_name
+#define comedi_get_board_name simcomedi_get_board_name
+#define comedi_get_version_code simcomedi_get_version_code
+#define comedi_get_n_subdevices simcomedi_get_n_subdevices
+#define comedi_get_subdevice_type simcomedi_get_subdevice_type
+#define comedi_get_n_channels simcomedi_get_n_channels
+#define comedi_get_maxdata simcomedi_get_maxdata
+#define comedi_get_n_ranges simcomedi_get_n_ranges
+#define comedi_get_range simcomedi_get_range
+#define comedi_get_krange simcomedi_get_krange
+#define comedi_data_read simcomedi_data_read
+#define comedi_data_write simcomedi_data_write
+#define comedi_dio_config simcomedi_dio_config
+#define comedi_dio_read simcomedi_dio_read
+#define comedi_dio_write simcomedi_dio_write
+#define comedi_dio_bitfield simcomedi_dio_bitfield
+
+#endif
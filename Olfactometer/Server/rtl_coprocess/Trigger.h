@@ -0,0 +1,47 @@
+#ifndef Trigger_H
+#define Trigger_H
+
+#include "SysDep.h"
+#include "SeqProgram.h"
+
+/** A rule run by the coprocess (see Kernel::Triggers) when a digital
+    input line changes: on an edge of line chan of DAQ task daq, do the
+    actions, and if start_program is set start the armed trial program
+    (see SeqProgram::Control::Arm).  The edge is seen by the input task's
+    own periodic thread, right after the scan that read it, so the
+    reaction time is a period of that task plus whatever the actions
+    write through, rather than a trip through userspace.
+
+    The actions are SeqSteps, Bits, Flow, PWM and Mark only, the Bits
+    ones written together (see DAQTask::putBits()).  Handles are as in
+    SeqStep.
+
+    NB: like PIDFCParams, init and copy with Clr() and Cpy() only. */
+struct Trigger
+{
+  enum Edge { Off = 0, Rising = 1, Falling = 2, Both = Rising|Falling };
+  enum {
+    MaxTriggers = 16,
+    MaxActions = 8
+  };
+
+  // set by userspace
+  unsigned daq, chan;
+  int edge;           ///< an Edge, Off clears the trigger
+  bool once;          ///< disarm after firing
+  bool start_program;
+  unsigned log_id;    ///< data log id for the firing marker (datum: the trigger's slot, meta "trig")
+  unsigned n;         ///< actions in use
+  SeqStep action[MaxActions];
+
+  // reported back
+  bool armed;
+  unsigned fired;     ///< times fired since set
+  AbsTime_t last_ns;  ///< when it last fired
+
+  Trigger() { Memset(this, 0, sizeof(*this)); }
+  Trigger(const Trigger &o) { *this = o; }
+  Trigger & operator=(const Trigger &o) { Cpy(*this, o); return *this; }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef Waveform_H
+#define Waveform_H
+
+#include "SysDep.h"
+
+/** A setpoint waveform played back by a PID flow controller's RT loop:
+    while it plays, every control period sets flow_set from the table
+    instead of userspace doing it, so the setpoint moves on the
+    controller's own clock with no fifo round trip per step.
+
+    Point i is flow[i] at period at[i] after the start; at[0] is 0 and
+    the at[] never decrease (two points at the same period make a jump).
+    Between points the setpoint is interpolated linearly, or with Step
+    held at the earlier point.  A pass lasts at[n-1] periods, after which
+    the table either starts over or, on the last pass, the setpoint stays
+    at flow[n-1].
+
+    Tables are built in userspace (see PIDFlowController::setWaveform())
+    and uploaded over the fifo in Chunk sized pieces, see Cmd::pidWaveLoad.
+    Playback is started, stopped and watched with a Control, see
+    Cmd::pidWave.  */
+struct Waveform
+{
+  enum {
+    MaxPts = 2048,
+    ChunkSize = 256
+  };
+  enum Interp { Linear = 0, Step };
+  enum State { Empty = 0, Loaded, Armed, Playing, Done, Aborted };
+
+  unsigned n;   ///< points in use, 0 means no table
+  int interp;
+  unsigned at[MaxPts];
+  float flow[MaxPts];
+
+  /// one piece of a table upload, like CalibLUT::Chunk.  The first chunk
+  /// (offset 0) starts a new table of total points, the chunk with
+  /// commit set makes it playable.  Refused while a table is playing.
+  struct Chunk
+  {
+    unsigned offset, count, total;
+    int interp;
+    bool commit;
+    unsigned at[ChunkSize];
+    float flow[ChunkSize];
+  };
+
+  /** Start/stop and status of playback.
+
+      NB: like PIDFCParams, init and copy with Clr() and Cpy() only. */
+  struct Control
+  {
+    enum Action { Status = 0, Start, Abort };
+
+    // set by userspace
+    int action;
+    unsigned loops;    ///< passes to play, 0 for until aborted
+    AbsTime_t startAt; ///< start on the first period at or after this absolute time, ns
+    Time_t delay;      ///< if startAt is 0, start this long after the command, ns.  The
+                       ///  start time used is passed back in startAt, so several
+                       ///  controllers can be started together (see Mix).
+
+    // reported back
+    int state;
+    unsigned n;         ///< points in the table
+    unsigned loopsDone; ///< passes finished
+    unsigned pos;       ///< periods into the current pass
+    double flow_set;    ///< the setpoint now
+
+    Control() { Memset(this, 0, sizeof(*this)); }
+    Control(const Control &o) { *this = o; }
+    Control & operator=(const Control &o) { Cpy(*this, o); return *this; }
+  };
+};
+
+#endif
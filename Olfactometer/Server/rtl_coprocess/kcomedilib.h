@@ -1,6 +1,10 @@
 #ifndef kcomedilib_h
 #define kcomedilib_h
 
+#ifdef COMEDI_SIM
+#  include "SimComedi.h"
+#else
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -10,6 +14,7 @@ extern "C" {
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
-	
+
+#endif /* COMEDI_SIM */
 
 #endif /* !kcomedilib_h */
@@ -0,0 +1,6 @@
+#ifndef sim_comedilib_h
+#define sim_comedilib_h
+/* Picked up instead of the real comedilib.h when building with make SIM=1,
+   see rtl_coprocess/SimComedi.h */
+#include "../rtl_coprocess/SimComedi.h"
+#endif